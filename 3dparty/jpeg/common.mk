@@ -6,7 +6,7 @@ include $(QCONFIG)
 CCFLAGS+=-O3 -march=core2
 EXCLUDE_OBJS += cdjpeg.o cjpeg.o ckconfig.o djpeg.o example.o rdbmp.o \
                 rdcolmap.o rdgif.o rdjpgcom.o rdppm.o rdrle.o rdswitch.o \
-                rdtarga.o transupp.o wrbmp.o wrgif.o wrjpgcom.o wrppm.o \
+                rdtarga.o wrbmp.o wrgif.o wrjpgcom.o wrppm.o jpegbench.o \
                 wrrle.o wrtarga.o jmemmac.o jmemdos.o jmemname.o jmemnobs.o
 
 define PINFO
@@ -330,6 +330,10 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
 	fdct->do_dct[ci] = jpeg_fdct_islow;
+#ifdef FDCT_SSE2_SUPPORTED
+	if (jpeg_sse2_usable())
+	  fdct->do_dct[ci] = jpeg_fdct_islow_sse2;
+#endif
 	method = JDCT_ISLOW;
 	break;
 #endif
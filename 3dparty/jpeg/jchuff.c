@@ -37,6 +37,13 @@
 #define MAX_COEF_BITS 14
 #endif
 
+/* The fast sequential encoder (encode_mcu_fast) needs a 64-bit bit buffer,
+ * so it is only compiled where the compiler provides such a type.
+ */
+#if defined(__GNUC__) && ! defined(SLOW_SHIFT_32)
+#define HUFF_FAST_SUPPORTED
+#endif
+
 /* Derived data constructed for each Huffman table */
 
 typedef struct {
@@ -1005,6 +1012,185 @@ encode_one_block (working_state * state, JCOEFPTR block, int last_dc_val,
 }
 
 
+#ifdef HUFF_FAST_SUPPORTED
+
+/*
+ * Fast path for sequential scans, used when the output buffer has room for
+ * a worst-case MCU so that it never has to suspend.  Bits are collected in
+ * a 64-bit buffer, right-justified, and written out 32 bits at a time; a
+ * block never adds more than 16 + 15 bits in one step.
+ *
+ * A block codes at most 64 symbols of 16 + 15 bits; with every byte
+ * stuffed this is below DCTSIZE2 * 8 bytes.
+ */
+
+#define FAST_BYTES_PER_BLOCK  (DCTSIZE2 * 8)
+
+typedef unsigned long long put_buf_type; /* type of fast bit buffer */
+
+/* Nonzero if any byte of the 32-bit word x is 0xFF */
+#define HAS_FF_BYTE(x) \
+	((~(x) - 0x01010101U) & (x) & 0x80808080U)
+
+/* Write the 32-bit word w, stuffing a zero byte after each 0xFF */
+
+LOCAL(JOCTET *)
+emit_word_fast (JOCTET * next_output_byte, unsigned int w)
+{
+  int i;
+
+  if (! HAS_FF_BYTE(w)) {
+    next_output_byte[0] = (JOCTET) (w >> 24);
+    next_output_byte[1] = (JOCTET) (w >> 16);
+    next_output_byte[2] = (JOCTET) (w >> 8);
+    next_output_byte[3] = (JOCTET) w;
+    return next_output_byte + 4;
+  }
+
+  for (i = 0; i < 4; i++) {
+    int c = (int) ((w >> 24) & 0xFF);
+
+    *next_output_byte++ = (JOCTET) c;
+    if (c == 0xFF)		/* need to stuff a zero byte? */
+      *next_output_byte++ = 0;
+    w <<= 8;
+  }
+  return next_output_byte;
+}
+
+/* Append size bits of code (already masked) to the bit buffer */
+
+#define EMIT_BITS_FAST(code,size)  \
+	{ put_buffer = (put_buffer << (size)) | (code);  \
+	  put_bits += (size);  \
+	  if (put_bits >= 32) {  \
+	    put_bits -= 32;  \
+	    next_output_byte = emit_word_fast(next_output_byte,  \
+			(unsigned int) (put_buffer >> put_bits));  \
+	  } }
+
+/* Number of bits needed for the magnitude temp (nonzero) */
+
+#define NBITS_FAST(temp)  (32 - __builtin_clz((unsigned int) (temp)))
+
+
+LOCAL(void)
+encode_mcu_fast (working_state * state, JBLOCKROW *MCU_data)
+{
+  j_compress_ptr cinfo = state->cinfo;
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  JOCTET * next_output_byte = state->next_output_byte;
+  put_buf_type put_buffer;
+  int put_bits;
+  int Se = cinfo->lim_Se;
+  const int * natural_order = cinfo->natural_order;
+  int blkn, ci;
+
+  /* Convert the bit buffer: the put_bits valid bits of the saved state
+   * are left-justified in its right 24 bits.
+   */
+  put_bits = state->cur.put_bits;
+  put_buffer = (put_buf_type) (state->cur.put_buffer >> (24 - put_bits));
+
+  for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
+    JCOEFPTR block = MCU_data[blkn][0];
+    jpeg_component_info * compptr;
+    c_derived_tbl *dctbl, *actbl;
+    register int temp, temp2;
+    register int nbits;
+    register int r, k;
+
+    ci = cinfo->MCU_membership[blkn];
+    compptr = cinfo->cur_comp_info[ci];
+    dctbl = entropy->dc_derived_tbls[compptr->dc_tbl_no];
+    actbl = entropy->ac_derived_tbls[compptr->ac_tbl_no];
+
+    /* Encode the DC coefficient difference per section F.1.2.1 */
+
+    temp = temp2 = block[0] - state->cur.last_dc_val[ci];
+    if (temp < 0) {
+      temp = -temp;
+      temp2--;
+    }
+    nbits = temp ? NBITS_FAST(temp) : 0;
+    if (nbits > MAX_COEF_BITS+1)
+      ERREXIT(cinfo, JERR_BAD_DCT_COEF);
+    if (dctbl->ehufsi[nbits] == 0)
+      ERREXIT(cinfo, JERR_HUFF_MISSING_CODE);
+
+    /* Emit the Huffman symbol together with the value bits */
+    temp2 &= (1 << nbits) - 1;
+    EMIT_BITS_FAST(((put_buf_type) dctbl->ehufco[nbits] << nbits) | temp2,
+		   dctbl->ehufsi[nbits] + nbits);
+
+    /* Encode the AC coefficients per section F.1.2.2 */
+
+    r = 0;			/* r = run length of zeros */
+
+    for (k = 1; k <= Se; k++) {
+      if ((temp2 = block[natural_order[k]]) == 0) {
+	r++;
+	continue;
+      }
+      /* if run length > 15, must emit special run-length-16 codes (0xF0) */
+      while (r > 15) {
+	if (actbl->ehufsi[0xF0] == 0)
+	  ERREXIT(cinfo, JERR_HUFF_MISSING_CODE);
+	EMIT_BITS_FAST(actbl->ehufco[0xF0], actbl->ehufsi[0xF0]);
+	r -= 16;
+      }
+
+      temp = temp2;
+      if (temp < 0) {
+	temp = -temp;
+	temp2--;
+      }
+      nbits = NBITS_FAST(temp);
+      if (nbits > MAX_COEF_BITS)
+	ERREXIT(cinfo, JERR_BAD_DCT_COEF);
+
+      temp = (r << 4) + nbits;
+      if (actbl->ehufsi[temp] == 0)
+	ERREXIT(cinfo, JERR_HUFF_MISSING_CODE);
+      temp2 &= (1 << nbits) - 1;
+      EMIT_BITS_FAST(((put_buf_type) actbl->ehufco[temp] << nbits) | temp2,
+		     actbl->ehufsi[temp] + nbits);
+
+      r = 0;
+    }
+
+    /* If the last coef(s) were zero, emit an end-of-block code */
+    if (r > 0) {
+      if (actbl->ehufsi[0] == 0)
+	ERREXIT(cinfo, JERR_HUFF_MISSING_CODE);
+      EMIT_BITS_FAST(actbl->ehufco[0], actbl->ehufsi[0]);
+    }
+
+    /* Update last_dc_val */
+    state->cur.last_dc_val[ci] = block[0];
+  }
+
+  /* Write out whole bytes, keeping fewer than 8 bits as emit_bits_s does */
+  while (put_bits >= 8) {
+    int c;
+
+    put_bits -= 8;
+    c = (int) ((put_buffer >> put_bits) & 0xFF);
+    *next_output_byte++ = (JOCTET) c;
+    if (c == 0xFF)		/* need to stuff a zero byte? */
+      *next_output_byte++ = 0;
+  }
+  state->cur.put_buffer =
+    (INT32) ((put_buffer & ((1 << put_bits) - 1)) << (24 - put_bits));
+  state->cur.put_bits = put_bits;
+
+  state->free_in_buffer -= (size_t) (next_output_byte - state->next_output_byte);
+  state->next_output_byte = next_output_byte;
+}
+
+#endif /* HUFF_FAST_SUPPORTED */
+
+
 /*
  * Encode and output one MCU's worth of Huffman-compressed coefficients.
  */
@@ -1031,6 +1217,12 @@ encode_mcu_huff (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   }
 
   /* Encode the MCU data blocks */
+#ifdef HUFF_FAST_SUPPORTED
+  if (state.free_in_buffer >=
+      (size_t) cinfo->blocks_in_MCU * FAST_BYTES_PER_BLOCK)
+    encode_mcu_fast(&state, MCU_data);
+  else
+#endif
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     ci = cinfo->MCU_membership[blkn];
     compptr = cinfo->cur_comp_info[ci];
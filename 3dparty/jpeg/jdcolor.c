@@ -266,6 +266,118 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
 }
 
 
+/*
+ * Convert some rows of samples to BGRX, the same as ycc_rgb_convert
+ * but with 4 bytes per pixel, the pad byte is set to MAXJSAMPLE.
+ */
+
+METHODDEF(void)
+ycc_bgrx_convert (j_decompress_ptr cinfo,
+		  JSAMPIMAGE input_buf, JDIMENSION input_row,
+		  JSAMPARRAY output_buf, int num_rows)
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  register int y, cb, cr;
+  register JSAMPROW outptr;
+  register JSAMPROW inptr0, inptr1, inptr2;
+  register JDIMENSION col;
+  JDIMENSION num_cols = cinfo->output_width;
+  /* copy these pointers into registers if possible */
+  register JSAMPLE * range_limit = cconvert->range_limit;
+  register int * Crrtab = cconvert->Cr_r_tab;
+  register int * Cbbtab = cconvert->Cb_b_tab;
+  register INT32 * Crgtab = cconvert->Cr_g_tab;
+  register INT32 * Cbgtab = cconvert->Cb_g_tab;
+  SHIFT_TEMPS
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col < num_cols; col++) {
+      y  = GETJSAMPLE(inptr0[col]);
+      cb = GETJSAMPLE(inptr1[col]);
+      cr = GETJSAMPLE(inptr2[col]);
+      outptr[0] = range_limit[y + Cbbtab[cb]];	/* blue */
+      outptr[1] = range_limit[y +			/* green */
+			      ((int) RIGHT_SHIFT(Cbgtab[cb] + Crgtab[cr],
+						 SCALEBITS))];
+      outptr[2] = range_limit[y + Crrtab[cr]];	/* red */
+      outptr[3] = MAXJSAMPLE;			/* pad */
+      outptr += 4;
+    }
+  }
+}
+
+
+/*
+ * Pack full resolution YCbCr to YUYV: each pair of pixels shares the
+ * average chroma of both.  A lone last pixel keeps its own Cb only.
+ */
+
+METHODDEF(void)
+ycc_yuyv_convert (j_decompress_ptr cinfo,
+		  JSAMPIMAGE input_buf, JDIMENSION input_row,
+		  JSAMPARRAY output_buf, int num_rows)
+{
+  register JSAMPROW outptr;
+  register JSAMPROW inptr0, inptr1, inptr2;
+  register JDIMENSION col;
+  JDIMENSION num_cols = cinfo->output_width;
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col + 1 < num_cols; col += 2) {
+      outptr[0] = inptr0[col];
+      outptr[1] = (JSAMPLE) ((GETJSAMPLE(inptr1[col]) +
+			      GETJSAMPLE(inptr1[col+1]) + 1) >> 1);
+      outptr[2] = inptr0[col+1];
+      outptr[3] = (JSAMPLE) ((GETJSAMPLE(inptr2[col]) +
+			      GETJSAMPLE(inptr2[col+1]) + 1) >> 1);
+      outptr += 4;
+    }
+    if (col < num_cols) {
+      outptr[0] = inptr0[col];
+      outptr[1] = inptr1[col];
+    }
+  }
+}
+
+
+#ifdef SSE2_SUPPORTED
+
+/*
+ * SSE2 version of YCbCr->RGB, BGRX and YUYV conversion, see jdcolsse.c.
+ * It is used only with the standard YCbCr tables, not for BG_YCC.
+ */
+
+METHODDEF(void)
+ycc_convert_sse2 (j_decompress_ptr cinfo,
+		  JSAMPIMAGE input_buf, JDIMENSION input_row,
+		  JSAMPARRAY output_buf, int num_rows)
+{
+  while (--num_rows >= 0) {
+    jpeg_ycc_convert_sse2(input_buf[0][input_row], input_buf[1][input_row],
+			  input_buf[2][input_row], *output_buf++,
+			  cinfo->output_width, FALSE, cinfo->out_color_space);
+    input_row++;
+  }
+}
+
+/* The SSE2 code stores RGB triplets in R, G, B order only */
+#if RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2 && RGB_PIXELSIZE == 3
+#define RGB_SSE2_SUPPORTED
+#endif
+
+#endif /* SSE2_SUPPORTED */
+
+
 /**************** Cases other than YCC -> RGB ****************/
 
 
@@ -676,6 +788,10 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
       break;
     case JCS_YCbCr:
       cconvert->pub.color_convert = ycc_rgb_convert;
+#ifdef RGB_SSE2_SUPPORTED
+      if (jpeg_sse2_usable())
+	cconvert->pub.color_convert = ycc_convert_sse2;
+#endif
       build_ycc_rgb_table(cinfo);
       break;
     case JCS_BG_YCC:
@@ -716,6 +832,31 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
       ERREXIT(cinfo, JERR_CONVERSION_NOTIMPL);
     break;
 
+  case JCS_EXT_BGRX:
+    cinfo->out_color_components = 4;
+    if (cinfo->jpeg_color_space == JCS_YCbCr) {
+      cconvert->pub.color_convert = ycc_bgrx_convert;
+#ifdef SSE2_SUPPORTED
+      if (jpeg_sse2_usable())
+	cconvert->pub.color_convert = ycc_convert_sse2;
+#endif
+      build_ycc_rgb_table(cinfo);
+    } else
+      ERREXIT(cinfo, JERR_CONVERSION_NOTIMPL);
+    break;
+
+  case JCS_EXT_YUYV:
+    cinfo->out_color_components = 2;
+    if (cinfo->jpeg_color_space == JCS_YCbCr) {
+      cconvert->pub.color_convert = ycc_yuyv_convert;
+#ifdef SSE2_SUPPORTED
+      if (jpeg_sse2_usable())
+	cconvert->pub.color_convert = ycc_convert_sse2;
+#endif
+    } else
+      ERREXIT(cinfo, JERR_CONVERSION_NOTIMPL);
+    break;
+
   case JCS_CMYK:
     cinfo->out_color_components = 4;
     switch (cinfo->jpeg_color_space) {
@@ -0,0 +1,263 @@
+/*
+ * jdcolsse.c
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains the SSE2 version of YCbCr->RGB colorspace conversion
+ * and of YCbCr->YUYV packing.  It is shared by the color deconverter
+ * (jdcolor.c) and by the merged upsampler (jdmerge.c), which passes
+ * chroma rows of half width.
+ *
+ * The output is bit-exact with the table driven scalar code.  The table
+ * entries are computed here with 16-bit multiplies, splitting the scaled
+ * constants which don't fit into 16 bits into an integer part and a
+ * fractional part:
+ *
+ *	Cr_r_tab[x] = (91881 * x + ONE_HALF) >> 16
+ *		    = x + ((26345 * x + ONE_HALF) >> 16)
+ *	Cb_b_tab[x] = (116130 * x + ONE_HALF) >> 16
+ *		    = 2 * x + ((-14942 * x + ONE_HALF) >> 16)
+ *	(Cb_g_tab[cb] + Cr_g_tab[cr]) >> 16
+ *		    = (-22553 * cb - 46802 * cr + ONE_HALF) >> 16
+ *		    = - cr + ((-22553 * cb + 18734 * cr + ONE_HALF) >> 16)
+ *
+ * where x, cb and cr are the chroma samples less CENTERJSAMPLE.  Adding
+ * a multiple of 2^16 before the shift doesn't change the fraction, so the
+ * results are exactly those of the tables.  The final range limiting of
+ * the sums (-179..433) is the same as saturation to 0..MAXJSAMPLE.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+
+#ifdef SSE2_SUPPORTED
+
+#include <emmintrin.h>
+
+
+/* Pixels processed per iteration */
+#define BLOCK_PIXELS  16
+
+/* Pair of 16-bit multipliers of _mm_madd_epi16, a is the low one */
+#define MADD_CONST(a, b)  \
+  _mm_set1_epi32((int) (((unsigned int) (b) << 16) | ((a) & 0xFFFF)))
+
+
+/* Returns (x * c + ONE_HALF) >> 16 for 16-bit lanes; the multiplier pair
+ * holds c and ONE_HALF / 2, the latter is multiplied by 2.
+ */
+
+LOCAL(__m128i)
+mul_round (__m128i x, __m128i c)
+{
+  __m128i two = _mm_set1_epi16(2);
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(x, two), c);
+  __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(x, two), c);
+
+  return _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+}
+
+
+/* Convert 8 pixels given as 16-bit lanes, chroma less CENTERJSAMPLE.
+ * Results are 16-bit values before range limiting.
+ */
+
+LOCAL(void)
+ycc_rgb_8 (__m128i y, __m128i cb, __m128i cr,
+	   __m128i * r, __m128i * g, __m128i * b)
+{
+  __m128i gfrac, lo, hi;
+  __m128i half = _mm_set1_epi32(1 << 15);
+  __m128i gconst = MADD_CONST(-22553, 18734);
+
+  lo = _mm_madd_epi16(_mm_unpacklo_epi16(cb, cr), gconst);
+  hi = _mm_madd_epi16(_mm_unpackhi_epi16(cb, cr), gconst);
+  gfrac = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(lo, half), 16),
+			  _mm_srai_epi32(_mm_add_epi32(hi, half), 16));
+
+  *r = _mm_add_epi16(_mm_add_epi16(y, cr),
+		     mul_round(cr, MADD_CONST(26345, 1 << 14)));
+  *g = _mm_add_epi16(_mm_sub_epi16(y, cr), gfrac);
+  *b = _mm_add_epi16(_mm_add_epi16(y, _mm_add_epi16(cb, cb)),
+		     mul_round(cb, MADD_CONST(-14942, 1 << 14)));
+}
+
+
+/* Store 16 pixels of 8-bit R, G and B as RGB triplets (48 bytes) */
+
+LOCAL(void)
+store_rgb (JSAMPROW outptr, __m128i r, __m128i g, __m128i b)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i mask24 = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+  __m128i mask48 = _mm_set_epi32(0, 0, -1, -1);
+  __m128i rg, bz, px[4];
+  int i;
+
+  rg = _mm_unpacklo_epi8(r, g);
+  bz = _mm_unpacklo_epi8(b, zero);
+  px[0] = _mm_unpacklo_epi16(rg, bz);
+  px[1] = _mm_unpackhi_epi16(rg, bz);
+  rg = _mm_unpackhi_epi8(r, g);
+  bz = _mm_unpackhi_epi8(b, zero);
+  px[2] = _mm_unpacklo_epi16(rg, bz);
+  px[3] = _mm_unpackhi_epi16(rg, bz);
+
+  /* Squeeze 4 pixels of 32 bits to 12 bytes: first the pixel pairs within
+   * each 64-bit half, then the upper half down by 2 bytes.
+   */
+  for (i = 0; i < 4; i++) {
+    px[i] = _mm_or_si128(_mm_and_si128(px[i], mask24),
+			 _mm_andnot_si128(mask24, _mm_srli_epi64(px[i], 8)));
+    px[i] = _mm_or_si128(_mm_and_si128(px[i], mask48),
+			 _mm_srli_si128(_mm_andnot_si128(mask48, px[i]), 2));
+  }
+
+  _mm_storeu_si128((__m128i *) outptr,
+		   _mm_or_si128(px[0], _mm_slli_si128(px[1], 12)));
+  _mm_storeu_si128((__m128i *) (outptr + 16),
+		   _mm_or_si128(_mm_srli_si128(px[1], 4), _mm_slli_si128(px[2], 8)));
+  _mm_storeu_si128((__m128i *) (outptr + 32),
+		   _mm_or_si128(_mm_srli_si128(px[2], 8), _mm_slli_si128(px[3], 4)));
+}
+
+
+/* Store 16 pixels of 8-bit R, G and B as BGRX quadruplets (64 bytes) */
+
+LOCAL(void)
+store_bgrx (JSAMPROW outptr, __m128i r, __m128i g, __m128i b)
+{
+  __m128i pad = _mm_set1_epi8((char) MAXJSAMPLE);
+  __m128i bg, rx;
+
+  bg = _mm_unpacklo_epi8(b, g);
+  rx = _mm_unpacklo_epi8(r, pad);
+  _mm_storeu_si128((__m128i *) outptr, _mm_unpacklo_epi16(bg, rx));
+  _mm_storeu_si128((__m128i *) (outptr + 16), _mm_unpackhi_epi16(bg, rx));
+  bg = _mm_unpackhi_epi8(b, g);
+  rx = _mm_unpackhi_epi8(r, pad);
+  _mm_storeu_si128((__m128i *) (outptr + 32), _mm_unpacklo_epi16(bg, rx));
+  _mm_storeu_si128((__m128i *) (outptr + 48), _mm_unpackhi_epi16(bg, rx));
+}
+
+
+/* Convert one block of 16 pixels.  Chroma is 8 samples if h2_chroma. */
+
+LOCAL(void)
+convert_block (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	       JSAMPROW outptr, boolean h2_chroma,
+	       J_COLOR_SPACE out_color_space)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i center = _mm_set1_epi16(CENTERJSAMPLE);
+  __m128i y, cb, cr, cbcr;
+  __m128i rl, gl, bl, rh, gh, bh;
+
+  y = _mm_loadu_si128((__m128i *) inptr0);
+
+  if (out_color_space == JCS_EXT_YUYV) {
+    if (h2_chroma) {
+      cbcr = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) inptr1),
+			       _mm_loadl_epi64((__m128i *) inptr2));
+    } else {
+      /* Average chroma of pixel pairs, rounding up as (a + b + 1) >> 1 */
+      __m128i mask = _mm_set1_epi16(0xFF);
+
+      cb = _mm_loadu_si128((__m128i *) inptr1);
+      cr = _mm_loadu_si128((__m128i *) inptr2);
+      cb = _mm_avg_epu16(_mm_and_si128(cb, mask), _mm_srli_epi16(cb, 8));
+      cr = _mm_avg_epu16(_mm_and_si128(cr, mask), _mm_srli_epi16(cr, 8));
+      cbcr = _mm_or_si128(cb, _mm_slli_epi16(cr, 8));
+    }
+    _mm_storeu_si128((__m128i *) outptr, _mm_unpacklo_epi8(y, cbcr));
+    _mm_storeu_si128((__m128i *) (outptr + 16), _mm_unpackhi_epi8(y, cbcr));
+    return;
+  }
+
+  if (h2_chroma) {
+    cb = _mm_loadl_epi64((__m128i *) inptr1);
+    cr = _mm_loadl_epi64((__m128i *) inptr2);
+    cb = _mm_unpacklo_epi8(cb, cb);
+    cr = _mm_unpacklo_epi8(cr, cr);
+  } else {
+    cb = _mm_loadu_si128((__m128i *) inptr1);
+    cr = _mm_loadu_si128((__m128i *) inptr2);
+  }
+
+  ycc_rgb_8(_mm_unpacklo_epi8(y, zero),
+	    _mm_sub_epi16(_mm_unpacklo_epi8(cb, zero), center),
+	    _mm_sub_epi16(_mm_unpacklo_epi8(cr, zero), center),
+	    &rl, &gl, &bl);
+  ycc_rgb_8(_mm_unpackhi_epi8(y, zero),
+	    _mm_sub_epi16(_mm_unpackhi_epi8(cb, zero), center),
+	    _mm_sub_epi16(_mm_unpackhi_epi8(cr, zero), center),
+	    &rh, &gh, &bh);
+
+  if (out_color_space == JCS_EXT_BGRX)
+    store_bgrx(outptr, _mm_packus_epi16(rl, rh), _mm_packus_epi16(gl, gh),
+	       _mm_packus_epi16(bl, bh));
+  else
+    store_rgb(outptr, _mm_packus_epi16(rl, rh), _mm_packus_epi16(gl, gh),
+	      _mm_packus_epi16(bl, bh));
+}
+
+
+/*
+ * Convert one row of YCbCr samples to RGB (RGB_PIXELSIZE must be 3 with
+ * R, G, B order), BGRX or YUYV.  If h2_chroma is set, the chroma rows are
+ * half as wide as the luma row, each chroma sample covers two pixels.
+ */
+
+GLOBAL(void)
+jpeg_ycc_convert_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		       JSAMPROW outptr, JDIMENSION num_cols, boolean h2_chroma,
+		       J_COLOR_SPACE out_color_space)
+{
+  JSAMPLE tmp[3][BLOCK_PIXELS];
+  JSAMPLE out[BLOCK_PIXELS*4];
+  JDIMENSION col, count, chroma;
+  int pixelsize;
+
+  switch (out_color_space) {
+  case JCS_EXT_BGRX:
+    pixelsize = 4;
+    break;
+  case JCS_EXT_YUYV:
+    pixelsize = 2;
+    break;
+  default:
+    pixelsize = 3;
+    break;
+  }
+
+  for (col = 0; col + BLOCK_PIXELS <= num_cols; col += BLOCK_PIXELS) {
+    chroma = h2_chroma ? col >> 1 : col;
+    convert_block(inptr0 + col, inptr1 + chroma, inptr2 + chroma,
+		  outptr, h2_chroma, out_color_space);
+    outptr += BLOCK_PIXELS * pixelsize;
+  }
+
+  /* Last partial block goes through the temporary buffers, so that no
+   * sample beyond the end of the rows is read or written.
+   */
+  if (col < num_cols) {
+    count = num_cols - col;
+    chroma = h2_chroma ? (count + 1) >> 1 : count;
+    MEMZERO(tmp, SIZEOF(tmp));
+    MEMCOPY(tmp[0], inptr0 + col, count * SIZEOF(JSAMPLE));
+    col = h2_chroma ? col >> 1 : col;
+    MEMCOPY(tmp[1], inptr1 + col, chroma * SIZEOF(JSAMPLE));
+    MEMCOPY(tmp[2], inptr2 + col, chroma * SIZEOF(JSAMPLE));
+    if (! h2_chroma && (count & 1)) {
+      /* Lone last pixel of YUYV keeps its own chroma */
+      tmp[1][count] = tmp[1][count-1];
+      tmp[2][count] = tmp[2][count-1];
+    }
+    convert_block(tmp[0], tmp[1], tmp[2], out, h2_chroma, out_color_space);
+    MEMCOPY(outptr, out, count * pixelsize * SIZEOF(JSAMPLE));
+  }
+}
+
+#endif /* SSE2_SUPPORTED */
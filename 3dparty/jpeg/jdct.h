@@ -158,6 +158,10 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 #define jpeg_idct_3x6		jRD3x8
 #define jpeg_idct_2x4		jRD2x4
 #define jpeg_idct_1x2		jRD1x2
+#define jpeg_idct_islow_sse2	jRSislow
+#define jpeg_idct_ifast_sse2	jRSifast
+#define jpeg_idct_4x4_sse2	jRS4x4
+#define jpeg_fdct_islow_sse2	jFSislow
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 /* Extern declarations for the forward and inverse DCT routines. */
@@ -334,6 +338,34 @@ EXTERN(void) jpeg_idct_1x2
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
 
+/* SSE2 versions of the integer IDCT routines (jidctsse.c) and of the
+ * integer FDCT routine (jfdctsse.c).  They give exactly the same output as
+ * jidctint.c, jidctfst.c and jfdctint.c, and are selected by jddctmgr.c
+ * and jcdctmgr.c if the CPU reports SSE2 support.
+ */
+
+#ifdef SSE2_SUPPORTED
+#define IDCT_SSE2_SUPPORTED
+#define FDCT_SSE2_SUPPORTED
+#endif
+
+#ifdef IDCT_SSE2_SUPPORTED
+EXTERN(void) jpeg_idct_islow_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_ifast_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_4x4_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+#endif
+
+#ifdef FDCT_SSE2_SUPPORTED
+EXTERN(void) jpeg_fdct_islow_sse2
+    JPP((DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col));
+#endif
+
 
 /*
  * Macros for handling fixed-point arithmetic; these are used by many
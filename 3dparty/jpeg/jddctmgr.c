@@ -115,6 +115,10 @@ start_pass (j_decompress_ptr cinfo)
       break;
     case ((4 << 8) + 4):
       method_ptr = jpeg_idct_4x4;
+#ifdef IDCT_SSE2_SUPPORTED
+      if (jpeg_sse2_usable())
+	method_ptr = jpeg_idct_4x4_sse2;
+#endif
       method = JDCT_ISLOW;	/* jidctint uses islow-style table */
       break;
     case ((5 << 8) + 5):
@@ -231,12 +235,20 @@ start_pass (j_decompress_ptr cinfo)
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
 	method_ptr = jpeg_idct_islow;
+#ifdef IDCT_SSE2_SUPPORTED
+	if (jpeg_sse2_usable())
+	  method_ptr = jpeg_idct_islow_sse2;
+#endif
 	method = JDCT_ISLOW;
 	break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
       case JDCT_IFAST:
 	method_ptr = jpeg_idct_ifast;
+#ifdef IDCT_SSE2_SUPPORTED
+	if (jpeg_sse2_usable())
+	  method_ptr = jpeg_idct_ifast_sse2;
+#endif
 	method = JDCT_IFAST;
 	break;
 #endif
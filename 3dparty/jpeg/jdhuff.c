@@ -25,6 +25,14 @@
 
 #define HUFF_LOOKAHEAD	8	/* # of bits of lookahead */
 
+/* The fast baseline decoder (decode_mcu_fast) needs a 64-bit bit buffer,
+ * so it is only compiled where the compiler provides such a type.
+ */
+#if defined(__GNUC__) && ! defined(SLOW_SHIFT_32)
+#define HUFF_FAST_SUPPORTED
+#define HUFF_FAST_LOOKAHEAD 10	/* # of bits of combined lookahead */
+#endif
+
 typedef struct {
   /* Basic tables: (element [0] of each array is unused) */
   INT32 maxcode[18];		/* largest code of length k (-1 if none) */
@@ -45,6 +53,16 @@ typedef struct {
    */
   int look_nbits[1<<HUFF_LOOKAHEAD]; /* # bits, or 0 if too long */
   UINT8 look_sym[1<<HUFF_LOOKAHEAD]; /* symbol, or unused */
+
+#ifdef HUFF_FAST_SUPPORTED
+  /* Combined lookahead table: indexed by the next HUFF_FAST_LOOKAHEAD bits.
+   * If the Huffman code and the value bits following it both fit in the
+   * lookahead, the entry holds the total # of bits in bits 0..7, the
+   * symbol in bits 8..15 and the sign-extended value in the upper bits;
+   * otherwise the entry is 0.
+   */
+  INT32 look_fast[1<<HUFF_FAST_LOOKAHEAD];
+#endif
 } d_derived_tbl;
 
 
@@ -66,8 +84,13 @@ typedef struct {
  * necessary.
  */
 
+#ifdef HUFF_FAST_SUPPORTED
+typedef unsigned long long bit_buf_type; /* type of bit-extraction buffer */
+#define BIT_BUF_SIZE  64	/* size of buffer in bits */
+#else
 typedef INT32 bit_buf_type;	/* type of bit-extraction buffer */
 #define BIT_BUF_SIZE  32	/* size of buffer in bits */
+#endif
 
 /* If long is > 32 bits on your machine, and shifting/masking longs is
  * reasonably fast, making bit_buf_type be long and setting BIT_BUF_SIZE
@@ -424,6 +447,37 @@ jpeg_make_d_derived_tbl (j_decompress_ptr cinfo, boolean isDC, int tblno,
     }
   }
 
+#ifdef HUFF_FAST_SUPPORTED
+  /* Compute the combined lookahead table.  For each code short enough,
+   * enumerate all values of its s following bits (s = low 4 bits of
+   * the symbol; DC symbols are validated below to be s itself) and
+   * fill in all entries starting with that code and value.
+   */
+
+  MEMZERO(dtbl->look_fast, SIZEOF(dtbl->look_fast));
+
+  p = 0;
+  for (l = 1; l <= HUFF_FAST_LOOKAHEAD; l++) {
+    for (i = 1; i <= (int) htbl->bits[l]; i++, p++) {
+      int sym = htbl->huffval[p];
+      int s = sym & 15;
+      int v;
+
+      if (l + s > HUFF_FAST_LOOKAHEAD)
+	continue;
+      for (v = 0; v < (1 << s); v++) {
+	/* Sign extension as in HUFF_EXTEND */
+	INT32 val = (s && v < (1 << (s-1))) ? (INT32) v - ((1 << s) - 1) : v;
+	INT32 entry = val * 65536 + (sym << 8) + (l + s);
+
+	lookbits = ((huffcode[p] << s) | v) << (HUFF_FAST_LOOKAHEAD-l-s);
+	for (ctr = 1 << (HUFF_FAST_LOOKAHEAD-l-s); ctr > 0; ctr--)
+	  dtbl->look_fast[lookbits++] = entry;
+      }
+    }
+  }
+#endif
+
   /* Validate symbols as being reasonable.
    * For AC tables, we make no check, but accept all byte values 0..255.
    * For DC tables, we require the symbols to be in range 0..15.
@@ -1190,6 +1244,188 @@ decode_mcu_sub (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+#ifdef HUFF_FAST_SUPPORTED
+
+/*
+ * Fast path for baseline sequential scans with full-size blocks, which is
+ * what MJPEG cameras produce.  It is used only when the source buffer holds
+ * enough data for a worst-case MCU, so it never has to suspend, and it
+ * gives up (leaving the MCU to decode_mcu) as soon as it meets a marker.
+ *
+ * A block codes at most 64 symbols of 16 + 15 bits; with every byte
+ * stuffed this is below DCTSIZE2 * 8 bytes, which leaves room for the
+ * 8 bytes peeked by fill_bit_buffer_fast.
+ */
+
+#define FAST_BYTES_PER_BLOCK  (DCTSIZE2 * 8)
+
+/* Nonzero if any byte of the 64-bit word x is 0xFF */
+#define HAS_FF_BYTE(x) \
+	((~(x) - 0x0101010101010101ULL) & (x) & 0x8080808080808080ULL)
+
+/*
+ * Refill get_buffer to at least 49 bits; called with fewer than 32 bits
+ * left.  If none of the next 8 bytes is 0xFF, the whole bytes that fit
+ * are shifted in at once; otherwise they are taken one at a time,
+ * removing stuffed zero bytes.  Returns FALSE on a marker.
+ */
+
+LOCAL(boolean)
+fill_bit_buffer_fast (bit_buf_type * pbuffer, int * pbits_left,
+		      const JOCTET ** pinput)
+{
+  const JOCTET * next_input_byte = *pinput;
+  bit_buf_type word = 0;
+  int nbytes = (BIT_BUF_SIZE - 8 - *pbits_left) >> 3;
+  int i;
+
+  for (i = 0; i < 8; i++)
+    word = (word << 8) | GETJOCTET(next_input_byte[i]);
+
+  if (! HAS_FF_BYTE(word)) {
+    *pbuffer = (*pbuffer << (nbytes * 8)) | (word >> (64 - nbytes * 8));
+    *pbits_left += nbytes * 8;
+    next_input_byte += nbytes;
+  } else {
+    for (; nbytes > 0; nbytes--) {
+      int c = GETJOCTET(*next_input_byte++);
+      if (c == 0xFF) {
+	if (GETJOCTET(*next_input_byte) != 0)
+	  return FALSE;		/* marker or fill byte: leave to slow path */
+	next_input_byte++;	/* discard stuffed zero byte */
+      }
+      *pbuffer = (*pbuffer << 8) | c;
+      *pbits_left += 8;
+    }
+  }
+
+  *pinput = next_input_byte;
+  return TRUE;
+}
+
+#define FILL_BIT_BUFFER_FAST(action) \
+	{ if (bits_left < 32) { \
+	    if (! fill_bit_buffer_fast(&get_buffer, &bits_left, \
+				       &next_input_byte)) \
+	      { action; } } }
+
+/*
+ * Decode the next symbol and its value bits.  The combined lookahead
+ * table handles the common case in one step; otherwise we fall back to
+ * the HUFF_LOOKAHEAD table and jpeg_huff_decode.  The caller guarantees
+ * at least 32 bits in get_buffer, enough for any code plus value.
+ */
+
+#define HUFF_DECODE_FAST(sym,val,htbl) \
+{ register INT32 entry = htbl->look_fast[PEEK_BITS(HUFF_FAST_LOOKAHEAD)]; \
+  if (entry != 0) { \
+    DROP_BITS((int) (entry & 0xFF)); \
+    sym = (int) (entry >> 8) & 0xFF; \
+    val = (int) RIGHT_SHIFT(entry, 16); \
+  } else { \
+    register int nb, look = PEEK_BITS(HUFF_LOOKAHEAD); \
+    if ((nb = htbl->look_nbits[look]) != 0) { \
+      DROP_BITS(nb); \
+      sym = htbl->look_sym[look]; \
+    } else { \
+      sym = jpeg_huff_decode(&br_state, get_buffer, bits_left, htbl, \
+			     HUFF_LOOKAHEAD+1); \
+      get_buffer = br_state.get_buffer; bits_left = br_state.bits_left; \
+    } \
+    if ((nb = sym & 15) != 0) { \
+      val = GET_BITS(nb); \
+      val = HUFF_EXTEND(val, nb); \
+    } else \
+      val = 0; \
+  } \
+}
+
+LOCAL(boolean)
+decode_mcu_fast (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  bit_buf_type get_buffer = entropy->bitstate.get_buffer;
+  int bits_left = entropy->bitstate.bits_left;
+  const JOCTET * next_input_byte = cinfo->src->next_input_byte;
+  bitread_working_state br_state;
+  savable_state state;
+  int blkn;
+  SHIFT_TEMPS
+
+  br_state.cinfo = cinfo;	/* jpeg_huff_decode may emit a warning */
+  ASSIGN_STATE(state, entropy->saved);
+
+  for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
+    JBLOCKROW block = MCU_data[blkn];
+    d_derived_tbl * htbl;
+    register int s, k, r;
+    int coef_limit, ci;
+
+    /* Section F.2.2.1: decode the DC coefficient difference */
+    htbl = entropy->dc_cur_tbls[blkn];
+    FILL_BIT_BUFFER_FAST(goto marker);
+    HUFF_DECODE_FAST(s, r, htbl);
+
+    htbl = entropy->ac_cur_tbls[blkn];
+    k = 1;
+    coef_limit = entropy->coef_limit[blkn];
+    if (coef_limit) {
+      ci = cinfo->MCU_membership[blkn];
+      r += state.last_dc_val[ci];
+      state.last_dc_val[ci] = r;
+      (*block)[0] = (JCOEF) r;
+
+      /* Section F.2.2.2: decode the AC coefficients */
+      for (; k < coef_limit; k++) {
+	FILL_BIT_BUFFER_FAST(goto marker);
+	HUFF_DECODE_FAST(s, r, htbl);
+	if (s & 15) {
+	  k += s >> 4;
+	  (*block)[jpeg_natural_order[k]] = (JCOEF) r;
+	} else {
+	  if (s != 0xF0)
+	    goto EndOfBlock;
+	  k += 15;
+	}
+      }
+    }
+
+    /* In this path we just discard the values */
+    for (; k < DCTSIZE2; k++) {
+      FILL_BIT_BUFFER_FAST(goto marker);
+      HUFF_DECODE_FAST(s, r, htbl);
+      if (s & 15) {
+	k += s >> 4;
+      } else {
+	if (s != 0xF0)
+	  break;
+	k += 15;
+      }
+    }
+
+  EndOfBlock: ;
+  }
+
+  /* Completed MCU, so update state */
+  cinfo->src->bytes_in_buffer -= next_input_byte - cinfo->src->next_input_byte;
+  cinfo->src->next_input_byte = next_input_byte;
+  entropy->bitstate.get_buffer = get_buffer;
+  entropy->bitstate.bits_left = bits_left;
+  ASSIGN_STATE(entropy->saved, state);
+  return TRUE;
+
+marker:
+  /* Nothing has been committed; clear the blocks and let the caller
+   * decode the MCU again with full marker handling.
+   */
+  for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+    FMEMZERO((void FAR *) MCU_data[blkn], SIZEOF(JBLOCK));
+  return FALSE;
+}
+
+#endif /* HUFF_FAST_SUPPORTED */
+
+
 /*
  * Decode one MCU's worth of Huffman-compressed coefficients,
  * full-size blocks.
@@ -1215,6 +1451,19 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
    */
   if (! entropy->insufficient_data) {
 
+#ifdef HUFF_FAST_SUPPORTED
+    /* Take the fast path if no marker is pending and the whole MCU is
+     * sure to be in the source buffer.
+     */
+    if (cinfo->unread_marker == 0 &&
+	cinfo->src->bytes_in_buffer >=
+	(size_t) cinfo->blocks_in_MCU * FAST_BYTES_PER_BLOCK &&
+	decode_mcu_fast(cinfo, MCU_data)) {
+      entropy->restarts_to_go--;
+      return TRUE;
+    }
+#endif
+
     /* Load up working state */
     BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
     ASSIGN_STATE(state, entropy->saved);
@@ -48,12 +48,15 @@ use_merged_upsample (j_decompress_ptr cinfo)
   /* Merging is the equivalent of plain box-filter upsampling */
   if (cinfo->do_fancy_upsampling || cinfo->CCIR601_sampling)
     return FALSE;
-  /* jdmerge.c only supports YCC=>RGB color conversion */
+  /* jdmerge.c only supports YCC=>RGB, BGRX and YUYV color conversion */
   if (cinfo->jpeg_color_space != JCS_YCbCr || cinfo->num_components != 3 ||
-      cinfo->out_color_space != JCS_RGB ||
-      cinfo->out_color_components != RGB_PIXELSIZE ||
       cinfo->color_transform)
     return FALSE;
+  if ((cinfo->out_color_space != JCS_RGB ||
+       cinfo->out_color_components != RGB_PIXELSIZE) &&
+      cinfo->out_color_space != JCS_EXT_BGRX &&
+      cinfo->out_color_space != JCS_EXT_YUYV)
+    return FALSE;
   /* and it only handles 2h1v or 2h2v sampling ratios */
   if (cinfo->comp_info[0].h_samp_factor != 2 ||
       cinfo->comp_info[1].h_samp_factor != 1 ||
@@ -168,8 +171,12 @@ jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
     break;
   case JCS_CMYK:
   case JCS_YCCK:
+  case JCS_EXT_BGRX:
     cinfo->out_color_components = 4;
     break;
+  case JCS_EXT_YUYV:		/* 2 samples per pixel, chroma is shared */
+    cinfo->out_color_components = 2;
+    break;
   default:			/* else must be same colorspace as in file */
     cinfo->out_color_components = cinfo->num_components;
     break;
@@ -24,7 +24,7 @@
  * multiplications needed for color conversion.
  *
  * This file currently provides implementations for the following cases:
- *	YCbCr => RGB color conversion only.
+ *	YCbCr => RGB, BGRX or YUYV color conversion only.
  *	Sampling ratios of 2h1v or 2h2v.
  *	No scaling needed at upsample time.
  *	Corner-aligned (non-CCIR601) sampling alignment.
@@ -359,6 +359,141 @@ h2v2_merged_upsample (j_decompress_ptr cinfo,
 }
 
 
+/*
+ * Upsample and color convert one row for the BGRX and YUYV output
+ * colorspaces.  For YUYV the chroma samples are just interleaved with
+ * the luma samples, box filter upsampling doesn't change them.
+ */
+
+LOCAL(void)
+h2_merged_row (j_decompress_ptr cinfo,
+	       JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	       JSAMPROW outptr)
+{
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  register int y, cred, cgreen, cblue;
+  int cb, cr;
+  JDIMENSION col;
+  /* copy these pointers into registers if possible */
+  register JSAMPLE * range_limit = cinfo->sample_range_limit;
+  int * Crrtab = upsample->Cr_r_tab;
+  int * Cbbtab = upsample->Cb_b_tab;
+  INT32 * Crgtab = upsample->Cr_g_tab;
+  INT32 * Cbgtab = upsample->Cb_g_tab;
+  SHIFT_TEMPS
+
+  if (cinfo->out_color_space == JCS_EXT_YUYV) {
+    for (col = cinfo->output_width >> 1; col > 0; col--) {
+      outptr[0] = *inptr0++;
+      outptr[1] = *inptr1++;
+      outptr[2] = *inptr0++;
+      outptr[3] = *inptr2++;
+      outptr += 4;
+    }
+    if (cinfo->output_width & 1) {
+      outptr[0] = *inptr0;
+      outptr[1] = *inptr1;
+    }
+    return;
+  }
+
+  /* BGRX; if image width is odd, the last output column is done as a pair
+   * with just one pixel stored.
+   */
+  for (col = 0; col < cinfo->output_width; col += 2) {
+    cb = GETJSAMPLE(*inptr1++);
+    cr = GETJSAMPLE(*inptr2++);
+    cred = Crrtab[cr];
+    cgreen = (int) RIGHT_SHIFT(Cbgtab[cb] + Crgtab[cr], SCALEBITS);
+    cblue = Cbbtab[cb];
+    y  = GETJSAMPLE(*inptr0++);
+    outptr[0] = range_limit[y + cblue];
+    outptr[1] = range_limit[y + cgreen];
+    outptr[2] = range_limit[y + cred];
+    outptr[3] = MAXJSAMPLE;
+    outptr += 4;
+    if (col + 1 < cinfo->output_width) {
+      y  = GETJSAMPLE(*inptr0++);
+      outptr[0] = range_limit[y + cblue];
+      outptr[1] = range_limit[y + cgreen];
+      outptr[2] = range_limit[y + cred];
+      outptr[3] = MAXJSAMPLE;
+      outptr += 4;
+    }
+  }
+}
+
+
+METHODDEF(void)
+h2v1_merged_upsample_ext (j_decompress_ptr cinfo,
+			  JSAMPIMAGE input_buf, JDIMENSION in_row_group_ctr,
+			  JSAMPARRAY output_buf)
+{
+  h2_merged_row(cinfo, input_buf[0][in_row_group_ctr],
+		input_buf[1][in_row_group_ctr], input_buf[2][in_row_group_ctr],
+		output_buf[0]);
+}
+
+
+METHODDEF(void)
+h2v2_merged_upsample_ext (j_decompress_ptr cinfo,
+			  JSAMPIMAGE input_buf, JDIMENSION in_row_group_ctr,
+			  JSAMPARRAY output_buf)
+{
+  h2_merged_row(cinfo, input_buf[0][in_row_group_ctr*2],
+		input_buf[1][in_row_group_ctr], input_buf[2][in_row_group_ctr],
+		output_buf[0]);
+  h2_merged_row(cinfo, input_buf[0][in_row_group_ctr*2 + 1],
+		input_buf[1][in_row_group_ctr], input_buf[2][in_row_group_ctr],
+		output_buf[1]);
+}
+
+
+#ifdef SSE2_SUPPORTED
+
+/*
+ * SSE2 versions for all output colorspaces, see jdcolsse.c.  The chroma
+ * terms are computed for each output pixel rather than once per pair,
+ * which gives the same results.
+ */
+
+METHODDEF(void)
+h2v1_merged_upsample_sse2 (j_decompress_ptr cinfo,
+			   JSAMPIMAGE input_buf, JDIMENSION in_row_group_ctr,
+			   JSAMPARRAY output_buf)
+{
+  jpeg_ycc_convert_sse2(input_buf[0][in_row_group_ctr],
+			input_buf[1][in_row_group_ctr],
+			input_buf[2][in_row_group_ctr], output_buf[0],
+			cinfo->output_width, TRUE, cinfo->out_color_space);
+}
+
+
+METHODDEF(void)
+h2v2_merged_upsample_sse2 (j_decompress_ptr cinfo,
+			   JSAMPIMAGE input_buf, JDIMENSION in_row_group_ctr,
+			   JSAMPARRAY output_buf)
+{
+  jpeg_ycc_convert_sse2(input_buf[0][in_row_group_ctr*2],
+			input_buf[1][in_row_group_ctr],
+			input_buf[2][in_row_group_ctr], output_buf[0],
+			cinfo->output_width, TRUE, cinfo->out_color_space);
+  jpeg_ycc_convert_sse2(input_buf[0][in_row_group_ctr*2 + 1],
+			input_buf[1][in_row_group_ctr],
+			input_buf[2][in_row_group_ctr], output_buf[1],
+			cinfo->output_width, TRUE, cinfo->out_color_space);
+}
+
+/* The SSE2 code stores RGB triplets in R, G, B order only */
+#if RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2 && RGB_PIXELSIZE == 3
+#define SSE2_COLOR_SPACE(space)  TRUE
+#else
+#define SSE2_COLOR_SPACE(space)  ((space) != JCS_RGB)
+#endif
+
+#endif /* SSE2_SUPPORTED */
+
+
 /*
  * Module initialization routine for merged upsampling/color conversion.
  *
@@ -395,6 +530,23 @@ jinit_merged_upsampler (j_decompress_ptr cinfo)
     upsample->spare_row = NULL;
   }
 
+  /* Other than RGB output colorspaces */
+  if (cinfo->out_color_space != JCS_RGB) {
+    if (cinfo->max_v_samp_factor == 2)
+      upsample->upmethod = h2v2_merged_upsample_ext;
+    else
+      upsample->upmethod = h2v1_merged_upsample_ext;
+  }
+
+#ifdef SSE2_SUPPORTED
+  if (SSE2_COLOR_SPACE(cinfo->out_color_space) && jpeg_sse2_usable()) {
+    if (cinfo->max_v_samp_factor == 2)
+      upsample->upmethod = h2v2_merged_upsample_sse2;
+    else
+      upsample->upmethod = h2v1_merged_upsample_sse2;
+  }
+#endif
+
   build_ycc_rgb_table(cinfo);
 }
 
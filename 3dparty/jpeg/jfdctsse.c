@@ -0,0 +1,212 @@
+/*
+ * jfdctsse.c
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains an SSE2 version of the integer forward DCT routine
+ * jpeg_fdct_islow (jfdctint.c).  Four rows (or columns) are processed at
+ * once in 32-bit lanes, following the scalar code statement by statement,
+ * so the output is bit-exact with the scalar routine.
+ *
+ * SSE2 has no 32x32->32 bit multiply, multiplications by the constants
+ * (which fit into 16 bits) are composed of 16-bit multiplies as in
+ * jidctsse.c.  Negative constants are applied by subtracting the product
+ * with the positive one, which gives the same low 32 bits.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+
+#ifdef FDCT_SSE2_SUPPORTED
+
+#include <emmintrin.h>
+
+
+/* Constants of jfdctint.c, CONST_BITS = 13 and PASS1_BITS = 2 */
+
+#define ISLOW_CONST_BITS  13
+#define ISLOW_PASS1_BITS  2
+
+#define FIX_0_298631336  2446
+#define FIX_0_390180644  3196
+#define FIX_0_541196100  4433
+#define FIX_0_765366865  6270
+#define FIX_0_899976223  7373
+#define FIX_1_175875602  9633
+#define FIX_1_501321110  12299
+#define FIX_1_847759065  15137
+#define FIX_1_961570560  16069
+#define FIX_2_053119869  16819
+#define FIX_2_562915447  20995
+#define FIX_3_072711026  25172
+
+
+/* Multiply 32-bit lanes by a positive constant below 65536, keeping the
+ * low 32 bits of the product.  The constant is given in both 16-bit halves
+ * of each lane.
+ */
+
+LOCAL(__m128i)
+mul_const (__m128i var, __m128i c)
+{
+  __m128i lo = _mm_mullo_epi16(var, c);
+  __m128i hi = _mm_mulhi_epu16(var, c);
+
+  return _mm_add_epi32(lo, _mm_slli_epi32(hi, 16));
+}
+
+#define CONST16(c)  _mm_set1_epi16((short) (c))
+
+/* Transpose 4x4 matrix of 32-bit elements */
+
+#define TRANSPOSE4(r0, r1, r2, r3)  \
+  { __m128i t0 = _mm_unpacklo_epi32(r0, r1); \
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3); \
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1); \
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3); \
+    r0 = _mm_unpacklo_epi64(t0, t1); \
+    r1 = _mm_unpackhi_epi64(t0, t1); \
+    r2 = _mm_unpacklo_epi64(t2, t3); \
+    r3 = _mm_unpackhi_epi64(t2, t3); }
+
+
+/*
+ * 1-D pass of jpeg_fdct_islow on 4 rows (pass 1) or 4 columns (pass 2).
+ * Pass 1 removes the sample offset from the DC term and scales the results
+ * up by 2**PASS1_BITS, pass 2 removes this scaling again.
+ */
+
+LOCAL(void)
+islow_1d (__m128i in[8], __m128i out[8], int pass1)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+  __m128i z1;
+  __m128i fudge;
+  __m128i count;
+
+  if (pass1) {
+    fudge = _mm_set1_epi32(1 << (ISLOW_CONST_BITS-ISLOW_PASS1_BITS-1));
+    count = _mm_cvtsi32_si128(ISLOW_CONST_BITS-ISLOW_PASS1_BITS);
+  } else {
+    fudge = _mm_set1_epi32(1 << (ISLOW_CONST_BITS+ISLOW_PASS1_BITS-1));
+    count = _mm_cvtsi32_si128(ISLOW_CONST_BITS+ISLOW_PASS1_BITS);
+  }
+
+  /* Even part */
+
+  tmp0 = _mm_add_epi32(in[0], in[7]);
+  tmp1 = _mm_add_epi32(in[1], in[6]);
+  tmp2 = _mm_add_epi32(in[2], in[5]);
+  tmp3 = _mm_add_epi32(in[3], in[4]);
+
+  tmp10 = _mm_add_epi32(tmp0, tmp3);
+  tmp12 = _mm_sub_epi32(tmp0, tmp3);
+  tmp11 = _mm_add_epi32(tmp1, tmp2);
+  tmp13 = _mm_sub_epi32(tmp1, tmp2);
+
+  tmp0 = _mm_sub_epi32(in[0], in[7]);
+  tmp1 = _mm_sub_epi32(in[1], in[6]);
+  tmp2 = _mm_sub_epi32(in[2], in[5]);
+  tmp3 = _mm_sub_epi32(in[3], in[4]);
+
+  if (pass1) {
+    /* Apply unsigned->signed conversion */
+    out[0] = _mm_slli_epi32(_mm_sub_epi32(_mm_add_epi32(tmp10, tmp11),
+					  _mm_set1_epi32(8 * CENTERJSAMPLE)),
+			    ISLOW_PASS1_BITS);
+    out[4] = _mm_slli_epi32(_mm_sub_epi32(tmp10, tmp11), ISLOW_PASS1_BITS);
+  } else {
+    tmp10 = _mm_add_epi32(tmp10, _mm_set1_epi32(1 << (ISLOW_PASS1_BITS-1)));
+    out[0] = _mm_srai_epi32(_mm_add_epi32(tmp10, tmp11), ISLOW_PASS1_BITS);
+    out[4] = _mm_srai_epi32(_mm_sub_epi32(tmp10, tmp11), ISLOW_PASS1_BITS);
+  }
+
+  z1 = mul_const(_mm_add_epi32(tmp12, tmp13), CONST16(FIX_0_541196100));
+  z1 = _mm_add_epi32(z1, fudge);
+
+  out[2] = _mm_sra_epi32(_mm_add_epi32(z1, mul_const(tmp12, CONST16(FIX_0_765366865))), count);
+  out[6] = _mm_sra_epi32(_mm_sub_epi32(z1, mul_const(tmp13, CONST16(FIX_1_847759065))), count);
+
+  /* Odd part */
+
+  tmp12 = _mm_add_epi32(tmp0, tmp2);
+  tmp13 = _mm_add_epi32(tmp1, tmp3);
+
+  z1 = mul_const(_mm_add_epi32(tmp12, tmp13), CONST16(FIX_1_175875602));
+  z1 = _mm_add_epi32(z1, fudge);
+
+  tmp12 = _mm_sub_epi32(z1, mul_const(tmp12, CONST16(FIX_0_390180644)));
+  tmp13 = _mm_sub_epi32(z1, mul_const(tmp13, CONST16(FIX_1_961570560)));
+
+  z1 = mul_const(_mm_add_epi32(tmp0, tmp3), CONST16(FIX_0_899976223));
+  tmp0 = mul_const(tmp0, CONST16(FIX_1_501321110));
+  tmp3 = mul_const(tmp3, CONST16(FIX_0_298631336));
+  tmp0 = _mm_add_epi32(tmp0, _mm_sub_epi32(tmp12, z1));
+  tmp3 = _mm_add_epi32(tmp3, _mm_sub_epi32(tmp13, z1));
+
+  z1 = mul_const(_mm_add_epi32(tmp1, tmp2), CONST16(FIX_2_562915447));
+  tmp1 = mul_const(tmp1, CONST16(FIX_3_072711026));
+  tmp2 = mul_const(tmp2, CONST16(FIX_2_053119869));
+  tmp1 = _mm_add_epi32(tmp1, _mm_sub_epi32(tmp13, z1));
+  tmp2 = _mm_add_epi32(tmp2, _mm_sub_epi32(tmp12, z1));
+
+  out[1] = _mm_sra_epi32(tmp0, count);
+  out[3] = _mm_sra_epi32(tmp1, count);
+  out[5] = _mm_sra_epi32(tmp2, count);
+  out[7] = _mm_sra_epi32(tmp3, count);
+}
+
+
+/*
+ * Perform the forward DCT on one block of samples, the same as
+ * jpeg_fdct_islow.
+ */
+
+GLOBAL(void)
+jpeg_fdct_islow_sse2 (DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col)
+{
+  __m128i in[8], out[8];
+  __m128i zero = _mm_setzero_si128();
+  int row, i;
+
+  /* Pass 1: process rows 0-3 and 4-7, results are stored by rows */
+
+  for (row = 0; row < DCTSIZE; row += 4) {
+    for (i = 0; i < 4; i++) {
+      __m128i samples = _mm_loadl_epi64((__m128i *) (sample_data[row+i] + start_col));
+
+      samples = _mm_unpacklo_epi8(samples, zero);
+      in[i] = _mm_unpacklo_epi16(samples, zero);
+      in[i+4] = _mm_unpackhi_epi16(samples, zero);
+    }
+    TRANSPOSE4(in[0], in[1], in[2], in[3]);
+    TRANSPOSE4(in[4], in[5], in[6], in[7]);
+
+    islow_1d(in, out, TRUE);
+
+    TRANSPOSE4(out[0], out[1], out[2], out[3]);
+    TRANSPOSE4(out[4], out[5], out[6], out[7]);
+    for (i = 0; i < 4; i++) {
+      _mm_storeu_si128((__m128i *) (data + DCTSIZE*(row+i)), out[i]);
+      _mm_storeu_si128((__m128i *) (data + DCTSIZE*(row+i) + 4), out[i+4]);
+    }
+  }
+
+  /* Pass 2: process columns 0-3 and 4-7, rows are already in lanes */
+
+  for (i = 0; i < 2; i++) {
+    for (row = 0; row < DCTSIZE; row++)
+      in[row] = _mm_loadu_si128((__m128i *) (data + DCTSIZE*row + 4*i));
+
+    islow_1d(in, out, FALSE);
+
+    for (row = 0; row < DCTSIZE; row++)
+      _mm_storeu_si128((__m128i *) (data + DCTSIZE*row + 4*i), out[row]);
+  }
+}
+
+#endif /* FDCT_SSE2_SUPPORTED */
@@ -0,0 +1,501 @@
+/*
+ * jidctsse.c
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains SSE2 versions of the integer inverse DCT routines
+ * jpeg_idct_islow and jpeg_idct_4x4 (jidctint.c) and jpeg_idct_ifast
+ * (jidctfst.c).  Four columns (or rows) are processed at once in 32-bit
+ * lanes, following the scalar code statement by statement, so that the
+ * output is bit-exact with the scalar routines for any input where INT32
+ * is 32 bits wide, including the corrupted coefficients and the range
+ * limiting of overflowed results.  With a wider INT32 only the results of
+ * coefficients which overflow 32 bits differ, these never occur in valid
+ * streams.
+ *
+ * SSE2 has no 32x32->32 bit multiply, so multiplications by the constants
+ * (which fit into 16 bits) are composed of 16-bit multiplies, and the
+ * dequantization uses two 32x32->64 bit multiplies.  Both give the same
+ * low 32 bits as the C multiplication.
+ *
+ * The scalar routines short-circuit the columns and rows with zero AC
+ * terms.  Where this shortcut may give a different result than the full
+ * calculation (overflow in jpeg_idct_islow), it is reproduced by masks.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+
+#ifdef IDCT_SSE2_SUPPORTED
+
+#include <emmintrin.h>
+
+
+/* Constants of jidctint.c, CONST_BITS = 13 and PASS1_BITS = 2 */
+
+#define ISLOW_CONST_BITS  13
+#define ISLOW_PASS1_BITS  2
+
+#define FIX_0_298631336  2446
+#define FIX_0_390180644  3196
+#define FIX_0_541196100  4433
+#define FIX_0_765366865  6270
+#define FIX_0_899976223  7373
+#define FIX_1_175875602  9633
+#define FIX_1_501321110  12299
+#define FIX_1_847759065  15137
+#define FIX_1_961570560  16069
+#define FIX_2_053119869  16819
+#define FIX_2_562915447  20995
+#define FIX_3_072711026  25172
+
+/* Constants of jidctfst.c, CONST_BITS = 8 and PASS1_BITS = 2 */
+
+#define IFAST_CONST_BITS  8
+#define IFAST_PASS1_BITS  2
+
+#define IFAST_1_082392200  277
+#define IFAST_1_414213562  362
+#define IFAST_1_847759065  473
+#define IFAST_2_613125930  669
+
+
+/* Multiply 32-bit lanes by a positive constant below 65536, keeping the
+ * low 32 bits of the product.  The constant is given in both 16-bit halves
+ * of each lane.
+ */
+
+LOCAL(__m128i)
+mul_const (__m128i var, __m128i c)
+{
+  __m128i lo = _mm_mullo_epi16(var, c);
+  __m128i hi = _mm_mulhi_epu16(var, c);
+
+  return _mm_add_epi32(lo, _mm_slli_epi32(hi, 16));
+}
+
+#define CONST16(c)  _mm_set1_epi16((short) (c))
+
+/* Multiply 32-bit lanes, keeping the low 32 bits of the products */
+
+LOCAL(__m128i)
+mul_32 (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* Load 4 coefficients sign-extended to 32 bits and dequantize them */
+
+LOCAL(__m128i)
+dequantize (JCOEFPTR inptr, int * quantptr)
+{
+  __m128i coef = _mm_loadl_epi64((__m128i *) inptr);
+
+  coef = _mm_srai_epi32(_mm_unpacklo_epi16(coef, coef), 16);
+  return mul_32(coef, _mm_loadu_si128((__m128i *) quantptr));
+}
+
+/* Transpose 4x4 matrix of 32-bit elements */
+
+#define TRANSPOSE4(r0, r1, r2, r3)  \
+  { __m128i t0 = _mm_unpacklo_epi32(r0, r1); \
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3); \
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1); \
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3); \
+    r0 = _mm_unpacklo_epi64(t0, t1); \
+    r1 = _mm_unpackhi_epi64(t0, t1); \
+    r2 = _mm_unpacklo_epi64(t2, t3); \
+    r3 = _mm_unpackhi_epi64(t2, t3); }
+
+/* Range limit of the results, the same as range_limit[x & RANGE_MASK]:
+ * the low 10 bits are taken as a signed value, which is then offset by
+ * CENTERJSAMPLE and clamped to 0..MAXJSAMPLE.  Returns 16-bit samples.
+ */
+
+LOCAL(__m128i)
+range_limit_8 (__m128i lo, __m128i hi)
+{
+  lo = _mm_srai_epi32(_mm_slli_epi32(lo, 22), 22);
+  hi = _mm_srai_epi32(_mm_slli_epi32(hi, 22), 22);
+  return _mm_add_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(CENTERJSAMPLE));
+}
+
+/* Select b where mask is set, a elsewhere */
+
+#define BLEND(mask, a, b)  \
+  _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a))
+
+
+#ifdef DCT_ISLOW_SUPPORTED
+
+/*
+ * 1-D pass of jpeg_idct_islow on 4 columns.  in[] are dequantized inputs
+ * (pass 1) or workspace values (pass 2), shift is the final descale.  Pass 1
+ * scales in[0] and in[4] before adding the fudge factor, while pass 2 adds
+ * it first, the order matters if the values overflow.
+ */
+
+LOCAL(void)
+islow_1d (__m128i in[8], __m128i out[8], int pass1, int shift)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+  __m128i z1, z2, z3;
+  __m128i zero = _mm_setzero_si128();
+  __m128i count = _mm_cvtsi32_si128(shift);
+
+  /* Even part */
+
+  z2 = in[2];
+  z3 = in[6];
+
+  z1 = mul_const(_mm_add_epi32(z2, z3), CONST16(FIX_0_541196100));
+  tmp2 = _mm_add_epi32(z1, mul_const(z2, CONST16(FIX_0_765366865)));
+  tmp3 = _mm_sub_epi32(z1, mul_const(z3, CONST16(FIX_1_847759065)));
+
+  if (pass1) {
+    z2 = _mm_slli_epi32(in[0], ISLOW_CONST_BITS);
+    z3 = _mm_slli_epi32(in[4], ISLOW_CONST_BITS);
+    z2 = _mm_add_epi32(z2, _mm_set1_epi32(1 << (ISLOW_CONST_BITS-ISLOW_PASS1_BITS-1)));
+    tmp0 = _mm_add_epi32(z2, z3);
+    tmp1 = _mm_sub_epi32(z2, z3);
+  } else {
+    z2 = _mm_add_epi32(in[0], _mm_set1_epi32(1 << (ISLOW_PASS1_BITS+2)));
+    z3 = in[4];
+    tmp0 = _mm_slli_epi32(_mm_add_epi32(z2, z3), ISLOW_CONST_BITS);
+    tmp1 = _mm_slli_epi32(_mm_sub_epi32(z2, z3), ISLOW_CONST_BITS);
+  }
+
+  tmp10 = _mm_add_epi32(tmp0, tmp2);
+  tmp13 = _mm_sub_epi32(tmp0, tmp2);
+  tmp11 = _mm_add_epi32(tmp1, tmp3);
+  tmp12 = _mm_sub_epi32(tmp1, tmp3);
+
+  /* Odd part */
+
+  tmp0 = in[7];
+  tmp1 = in[5];
+  tmp2 = in[3];
+  tmp3 = in[1];
+
+  z2 = _mm_add_epi32(tmp0, tmp2);
+  z3 = _mm_add_epi32(tmp1, tmp3);
+
+  z1 = mul_const(_mm_add_epi32(z2, z3), CONST16(FIX_1_175875602));
+  z2 = _mm_sub_epi32(z1, mul_const(z2, CONST16(FIX_1_961570560)));
+  z3 = _mm_sub_epi32(z1, mul_const(z3, CONST16(FIX_0_390180644)));
+
+  z1 = _mm_sub_epi32(zero, mul_const(_mm_add_epi32(tmp0, tmp3), CONST16(FIX_0_899976223)));
+  tmp0 = mul_const(tmp0, CONST16(FIX_0_298631336));
+  tmp3 = mul_const(tmp3, CONST16(FIX_1_501321110));
+  tmp0 = _mm_add_epi32(tmp0, _mm_add_epi32(z1, z2));
+  tmp3 = _mm_add_epi32(tmp3, _mm_add_epi32(z1, z3));
+
+  z1 = _mm_sub_epi32(zero, mul_const(_mm_add_epi32(tmp1, tmp2), CONST16(FIX_2_562915447)));
+  tmp1 = mul_const(tmp1, CONST16(FIX_2_053119869));
+  tmp2 = mul_const(tmp2, CONST16(FIX_3_072711026));
+  tmp1 = _mm_add_epi32(tmp1, _mm_add_epi32(z1, z3));
+  tmp2 = _mm_add_epi32(tmp2, _mm_add_epi32(z1, z2));
+
+  /* Final output stage */
+
+  out[0] = _mm_sra_epi32(_mm_add_epi32(tmp10, tmp3), count);
+  out[7] = _mm_sra_epi32(_mm_sub_epi32(tmp10, tmp3), count);
+  out[1] = _mm_sra_epi32(_mm_add_epi32(tmp11, tmp2), count);
+  out[6] = _mm_sra_epi32(_mm_sub_epi32(tmp11, tmp2), count);
+  out[2] = _mm_sra_epi32(_mm_add_epi32(tmp12, tmp1), count);
+  out[5] = _mm_sra_epi32(_mm_sub_epi32(tmp12, tmp1), count);
+  out[3] = _mm_sra_epi32(_mm_add_epi32(tmp13, tmp0), count);
+  out[4] = _mm_sra_epi32(_mm_sub_epi32(tmp13, tmp0), count);
+}
+
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients,
+ * the same as jpeg_idct_islow.
+ */
+
+GLOBAL(void)
+jpeg_idct_islow_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i in[8], ws[2][8], out[8];
+  __m128i ac, mask, dcval;
+  __m128i zero = _mm_setzero_si128();
+  int * quantptr = (int *) compptr->dct_table;
+  int half, row, i;
+
+  /* Columns which have all AC terms zero: pass 1 of the scalar code
+   * stores the dequantized DC coefficient scaled by PASS1_BITS there.
+   */
+  ac = _mm_loadu_si128((__m128i *) (coef_block + DCTSIZE*1));
+  for (i = 2; i < DCTSIZE; i++)
+    ac = _mm_or_si128(ac, _mm_loadu_si128((__m128i *) (coef_block + DCTSIZE*i)));
+  ac = _mm_cmpeq_epi16(ac, zero);
+
+  /* Pass 1: process columns 0-3 and 4-7 from input */
+
+  for (half = 0; half < 2; half++) {
+    for (i = 0; i < DCTSIZE; i++)
+      in[i] = dequantize(coef_block + DCTSIZE*i + half*4, quantptr + DCTSIZE*i + half*4);
+
+    islow_1d(in, ws[half], 1, ISLOW_CONST_BITS-ISLOW_PASS1_BITS);
+
+    mask = half ? _mm_unpackhi_epi16(ac, ac) : _mm_unpacklo_epi16(ac, ac);
+    dcval = _mm_slli_epi32(in[0], ISLOW_PASS1_BITS);
+    for (i = 0; i < DCTSIZE; i++)
+      ws[half][i] = BLEND(mask, ws[half][i], dcval);
+  }
+
+  /* Pass 2: process rows 0-3 and 4-7 from work array.  ws[half][i] holds
+   * row i of columns half*4..half*4+3, so 4x4 blocks are transposed to get
+   * columns of the rows.
+   */
+
+  for (row = 0; row < DCTSIZE; row += 4) {
+    for (i = 0; i < 4; i++) {
+      in[i] = ws[0][row+i];
+      in[i+4] = ws[1][row+i];
+    }
+    TRANSPOSE4(in[0], in[1], in[2], in[3]);
+    TRANSPOSE4(in[4], in[5], in[6], in[7]);
+
+    islow_1d(in, out, 0, ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3);
+
+    /* Rows which have all AC terms zero */
+    ac = in[1];
+    for (i = 2; i < DCTSIZE; i++)
+      ac = _mm_or_si128(ac, in[i]);
+    mask = _mm_cmpeq_epi32(ac, zero);
+    dcval = _mm_srai_epi32(_mm_add_epi32(in[0], _mm_set1_epi32(1 << (ISLOW_PASS1_BITS+2))),
+			   ISLOW_PASS1_BITS+3);
+    for (i = 0; i < DCTSIZE; i++)
+      out[i] = BLEND(mask, out[i], dcval);
+
+    TRANSPOSE4(out[0], out[1], out[2], out[3]);
+    TRANSPOSE4(out[4], out[5], out[6], out[7]);
+    for (i = 0; i < 4; i++) {
+      __m128i samples = range_limit_8(out[i], out[i+4]);
+
+      _mm_storel_epi64((__m128i *) (output_buf[row+i] + output_col),
+		       _mm_packus_epi16(samples, samples));
+    }
+  }
+}
+
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients,
+ * producing a reduced-size 4x4 output block, the same as jpeg_idct_4x4.
+ */
+
+GLOBAL(void)
+jpeg_idct_4x4_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		    JCOEFPTR coef_block,
+		    JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i in0, in1, in2, in3;
+  __m128i tmp0, tmp2, tmp10, tmp12;
+  __m128i z1, z2, z3;
+  __m128i samples;
+  int * quantptr = (int *) compptr->dct_table;
+  int i;
+  INT32 value;
+
+  /* Pass 1: process columns from input */
+
+  in0 = dequantize(coef_block + DCTSIZE*0, quantptr + DCTSIZE*0);
+  in1 = dequantize(coef_block + DCTSIZE*1, quantptr + DCTSIZE*1);
+  in2 = dequantize(coef_block + DCTSIZE*2, quantptr + DCTSIZE*2);
+  in3 = dequantize(coef_block + DCTSIZE*3, quantptr + DCTSIZE*3);
+
+  /* Even part */
+
+  tmp10 = _mm_slli_epi32(_mm_add_epi32(in0, in2), ISLOW_PASS1_BITS);
+  tmp12 = _mm_slli_epi32(_mm_sub_epi32(in0, in2), ISLOW_PASS1_BITS);
+
+  /* Odd part */
+
+  z2 = in1;
+  z3 = in3;
+
+  z1 = mul_const(_mm_add_epi32(z2, z3), CONST16(FIX_0_541196100));
+  z1 = _mm_add_epi32(z1, _mm_set1_epi32(1 << (ISLOW_CONST_BITS-ISLOW_PASS1_BITS-1)));
+  tmp0 = _mm_srai_epi32(_mm_add_epi32(z1, mul_const(z2, CONST16(FIX_0_765366865))),
+			ISLOW_CONST_BITS-ISLOW_PASS1_BITS);
+  tmp2 = _mm_srai_epi32(_mm_sub_epi32(z1, mul_const(z3, CONST16(FIX_1_847759065))),
+			ISLOW_CONST_BITS-ISLOW_PASS1_BITS);
+
+  in0 = _mm_add_epi32(tmp10, tmp0);
+  in3 = _mm_sub_epi32(tmp10, tmp0);
+  in1 = _mm_add_epi32(tmp12, tmp2);
+  in2 = _mm_sub_epi32(tmp12, tmp2);
+
+  /* Pass 2: process 4 rows from work array */
+
+  TRANSPOSE4(in0, in1, in2, in3);
+
+  /* Even part */
+
+  tmp0 = _mm_add_epi32(in0, _mm_set1_epi32(1 << (ISLOW_PASS1_BITS+2)));
+  tmp2 = in2;
+
+  tmp10 = _mm_slli_epi32(_mm_add_epi32(tmp0, tmp2), ISLOW_CONST_BITS);
+  tmp12 = _mm_slli_epi32(_mm_sub_epi32(tmp0, tmp2), ISLOW_CONST_BITS);
+
+  /* Odd part */
+
+  z2 = in1;
+  z3 = in3;
+
+  z1 = mul_const(_mm_add_epi32(z2, z3), CONST16(FIX_0_541196100));
+  tmp0 = _mm_add_epi32(z1, mul_const(z2, CONST16(FIX_0_765366865)));
+  tmp2 = _mm_sub_epi32(z1, mul_const(z3, CONST16(FIX_1_847759065)));
+
+  /* Final output stage */
+
+  in0 = _mm_srai_epi32(_mm_add_epi32(tmp10, tmp0), ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3);
+  in3 = _mm_srai_epi32(_mm_sub_epi32(tmp10, tmp0), ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3);
+  in1 = _mm_srai_epi32(_mm_add_epi32(tmp12, tmp2), ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3);
+  in2 = _mm_srai_epi32(_mm_sub_epi32(tmp12, tmp2), ISLOW_CONST_BITS+ISLOW_PASS1_BITS+3);
+
+  TRANSPOSE4(in0, in1, in2, in3);
+
+  samples = _mm_packus_epi16(range_limit_8(in0, in1), range_limit_8(in2, in3));
+  for (i = 0; i < 4; i++) {
+    value = _mm_cvtsi128_si32(samples);
+    MEMCOPY(output_buf[i] + output_col, &value, 4);
+    samples = _mm_srli_si128(samples, 4);
+  }
+}
+
+#endif /* DCT_ISLOW_SUPPORTED */
+
+
+#ifdef DCT_IFAST_SUPPORTED
+
+/* MULTIPLY of jidctfst.c: multiply and descale without rounding */
+
+#define IFAST_MULTIPLY(var, c)  \
+  _mm_srai_epi32(mul_const(var, CONST16(c)), IFAST_CONST_BITS)
+
+/*
+ * 1-D pass of jpeg_idct_ifast on 4 columns.  Since the scalar code has no
+ * descaling shift in the zero AC shortcut, the shortcut always gives the
+ * same result as the full calculation and needs no special handling.
+ */
+
+LOCAL(void)
+ifast_1d (__m128i in[8], __m128i out[8])
+{
+  __m128i tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+  __m128i z5, z10, z11, z12, z13;
+
+  /* Even part */
+
+  tmp10 = _mm_add_epi32(in[0], in[4]);	/* phase 3 */
+  tmp11 = _mm_sub_epi32(in[0], in[4]);
+
+  tmp13 = _mm_add_epi32(in[2], in[6]);	/* phases 5-3 */
+  tmp12 = _mm_sub_epi32(IFAST_MULTIPLY(_mm_sub_epi32(in[2], in[6]), IFAST_1_414213562),
+			tmp13);		/* 2*c4 */
+
+  tmp0 = _mm_add_epi32(tmp10, tmp13);	/* phase 2 */
+  tmp3 = _mm_sub_epi32(tmp10, tmp13);
+  tmp1 = _mm_add_epi32(tmp11, tmp12);
+  tmp2 = _mm_sub_epi32(tmp11, tmp12);
+
+  /* Odd part */
+
+  z13 = _mm_add_epi32(in[5], in[3]);	/* phase 6 */
+  z10 = _mm_sub_epi32(in[5], in[3]);
+  z11 = _mm_add_epi32(in[1], in[7]);
+  z12 = _mm_sub_epi32(in[1], in[7]);
+
+  tmp7 = _mm_add_epi32(z11, z13);	/* phase 5 */
+  tmp11 = IFAST_MULTIPLY(_mm_sub_epi32(z11, z13), IFAST_1_414213562); /* 2*c4 */
+
+  z5 = IFAST_MULTIPLY(_mm_add_epi32(z10, z12), IFAST_1_847759065); /* 2*c2 */
+  tmp10 = _mm_sub_epi32(IFAST_MULTIPLY(z12, IFAST_1_082392200), z5); /* 2*(c2-c6) */
+  /* MULTIPLY(z10, - FIX_2_613125930): negate the product before descale */
+  tmp12 = _mm_add_epi32(_mm_srai_epi32(_mm_sub_epi32(_mm_setzero_si128(),
+			mul_const(z10, CONST16(IFAST_2_613125930))), IFAST_CONST_BITS),
+			z5);		/* -2*(c2+c6) */
+
+  tmp6 = _mm_sub_epi32(tmp12, tmp7);	/* phase 2 */
+  tmp5 = _mm_sub_epi32(tmp11, tmp6);
+  tmp4 = _mm_add_epi32(tmp10, tmp5);
+
+  out[0] = _mm_add_epi32(tmp0, tmp7);
+  out[7] = _mm_sub_epi32(tmp0, tmp7);
+  out[1] = _mm_add_epi32(tmp1, tmp6);
+  out[6] = _mm_sub_epi32(tmp1, tmp6);
+  out[2] = _mm_add_epi32(tmp2, tmp5);
+  out[5] = _mm_sub_epi32(tmp2, tmp5);
+  out[4] = _mm_add_epi32(tmp3, tmp4);
+  out[3] = _mm_sub_epi32(tmp3, tmp4);
+}
+
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients,
+ * the same as jpeg_idct_ifast.
+ */
+
+GLOBAL(void)
+jpeg_idct_ifast_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i in[8], ws[2][8], out[8];
+  int * quantptr = (int *) compptr->dct_table;
+  int half, row, i;
+
+  /* Pass 1: process columns 0-3 and 4-7 from input */
+
+  for (half = 0; half < 2; half++) {
+    for (i = 0; i < DCTSIZE; i++)
+      in[i] = dequantize(coef_block + DCTSIZE*i + half*4, quantptr + DCTSIZE*i + half*4);
+
+    ifast_1d(in, ws[half]);
+  }
+
+  /* Pass 2: process rows 0-3 and 4-7 from work array */
+
+  for (row = 0; row < DCTSIZE; row += 4) {
+    for (i = 0; i < 4; i++) {
+      in[i] = ws[0][row+i];
+      in[i+4] = ws[1][row+i];
+    }
+    TRANSPOSE4(in[0], in[1], in[2], in[3]);
+    TRANSPOSE4(in[4], in[5], in[6], in[7]);
+
+    ifast_1d(in, out);
+
+    /* Scale down by a factor of 8 and range-limit */
+    for (i = 0; i < DCTSIZE; i++)
+      out[i] = _mm_srai_epi32(out[i], IFAST_PASS1_BITS+3);
+
+    TRANSPOSE4(out[0], out[1], out[2], out[3]);
+    TRANSPOSE4(out[4], out[5], out[6], out[7]);
+    for (i = 0; i < 4; i++) {
+      __m128i samples = range_limit_8(out[i], out[i+4]);
+
+      _mm_storel_epi64((__m128i *) (output_buf[row+i] + output_col),
+		       _mm_packus_epi16(samples, samples));
+    }
+  }
+}
+
+#endif /* DCT_IFAST_SUPPORTED */
+
+#endif /* IDCT_SSE2_SUPPORTED */
@@ -136,6 +136,14 @@ typedef struct {
    * array routines.
    */
   JDIMENSION last_rowsperchunk;	/* from most recent alloc_sarray/barray */
+
+  /* Optional fixed arena for the IMAGE pool (see jpeg_mem_arena).  Pools
+   * are carved from it in order, and it is rewound when the IMAGE pool is
+   * released; requests which do not fit go to jpeg_get_small/large.
+   */
+  char FAR * arena;
+  size_t arena_size;
+  size_t arena_used;
 } my_memory_mgr;
 
 typedef my_memory_mgr * my_mem_ptr;
@@ -254,6 +262,36 @@ static const size_t extra_pool_slop[JPOOL_NUMPOOLS] =
 #define MIN_SLOP  50		/* greater than 0 to avoid futile looping */
 
 
+/*
+ * Take a pool of the given size from the IMAGE pool arena.
+ * Returns NULL if there is no arena or it is exhausted.
+ */
+
+#define IN_ARENA(mem,ptr)  ((char FAR *) (ptr) >= (mem)->arena && \
+			    (char FAR *) (ptr) < (mem)->arena + (mem)->arena_size)
+
+LOCAL(void FAR *)
+arena_get (my_mem_ptr mem, int pool_id, size_t sizeofpool)
+{
+  char FAR * pool_ptr;
+  size_t odd_bytes;
+
+  if (pool_id != JPOOL_IMAGE || mem->arena == NULL)
+    return NULL;
+
+  /* Keep the next pool aligned */
+  odd_bytes = sizeofpool % SIZEOF(ALIGN_TYPE);
+  if (odd_bytes > 0)
+    sizeofpool += SIZEOF(ALIGN_TYPE) - odd_bytes;
+  if (sizeofpool > mem->arena_size - mem->arena_used)
+    return NULL;
+
+  pool_ptr = mem->arena + mem->arena_used;
+  mem->arena_used += sizeofpool;
+  return (void FAR *) pool_ptr;
+}
+
+
 METHODDEF(void *)
 alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
 /* Allocate a "small" object */
@@ -297,7 +335,9 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
       slop = (size_t) (MAX_ALLOC_CHUNK-min_request);
     /* Try to get space, if fail reduce slop and try again */
     for (;;) {
-      hdr_ptr = (small_pool_ptr) jpeg_get_small(cinfo, min_request + slop);
+      hdr_ptr = (small_pool_ptr) arena_get(mem, pool_id, min_request + slop);
+      if (hdr_ptr == NULL)
+	hdr_ptr = (small_pool_ptr) jpeg_get_small(cinfo, min_request + slop);
       if (hdr_ptr != NULL)
 	break;
       slop /= 2;
@@ -360,8 +400,11 @@ alloc_large (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
 
-  hdr_ptr = (large_pool_ptr) jpeg_get_large(cinfo, sizeofobject +
-					    SIZEOF(large_pool_hdr));
+  hdr_ptr = (large_pool_ptr) arena_get(mem, pool_id, sizeofobject +
+				      SIZEOF(large_pool_hdr));
+  if (hdr_ptr == NULL)
+    hdr_ptr = (large_pool_ptr) jpeg_get_large(cinfo, sizeofobject +
+					      SIZEOF(large_pool_hdr));
   if (hdr_ptr == NULL)
     out_of_memory(cinfo, 4);	/* jpeg_get_large failed */
   mem->total_space_allocated += sizeofobject + SIZEOF(large_pool_hdr);
@@ -973,7 +1016,8 @@ free_pool (j_common_ptr cinfo, int pool_id)
     space_freed = lhdr_ptr->hdr.bytes_used +
 		  lhdr_ptr->hdr.bytes_left +
 		  SIZEOF(large_pool_hdr);
-    jpeg_free_large(cinfo, (void FAR *) lhdr_ptr, space_freed);
+    if (! IN_ARENA(mem, lhdr_ptr))
+      jpeg_free_large(cinfo, (void FAR *) lhdr_ptr, space_freed);
     mem->total_space_allocated -= space_freed;
     lhdr_ptr = next_lhdr_ptr;
   }
@@ -987,10 +1031,15 @@ free_pool (j_common_ptr cinfo, int pool_id)
     space_freed = shdr_ptr->hdr.bytes_used +
 		  shdr_ptr->hdr.bytes_left +
 		  SIZEOF(small_pool_hdr);
-    jpeg_free_small(cinfo, (void *) shdr_ptr, space_freed);
+    if (! IN_ARENA(mem, shdr_ptr))
+      jpeg_free_small(cinfo, (void *) shdr_ptr, space_freed);
     mem->total_space_allocated -= space_freed;
     shdr_ptr = next_shdr_ptr;
   }
+
+  /* Nothing of the IMAGE pool is left in the arena */
+  if (pool_id == JPOOL_IMAGE)
+    mem->arena_used = 0;
 }
 
 
@@ -1012,6 +1061,9 @@ self_destruct (j_common_ptr cinfo)
     free_pool(cinfo, pool);
   }
 
+  /* Release the IMAGE pool arena, if any */
+  jpeg_mem_arena(cinfo, 0);
+
   /* Release the memory manager control block too. */
   jpeg_free_small(cinfo, (void *) cinfo->mem, SIZEOF(my_memory_mgr));
   cinfo->mem = NULL;		/* ensures I will be called only once */
@@ -1089,6 +1141,9 @@ jinit_memory_mgr (j_common_ptr cinfo)
   }
   mem->virt_sarray_list = NULL;
   mem->virt_barray_list = NULL;
+  mem->arena = NULL;
+  mem->arena_size = 0;
+  mem->arena_used = 0;
 
   mem->total_space_allocated = SIZEOF(my_memory_mgr);
 
@@ -1117,3 +1172,39 @@ jinit_memory_mgr (j_common_ptr cinfo)
 #endif
 
 }
+
+
+/*
+ * Reserve a fixed arena of the given size for the IMAGE pool, or release
+ * it if size is 0.  An object which is reused for a stream of similar
+ * images (e.g. video frames) then makes no allocations per image once
+ * the arena is large enough.  Must be called while the IMAGE pool is
+ * empty, i.e. right after jpeg_create_xxx(), jpeg_finish_xxx() or
+ * jpeg_abort().
+ */
+
+GLOBAL(void)
+jpeg_mem_arena (j_common_ptr cinfo, size_t size)
+{
+  my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
+
+  if (mem->small_list[JPOOL_IMAGE] != NULL ||
+      mem->large_list[JPOOL_IMAGE] != NULL)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  if (mem->arena != NULL) {
+    jpeg_free_large(cinfo, (void FAR *) mem->arena, mem->arena_size);
+    mem->arena = NULL;
+    mem->arena_size = 0;
+    mem->arena_used = 0;
+  }
+
+  if (size > 0) {
+    if (size > (size_t) MAX_ALLOC_CHUNK)
+      out_of_memory(cinfo, 5);
+    mem->arena = (char FAR *) jpeg_get_large(cinfo, size);
+    if (mem->arena == NULL)
+      out_of_memory(cinfo, 6);
+    mem->arena_size = size;
+  }
+}
@@ -0,0 +1,918 @@
+/*
+ * jpegbench.c
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains a decoder benchmark for Motion-JPEG frame corpora,
+ * such as frames captured from UVC cameras.  Each input file holds one or
+ * more concatenated JPEG frames.  AVI1 frames come without Huffman tables
+ * (DHT), they are decoded with the standard tables of JPEG spec section K.3
+ * as video decoders do.
+ *
+ * The frames are decoded the way the UVC driver does it: fast integer IDCT,
+ * no fancy upsampling, reduced-size IDCT for 1/2, 1/4 and 1/8 scale, raw
+ * YCbCr planes for YUYV and NV12 output, and direct color conversion for
+ * RGB and BGRX.  For every output format and scale the program reports
+ * frames per second, nanoseconds per source pixel and the split of the
+ * decoding time between Huffman decoding, IDCT, upsampling and color
+ * conversion.
+ *
+ * The split is measured in a separate pass by wrapping the method pointers
+ * of the decoder modules (hence JPEG_INTERNALS), so the timer overhead does
+ * not affect the throughput figures.  It is exact for sequential frames,
+ * which is all UVC cameras produce; for progressive frames everything ends
+ * up in "other".
+ *
+ *	jpegbench [switches] file...
+ */
+
+#define JPEG_INTERNALS
+#include "cdjpeg.h"		/* Common decls for cjpeg/djpeg applications */
+
+#include <setjmp.h>
+#include <time.h>		/* for clock_gettime() */
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>		/* for __rdtsc() */
+#define USE_RDTSC
+#endif
+
+
+/* Output formats */
+
+#define FMT_YUYV	0
+#define FMT_NV12	1
+#define FMT_RGB		2
+#define FMT_BGRX	3
+#define NUM_FORMATS	4
+
+static const char * const format_names[NUM_FORMATS] = {
+  "yuyv", "nv12", "rgb", "bgrx"
+};
+
+static const int format_bpp[NUM_FORMATS] = { 2, 1, 3, 4 };
+
+/* Reported stages of the decoder */
+
+#define STAGE_HUFFMAN	0
+#define STAGE_IDCT	1
+#define STAGE_UPSAMPLE	2
+#define STAGE_COLOR	3
+#define STAGE_OTHER	4
+#define NUM_STAGES	5
+
+static const char * const stage_names[NUM_STAGES] = {
+  "huffman", "idct", "upsample", "color", "other"
+};
+
+/* Per-image allocations of the reused decoder are served from an arena of
+ * the same size the driver reserves.
+ */
+
+#define ARENA_SIZE(width)  (32768 + (size_t) (width) * 48)
+
+
+typedef struct {
+  JOCTET * data;		/* frame inside the file buffer */
+  size_t size;
+  JDIMENSION width;		/* source dimensions */
+  JDIMENSION height;
+  boolean has_dht;		/* FALSE for AVI1 frames */
+} frame_info;
+
+typedef struct {
+  struct jpeg_error_mgr pub;	/* "public" fields */
+  jmp_buf setjmp_buffer;	/* for return to caller */
+} bench_error_mgr;
+
+typedef unsigned long long bench_ticks;
+
+
+static const char * progname;	/* program name for error messages */
+
+static frame_info * frames;	/* the corpus */
+static int num_frames;
+static int max_frames;
+static int num_dhtless;		/* frames without Huffman tables */
+static int num_dropped;		/* truncated frames and bad headers */
+static JDIMENSION max_width, max_height;
+
+static int format_mask;		/* selected output formats */
+static int scale_mask;		/* selected scale denominators, bit N for 1/N */
+static int iterations;		/* passes over the corpus for throughput */
+static J_DCT_METHOD dct_method;
+static boolean use_arena;
+static boolean measure_stages;
+
+static JSAMPLE * output_buffer;	/* decoded frame, discarded */
+
+static struct jpeg_compress_struct table_source; /* holds K.3 Huffman tables */
+
+static double ns_per_tick;
+
+
+/*
+ * Timer.  The time stamp counter is cheap enough to be read per MCU, it is
+ * calibrated against the monotonic clock at startup.
+ */
+
+LOCAL(double)
+clock_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+LOCAL(bench_ticks)
+read_ticks (void)
+{
+#ifdef USE_RDTSC
+  return (bench_ticks) __rdtsc();
+#else
+  return (bench_ticks) clock_ns();
+#endif
+}
+
+LOCAL(void)
+calibrate_ticks (void)
+{
+#ifdef USE_RDTSC
+  double start_ns, end_ns;
+  bench_ticks start;
+
+  start_ns = clock_ns();
+  start = read_ticks();
+  do {
+    end_ns = clock_ns();
+  } while (end_ns - start_ns < 50e6);
+  ns_per_tick = (end_ns - start_ns) / (double) (read_ticks() - start);
+#else
+  ns_per_tick = 1.0;
+#endif
+}
+
+
+/*
+ * Stage timing.  The original methods are saved when a frame starts and the
+ * wrappers accumulate the time spent in them.  Upsampling calls the color
+ * converter, its time is subtracted later; the same holds for the Huffman
+ * decoder called by the coefficient controller.
+ */
+
+static bench_ticks stage_ticks[NUM_STAGES];
+static bench_ticks coef_ticks;	/* coefficient controller incl. Huffman */
+static bench_ticks upsample_ticks; /* upsampler incl. color conversion */
+
+static JMETHOD(boolean, orig_decode_mcu,
+	       (j_decompress_ptr cinfo, JBLOCKROW *MCU_data));
+static JMETHOD(int, orig_decompress_data,
+	       (j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
+static JMETHOD(void, orig_upsample,
+	       (j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
+		JDIMENSION *in_row_group_ctr, JDIMENSION in_row_groups_avail,
+		JSAMPARRAY output_buf, JDIMENSION *out_row_ctr,
+		JDIMENSION out_rows_avail));
+static JMETHOD(void, orig_color_convert,
+	       (j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
+		JDIMENSION input_row, JSAMPARRAY output_buf, int num_rows));
+
+METHODDEF(boolean)
+timed_decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  bench_ticks start = read_ticks();
+  boolean retval = (*orig_decode_mcu) (cinfo, MCU_data);
+
+  stage_ticks[STAGE_HUFFMAN] += read_ticks() - start;
+  return retval;
+}
+
+METHODDEF(int)
+timed_decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+  bench_ticks start = read_ticks();
+  int retval = (*orig_decompress_data) (cinfo, output_buf);
+
+  coef_ticks += read_ticks() - start;
+  return retval;
+}
+
+METHODDEF(void)
+timed_upsample (j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
+		JDIMENSION *in_row_group_ctr, JDIMENSION in_row_groups_avail,
+		JSAMPARRAY output_buf, JDIMENSION *out_row_ctr,
+		JDIMENSION out_rows_avail)
+{
+  bench_ticks start = read_ticks();
+
+  (*orig_upsample) (cinfo, input_buf, in_row_group_ctr, in_row_groups_avail,
+		    output_buf, out_row_ctr, out_rows_avail);
+  upsample_ticks += read_ticks() - start;
+}
+
+METHODDEF(void)
+timed_color_convert (j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
+		     JDIMENSION input_row, JSAMPARRAY output_buf, int num_rows)
+{
+  bench_ticks start = read_ticks();
+
+  (*orig_color_convert) (cinfo, input_buf, input_row, output_buf, num_rows);
+  stage_ticks[STAGE_COLOR] += read_ticks() - start;
+}
+
+/* Install the wrappers after jpeg_start_decompress().  The upsampler and
+ * color converter pointers were cleared before, they stay NULL when the
+ * module isn't used (raw output, merged upsampling).
+ */
+
+LOCAL(void)
+install_stage_timers (j_decompress_ptr cinfo, boolean * merged)
+{
+  *merged = FALSE;
+  if (cinfo->inputctl->has_multiple_scans)
+    return;
+
+  orig_decode_mcu = cinfo->entropy->decode_mcu;
+  cinfo->entropy->decode_mcu = timed_decode_mcu;
+  orig_decompress_data = cinfo->coef->decompress_data;
+  cinfo->coef->decompress_data = timed_decompress_data;
+  if (cinfo->upsample != NULL) {
+    orig_upsample = cinfo->upsample->upsample;
+    cinfo->upsample->upsample = timed_upsample;
+    /* Without quantization the postprocessor calls the upsampler directly */
+    if (cinfo->post->post_process_data == orig_upsample)
+      cinfo->post->post_process_data = timed_upsample;
+    if (cinfo->cconvert != NULL) {
+      orig_color_convert = cinfo->cconvert->color_convert;
+      cinfo->cconvert->color_convert = timed_color_convert;
+    } else
+      *merged = TRUE;		/* upsampling and color conversion at once */
+  }
+}
+
+
+/*
+ * Error handling: a broken frame aborts its decoding only.  Warnings about
+ * corrupt data are expected in captured streams and are not printed.
+ */
+
+METHODDEF(void)
+bench_error_exit (j_common_ptr cinfo)
+{
+  bench_error_mgr * err = (bench_error_mgr *) cinfo->err;
+
+  longjmp(err->setjmp_buffer, 1);
+}
+
+METHODDEF(void)
+bench_output_message (j_common_ptr cinfo)
+{
+  /* suppressed */
+}
+
+
+/*
+ * Find the end of the frame starting with SOI at data[0].  Returns the frame
+ * length including EOI, or 0 if the frame is truncated.  Marker segments are
+ * skipped by their length and entropy-coded data is scanned for a marker
+ * other than RSTn, so FF D9 bytes inside APPn segments do not end the frame.
+ */
+
+LOCAL(size_t)
+frame_length (JOCTET * data, size_t size, boolean * has_dht)
+{
+  size_t pos = 2;
+  int marker;
+
+  *has_dht = FALSE;
+  for (;;) {
+    while (pos < size && data[pos] != 0xFF)
+      pos++;
+    while (pos < size && data[pos] == 0xFF)
+      pos++;			/* fill bytes */
+    if (pos >= size)
+      return 0;
+    marker = data[pos++];
+
+    if (marker == 0xD9)		/* EOI */
+      return pos;
+    if (marker == 0xD8)		/* next frame started, no EOI */
+      return 0;
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+      continue;			/* markers without a segment */
+    if (marker == 0xC4)
+      *has_dht = TRUE;
+
+    if (pos + 2 > size)
+      return 0;
+    pos += ((size_t) data[pos] << 8) + data[pos+1];
+
+    if (marker == 0xDA) {	/* skip entropy-coded data */
+      while (pos + 1 < size &&
+	     (data[pos] != 0xFF || data[pos+1] == 0x00 ||
+	      (data[pos+1] >= 0xD0 && data[pos+1] <= 0xD7)))
+	pos++;
+    }
+  }
+}
+
+
+LOCAL(void)
+add_frame (j_decompress_ptr cinfo, JOCTET * data, size_t size, boolean has_dht)
+{
+  bench_error_mgr * err = (bench_error_mgr *) cinfo->err;
+  frame_info * frame;
+
+  if (setjmp(err->setjmp_buffer)) {
+    jpeg_abort_decompress(cinfo);
+    num_dropped++;
+    return;
+  }
+  jpeg_mem_src(cinfo, data, (unsigned long) size);
+  jpeg_read_header(cinfo, TRUE);
+  jpeg_abort_decompress(cinfo);
+
+  if (num_frames == max_frames) {
+    max_frames = max_frames ? max_frames * 2 : 256;
+    frames = (frame_info *) realloc(frames, max_frames * SIZEOF(frame_info));
+    if (frames == NULL) {
+      fprintf(stderr, "%s: out of memory\n", progname);
+      exit(EXIT_FAILURE);
+    }
+  }
+  frame = &frames[num_frames++];
+  frame->data = data;
+  frame->size = size;
+  frame->width = cinfo->image_width;
+  frame->height = cinfo->image_height;
+  frame->has_dht = has_dht;
+
+  if (! has_dht)
+    num_dhtless++;
+  if (frame->width > max_width)
+    max_width = frame->width;
+  if (frame->height > max_height)
+    max_height = frame->height;
+}
+
+
+/*
+ * Load a file and split it into frames.  The file buffer is kept, frames
+ * refer to it.
+ */
+
+LOCAL(void)
+load_file (j_decompress_ptr cinfo, char * filename)
+{
+  FILE * input_file;
+  JOCTET * data = NULL;
+  size_t size = 0, allocated = 0, nbytes;
+  size_t pos, length;
+  boolean has_dht;
+  int first = num_frames;
+
+  if ((input_file = fopen(filename, READ_BINARY)) == NULL) {
+    fprintf(stderr, "%s: can't open %s\n", progname, filename);
+    exit(EXIT_FAILURE);
+  }
+  do {
+    if (size == allocated) {
+      allocated = allocated ? allocated * 2 : 1 << 20;
+      data = (JOCTET *) realloc(data, allocated);
+      if (data == NULL) {
+	fprintf(stderr, "%s: out of memory\n", progname);
+	exit(EXIT_FAILURE);
+      }
+    }
+    nbytes = fread(data + size, 1, allocated - size, input_file);
+    size += nbytes;
+  } while (nbytes > 0);
+  fclose(input_file);
+
+  for (pos = 0; pos + 1 < size; ) {
+    if (data[pos] != 0xFF || data[pos+1] != 0xD8) {
+      pos++;			/* look for SOI */
+      continue;
+    }
+    length = frame_length(data + pos, size - pos, &has_dht);
+    if (length == 0) {
+      num_dropped++;
+      pos += 2;
+      continue;
+    }
+    add_frame(cinfo, data + pos, length, has_dht);
+    pos += length;
+  }
+
+  if (num_frames == first)
+    fprintf(stderr, "%s: no JPEG frames in %s\n", progname, filename);
+}
+
+
+/*
+ * Install the standard Huffman tables in a frame without DHT.  They are
+ * taken from a compression object, jpeg_set_defaults() created them there.
+ */
+
+LOCAL(void)
+std_huff_tables (j_decompress_ptr cinfo)
+{
+  int tbl;
+
+  for (tbl = 0; tbl < 2; tbl++) {
+    if (cinfo->dc_huff_tbl_ptrs[tbl] == NULL)
+      cinfo->dc_huff_tbl_ptrs[tbl] = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+    MEMCOPY(cinfo->dc_huff_tbl_ptrs[tbl], table_source.dc_huff_tbl_ptrs[tbl],
+	    SIZEOF(JHUFF_TBL));
+    if (cinfo->ac_huff_tbl_ptrs[tbl] == NULL)
+      cinfo->ac_huff_tbl_ptrs[tbl] = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+    MEMCOPY(cinfo->ac_huff_tbl_ptrs[tbl], table_source.ac_huff_tbl_ptrs[tbl],
+	    SIZEOF(JHUFF_TBL));
+  }
+}
+
+
+/*
+ * YCbCr frames with a single sample of each chroma component per MCU can
+ * be read as raw planes, as the driver does for YUYV and NV12.
+ */
+
+LOCAL(boolean)
+raw_capable (j_decompress_ptr cinfo)
+{
+  jpeg_component_info * comp = cinfo->comp_info;
+
+  if (cinfo->num_components != 3 || cinfo->jpeg_color_space != JCS_YCbCr)
+    return FALSE;
+  if (comp[1].h_samp_factor != 1 || comp[1].v_samp_factor != 1 ||
+      comp[2].h_samp_factor != 1 || comp[2].v_samp_factor != 1)
+    return FALSE;
+  return comp[0].h_samp_factor <= 2 && comp[0].v_samp_factor <= 2;
+}
+
+LOCAL(void)
+pack_uv (JSAMPROW cb, JSAMPROW cr, int ratio, JSAMPROW dst, JDIMENSION pairs)
+{
+  JDIMENSION i;
+
+  if (ratio == 2) {
+    for (i = 0; i < pairs; i++) {
+      dst[i*2] = cb[i];
+      dst[i*2+1] = cr[i];
+    }
+  } else {
+    for (i = 0; i < pairs; i++) {
+      dst[i*2] = (JSAMPLE) ((cb[i*2] + cb[i*2+1] + 1) >> 1);
+      dst[i*2+1] = (JSAMPLE) ((cr[i*2] + cr[i*2+1] + 1) >> 1);
+    }
+  }
+}
+
+LOCAL(void)
+pack_yuyv (JSAMPROW y, JSAMPROW cb, JSAMPROW cr, int ratio, JSAMPROW dst,
+	   JDIMENSION pairs)
+{
+  JDIMENSION i;
+
+  if (ratio == 2) {
+    for (i = 0; i < pairs; i++) {
+      dst[i*4] = y[i*2];
+      dst[i*4+1] = cb[i];
+      dst[i*4+2] = y[i*2+1];
+      dst[i*4+3] = cr[i];
+    }
+  } else {
+    for (i = 0; i < pairs; i++) {
+      dst[i*4] = y[i*2];
+      dst[i*4+1] = (JSAMPLE) ((cb[i*2] + cb[i*2+1] + 1) >> 1);
+      dst[i*4+2] = y[i*2+1];
+      dst[i*4+3] = (JSAMPLE) ((cr[i*2] + cr[i*2+1] + 1) >> 1);
+    }
+  }
+}
+
+/* Read raw planes by iMCU rows and pack them to YUYV or NV12, the same way
+ * as the driver.  Packing time is counted as color conversion.
+ */
+
+LOCAL(boolean)
+read_raw (j_decompress_ptr cinfo, JSAMPLE * dst, JDIMENSION stride,
+	  int format, boolean stages)
+{
+  jpeg_component_info * comp = cinfo->comp_info;
+  int ylines = comp[0].v_samp_factor * comp[0].DCT_v_scaled_size;
+  JDIMENSION ywidth = comp[0].width_in_blocks * comp[0].DCT_h_scaled_size;
+  int hratio = comp[0].h_samp_factor * comp[0].DCT_h_scaled_size /
+	       comp[1].DCT_h_scaled_size;
+  int vratio = ylines / comp[1].DCT_v_scaled_size;
+  JDIMENSION width = cinfo->output_width;
+  JDIMENSION height = cinfo->output_height;
+  JSAMPLE * uvplane = dst + stride * height;
+  JSAMPARRAY yscratch, uvscratch;
+  JSAMPARRAY planes[3];
+  JDIMENSION base, line, k;
+  bench_ticks start = 0;
+  int i, ci;
+
+  if ((hratio != 1 && hratio != 2) || (vratio != 1 && vratio != 2))
+    return FALSE;
+
+  yscratch = (*cinfo->mem->alloc_sarray)
+    ((j_common_ptr) cinfo, JPOOL_IMAGE, ywidth, (JDIMENSION) ylines);
+  uvscratch = (*cinfo->mem->alloc_sarray)
+    ((j_common_ptr) cinfo, JPOOL_IMAGE, width, 1);
+  planes[0] = (JSAMPARRAY) (*cinfo->mem->alloc_small)
+    ((j_common_ptr) cinfo, JPOOL_IMAGE, ylines * SIZEOF(JSAMPROW));
+  for (ci = 1; ci < 3; ci++)
+    planes[ci] = (*cinfo->mem->alloc_sarray)
+      ((j_common_ptr) cinfo, JPOOL_IMAGE,
+       comp[ci].width_in_blocks * comp[ci].DCT_h_scaled_size,
+       (JDIMENSION) comp[ci].DCT_v_scaled_size);
+
+  for (base = 0; cinfo->output_scanline < height; base += ylines) {
+    /* Luma of NV12 is decoded in place */
+    for (i = 0; i < ylines; i++) {
+      line = base + i;
+      if (format == FMT_NV12 && line < height && stride >= ywidth)
+	planes[0][i] = dst + line * stride;
+      else
+	planes[0][i] = yscratch[i];
+    }
+
+    if (jpeg_read_raw_data(cinfo, planes, (JDIMENSION) ylines) !=
+	(JDIMENSION) ylines)
+      return FALSE;
+
+    if (stages)
+      start = read_ticks();
+    for (i = 0; i < ylines && base + i < height; i++) {
+      line = base + i;
+      ci = i / vratio;
+      if (format == FMT_YUYV) {
+	pack_yuyv(planes[0][i], planes[1][ci], planes[2][ci], hratio,
+		  dst + line * stride, width / 2);
+	continue;
+      }
+      if (planes[0][i] != dst + line * stride)
+	MEMCOPY(dst + line * stride, planes[0][i], width);
+      if ((line & 1) == 0)
+	pack_uv(planes[1][ci], planes[2][ci], hratio,
+		uvplane + (line / 2) * stride, width / 2);
+      else if (vratio == 1) {
+	/* Average of two chroma lines */
+	JSAMPROW uv = uvplane + (line / 2) * stride;
+
+	pack_uv(planes[1][ci], planes[2][ci], hratio, uvscratch[0], width / 2);
+	for (k = 0; k < (width & ~1); k++)
+	  uv[k] = (JSAMPLE) ((uv[k] + uvscratch[0][k] + 1) >> 1);
+      }
+    }
+    if (stages)
+      stage_ticks[STAGE_COLOR] += read_ticks() - start;
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Decode one frame to the output buffer.  Returns FALSE if the frame is
+ * broken or can't be decoded to the format.
+ */
+
+LOCAL(boolean)
+decode_frame (j_decompress_ptr cinfo, frame_info * frame, int format,
+	      int scale, boolean stages)
+{
+  bench_error_mgr * err = (bench_error_mgr *) cinfo->err;
+  JDIMENSION stride, line;
+  JSAMPROW row;
+  boolean merged;
+  bench_ticks start;
+
+  /* Not assigned after setjmp, so it survives a longjmp from the decoder */
+  start = stages ? read_ticks() : 0;
+
+  if (setjmp(err->setjmp_buffer)) {
+    jpeg_abort_decompress(cinfo);
+    return FALSE;
+  }
+
+  jpeg_mem_src(cinfo, frame->data, (unsigned long) frame->size);
+  jpeg_read_header(cinfo, TRUE);
+  if (! frame->has_dht)
+    std_huff_tables(cinfo);
+
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = scale;
+  cinfo->dct_method = dct_method;
+  cinfo->do_fancy_upsampling = FALSE;
+  switch (format) {
+  case FMT_YUYV:
+  case FMT_NV12:
+    if (raw_capable(cinfo)) {
+      cinfo->raw_data_out = TRUE;
+      break;
+    }
+    if (format == FMT_NV12) {
+      jpeg_abort_decompress(cinfo);
+      return FALSE;
+    }
+    cinfo->out_color_space = JCS_EXT_YUYV;
+    break;
+  case FMT_RGB:
+    cinfo->out_color_space = JCS_RGB;
+    break;
+  case FMT_BGRX:
+    cinfo->out_color_space = JCS_EXT_BGRX;
+    break;
+  }
+
+  cinfo->upsample = NULL;
+  cinfo->cconvert = NULL;
+  jpeg_start_decompress(cinfo);
+  merged = FALSE;
+  if (stages)
+    install_stage_timers(cinfo, &merged);
+
+  stride = cinfo->output_width * format_bpp[format];
+  if (format == FMT_YUYV || format == FMT_NV12)
+    stride = (stride + 1) & ~1;
+
+  if (cinfo->raw_data_out) {
+    if (! read_raw(cinfo, output_buffer, stride, format, stages)) {
+      jpeg_abort_decompress(cinfo);
+      return FALSE;
+    }
+  } else {
+    while (cinfo->output_scanline < cinfo->output_height) {
+      line = cinfo->output_scanline;
+      row = output_buffer + line * stride;
+      jpeg_read_scanlines(cinfo, &row, 1);
+    }
+  }
+  jpeg_finish_decompress(cinfo);
+
+  if (stages) {
+    stage_ticks[STAGE_OTHER] += read_ticks() - start;
+    stage_ticks[STAGE_IDCT] += coef_ticks;
+    if (merged)
+      stage_ticks[STAGE_COLOR] += upsample_ticks;
+    else
+      stage_ticks[STAGE_UPSAMPLE] += upsample_ticks;
+    coef_ticks = upsample_ticks = 0;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Benchmark one output format and scale over the whole corpus.
+ */
+
+LOCAL(void)
+run_config (j_decompress_ptr cinfo, int format, int scale)
+{
+  double pixels = 0.0, elapsed, ns_per_pixel, stage_pixels;
+  double start;
+  long decoded = 0;
+  int failed = 0;
+  int iter, i, stage;
+
+  /* Warm-up pass, also finds the frames which can't be decoded */
+  for (i = 0; i < num_frames; i++) {
+    if (! decode_frame(cinfo, &frames[i], format, scale, FALSE))
+      failed++;
+  }
+  if (failed == num_frames) {
+    printf("%-6s 1/%d    all frames failed\n", format_names[format], scale);
+    return;
+  }
+
+  start = clock_ns();
+  for (iter = 0; iter < iterations; iter++) {
+    for (i = 0; i < num_frames; i++) {
+      if (decode_frame(cinfo, &frames[i], format, scale, FALSE)) {
+	pixels += (double) frames[i].width * (double) frames[i].height;
+	decoded++;
+      }
+    }
+  }
+  elapsed = clock_ns() - start;
+  ns_per_pixel = elapsed / pixels;
+
+  printf("%-6s 1/%d  %7ld %9.1f %8.3f", format_names[format], scale,
+	 decoded, decoded * 1e9 / elapsed, ns_per_pixel);
+
+  if (measure_stages) {
+    MEMZERO(stage_ticks, SIZEOF(stage_ticks));
+    stage_pixels = 0.0;
+    for (i = 0; i < num_frames; i++) {
+      if (decode_frame(cinfo, &frames[i], format, scale, TRUE))
+	stage_pixels += (double) frames[i].width * (double) frames[i].height;
+    }
+    /* Nested stages were counted in their callers as well */
+    stage_ticks[STAGE_IDCT] -= stage_ticks[STAGE_HUFFMAN];
+    if (stage_ticks[STAGE_UPSAMPLE] >= stage_ticks[STAGE_COLOR])
+      stage_ticks[STAGE_UPSAMPLE] -= stage_ticks[STAGE_COLOR];
+    for (stage = 0; stage < STAGE_OTHER; stage++) {
+      if (stage_ticks[STAGE_OTHER] >= stage_ticks[stage])
+	stage_ticks[STAGE_OTHER] -= stage_ticks[stage];
+      else
+	stage_ticks[STAGE_OTHER] = 0;
+    }
+    for (stage = 0; stage < NUM_STAGES; stage++)
+      printf(" %8.3f", stage_ticks[stage] * ns_per_tick / stage_pixels);
+  }
+  if (failed)
+    printf("  (%d failed)", failed);
+  printf("\n");
+}
+
+
+LOCAL(void)
+usage (void)
+/* complain about bad command line */
+{
+  fprintf(stderr, "usage: %s [switches] file...\n", progname);
+  fprintf(stderr, "Each file holds one or more concatenated JPEG frames.\n");
+  fprintf(stderr, "Switches (names may be abbreviated):\n");
+  fprintf(stderr, "  -format F      Decode to yuyv, nv12, rgb or bgrx (default all)\n");
+  fprintf(stderr, "  -scale 1/N     Decode at scale 1/1, 1/2, 1/4 or 1/8 (default all)\n");
+  fprintf(stderr, "  -iterations N  Decode the corpus N times per setting (default 10)\n");
+  fprintf(stderr, "  -dct int       Use integer DCT method\n");
+  fprintf(stderr, "  -dct fast      Use fast integer DCT (default, as the driver)\n");
+  fprintf(stderr, "  -dct float     Use floating-point DCT method\n");
+  fprintf(stderr, "  -noarena       Don't reserve a memory arena for the decoder\n");
+  fprintf(stderr, "  -nostages      Don't measure time per decoder stage\n");
+  exit(EXIT_FAILURE);
+}
+
+
+LOCAL(int)
+parse_switches (int argc, char **argv)
+/* Parse optional switches.
+ * Returns argv[] index of first file-name argument (== argc if none).
+ */
+{
+  int argn, i;
+  char * arg;
+  unsigned int num, denom;
+  char ch;
+
+  format_mask = 0;
+  scale_mask = 0;
+  iterations = 10;
+  dct_method = JDCT_IFAST;
+  use_arena = TRUE;
+  measure_stages = TRUE;
+
+  for (argn = 1; argn < argc; argn++) {
+    arg = argv[argn];
+    if (*arg != '-')
+      break;			/* done parsing switches */
+    arg++;			/* advance past switch marker character */
+
+    if (keymatch(arg, "dct", 1)) {
+      /* Select IDCT algorithm. */
+      if (++argn >= argc)	/* advance to next argument */
+	usage();
+      if (keymatch(argv[argn], "int", 1)) {
+	dct_method = JDCT_ISLOW;
+      } else if (keymatch(argv[argn], "fast", 2)) {
+	dct_method = JDCT_IFAST;
+      } else if (keymatch(argv[argn], "float", 2)) {
+	dct_method = JDCT_FLOAT;
+      } else
+	usage();
+
+    } else if (keymatch(arg, "format", 1)) {
+      /* Add an output format. */
+      if (++argn >= argc)
+	usage();
+      for (i = 0; i < NUM_FORMATS; i++) {
+	if (keymatch(argv[argn], format_names[i], 1))
+	  break;
+      }
+      if (i == NUM_FORMATS)
+	usage();
+      format_mask |= 1 << i;
+
+    } else if (keymatch(arg, "iterations", 1)) {
+      /* Passes over the corpus. */
+      if (++argn >= argc)
+	usage();
+      if (sscanf(argv[argn], "%d%c", &iterations, &ch) != 1 || iterations < 1)
+	usage();
+
+    } else if (keymatch(arg, "noarena", 3)) {
+      use_arena = FALSE;
+
+    } else if (keymatch(arg, "nostages", 3)) {
+      measure_stages = FALSE;
+
+    } else if (keymatch(arg, "scale", 1)) {
+      /* Add a scale factor, 1/N or just N. */
+      if (++argn >= argc)
+	usage();
+      if (sscanf(argv[argn], "%u/%u", &num, &denom) == 2) {
+	if (num != 1)
+	  usage();
+      } else if (sscanf(argv[argn], "%u%c", &denom, &ch) != 1)
+	usage();
+      if (denom != 1 && denom != 2 && denom != 4 && denom != 8)
+	usage();
+      scale_mask |= 1 << denom;
+
+    } else {
+      usage();			/* bogus switch */
+    }
+  }
+
+  if (format_mask == 0)
+    format_mask = (1 << NUM_FORMATS) - 1;
+  if (scale_mask == 0)
+    scale_mask = (1 << 1) | (1 << 2) | (1 << 4) | (1 << 8);
+
+  return argn;			/* return index of next arg (file name) */
+}
+
+
+/*
+ * The main program.
+ */
+
+int
+main (int argc, char **argv)
+{
+  struct jpeg_decompress_struct cinfo;
+  bench_error_mgr jerr;
+  struct jpeg_error_mgr cerr;
+  int file_index, format, scale, stage;
+
+  progname = argv[0];
+  if (progname == NULL || progname[0] == 0)
+    progname = "jpegbench";	/* in case C library doesn't provide it */
+
+  file_index = parse_switches(argc, argv);
+  if (file_index >= argc)
+    usage();
+
+  /* Decompression object, reused for all frames as the driver does */
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = bench_error_exit;
+  jerr.pub.output_message = bench_output_message;
+  jpeg_create_decompress(&cinfo);
+
+  /* Standard Huffman tables for frames without DHT */
+  table_source.err = jpeg_std_error(&cerr);
+  jpeg_create_compress(&table_source);
+  table_source.in_color_space = JCS_YCbCr;
+  table_source.input_components = 3;
+  jpeg_set_defaults(&table_source);
+
+  for (; file_index < argc; file_index++)
+    load_file(&cinfo, argv[file_index]);
+  if (num_frames == 0) {
+    fprintf(stderr, "%s: no frames to decode\n", progname);
+    exit(EXIT_FAILURE);
+  }
+
+  output_buffer = (JSAMPLE *) malloc((size_t) (max_width + 1) *
+				     (size_t) (max_height + 1) * 4);
+  if (output_buffer == NULL) {
+    fprintf(stderr, "%s: out of memory\n", progname);
+    exit(EXIT_FAILURE);
+  }
+  if (use_arena)
+    jpeg_mem_arena((j_common_ptr) &cinfo, ARENA_SIZE(max_width));
+
+  calibrate_ticks();
+
+  printf("%d frames (%d without DHT, %d dropped), up to %ux%u, %d iterations\n",
+	 num_frames, num_dhtless, num_dropped, (unsigned int) max_width,
+	 (unsigned int) max_height, iterations);
+  printf("format scale  frames  frames/s  ns/pixel");
+  if (measure_stages) {
+    for (stage = 0; stage < NUM_STAGES; stage++)
+      printf(" %8s", stage_names[stage]);
+  }
+  printf("\n");
+
+  for (format = 0; format < NUM_FORMATS; format++) {
+    if (! (format_mask & (1 << format)))
+      continue;
+    for (scale = 1; scale <= 8; scale <<= 1) {
+      if (scale_mask & (1 << scale))
+	run_config(&cinfo, format, scale);
+    }
+  }
+
+  jpeg_destroy_decompress(&cinfo);
+  jpeg_destroy_compress(&table_source);
+
+  exit(EXIT_SUCCESS);
+  return 0;			/* suppress no-return-value warnings */
+}
@@ -333,6 +333,8 @@ struct jpeg_color_quantizer {
 #define jpeg_natural_order3	jZAG3Table
 #define jpeg_natural_order2	jZAG2Table
 #define jpeg_aritab		jAriTab
+#define jpeg_sse2_usable	jSSE2Usable
+#define jpeg_ycc_convert_sse2	jYCCSSE2
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 
@@ -401,6 +403,23 @@ EXTERN(void) jcopy_sample_rows JPP((JSAMPARRAY input_array, int source_row,
 				    int num_rows, JDIMENSION num_cols));
 EXTERN(void) jcopy_block_row JPP((JBLOCKROW input_row, JBLOCKROW output_row,
 				  JDIMENSION num_blocks));
+
+/* SSE2 versions of the hot decoder loops (jutils.c, jidctsse.c, jdcolsse.c).
+ * They are compiled in for 8-bit samples when the compiler targets SSE2,
+ * and are selected at run time if the CPU reports SSE2 support.
+ */
+#if defined(__SSE2__) && BITS_IN_JSAMPLE == 8
+#define SSE2_SUPPORTED
+#endif
+
+#ifdef SSE2_SUPPORTED
+EXTERN(int) jpeg_sse2_usable JPP((void));
+EXTERN(void) jpeg_ycc_convert_sse2
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols, boolean h2_chroma,
+	 J_COLOR_SPACE out_color_space));
+#endif
+
 /* Constant tables in jutils.c */
 #if 0				/* This table is not actually needed in v6a */
 extern const int jpeg_zigzag_order[]; /* natural coef order to zigzag order */
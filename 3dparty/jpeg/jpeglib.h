@@ -225,7 +225,9 @@ typedef enum {
 	JCS_CMYK,		/* C/M/Y/K */
 	JCS_YCCK,		/* Y/Cb/Cr/K */
 	JCS_BG_RGB,		/* big gamut red/green/blue, bg-sRGB */
-	JCS_BG_YCC		/* big gamut Y/Cb/Cr, bg-sYCC */
+	JCS_BG_YCC,		/* big gamut Y/Cb/Cr, bg-sYCC */
+	JCS_EXT_BGRX,		/* blue/green/red/pad, output only */
+	JCS_EXT_YUYV		/* Y/Cb/Y/Cr 4:2:2 interleaved, output only */
 } J_COLOR_SPACE;
 
 /* Supported color transforms. */
@@ -941,6 +943,7 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_abort		jAbort
 #define jpeg_destroy		jDestroy
 #define jpeg_resync_to_restart	jResyncRestart
+#define jpeg_mem_arena		jMemArena
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 
@@ -1111,6 +1114,11 @@ EXTERN(void) jpeg_abort_decompress JPP((j_decompress_ptr cinfo));
 EXTERN(void) jpeg_abort JPP((j_common_ptr cinfo));
 EXTERN(void) jpeg_destroy JPP((j_common_ptr cinfo));
 
+/* Reserve a fixed arena for per-image allocations of a reused object
+ * (size 0 releases it).  Call only between images.
+ */
+EXTERN(void) jpeg_mem_arena JPP((j_common_ptr cinfo, size_t size));
+
 /* Default restart-marker-resync procedure for use by data source modules */
 EXTERN(boolean) jpeg_resync_to_restart JPP((j_decompress_ptr cinfo,
 					    int desired));
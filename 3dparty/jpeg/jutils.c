@@ -16,6 +16,10 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 
+#ifdef SSE2_SUPPORTED
+#include <cpuid.h>
+#endif
+
 
 /*
  * jpeg_zigzag_order[i] is the zigzag-order position of the i'th element
@@ -225,3 +229,23 @@ jcopy_block_row (JBLOCKROW input_row, JBLOCKROW output_row,
   }
 #endif
 }
+
+
+#ifdef SSE2_SUPPORTED
+
+GLOBAL(int)
+jpeg_sse2_usable (void)
+/* Returns nonzero if the CPU supports SSE2.  The CPUID query is done once. */
+{
+  static int usable = -1;
+  unsigned int eax, ebx, ecx, edx;
+
+  if (usable < 0) {
+    usable = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2))
+      usable = 1;
+  }
+  return usable;
+}
+
+#endif /* SSE2_SUPPORTED */
@@ -351,6 +351,16 @@
 #define UVC_REQUEST_SET_VS                                         0x00000022
 #define UVC_REQUEST_GET_VS                                         0x000000A2
 
+/* Payload header, bmHeaderInfo bits (2.4.3.3 Video and Still Image Payload Headers) */
+#define UVC_PAYLOAD_HEADER_FID                                     0x00000001
+#define UVC_PAYLOAD_HEADER_EOF                                     0x00000002
+#define UVC_PAYLOAD_HEADER_PTS                                     0x00000004
+#define UVC_PAYLOAD_HEADER_SCR                                     0x00000008
+#define UVC_PAYLOAD_HEADER_RES                                     0x00000010
+#define UVC_PAYLOAD_HEADER_STI                                     0x00000020
+#define UVC_PAYLOAD_HEADER_ERR                                     0x00000040
+#define UVC_PAYLOAD_HEADER_EOH                                     0x00000080
+
 /* Interrupt packets */
 #define UVC_INTERRUPT_ORIGINATOR_MASK                              0x00000003
 #define UVC_INTERRUPT_ORIGINATOR_VC                                0x00000001
@@ -367,4 +377,11 @@
 #define UVC_INTERRUPT_VC_CONTROL_MIN_CHANGE                        0x00000003
 #define UVC_INTERRUPT_VC_CONTROL_MAX_CHANGE                        0x00000004
 
+/* GET_INFO response bits (4.1.2 Get Request) */
+#define UVC_CONTROL_INFO_GET                                       0x00000001
+#define UVC_CONTROL_INFO_SET                                       0x00000002
+#define UVC_CONTROL_INFO_DISABLED                                  0x00000004
+#define UVC_CONTROL_INFO_AUTOUPDATE                                0x00000008
+#define UVC_CONTROL_INFO_ASYNCHRONOUS                              0x00000010
+
 #endif /* __USBVC_H__ */
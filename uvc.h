@@ -26,6 +26,7 @@ struct _uvc_ocb;
 #define IOFUNC_ATTR_T   struct _uvc_device
 #define IOFUNC_OCB_T    struct _uvc_ocb
 
+#include <time.h>
 #include <stdint.h>
 #include <pthread.h>
 #include <sys/usbdi.h>
@@ -35,6 +36,7 @@ struct _uvc_ocb;
 
 #include <linux/media.h>
 #include <linux/videodev2.h>
+#include <linux/uvcvideo.h>
 
 #include "bsdqueue.h"
 #include "uuid.h"
@@ -328,9 +330,15 @@ typedef struct _uvc_ocb
 #define UVC_MAX_ENTITIES        (UVC_MAX_EXTENSION_UNITS*2)
 #define UVC_MAX_ENTITY_PADS     8
 
+/* States of control and frame workers */
+#define UVC_WORKER_NONE     0
+#define UVC_WORKER_RUNNING  1
+#define UVC_WORKER_STOPPING 2
+
 struct _uvc_device_mapping;
 struct _uvc_sysfs_device;
 struct _uvc_media_device;
+struct _uvc_preview_device;
 
 /* native formats */
 #define UVC_FORMAT_NONE    (0)
@@ -346,11 +354,21 @@ struct _uvc_media_device;
 #define UVC_FORMAT_UYVY    (16+1)
 #define UVC_FORMAT_VYUY    (17+1)
 #define UVC_FORMAT_YVYU    (18+1)
-#define UVC_TOTAL_FORMATS  12
+#define UVC_FORMAT_MJPG_YUY2 (19+1) /* YUY2 decoded from MJPEG */
+#define UVC_FORMAT_RGB24   (20+1)
+#define UVC_FORMAT_BGR32   (21+1)
+#define UVC_FORMAT_RGB565  (22+1)
+#define UVC_FORMAT_MJPG_NV12 (23+1) /* NV12 decoded from MJPEG */
+#define UVC_FORMAT_YUV_MJPG  (24+1) /* MJPEG encoded from YUY2 or NV12 */
+#define UVC_TOTAL_FORMATS  16
 
 #define UVC_MAX_OPEN_FDS    32
 #define UVC_MAX_ISO_BUFFERS 4
 #define UVC_MAX_ISO_FRAMES  32
+#define UVC_MAX_CONTROL_URBS 4
+#define UVC_MAX_CACHED_CONTROLS 64
+#define UVC_MAX_CONTROLS 64
+#define UVC_MAX_CACHED_CONTROL_SIZE 16
 
 typedef struct _uvc_event_entry
 {
@@ -358,12 +376,17 @@ typedef struct _uvc_event_entry
     struct v4l2_event event;
 } uvc_event_entry_t;
 
+/* Subscriptions are indexed by event type, private events take slots after */
+/* the standard ones.                                                        */
+#define UVC_EVENT_SLOT_MOTION (V4L2_EVENT_FRAME_SYNC+1)
+#define UVC_EVENT_SLOTS       (V4L2_EVENT_FRAME_SYNC+2)
+
 typedef struct _uvc_event
 {
     uvc_ocb_t* ocb;
-    uint32_t type[V4L2_EVENT_FRAME_SYNC+1];
-    uint32_t flags[V4L2_EVENT_FRAME_SYNC+1];
-    uint32_t id[V4L2_EVENT_FRAME_SYNC+1];
+    uint32_t type[UVC_EVENT_SLOTS];
+    uint32_t flags[UVC_EVENT_SLOTS];
+    uint32_t id[UVC_EVENT_SLOTS];
     uint32_t sequence;
     TAILQ_HEAD(, _uvc_event_entry) head;
     pthread_mutex_t access;
@@ -384,6 +407,63 @@ typedef struct _uvc_buffer
     TAILQ_HEAD(, _uvc_buffer_entry) head;
 } uvc_buffer_t;
 
+/* Control write request queued to the control worker of device. Controls */
+/* are stored after the job, rcvid is -1 if client is replied already.    */
+/* Per-frame requests have nonzero id and wait for the frame sequence.    */
+typedef struct _uvc_control_job
+{
+    TAILQ_ENTRY(_uvc_control_job) link;
+    int rcvid;
+    uvc_ocb_t* ocb;
+    int subdev;
+    unsigned int dcmd;
+    uint32_t id;
+    uint32_t sequence;
+    struct v4l2_ext_controls ctrls;
+    struct v4l2_ext_control* controls;
+} uvc_control_job_t;
+
+/* Control table entry: current value of non-volatile control, limits and */
+/* default value, as they were read from device or set last time.        */
+#define UVC_CONTROL_CUR     0
+#define UVC_CONTROL_MIN     1
+#define UVC_CONTROL_MAX     2
+#define UVC_CONTROL_RES     3
+#define UVC_CONTROL_DEF     4
+#define UVC_CONTROL_LEN     5        /* GET_LEN and GET_INFO don't depend on */
+#define UVC_CONTROL_INFO    6        /* size of control value                */
+#define UVC_CONTROL_VALUES  7
+#define UVC_CONTROL_VALUE_MASK ((1<<UVC_CONTROL_LEN)-1)
+
+typedef struct _uvc_control_cache
+{
+    uint8_t unit_id;
+    uint8_t selector;
+    uint8_t size;
+    uint8_t valid;           /* Bit mask of UVC_CONTROL_* values which are read */
+    uint8_t data[UVC_CONTROL_VALUES][UVC_MAX_CACHED_CONTROL_SIZE];
+} uvc_control_cache_t;
+
+/* V4L2 control mapped to bit field of extension unit control by */
+/* UVCIOC_CTRL_MAP, length is GET_LEN of the control in bytes.    */
+#define UVC_MAX_MAPPINGS       32
+#define UVC_MAX_MAPPING_MENUS  16
+
+typedef struct _uvc_control_mapping
+{
+    uint32_t id;
+    char     name[32];
+    uint8_t  unit_id;
+    uint8_t  selector;
+    uint8_t  size;                /* Bits */
+    uint8_t  offset;              /* Bits */
+    uint16_t length;
+    uint32_t v4l2_type;
+    uint32_t data_type;
+    uint32_t menu_count;
+    struct uvc_menu_info menu[UVC_MAX_MAPPING_MENUS];
+} uvc_control_mapping_t;
+
 typedef struct _uvc_device
 {
     /* Resource manager data, hdr must be first! */
@@ -415,12 +495,53 @@ typedef struct _uvc_device
     /* USB: interrupt data */
     struct usbd_urb* interrupt_urb;
     uint8_t* interrupt_buffer;
+    /* USB: control transfers data, preallocated pool shared by VC and VS requests */
+    struct usbd_urb* control_urb[UVC_MAX_CONTROL_URBS];
+    uint8_t* control_buffer[UVC_MAX_CONTROL_URBS];
+    uint32_t control_busy;
+    pthread_mutex_t control_access;
+    pthread_cond_t control_free;
+    int control_inited;
+    pthread_mutex_t control_pipe_access;  /* One request at a time on the pipe */
+    uint32_t control_errors;      /* Failed control requests, including retries */
+    /* USB: control table of values and limits, protected by control_access */
+    uvc_control_cache_t control_cache[UVC_MAX_CACHED_CONTROLS];
+    int control_cached;
+    /* Control writes worker, queue is protected by control_job_access. Job */
+    /* being written is kept in control_job until its completion.          */
+    pthread_t control_worker;
+    pthread_mutex_t control_job_access;
+    pthread_cond_t control_job_ready;
+    pthread_cond_t control_job_done;
+    TAILQ_HEAD(, _uvc_control_job) control_jobs;
+    uvc_control_job_t* control_job;
+    int control_worker_state;
+    /* Frame conversion worker, frames handed over to it are protected by */
+    /* frame_work_access.                                                 */
+    pthread_t frame_worker;
+    pthread_mutex_t frame_work_access;
+    pthread_cond_t frame_work_ready;
+    pthread_cond_t frame_work_done;
+    int frame_worker_state;
+    /* Per-frame control requests of each stream ordered by frame sequence, */
+    /* they are queued to the worker at the end of the preceding frame.     */
+    TAILQ_HEAD(, _uvc_control_job) frame_jobs[UVC_MAX_VS_COUNT];
+    uint32_t frame_job_id[UVC_MAX_VS_COUNT];        /* Written request, 0 if none */
+    uint32_t frame_job_sequence[UVC_MAX_VS_COUNT];  /* The first frame it affects */
     /* USB: isochronous data */
     usbd_isoch_frame_request_t* iso_list[UVC_MAX_VS_COUNT][UVC_MAX_ISO_BUFFERS];
     struct usbd_urb* iso_urb[UVC_MAX_VS_COUNT][UVC_MAX_ISO_BUFFERS];
     uint8_t* iso_buffer[UVC_MAX_VS_COUNT][UVC_MAX_ISO_BUFFERS];
     int iso_payload_size[UVC_MAX_VS_COUNT];
 
+    /* V4L2 controls present at each stream, indexes of driver control table */
+    uint8_t controls[UVC_MAX_VS_COUNT][UVC_MAX_CONTROLS];
+    int     total_controls[UVC_MAX_VS_COUNT];
+
+    /* Extension unit controls mapped at runtime, entries are only added */
+    uvc_control_mapping_t mapping[UVC_MAX_MAPPINGS];
+    int total_mappings;
+
     /* Upper level device map */
     struct _uvc_device_mapping* map;
 
@@ -436,6 +557,9 @@ typedef struct _uvc_device
     int                       media_links;
     struct media_link_desc    entity_links[UVC_MAX_ENTITIES*UVC_MAX_ENTITY_PADS];
 
+    /* Preview video devices, registered if option is set */
+    struct _uvc_preview_device* preview[UVC_MAX_VS_COUNT];
+
     /* VideControl data */
     vc_header_t               vc_header;
     vc_input_terminal_t       vc_iterminal;
@@ -491,7 +615,61 @@ typedef struct _uvc_device
     uvc_buffer_t input_buffer[UVC_MAX_VS_COUNT];
     uvc_buffer_t output_buffer[UVC_MAX_VS_COUNT];
     void* buffer_ptr[UVC_MAX_VS_COUNT];
+    unsigned int current_buffer_size[UVC_MAX_VS_COUNT];
     int event_button;
+
+    /* Emulation data, format and frame which are really transferred over USB */
+    int current_source_format[UVC_MAX_VS_COUNT];
+    int current_source_frame[UVC_MAX_VS_COUNT];
+    int current_scale[UVC_MAX_VS_COUNT];
+    int current_decimation[UVC_MAX_VS_COUNT];  /* Source frames per delivered frame */
+
+    /* Lossless MJPEG transformations, crop width is zero if cropping is off */
+    struct v4l2_rect current_crop[UVC_MAX_VS_COUNT];
+    int current_hflip[UVC_MAX_VS_COUNT];
+    int current_vflip[UVC_MAX_VS_COUNT];
+    int current_rotate[UVC_MAX_VS_COUNT];
+
+    /* Frame assembly data */
+    uint8_t* frame_buffer[UVC_MAX_VS_COUNT];
+    unsigned int frame_buffer_size[UVC_MAX_VS_COUNT];
+    unsigned int frame_length[UVC_MAX_VS_COUNT];
+    int frame_fid[UVC_MAX_VS_COUNT];
+    int frame_error[UVC_MAX_VS_COUNT];
+    int frame_eof[UVC_MAX_VS_COUNT];
+    int frame_skip[UVC_MAX_VS_COUNT];
+    int frame_skip_count[UVC_MAX_VS_COUNT];
+    uint32_t frame_sequence[UVC_MAX_VS_COUNT];
+
+    /* Completed frame, which is converted by the frame worker. Its buffer */
+    /* is swapped with the assembly buffer, both are frame_buffer_size.    */
+    uint8_t* frame_work_buffer[UVC_MAX_VS_COUNT];
+    unsigned int frame_work_length[UVC_MAX_VS_COUNT];
+    int frame_work_error[UVC_MAX_VS_COUNT];
+    uint32_t frame_work_sequence[UVC_MAX_VS_COUNT];
+    uint32_t frame_work_job_id[UVC_MAX_VS_COUNT];
+    struct timespec frame_work_time[UVC_MAX_VS_COUNT];
+    int frame_work_state[UVC_MAX_VS_COUNT];
+
+    /* Line of decoded YUY2 data for conversion to larger pixel formats */
+    uint8_t* convert_buffer[UVC_MAX_VS_COUNT];
+    unsigned int convert_buffer_size[UVC_MAX_VS_COUNT];
+
+    /* MJPEG decoder, kept while stream is committed to MJPEG source */
+    struct _uvc_jpeg_context* jpeg_context[UVC_MAX_VS_COUNT];
+
+    /* Lossless transformer of MJPEG frames, which are passed through */
+    struct _uvc_jpeg_transformer* jpeg_transformer[UVC_MAX_VS_COUNT];
+
+    /* MJPEG encoder of uncompressed frames and its quality, 1-100 */
+    struct _uvc_jpeg_encoder* jpeg_encoder[UVC_MAX_VS_COUNT];
+    int current_quality[UVC_MAX_VS_COUNT];
+
+    /* Motion detector of MJPEG stream, created by the first subscription */
+    struct _uvc_motion* motion[UVC_MAX_VS_COUNT];
+
+    /* Statistics of uncompressed frames, created when they are enabled */
+    struct _uvc_stats* stats[UVC_MAX_VS_COUNT];
 } uvc_device_t;
 
 /* Private V4L2 controls */
@@ -500,4 +678,73 @@ typedef struct _uvc_device
 
 #define UVC_CID_EVENT_BUTTON                    (V4L2_CID_CAMERA_PRIVATE_BASE+0)
 
+/* Private V4L2 events */
+#define UVC_EVENT_MOTION                        (V4L2_EVENT_PRIVATE_START+0)
+
+/* Payload of UVC_EVENT_MOTION, placed in v4l2_event.u.data */
+typedef struct _uvc_event_motion
+{
+    uint32_t frame_sequence;  /* v4l2_buffer.sequence of the analysed frame         */
+    uint32_t score;           /* Changed area in 1/1000 of frame, 0 if motion stops */
+    struct v4l2_rect region;  /* Bounding box of changed area in MJPEG frame pixels */
+} uvc_event_motion_t;
+
+/* Private ioctls */
+#define UVC_MAX_FRAME_CONTROLS                  8
+#define UVC_MAX_FRAME_REQUESTS                  32
+
+/* Argument of UVCIOC_S_FRAME_CTRLS: controls are written at the end of frame */
+/* preceding the given v4l2_buffer.sequence (frames are counted from          */
+/* VIDIOC_STREAMON), request id is returned in v4l2_buffer.reserved2 of the   */
+/* first frame which was started after the write.                             */
+typedef struct _uvc_frame_ctrls
+{
+    uint32_t id;              /* Nonzero request id, chosen by application  */
+    uint32_t sequence;        /* Frame, which must be taken with controls   */
+    uint32_t count;
+    uint32_t error_idx;
+    uint32_t reserved[4];
+    struct v4l2_ext_control controls[UVC_MAX_FRAME_CONTROLS];
+} uvc_frame_ctrls_t;
+
+#define UVCIOC_S_FRAME_CTRLS                    _IOWR('V', BASE_VIDIOC_PRIVATE+0, uvc_frame_ctrls_t)
+
+/* Statistics of uncompressed (YUY2, NV12) native frames, they are gathered */
+/* while payloads are assembled. Mean values are kept for grid of tiles.     */
+#define UVC_STATS_MAX_GRID                      16
+#define UVC_STATS_MAX_TILES                     (UVC_STATS_MAX_GRID*UVC_STATS_MAX_GRID)
+
+/* Argument of UVCIOC_S_STATS */
+typedef struct _uvc_stats_config
+{
+    uint32_t enable;
+    uint32_t columns;         /* Grid of tiles, 1..UVC_STATS_MAX_GRID       */
+    uint32_t rows;
+    uint32_t clip_low;        /* Luma at or below is counted as clipped     */
+    uint32_t clip_high;       /* Luma at or above is counted as clipped     */
+    uint32_t reserved[3];
+} uvc_stats_config_t;
+
+/* Argument of UVCIOC_G_STATS, statistics of the frame in buffer with given */
+/* index are valid until the buffer is queued again.                        */
+typedef struct _uvc_frame_stats
+{
+    uint32_t index;           /* v4l2_buffer.index, set by application      */
+    uint32_t sequence;        /* v4l2_buffer.sequence of the frame          */
+    uint32_t width;           /* Native frame size                          */
+    uint32_t height;
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t clipped_low;
+    uint32_t clipped_high;
+    uint32_t reserved[4];
+    uint32_t histogram[256];  /* Luma histogram                             */
+    uint8_t  mean_y[UVC_STATS_MAX_TILES];  /* Tiles row by row              */
+    uint8_t  mean_u[UVC_STATS_MAX_TILES];
+    uint8_t  mean_v[UVC_STATS_MAX_TILES];
+} uvc_frame_stats_t;
+
+#define UVCIOC_S_STATS                          _IOWR('V', BASE_VIDIOC_PRIVATE+1, uvc_stats_config_t)
+#define UVCIOC_G_STATS                          _IOWR('V', BASE_VIDIOC_PRIVATE+2, uvc_frame_stats_t)
+
 #endif /* __UVC_H__ */
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#include <linux/videodev2.h>
+
+#include "uvc.h"
+#include "usbvc.h"
+#include "uvc_color.h"
+
+/* Builds conversion matrix for the color matching descriptor coefficients. */
+/* Uncompressed formats use video range (Y 16-235, Cb/Cr 16-240), while    */
+/* MJPEG frames are JFIF and use full range.                               */
+void uvc_color_matrix(int matrix_coefficients, int full_range, uvc_color_matrix_t* matrix)
+{
+    double kr, kb, kg;
+    double ys, cs;
+
+    switch (matrix_coefficients)
+    {
+        case VCFMC_BT_709:
+             kr=0.2126;
+             kb=0.0722;
+             break;
+        case VCFMC_FCC:
+             kr=0.30;
+             kb=0.11;
+             break;
+        case VCFMC_SMPTE_240M:
+             kr=0.212;
+             kb=0.087;
+             break;
+        case VCFMC_BT_470_2_BG:
+        case VCFMC_SMPTE_170M:
+        default:
+             kr=0.299;
+             kb=0.114;
+             break;
+    }
+    kg=1.0-kr-kb;
+
+    if (full_range)
+    {
+        matrix->y_offset=0;
+        ys=1.0;
+        cs=1.0;
+    }
+    else
+    {
+        matrix->y_offset=16;
+        ys=255.0/219.0;
+        cs=255.0/224.0;
+    }
+
+    matrix->y_coef=(int16_t)(ys*8192.0+0.5);
+    matrix->rv_coef=(int16_t)(2.0*(1.0-kr)*cs*8192.0+0.5);
+    matrix->gu_coef=(int16_t)(2.0*(1.0-kb)*kb/kg*cs*8192.0+0.5);
+    matrix->gv_coef=(int16_t)(2.0*(1.0-kr)*kr/kg*cs*8192.0+0.5);
+    matrix->bu_coef=(int16_t)(2.0*(1.0-kb)*cs*8192.0+0.5);
+}
+
+static uint8_t uvc_color_clamp(int value)
+{
+    if (value<0)
+    {
+        return 0;
+    }
+    if (value>255)
+    {
+        return 255;
+    }
+
+    return value;
+}
+
+/* Same math as SIMD path: operands are scaled by 128 and high 16 bits of */
+/* product are taken, so result has 4 fractional bits.                    */
+#define UVC_COLOR_MULHI(value, coef) (((int)(value)*128*(int)(coef))>>16)
+
+static void uvc_color_store(uint8_t* dst, int y, int u, int v, uint32_t pixelformat, uvc_color_matrix_t* matrix)
+{
+    int yc=UVC_COLOR_MULHI(y-matrix->y_offset, matrix->y_coef)+8;
+    int r=uvc_color_clamp((yc+UVC_COLOR_MULHI(v, matrix->rv_coef))>>4);
+    int g=uvc_color_clamp((yc-UVC_COLOR_MULHI(u, matrix->gu_coef)-UVC_COLOR_MULHI(v, matrix->gv_coef))>>4);
+    int b=uvc_color_clamp((yc+UVC_COLOR_MULHI(u, matrix->bu_coef))>>4);
+
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_RGB24:
+             dst[0]=r;
+             dst[1]=g;
+             dst[2]=b;
+             break;
+        case V4L2_PIX_FMT_BGR32:
+             dst[0]=b;
+             dst[1]=g;
+             dst[2]=r;
+             dst[3]=0xFF;
+             break;
+        case V4L2_PIX_FMT_RGB565:
+             dst[0]=((g & 0xFC)<<3) | (b>>3);
+             dst[1]=(r & 0xF8) | (g>>5);
+             break;
+    }
+}
+
+/* Converts one line of YUY2 pixels to RGB24, BGR32 or RGB565 */
+void uvc_color_yuy2_to_rgb(uint8_t* src, uint8_t* dst, int pixels, uint32_t pixelformat, uvc_color_matrix_t* matrix)
+{
+    int bpp;
+    int it=0;
+
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_RGB24:
+             bpp=3;
+             break;
+        case V4L2_PIX_FMT_BGR32:
+             bpp=4;
+             break;
+        case V4L2_PIX_FMT_RGB565:
+             bpp=2;
+             break;
+        default:
+             return;
+    }
+
+#if defined(__SSE2__)
+    {
+        const __m128i mask=_mm_set1_epi16(0x00FF);
+        const __m128i zero=_mm_setzero_si128();
+        const __m128i alpha=_mm_set1_epi16(0x00FF);
+        const __m128i chroma=_mm_set1_epi16(128);
+        const __m128i round=_mm_set1_epi16(8);
+        const __m128i yoff=_mm_set1_epi16(matrix->y_offset);
+        const __m128i ycoef=_mm_set1_epi16(matrix->y_coef);
+        const __m128i rvcoef=_mm_set1_epi16(matrix->rv_coef);
+        const __m128i gucoef=_mm_set1_epi16(matrix->gu_coef);
+        const __m128i gvcoef=_mm_set1_epi16(matrix->gv_coef);
+        const __m128i bucoef=_mm_set1_epi16(matrix->bu_coef);
+        __m128i yuyv, y, uv, u, v, r, g, b;
+        uint8_t rgb[3][16];
+        int jt;
+
+        /* 8 pixels per iteration */
+        for (; it+8<=pixels; it+=8)
+        {
+            yuyv=_mm_loadu_si128((__m128i*)src);
+            y=_mm_and_si128(yuyv, mask);
+            uv=_mm_srli_epi16(yuyv, 8);
+            u=_mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+            v=_mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+            y=_mm_slli_epi16(_mm_sub_epi16(y, yoff), 7);
+            u=_mm_slli_epi16(_mm_sub_epi16(u, chroma), 7);
+            v=_mm_slli_epi16(_mm_sub_epi16(v, chroma), 7);
+
+            y=_mm_add_epi16(_mm_mulhi_epi16(y, ycoef), round);
+            r=_mm_srai_epi16(_mm_add_epi16(y, _mm_mulhi_epi16(v, rvcoef)), 4);
+            g=_mm_srai_epi16(_mm_sub_epi16(_mm_sub_epi16(y, _mm_mulhi_epi16(u, gucoef)), _mm_mulhi_epi16(v, gvcoef)), 4);
+            b=_mm_srai_epi16(_mm_add_epi16(y, _mm_mulhi_epi16(u, bucoef)), 4);
+
+            /* Saturate to 0-255 */
+            r=_mm_packus_epi16(r, r);
+            g=_mm_packus_epi16(g, g);
+            b=_mm_packus_epi16(b, b);
+
+            switch (pixelformat)
+            {
+                case V4L2_PIX_FMT_BGR32:
+                     {
+                         __m128i bg=_mm_unpacklo_epi8(b, g);
+                         __m128i ra=_mm_unpacklo_epi8(r, _mm_packus_epi16(alpha, alpha));
+
+                         _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(bg, ra));
+                         _mm_storeu_si128((__m128i*)(dst+16), _mm_unpackhi_epi16(bg, ra));
+                     }
+                     break;
+                case V4L2_PIX_FMT_RGB565:
+                     r=_mm_slli_epi16(_mm_srli_epi16(_mm_unpacklo_epi8(r, zero), 3), 11);
+                     g=_mm_slli_epi16(_mm_srli_epi16(_mm_unpacklo_epi8(g, zero), 2), 5);
+                     b=_mm_srli_epi16(_mm_unpacklo_epi8(b, zero), 3);
+                     _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_or_si128(r, g), b));
+                     break;
+                case V4L2_PIX_FMT_RGB24:
+                     _mm_storeu_si128((__m128i*)rgb[0], r);
+                     _mm_storeu_si128((__m128i*)rgb[1], g);
+                     _mm_storeu_si128((__m128i*)rgb[2], b);
+                     for (jt=0; jt<8; jt++)
+                     {
+                         dst[jt*3+0]=rgb[0][jt];
+                         dst[jt*3+1]=rgb[1][jt];
+                         dst[jt*3+2]=rgb[2][jt];
+                     }
+                     break;
+            }
+
+            src+=16;
+            dst+=8*bpp;
+        }
+    }
+#endif /* __SSE2__ */
+
+    /* Remaining pixel pairs */
+    for (; it+2<=pixels; it+=2)
+    {
+        uvc_color_store(dst, src[0], src[1]-128, src[3]-128, pixelformat, matrix);
+        uvc_color_store(dst+bpp, src[2], src[1]-128, src[3]-128, pixelformat, matrix);
+        src+=4;
+        dst+=2*bpp;
+    }
+}
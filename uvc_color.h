@@ -0,0 +1,40 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#ifndef __UVC_COLOR_H__
+#define __UVC_COLOR_H__
+
+#include <stdint.h>
+
+/* Fixed point YCbCr->RGB coefficients, all are in Q13 format */
+typedef struct _uvc_color_matrix
+{
+    int16_t y_offset;    /* 16 for video range, 0 for full range */
+    int16_t y_coef;
+    int16_t rv_coef;
+    int16_t gu_coef;
+    int16_t gv_coef;
+    int16_t bu_coef;
+} uvc_color_matrix_t;
+
+void uvc_color_matrix(int matrix_coefficients, int full_range, uvc_color_matrix_t* matrix);
+void uvc_color_yuy2_to_rgb(uint8_t* src, uint8_t* dst, int pixels, uint32_t pixelformat, uvc_color_matrix_t* matrix);
+
+#endif /* __UVC_COLOR_H__ */
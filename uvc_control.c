@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/slog.h>
 #include <sys/usbdi.h>
@@ -1053,52 +1054,459 @@ void uvc_parse_control_descriptor(uvc_device_t* uvcd, uint8_t* data)
     }
 }
 
-int uvc_control_get(uvc_device_t* dev, int operation, int unit, int selector, int size, uint8_t* data)
+/* Preallocates URBs and DMA buffers for control transfers, so controls set */
+/* by sliders or tuning loops don't allocate anything on each request.      */
+int uvc_setup_control(uvc_device_t* dev)
 {
-    struct usbd_urb* urb;
-    uint8_t* buffer;
+    int it;
+
+    for (it=0; it<UVC_MAX_CONTROL_URBS; it++)
+    {
+        dev->control_urb[it]=usbd_alloc_urb(NULL);
+        if (dev->control_urb[it]==NULL)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate control urb");
+            break;
+        }
+
+        dev->control_buffer[it]=usbd_alloc(UVC_MAX_CONTROL_PAYLOAD_SIZE);
+        if (dev->control_buffer[it]==NULL)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate buffer for control");
+            break;
+        }
+    }
+
+    if (it!=UVC_MAX_CONTROL_URBS)
+    {
+        for (it=0; it<UVC_MAX_CONTROL_URBS; it++)
+        {
+            if (dev->control_urb[it]!=NULL)
+            {
+                usbd_free_urb(dev->control_urb[it]);
+                dev->control_urb[it]=NULL;
+            }
+            if (dev->control_buffer[it]!=NULL)
+            {
+                usbd_free(dev->control_buffer[it]);
+                dev->control_buffer[it]=NULL;
+            }
+        }
+        return -1;
+    }
+
+    dev->control_busy=0;
+    dev->control_cached=0;
+    pthread_mutex_init(&dev->control_access, NULL);
+    pthread_cond_init(&dev->control_free, NULL);
+    pthread_mutex_init(&dev->control_pipe_access, NULL);
+    dev->control_inited=1;
+
+    return 0;
+}
+
+int uvc_unsetup_control(uvc_device_t* dev)
+{
+    int it;
+
+    if (!dev->control_inited)
+    {
+        return -1;
+    }
+
+    /* Wait for requests which are in flight */
+    pthread_mutex_lock(&dev->control_access);
+    while (dev->control_busy!=0)
+    {
+        pthread_cond_wait(&dev->control_free, &dev->control_access);
+    }
+    dev->control_inited=0;
+    pthread_mutex_unlock(&dev->control_access);
+
+    for (it=0; it<UVC_MAX_CONTROL_URBS; it++)
+    {
+        usbd_free_urb(dev->control_urb[it]);
+        dev->control_urb[it]=NULL;
+        usbd_free(dev->control_buffer[it]);
+        dev->control_buffer[it]=NULL;
+    }
+
+    pthread_mutex_destroy(&dev->control_pipe_access);
+    pthread_cond_destroy(&dev->control_free);
+    pthread_mutex_destroy(&dev->control_access);
+
+    return 0;
+}
+
+/* Performs control request, which is set up in urb. Timed out request or   */
+/* transport error leaves control pipe halted, so pipe is reset and request */
+/* is repeated up to UVC_CONTROL_RETRIES times, each try is bound by        */
+/* timeout. Stall is the answer of device to unsupported request, pipe is   */
+/* reset once and request is not repeated.                                  */
+/* URBs of the pool are prepared in parallel, but requests go to the shared */
+/* pipe one after another, so reset of the pipe never hits other request.   */
+int uvc_control_io(uvc_device_t* dev, struct usbd_urb* urb, uint32_t timeout)
+{
+    uint32_t urb_status;
+    uint32_t urb_len;
     int status;
-    uint16_t unit_id=0;
+    int it;
+
+    pthread_mutex_lock(&dev->control_pipe_access);
+    for (it=0; ; it++)
+    {
+        status=usbd_io(urb, dev->vc_control_pipe, NULL, dev, timeout);
+        if (status==EOK)
+        {
+            break;
+        }
+
+        pthread_mutex_lock(&dev->control_access);
+        dev->control_errors++;
+        pthread_mutex_unlock(&dev->control_access);
+
+        /* Device is gone, nothing to retry */
+        if (status==ENODEV)
+        {
+            break;
+        }
+
+        urb_status=0;
+        urb_len=0;
+        usbd_urb_status(urb, &urb_status, &urb_len);
+
+        if ((urb_status & USBD_USB_STATUS_MASK)==USBD_STATUS_STALL)
+        {
+            if (uvc_verbose)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Control request stalled, %u error(s) total, resetting pipe",
+                    dev->control_errors);
+            }
+            usbd_reset_pipe(dev->vc_control_pipe);
+            status=EIO;
+            break;
+        }
+
+        /* Only timeouts and transport errors are worth another try */
+        if ((status!=ETIMEDOUT) && (status!=EIO) && ((urb_status & USBD_STATUS_TIMEOUT)==0))
+        {
+            break;
+        }
+
+        if (uvc_verbose)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Control request failed, error %d, %u error(s) total, resetting pipe",
+                status, dev->control_errors);
+        }
+        usbd_reset_pipe(dev->vc_control_pipe);
+
+        if (it>=UVC_CONTROL_RETRIES)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dev->control_pipe_access);
+
+    return status;
+}
+
+/* Takes a free URB and buffer from the pool, blocks while all of them are */
+/* used by other threads. Returns slot number or -1.                      */
+int uvc_control_acquire(uvc_device_t* dev, int size)
+{
+    int it;
+
+    if ((size<0) || (size>UVC_MAX_CONTROL_PAYLOAD_SIZE))
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Control payload size %d is not supported", size);
+        return -1;
+    }
+
+    if (!dev->control_inited)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Control transfers are not initialized");
+        return -1;
+    }
+
+    pthread_mutex_lock(&dev->control_access);
+    for (;;)
+    {
+        for (it=0; it<UVC_MAX_CONTROL_URBS; it++)
+        {
+            if ((dev->control_busy & (1<<it))==0)
+            {
+                dev->control_busy|=(1<<it);
+                pthread_mutex_unlock(&dev->control_access);
+                return it;
+            }
+        }
+        pthread_cond_wait(&dev->control_free, &dev->control_access);
+    }
+}
+
+void uvc_control_release(uvc_device_t* dev, int slot)
+{
+    pthread_mutex_lock(&dev->control_access);
+    dev->control_busy&=~(1<<slot);
+    pthread_cond_broadcast(&dev->control_free);
+    pthread_mutex_unlock(&dev->control_access);
+}
+
+/* Returns bUnitID of destination unit, or -1 if device has no such unit */
+int uvc_control_unit_id(uvc_device_t* dev, int unit)
+{
     int it;
 
     switch (unit)
     {
         case UVC_PUNIT_SELECTOR:
-             unit_id=dev->vc_processing_unit.bUnitID;
-             break;
+             return dev->vc_processing_unit.bUnitID;
         case UVC_CAMERA_SELECTOR:
-             unit_id=dev->vc_iterminal.bTerminalID;
-             break;
+             return dev->vc_iterminal.bTerminalID;
         case UVC_ISEL_SELECTOR:
-             unit_id=dev->vc_selector_unit.bUnitID;
+             return dev->vc_selector_unit.bUnitID;
+    }
+
+    if (unit & UVC_XUNIT_FLAG)
+    {
+        for (it=0; it<dev->total_vc_extensions; it++)
+        {
+            if (dev->vc_extension[it].bUnitID==(unit & 0xFF))
+            {
+                return dev->vc_extension[it].bUnitID;
+            }
+        }
+    }
+
+    return -1;
+}
+
+/* Controls which are changed by the device itself, when an auto mode is on, */
+/* or which are commands rather than state. They always read from device.   */
+int uvc_control_volatile(int unit, int selector)
+{
+    /* Meaning of extension unit controls is unknown, device could change them */
+    if (unit & UVC_XUNIT_FLAG)
+    {
+        return 1;
+    }
+
+    switch (unit)
+    {
+        case UVC_CAMERA_SELECTOR:
+             switch (selector)
+             {
+                 case VCT_EXPOSURE_TIME_ABSOLUTE_CONTROL:
+                 case VCT_EXPOSURE_TIME_RELATIVE_CONTROL:
+                 case VCT_FOCUS_ABSOLUTE_CONTROL:
+                 case VCT_FOCUS_RELATIVE_CONTROL:
+                 case VCT_IRIS_ABSOLUTE_CONTROL:
+                 case VCT_IRIS_RELATIVE_CONTROL:
+                 case VCT_ZOOM_RELATIVE_CONTROL:
+                 case VCT_PANTILT_RELATIVE_CONTROL:
+                 case VCT_ROLL_RELATIVE_CONTROL:
+                      return 1;
+             }
+             break;
+        case UVC_PUNIT_SELECTOR:
+             switch (selector)
+             {
+                 case VPU_CONTRAST_CONTROL:
+                 case VPU_HUE_CONTROL:
+                 case VPU_WHITE_BALANCE_TEMPERATURE_CONTROL:
+                 case VPU_WHITE_BALANCE_COMPONENT_CONTROL:
+                 case VPU_ANALOG_LOCK_STATUS_CONTROL:
+                      return 1;
+             }
+             break;
+    }
+
+    return 0;
+}
+
+/* Slot of control table entry for the request, -1 if it is not kept */
+static int uvc_control_cache_index(int operation)
+{
+    switch (operation)
+    {
+        case VGET_CUR:
+        case VSET_CUR:
+             return UVC_CONTROL_CUR;
+        case VGET_MIN:
+             return UVC_CONTROL_MIN;
+        case VGET_MAX:
+             return UVC_CONTROL_MAX;
+        case VGET_RES:
+             return UVC_CONTROL_RES;
+        case VGET_DEF:
+             return UVC_CONTROL_DEF;
+        case VGET_LEN:
+             return UVC_CONTROL_LEN;
+        case VGET_INFO:
+             return UVC_CONTROL_INFO;
+    }
+
+    return -1;
+}
+
+/* Must be called with control_access locked */
+static uvc_control_cache_t* uvc_control_cache_find(uvc_device_t* dev, int unit_id, int selector)
+{
+    int it;
+
+    for (it=0; it<dev->control_cached; it++)
+    {
+        if ((dev->control_cache[it].unit_id==unit_id) && (dev->control_cache[it].selector==selector))
+        {
+            return &dev->control_cache[it];
+        }
+    }
+
+    return NULL;
+}
+
+static int uvc_control_cache_read(uvc_device_t* dev, int unit_id, int selector, int index, int size, uint8_t* data)
+{
+    uvc_control_cache_t* entry;
+    int ret=-1;
+
+    pthread_mutex_lock(&dev->control_access);
+    entry=uvc_control_cache_find(dev, unit_id, selector);
+    if ((entry!=NULL) && (entry->valid & (1<<index)) &&
+        ((index>=UVC_CONTROL_LEN) || (entry->size==size)))
+    {
+        memcpy(data, entry->data[index], size);
+        ret=0;
+    }
+    pthread_mutex_unlock(&dev->control_access);
+
+    return ret;
+}
+
+static void uvc_control_cache_write(uvc_device_t* dev, int unit_id, int selector, int index, int size, uint8_t* data)
+{
+    uvc_control_cache_t* entry;
+
+    if (size>UVC_MAX_CACHED_CONTROL_SIZE)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&dev->control_access);
+    entry=uvc_control_cache_find(dev, unit_id, selector);
+    if ((entry==NULL) && (dev->control_cached<UVC_MAX_CACHED_CONTROLS))
+    {
+        entry=&dev->control_cache[dev->control_cached];
+        entry->unit_id=unit_id;
+        entry->selector=selector;
+        entry->size=(index<UVC_CONTROL_LEN) ? size : 0;
+        entry->valid=0;
+        dev->control_cached++;
+    }
+    if (entry!=NULL)
+    {
+        /* Values of other size can't belong to the same control, length */
+        /* and capabilities are kept.                                    */
+        if ((index<UVC_CONTROL_LEN) && (entry->size!=size))
+        {
+            entry->size=size;
+            entry->valid&=~UVC_CONTROL_VALUE_MASK;
+        }
+        memcpy(entry->data[index], data, size);
+        entry->valid|=(1<<index);
+    }
+    pthread_mutex_unlock(&dev->control_access);
+}
+
+/* Applies VC control change interrupt to the table: new value, minimum or */
+/* maximum is stored as is, any other change (resolution, info, failure)  */
+/* makes device to be asked again.                                        */
+void uvc_control_cache_update(uvc_device_t* dev, int unit_id, int selector, int attribute, uint8_t* data, int size)
+{
+    uvc_control_cache_t* entry;
+    int index;
+
+    if (!dev->control_inited)
+    {
+        return;
+    }
+
+    switch (attribute)
+    {
+        case UVC_INTERRUPT_VC_CONTROL_VALUE_CHANGE:
+             index=UVC_CONTROL_CUR;
+             break;
+        case UVC_INTERRUPT_VC_CONTROL_MIN_CHANGE:
+             index=UVC_CONTROL_MIN;
+             break;
+        case UVC_INTERRUPT_VC_CONTROL_MAX_CHANGE:
+             index=UVC_CONTROL_MAX;
              break;
         default:
-             slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Unknown destination unit");
-             return -1;
+             index=-1;
+             break;
     }
 
-    urb=usbd_alloc_urb(NULL);
-    if (urb==NULL)
+    pthread_mutex_lock(&dev->control_access);
+    entry=uvc_control_cache_find(dev, unit_id, selector);
+    if (entry!=NULL)
+    {
+        if ((index>=0) && (size>=entry->size))
+        {
+            memcpy(entry->data[index], data, entry->size);
+            entry->valid|=(1<<index);
+        }
+        else
+        {
+            entry->valid=0;
+        }
+    }
+    pthread_mutex_unlock(&dev->control_access);
+}
+
+int uvc_control_get(uvc_device_t* dev, int operation, int unit, int selector, int size, uint8_t* data)
+{
+    struct usbd_urb* urb;
+    uint8_t* buffer;
+    int status;
+    int unit_id;
+    int index;
+    int slot;
+    int it;
+
+    unit_id=uvc_control_unit_id(dev, unit);
+    if (unit_id<0)
     {
-        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate urb");
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Unknown destination unit");
         return -1;
     }
 
-    buffer=usbd_alloc(size);
-    if (buffer==NULL)
+    /* Limits, defaults and current value of non-volatile control are served */
+    /* from the control table, once they were read from device.              */
+    index=uvc_control_cache_index(operation);
+    if ((index==UVC_CONTROL_CUR) && (uvc_control_volatile(unit, selector)))
+    {
+        index=-1;
+    }
+    if ((index>=0) && (uvc_control_cache_read(dev, unit_id, selector, index, size, data)==0))
+    {
+        return 0;
+    }
+
+    slot=uvc_control_acquire(dev, size);
+    if (slot<0)
     {
-        usbd_free_urb(urb);
-        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate buffer");
         return -1;
     }
+    urb=dev->control_urb[slot];
+    buffer=dev->control_buffer[slot];
     memset(buffer, 0x00, size);
 
     usbd_setup_vendor(urb, URB_DIR_IN, operation, UVC_REQUEST_GET_VC, selector<<8, unit_id<<8, buffer, size);
-    status=usbd_io(urb, dev->vc_control_pipe, NULL, dev, USBD_TIME_INFINITY);
+    status=uvc_control_io(dev, urb, UVC_CONTROL_GET_TIMEOUT);
     if (status!=EOK)
     {
-        usbd_free_urb(urb);
-        usbd_free(buffer);
+        uvc_control_release(dev, slot);
         slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't perform usb i/o operation");
         return -1;
     }
@@ -1150,7 +1558,8 @@ int uvc_control_get(uvc_device_t* dev, int operation, int unit, int selector, in
                  break;
         }
 
-        for (it=0; it<size; it++)
+        /* Extension unit controls could be longer than log line */
+        for (it=0; (it<size) && (it<32); it++)
         {
             sprintf(temp+strlen(temp), "%02X ", buffer[it]);
         }
@@ -1162,9 +1571,12 @@ int uvc_control_get(uvc_device_t* dev, int operation, int unit, int selector, in
     {
         data[it]=buffer[it];
     }
+    if (index>=0)
+    {
+        uvc_control_cache_write(dev, unit_id, selector, index, size, buffer);
+    }
 
-    usbd_free_urb(urb);
-    usbd_free(buffer);
+    uvc_control_release(dev, slot);
 
     return 0;
 }
@@ -1174,39 +1586,24 @@ int uvc_control_set(uvc_device_t* dev, int operation, int unit, int selector, in
     struct usbd_urb* urb;
     uint8_t* buffer;
     int status;
-    uint16_t unit_id=0;
+    int unit_id;
+    int slot;
     int it;
 
-    switch (unit)
+    unit_id=uvc_control_unit_id(dev, unit);
+    if (unit_id<0)
     {
-        case UVC_PUNIT_SELECTOR:
-             unit_id=dev->vc_processing_unit.bUnitID;
-             break;
-        case UVC_CAMERA_SELECTOR:
-             unit_id=dev->vc_iterminal.bTerminalID;
-             break;
-        case UVC_ISEL_SELECTOR:
-             unit_id=dev->vc_selector_unit.bUnitID;
-             break;
-        default:
-             slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Unknown destination unit");
-             return -1;
-    }
-
-    urb=usbd_alloc_urb(NULL);
-    if (urb==NULL)
-    {
-        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate urb");
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Unknown destination unit");
         return -1;
     }
 
-    buffer=usbd_alloc(size);
-    if (buffer==NULL)
+    slot=uvc_control_acquire(dev, size);
+    if (slot<0)
     {
-        usbd_free_urb(urb);
-        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate buffer");
         return -1;
     }
+    urb=dev->control_urb[slot];
+    buffer=dev->control_buffer[slot];
 
     /* Copy data to URB buffer */
     memcpy(buffer, data, size);
@@ -1225,7 +1622,8 @@ int uvc_control_set(uvc_device_t* dev, int operation, int unit, int selector, in
                  break;
         }
 
-        for (it=0; it<size; it++)
+        /* Extension unit controls could be longer than log line */
+        for (it=0; (it<size) && (it<32); it++)
         {
             sprintf(temp+strlen(temp), "%02X ", buffer[it]);
         }
@@ -1233,17 +1631,20 @@ int uvc_control_set(uvc_device_t* dev, int operation, int unit, int selector, in
     }
 
     usbd_setup_vendor(urb, URB_DIR_OUT, operation, UVC_REQUEST_SET_VC, selector<<8, unit_id<<8, buffer, size);
-    status=usbd_io(urb, dev->vc_control_pipe, NULL, dev, USBD_TIME_INFINITY);
+    status=uvc_control_io(dev, urb, UVC_CONTROL_SET_TIMEOUT);
     if (status!=EOK)
     {
-        usbd_free_urb(urb);
-        usbd_free(buffer);
+        uvc_control_release(dev, slot);
         slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't perform usb i/o operation");
         return -1;
     }
 
-    usbd_free_urb(urb);
-    usbd_free(buffer);
+    if ((operation==VSET_CUR) && (!uvc_control_volatile(unit, selector)))
+    {
+        uvc_control_cache_write(dev, unit_id, selector, UVC_CONTROL_CUR, size, buffer);
+    }
+
+    uvc_control_release(dev, slot);
 
     return 0;
 }
@@ -30,6 +30,34 @@ void uvc_parse_control_descriptor(uvc_device_t* uvcd, uint8_t* data);
 #define UVC_PUNIT_SELECTOR       0x00000002
 #define UVC_ISEL_SELECTOR        0x00000003
 
+/* Extension units are addressed by their bUnitID */
+#define UVC_XUNIT_FLAG           0x00000100
+#define UVC_XUNIT_SELECTOR(id)   (UVC_XUNIT_FLAG | (id))
+
+/* Size of each preallocated control transfer buffer, enough for probe/commit */
+/* controls of any UVC version and for all standard unit controls.          */
+#define UVC_MAX_CONTROL_PAYLOAD_SIZE 64
+
+/* Timeouts of control requests in ms. Unit control reads are answered  */
+/* from device memory, writes could move a motor or change the sensor  */
+/* mode, probe/commit could make device to reconfigure its pipeline.    */
+#define UVC_CONTROL_GET_TIMEOUT       500
+#define UVC_CONTROL_SET_TIMEOUT       2000
+#define UVC_CONTROL_STREAMING_TIMEOUT 3000
+
+/* Attempts after the first one, made after control pipe reset */
+#define UVC_CONTROL_RETRIES          2
+
+int uvc_setup_control(uvc_device_t* dev);
+int uvc_unsetup_control(uvc_device_t* dev);
+int uvc_control_acquire(uvc_device_t* dev, int size);
+void uvc_control_release(uvc_device_t* dev, int slot);
+int uvc_control_io(uvc_device_t* dev, struct usbd_urb* urb, uint32_t timeout);
+
+int uvc_control_unit_id(uvc_device_t* dev, int unit);
+int uvc_control_volatile(int unit, int selector);
+void uvc_control_cache_update(uvc_device_t* dev, int unit_id, int selector, int attribute, uint8_t* data, int size);
+
 int uvc_control_get(uvc_device_t* dev, int operation, int unit, int selector, int size, unsigned char* data);
 int uvc_control_set(uvc_device_t* dev, int operation, int unit, int selector, int size, unsigned char* data);
 
@@ -42,10 +42,15 @@
 #include "usbvc.h"
 #include "uvc_driver.h"
 #include "uvc_control.h"
+#include "uvc_emulation.h"
 #include "uvc_streaming.h"
+#include "uvc_jpeg.h"
+#include "uvc_stats.h"
+#include "uvc_motion.h"
 
 extern int uvc_verbose;
 extern int uvc_emulation;
+extern int uvc_control_async;
 
 typedef struct _control_data
 {
@@ -54,552 +59,577 @@ typedef struct _control_data
     int   selector;
     int   unit;
     int   size;
+    int   subdev;
+    int   mapping;     /* Extension unit mapping, -1 for controls of table */
 } control_data_t;
 
-int uvc_query_control_data(uvc_device_t* dev, uint32_t id, uint32_t subdev, control_data_t* data)
+/* Control is present, if the device or driver has:                 */
+#define UVC_CTRL_PU          1  /* bit of processing unit bmControls */
+#define UVC_CTRL_CT          2  /* bit of input terminal bmControls  */
+#define UVC_CTRL_PU_CLASS    3  /* any processing unit control       */
+#define UVC_CTRL_CT_CLASS    4  /* any input terminal control or     */
+                                /* still image trigger of stream     */
+#define UVC_CTRL_TRIGGER     5  /* still image trigger of stream     */
+#define UVC_CTRL_MJPG        6  /* MJPEG transformations by driver   */
+#define UVC_CTRL_YUV_MJPG    7  /* MJPEG encoder of driver           */
+
+/* All controls known to driver, must be sorted by id. Entries with the same id */
+/* are alternatives, the first one which is present at device is used.         */
+/*   X(id, name, type, unit, selector, size, presence, bmControls byte, bit)    */
+#define UVC_CONTROLS(X) \
+    X(V4L2_CTRL_CLASS_USER+1, "Processing Unit Controls", V4L2_CTRL_TYPE_CTRL_CLASS, 0, 0, 0, UVC_CTRL_PU_CLASS, 0, 0) \
+    X(V4L2_CID_BRIGHTNESS, "Brightness", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_BRIGHTNESS_CONTROL, 2, UVC_CTRL_PU, 0, VPU_B0_BRIGHTNESS) \
+    X(V4L2_CID_CONTRAST, "Contrast", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_CONTRAST_CONTROL, 2, UVC_CTRL_PU, 0, VPU_B0_CONTRAST) \
+    X(V4L2_CID_SATURATION, "Saturation", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_SATURATION_CONTROL, 2, UVC_CTRL_PU, 0, VPU_B0_SATURATION) \
+    X(V4L2_CID_HUE, "Hue", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_HUE_CONTROL, 2, UVC_CTRL_PU, 0, VPU_B0_HUE) \
+    X(V4L2_CID_AUTO_WHITE_BALANCE, "White Balance Temperature, Auto", V4L2_CTRL_TYPE_BOOLEAN, UVC_PUNIT_SELECTOR, VPU_WHITE_BALANCE_TEMPERATURE_AUTO_CONTROL, 1, UVC_CTRL_PU, 1, VPU_B1_WHITE_BALANCE_TEMPERATURE_AUTO) \
+    X(V4L2_CID_AUTO_WHITE_BALANCE, "White Balance Component, Auto", V4L2_CTRL_TYPE_BOOLEAN, UVC_PUNIT_SELECTOR, VPU_WHITE_BALANCE_COMPONENT_AUTO_CONTROL, 1, UVC_CTRL_PU, 1, VPU_B1_WHITE_BALANCE_COMPONENT_AUTO) \
+    X(V4L2_CID_RED_BALANCE, "White Balance Red Component", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_WHITE_BALANCE_COMPONENT_CONTROL, 4, UVC_CTRL_PU, 0, VPU_B0_WHITE_BALANCE_COMPONENT) \
+    X(V4L2_CID_BLUE_BALANCE, "White Balance Blue Component", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_WHITE_BALANCE_COMPONENT_CONTROL, 4, UVC_CTRL_PU, 0, VPU_B0_WHITE_BALANCE_COMPONENT) \
+    X(V4L2_CID_GAMMA, "Gamma", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_GAMMA_CONTROL, 2, UVC_CTRL_PU, 0, VPU_B0_GAMMA) \
+    X(V4L2_CID_GAIN, "Gain", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_GAIN_CONTROL, 2, UVC_CTRL_PU, 1, VPU_B1_GAIN) \
+    X(V4L2_CID_HFLIP, "Horizontal Flip", V4L2_CTRL_TYPE_BOOLEAN, UVC_UNKNOWN_SELECTOR, 0, 1, UVC_CTRL_MJPG, 0, 0) \
+    X(V4L2_CID_VFLIP, "Vertical Flip", V4L2_CTRL_TYPE_BOOLEAN, UVC_UNKNOWN_SELECTOR, 0, 1, UVC_CTRL_MJPG, 0, 0) \
+    X(V4L2_CID_POWER_LINE_FREQUENCY, "Power Line Frequency", V4L2_CTRL_TYPE_MENU, UVC_PUNIT_SELECTOR, VPU_POWER_LINE_FREQUENCY_CONTROL, 1, UVC_CTRL_PU, 1, VPU_B1_POWER_LINE_FREQUENCY) \
+    X(V4L2_CID_HUE_AUTO, "Hue, Auto", V4L2_CTRL_TYPE_BOOLEAN, UVC_PUNIT_SELECTOR, VPU_HUE_AUTO_CONTROL, 1, UVC_CTRL_PU, 1, VPU_B1_HUE_AUTO) \
+    X(V4L2_CID_WHITE_BALANCE_TEMPERATURE, "White Balance Temperature", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_WHITE_BALANCE_TEMPERATURE_CONTROL, 2, UVC_CTRL_PU, 0, VPU_B0_WHITE_BALANCE_TEMPERATURE) \
+    X(V4L2_CID_SHARPNESS, "Sharpness", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_SHARPNESS_CONTROL, 2, UVC_CTRL_PU, 0, VPU_B0_SHARPNESS) \
+    X(V4L2_CID_BACKLIGHT_COMPENSATION, "Backlight Compensation", V4L2_CTRL_TYPE_INTEGER, UVC_PUNIT_SELECTOR, VPU_BACKLIGHT_COMPENSATION_CONTROL, 2, UVC_CTRL_PU, 1, VPU_B1_BACKLIGHT_COMPENSATION) \
+    X(V4L2_CID_ROTATE, "Rotate", V4L2_CTRL_TYPE_INTEGER, UVC_UNKNOWN_SELECTOR, 0, 2, UVC_CTRL_MJPG, 0, 0) \
+    X(V4L2_CTRL_CLASS_CAMERA+1, "Input Terminal Controls", V4L2_CTRL_TYPE_CTRL_CLASS, 0, 0, 0, UVC_CTRL_CT_CLASS, 0, 0) \
+    X(V4L2_CID_EXPOSURE_AUTO, "Exposure, Auto", V4L2_CTRL_TYPE_MENU, UVC_CAMERA_SELECTOR, VCT_AE_MODE_CONTROL, 1, UVC_CTRL_CT, 0, VIT_B0_AUTO_EXPOSURE_MODE) \
+    X(V4L2_CID_EXPOSURE_ABSOLUTE, "Exposure, Absolute", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_EXPOSURE_TIME_ABSOLUTE_CONTROL, 4, UVC_CTRL_CT, 0, VIT_B0_EXPOSURE_TIME_ABSOLUTE) \
+    X(V4L2_CID_EXPOSURE_AUTO_PRIORITY, "Exposure, Auto Priority", V4L2_CTRL_TYPE_BOOLEAN, UVC_CAMERA_SELECTOR, VCT_AE_PRIORITY_CONTROL, 1, UVC_CTRL_CT, 0, VIT_B0_AUTO_EXPOSURE_PRIORITY) \
+    X(V4L2_CID_PAN_ABSOLUTE, "Pan, Absolute", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_PANTILT_ABSOLUTE_CONTROL, 8, UVC_CTRL_CT, 1, VIT_B1_PANTILT_ABSOLUTE) \
+    X(V4L2_CID_TILT_ABSOLUTE, "Tilt, Absolute", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_PANTILT_ABSOLUTE_CONTROL, 8, UVC_CTRL_CT, 1, VIT_B1_PANTILT_ABSOLUTE) \
+    X(V4L2_CID_FOCUS_ABSOLUTE, "Focus, Absolute", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_FOCUS_ABSOLUTE_CONTROL, 2, UVC_CTRL_CT, 0, VIT_B0_FOCUS_ABSOLUTE) \
+    X(V4L2_CID_FOCUS_RELATIVE, "Focus, Relative", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_FOCUS_RELATIVE_CONTROL, 2, UVC_CTRL_CT, 0, VIT_B0_FOCUS_RELATIVE) \
+    X(V4L2_CID_FOCUS_AUTO, "Focus, Auto", V4L2_CTRL_TYPE_BOOLEAN, UVC_CAMERA_SELECTOR, VCT_FOCUS_AUTO_CONTROL, 1, UVC_CTRL_CT, 2, VIT_B2_FOCUS_AUTO) \
+    X(V4L2_CID_ZOOM_ABSOLUTE, "Zoom, Absolute", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_ZOOM_ABSOLUTE_CONTROL, 2, UVC_CTRL_CT, 1, VIT_B1_ZOOM_ABSOLUTE) \
+    X(V4L2_CID_ZOOM_RELATIVE, "Zoom, Relative", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_ZOOM_RELATIVE_CONTROL, 3, UVC_CTRL_CT, 1, VIT_B1_ZOOM_RELATIVE) \
+    X(V4L2_CID_PRIVACY, "Privacy Shutter", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_PRIVACY_CONTROL, 1, UVC_CTRL_CT, 2, VIT_B2_PRIVACY) \
+    X(V4L2_CID_IRIS_ABSOLUTE, "Iris, Absolute", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_IRIS_ABSOLUTE_CONTROL, 2, UVC_CTRL_CT, 0, VIT_B0_IRIS_ABSOLUTE) \
+    X(V4L2_CID_IRIS_RELATIVE, "Iris, Relative", V4L2_CTRL_TYPE_INTEGER, UVC_CAMERA_SELECTOR, VCT_IRIS_RELATIVE_CONTROL, 1, UVC_CTRL_CT, 1, VIT_B1_IRIS_RELATIVE) \
+    X(UVC_CID_EVENT_BUTTON, "Trigger Button", V4L2_CTRL_TYPE_BOOLEAN, 0, 0, 1, UVC_CTRL_TRIGGER, 0, 0) \
+    X(V4L2_CTRL_CLASS_JPEG+1, "JPEG Compression Controls", V4L2_CTRL_TYPE_CTRL_CLASS, 0, 0, 0, UVC_CTRL_YUV_MJPG, 0, 0) \
+    X(V4L2_CID_JPEG_COMPRESSION_QUALITY, "Compression Quality", V4L2_CTRL_TYPE_INTEGER, UVC_UNKNOWN_SELECTOR, 0, 1, UVC_CTRL_YUV_MJPG, 0, 0)
+
+/* These are not supported by V4L2          */
+/*                                          */
+/* VCT_ZOOM_RELATIVE_CONTROL, on/off dig    */
+/*                            zoom          */
+/*                                          */
+/* VPU_B1_DIGITAL_MULTIPLIER (size 2)       */
+/* VPU_B1_DIGITAL_MULTIPLIER_LIMIT (size 2) */
+/* VPU_B2_CONTRAST_AUTO (size 1)            */
+/* VPU_B2_ANALOG_VIDEO_STANDARD (size 1)    */
+/* VPU_B2_ANALOG_VIDEO_LOCK_STATUS (size 1) */
+/* VIT_B0_SCANNING_MODE (size 1)            */
+/* VIT_B0_EXPOSURE_TIME_RELATIVE (size 1)   */
+/* VIT_B1_PANTILT_RELATIVE (size 4) havesup */
+/* VIT_B1_ROLL_ABSOLUTE (size 2)            */
+/* VIT_B1_ROLL_RELATIVE (size 2)            */
+/* VIT_B2_FOCUS_SIMPLE (size 1)             */
+/* VIT_B2_WINDOW (size 12)                  */
+/* VIT_B2_REGION_OF_INTEREST (size 10)      */
+
+typedef struct _control_desc
+{
+    uint32_t id;
+    char*    name;
+    int      type;
+    int      unit;
+    int      selector;
+    int      size;
+    int      presence;
+    int      byte;
+    uint8_t  bit;
+} control_desc_t;
+
+#define UVC_CONTROL_DESC(id, name, type, unit, selector, size, presence, byte, bit) \
+    { id, name, type, unit, selector, size, presence, byte, bit },
+
+static const control_desc_t uvc_controls[]=
+{
+    UVC_CONTROLS(UVC_CONTROL_DESC)
+};
+
+#define UVC_TOTAL_CONTROLS (sizeof(uvc_controls)/sizeof(uvc_controls[0]))
+
+static int uvc_control_present(uvc_device_t* dev, int subdev, const control_desc_t* desc)
 {
-    switch(id & V4L2_CTRL_ID_MASK)
+    switch (desc->presence)
     {
-        case V4L2_CTRL_CLASS_USER+1:
-             {
-                 if ((dev->vc_processing_unit.bmControls[0]==0) &&
-                     (dev->vc_processing_unit.bmControls[1]==0) &&
-                     (dev->vc_processing_unit.bmControls[2]==0))
-                 {
-                     /* If input processing unit capabilities are empty, then return */
-                     /* absence of processing unit controls */
-                     return 0;
-                 }
-                 if (data!=NULL)
-                 {
-                     data->name="Processing Unit Controls";
-                     data->type=V4L2_CTRL_TYPE_CTRL_CLASS;
-                     data->selector=0;
-                     data->unit=0;
-                     data->size=0;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CTRL_CLASS_CAMERA+1:
-             {
-                 if ((dev->vc_iterminal.bmControls[0]==0) &&
-                     (dev->vc_iterminal.bmControls[1]==0) &&
-                     (dev->vc_iterminal.bmControls[2]==0))
-                 {
-                     /* If input terminal capabilities are empty, then return  */
-                     /* absence of camera controls and check for private ctrls */
-                     if (!((dev->vs_input_header[subdev].bTriggerSupport) &&
-                         (dev->vs_input_header[subdev].bTriggerUsage)))
-                     {
-                         return 0;
-                     }
-                 }
-                 if (data!=NULL)
-                 {
-                     data->name="Input Terminal Controls";
-                     data->type=V4L2_CTRL_TYPE_CTRL_CLASS;
-                     data->selector=0;
-                     data->unit=0;
-                     data->size=0;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_BRIGHTNESS:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_BRIGHTNESS)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Brightness";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_BRIGHTNESS_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_CONTRAST:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_CONTRAST)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Contrast";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_CONTRAST_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_SATURATION:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_SATURATION)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Saturation";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_SATURATION_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_HUE:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_HUE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Hue";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_HUE_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_SHARPNESS:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_SHARPNESS)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Sharpness";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_SHARPNESS_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_GAMMA:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_GAMMA)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Gamma";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_GAMMA_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_WHITE_BALANCE_TEMPERATURE:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_WHITE_BALANCE_TEMPERATURE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="White Balance Temperature";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_WHITE_BALANCE_TEMPERATURE_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_BLUE_BALANCE:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_WHITE_BALANCE_COMPONENT)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="White Balance Blue Component";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_WHITE_BALANCE_COMPONENT_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=4;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_RED_BALANCE:
-             if (dev->vc_processing_unit.bmControls[0] & VPU_B0_WHITE_BALANCE_COMPONENT)
+        case UVC_CTRL_PU:
+             return (dev->vc_processing_unit.bmControls[desc->byte] & desc->bit)!=0;
+        case UVC_CTRL_CT:
+             return (dev->vc_iterminal.bmControls[desc->byte] & desc->bit)!=0;
+        case UVC_CTRL_PU_CLASS:
+             /* If input processing unit capabilities are empty, then report */
+             /* absence of processing unit controls                           */
+             return (dev->vc_processing_unit.bmControls[0]!=0) ||
+                    (dev->vc_processing_unit.bmControls[1]!=0) ||
+                    (dev->vc_processing_unit.bmControls[2]!=0);
+        case UVC_CTRL_CT_CLASS:
+             /* Input terminal class holds private trigger control too */
+             if ((dev->vc_iterminal.bmControls[0]!=0) ||
+                 (dev->vc_iterminal.bmControls[1]!=0) ||
+                 (dev->vc_iterminal.bmControls[2]!=0))
              {
-                 if (data!=NULL)
-                 {
-                     data->name="White Balance Red Component";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_WHITE_BALANCE_COMPONENT_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=4;
-                 }
                  return 1;
              }
+             /* Fall through */
+        case UVC_CTRL_TRIGGER:
+             return (dev->vs_input_header[subdev].bTriggerSupport) &&
+                    (dev->vs_input_header[subdev].bTriggerUsage);
+        case UVC_CTRL_MJPG:
+             /* Lossless MJPEG transformations are done by driver */
+             return (uvc_emulation) && (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG));
+        case UVC_CTRL_YUV_MJPG:
+             /* MJPEG encoder of uncompressed frames is a part of driver */
+             return (uvc_emulation) && (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUV_MJPG));
+    }
+
+    return 0;
+}
+
+/* Fills the list of controls present at the stream, it keeps order of ids */
+void uvc_build_controls(uvc_device_t* dev, int subdev)
+{
+    int it;
+
+    dev->total_controls[subdev]=0;
+    for (it=0; it<UVC_TOTAL_CONTROLS; it++)
+    {
+        /* Alternative of already found control */
+        if ((dev->total_controls[subdev]>0) &&
+            (uvc_controls[dev->controls[subdev][dev->total_controls[subdev]-1]].id==uvc_controls[it].id))
+        {
+            continue;
+        }
+        if (uvc_control_present(dev, subdev, &uvc_controls[it]))
+        {
+            if (dev->total_controls[subdev]==UVC_MAX_CONTROLS)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Too many controls, please report");
+                break;
+            }
+            dev->controls[subdev][dev->total_controls[subdev]]=it;
+            dev->total_controls[subdev]++;
+        }
+    }
+}
+
+/* Position of the first control of the stream with id not less than given */
+static int uvc_control_lower_bound(uvc_device_t* dev, uint32_t subdev, uint32_t id)
+{
+    int left=0;
+    int right=dev->total_controls[subdev];
+    int middle;
+
+    while (left<right)
+    {
+        middle=(left+right)/2;
+        if (uvc_controls[dev->controls[subdev][middle]].id<id)
+        {
+            left=middle+1;
+        }
+        else
+        {
+            right=middle;
+        }
+    }
+
+    return left;
+}
+
+/* Index of extension unit mapping of control id, or -1 */
+static int uvc_mapping_find(uvc_device_t* dev, uint32_t id)
+{
+    int it;
+
+    for (it=0; it<dev->total_mappings; it++)
+    {
+        if (dev->mapping[it].id==id)
+        {
+            return it;
+        }
+    }
+
+    return -1;
+}
+
+/* Returns id of the control which follows given id, or 0 if there are no more */
+uint32_t uvc_next_control(uvc_device_t* dev, uint32_t subdev, uint32_t id)
+{
+    uint32_t newid=0;
+    int pos;
+    int it;
+
+    id&=V4L2_CTRL_ID_MASK;
+    pos=uvc_control_lower_bound(dev, subdev, id+1);
+    if (pos!=dev->total_controls[subdev])
+    {
+        newid=uvc_controls[dev->controls[subdev][pos]].id;
+    }
+
+    /* Mapped controls are not sorted, there are only a few of them */
+    for (it=0; it<dev->total_mappings; it++)
+    {
+        if ((dev->mapping[it].id>id) && ((newid==0) || (dev->mapping[it].id<newid)))
+        {
+            newid=dev->mapping[it].id;
+        }
+    }
+
+    return newid;
+}
+
+int uvc_query_control_data(uvc_device_t* dev, uint32_t id, uint32_t subdev, control_data_t* data)
+{
+    const control_desc_t* desc;
+    int pos;
+
+    if (data!=NULL)
+    {
+        data->subdev=subdev;
+    }
+
+    pos=uvc_control_lower_bound(dev, subdev, id & V4L2_CTRL_ID_MASK);
+    if ((pos==dev->total_controls[subdev]) || (uvc_controls[dev->controls[subdev][pos]].id!=(id & V4L2_CTRL_ID_MASK)))
+    {
+        /* Extension unit controls, mapped by application */
+        pos=uvc_mapping_find(dev, id & V4L2_CTRL_ID_MASK);
+        if (pos<0)
+        {
+            return 0;
+        }
+        if (data!=NULL)
+        {
+            data->name=dev->mapping[pos].name;
+            data->type=dev->mapping[pos].v4l2_type;
+            data->selector=dev->mapping[pos].selector;
+            data->unit=UVC_XUNIT_SELECTOR(dev->mapping[pos].unit_id);
+            data->size=dev->mapping[pos].length;
+            data->mapping=pos;
+        }
+        return 1;
+    }
+    desc=&uvc_controls[dev->controls[subdev][pos]];
+
+    if (data!=NULL)
+    {
+        data->name=desc->name;
+        data->type=desc->type;
+        data->selector=desc->selector;
+        data->unit=desc->unit;
+        data->size=desc->size;
+        data->mapping=-1;
+    }
+
+    return 1;
+}
+
+/* Extracts value of mapped control from its bit field in control payload */
+static int32_t uvc_mapping_get(uvc_control_mapping_t* mapping, uint8_t* payload)
+{
+    uint32_t value=0;
+    int bit;
+    int it;
+
+    for (it=0; it<mapping->size; it++)
+    {
+        bit=mapping->offset+it;
+        if (payload[bit/8] & (1<<(bit%8)))
+        {
+            value|=1U<<it;
+        }
+    }
+
+    /* Sign extension */
+    if ((mapping->data_type==UVC_CTRL_DATA_TYPE_SIGNED) && (mapping->size<32) &&
+        (value & (1U<<(mapping->size-1))))
+    {
+        value|=~((1U<<mapping->size)-1);
+    }
+
+    return (int32_t)value;
+}
+
+/* Puts value of mapped control to its bit field, bits are marked in mask */
+static void uvc_mapping_set(uvc_control_mapping_t* mapping, uint8_t* payload, uint8_t* mask, int32_t value)
+{
+    int bit;
+    int it;
+
+    for (it=0; it<mapping->size; it++)
+    {
+        bit=mapping->offset+it;
+        if (((uint32_t)value) & (1U<<it))
+        {
+            payload[bit/8]|=1<<(bit%8);
+        }
+        else
+        {
+            payload[bit/8]&=~(1<<(bit%8));
+        }
+        mask[bit/8]|=1<<(bit%8);
+    }
+}
+
+/* Reads value, limit or default of mapped control, menu values are */
+/* converted to menu indexes.                                        */
+static int uvc_mapping_read(uvc_device_t* dev, control_data_t* data, int operation, int32_t* value)
+{
+    uvc_control_mapping_t* mapping=&dev->mapping[data->mapping];
+    uint8_t payload[UVC_MAX_CACHED_CONTROL_SIZE];
+    int it;
+
+    if (uvc_control_get(dev, operation, data->unit, data->selector, data->size, payload))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+        }
+        return EIO;
+    }
+
+    *value=uvc_mapping_get(mapping, payload);
+    switch (mapping->v4l2_type)
+    {
+        case V4L2_CTRL_TYPE_BOOLEAN:
+             *value=(*value!=0) ? 1 : 0;
              break;
-        case V4L2_CID_BACKLIGHT_COMPENSATION:
-             if (dev->vc_processing_unit.bmControls[1] & VPU_B1_BACKLIGHT_COMPENSATION)
+        case V4L2_CTRL_TYPE_MENU:
+             for (it=0; it<mapping->menu_count; it++)
              {
-                 if (data!=NULL)
+                 if (mapping->menu[it].value==(uint32_t)*value)
                  {
-                     data->name="Backlight Compensation";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_BACKLIGHT_COMPENSATION_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
+                     break;
                  }
-                 return 1;
              }
+             *value=(it<mapping->menu_count) ? it : 0;
              break;
-        case V4L2_CID_GAIN:
-             if (dev->vc_processing_unit.bmControls[1] & VPU_B1_GAIN)
+    }
+
+    return EOK;
+}
+
+int uvc_read_ctrl(uvc_device_t* dev, struct v4l2_control* ctrl, control_data_t* data)
+{
+    unsigned char value[16];
+    int status=0;
+    int ret=EOK;
+
+    if (data->mapping>=0)
+    {
+        return uvc_mapping_read(dev, data, VGET_CUR, &ctrl->value);
+    }
+
+    switch (data->type)
+    {
+        case V4L2_CTRL_TYPE_INTEGER:
+             switch (ctrl->id)
              {
-                 if (data!=NULL)
-                 {
-                     data->name="Gain";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VPU_GAIN_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
+                 case V4L2_CID_BLUE_BALANCE:
+                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
+                      ctrl->value=uvc_get_sinteger(2, &value[0]);
+                      break;
+                 case V4L2_CID_RED_BALANCE:
+                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
+                      ctrl->value=uvc_get_sinteger(2, &value[2]);
+                      break;
+                 case V4L2_CID_ROTATE:
+                      ctrl->value=dev->current_rotate[data->subdev];
+                      break;
+                 case V4L2_CID_JPEG_COMPRESSION_QUALITY:
+                      ctrl->value=dev->current_quality[data->subdev];
+                      break;
+                 default:
+                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
+                      ctrl->value=uvc_get_sinteger(data->size, &value[0]);
+                      break;
              }
              break;
-        case V4L2_CID_POWER_LINE_FREQUENCY:
-             if (dev->vc_processing_unit.bmControls[1] & VPU_B1_POWER_LINE_FREQUENCY)
+        case V4L2_CTRL_TYPE_MENU:
+             switch (ctrl->id)
              {
-                 if (data!=NULL)
-                 {
-                     data->name="Power Line Frequency";
-                     data->type=V4L2_CTRL_TYPE_MENU;
-                     data->selector=VPU_POWER_LINE_FREQUENCY_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
+                 case V4L2_CID_POWER_LINE_FREQUENCY:
+                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
+                      ctrl->value=uvc_get_sinteger(data->size, &value[0]);
+                      break;
              }
              break;
-        case V4L2_CID_HUE_AUTO:
-             if (dev->vc_processing_unit.bmControls[1] & VPU_B1_HUE_AUTO)
+        case V4L2_CTRL_TYPE_CTRL_CLASS:
+             if (uvc_verbose>2)
              {
-                 if (data!=NULL)
-                 {
-                     data->name="Hue, Auto";
-                     data->type=V4L2_CTRL_TYPE_BOOLEAN;
-                     data->selector=VPU_HUE_AUTO_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
+                 slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EACCES: control can't be retrieved");
              }
+             ret=EACCES;
              break;
-        case V4L2_CID_AUTO_WHITE_BALANCE:
-             if (dev->vc_processing_unit.bmControls[1] & VPU_B1_WHITE_BALANCE_TEMPERATURE_AUTO)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="White Balance Temperature, Auto";
-                     data->type=V4L2_CTRL_TYPE_BOOLEAN;
-                     data->selector=VPU_WHITE_BALANCE_TEMPERATURE_AUTO_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
-             }
-             if (dev->vc_processing_unit.bmControls[1] & VPU_B1_WHITE_BALANCE_COMPONENT_AUTO)
+        case V4L2_CTRL_TYPE_BOOLEAN:
+             switch (ctrl->id)
              {
-                 if (data!=NULL)
-                 {
-                     data->name="White Balance Component, Auto";
-                     data->type=V4L2_CTRL_TYPE_BOOLEAN;
-                     data->selector=VPU_WHITE_BALANCE_COMPONENT_AUTO_CONTROL;
-                     data->unit=UVC_PUNIT_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_EXPOSURE_AUTO:
-             if (dev->vc_iterminal.bmControls[0] & VIT_B0_AUTO_EXPOSURE_MODE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Exposure, Auto";
-                     data->type=V4L2_CTRL_TYPE_MENU;
-                     data->selector=VCT_AE_MODE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_EXPOSURE_AUTO_PRIORITY:
-             if (dev->vc_iterminal.bmControls[0] & VIT_B0_AUTO_EXPOSURE_PRIORITY)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Exposure, Auto Priority";
-                     data->type=V4L2_CTRL_TYPE_BOOLEAN;
-                     data->selector=VCT_AE_PRIORITY_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_EXPOSURE_ABSOLUTE:
-             if (dev->vc_iterminal.bmControls[0] & VIT_B0_EXPOSURE_TIME_ABSOLUTE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Exposure, Absolute";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_EXPOSURE_TIME_ABSOLUTE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=4;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_FOCUS_ABSOLUTE:
-             if (dev->vc_iterminal.bmControls[0] & VIT_B0_FOCUS_ABSOLUTE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Focus, Absolute";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_FOCUS_ABSOLUTE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_FOCUS_RELATIVE:
-             if (dev->vc_iterminal.bmControls[0] & VIT_B0_FOCUS_RELATIVE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Focus, Relative";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_FOCUS_RELATIVE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_IRIS_ABSOLUTE:
-             if (dev->vc_iterminal.bmControls[0] & VIT_B0_IRIS_ABSOLUTE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Iris, Absolute";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_IRIS_ABSOLUTE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_IRIS_RELATIVE:
-             if (dev->vc_iterminal.bmControls[1] & VIT_B1_IRIS_RELATIVE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Iris, Relative";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_IRIS_RELATIVE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_ZOOM_ABSOLUTE:
-             if (dev->vc_iterminal.bmControls[1] & VIT_B1_ZOOM_ABSOLUTE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Zoom, Absolute";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_ZOOM_ABSOLUTE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=2;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_ZOOM_RELATIVE:
-             if (dev->vc_iterminal.bmControls[1] & VIT_B1_ZOOM_RELATIVE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Zoom, Relative";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_ZOOM_RELATIVE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=3;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_PAN_ABSOLUTE:
-             if (dev->vc_iterminal.bmControls[1] & VIT_B1_PANTILT_ABSOLUTE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Pan, Absolute";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_PANTILT_ABSOLUTE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=8;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_TILT_ABSOLUTE:
-             if (dev->vc_iterminal.bmControls[1] & VIT_B1_PANTILT_ABSOLUTE)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Tilt, Absolute";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_PANTILT_ABSOLUTE_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=8;
-                 }
-                 return 1;
-             }
-             break;
-        case V4L2_CID_PRIVACY:
-             if (dev->vc_iterminal.bmControls[2] & VIT_B2_PRIVACY)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Privacy Shutter";
-                     data->type=V4L2_CTRL_TYPE_INTEGER;
-                     data->selector=VCT_PRIVACY_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
-             }
-        case V4L2_CID_FOCUS_AUTO:
-             if (dev->vc_iterminal.bmControls[2] & VIT_B2_FOCUS_AUTO)
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Focus, Auto";
-                     data->type=V4L2_CTRL_TYPE_BOOLEAN;
-                     data->selector=VCT_FOCUS_AUTO_CONTROL;
-                     data->unit=UVC_CAMERA_SELECTOR;
-                     data->size=1;
-                 }
-                 return 1;
-             }
-             break;
-        case UVC_CID_EVENT_BUTTON:
-             if ((dev->vs_input_header[subdev].bTriggerSupport) &&
-                 (dev->vs_input_header[subdev].bTriggerUsage))
-             {
-                 if (data!=NULL)
-                 {
-                     data->name="Trigger Button";
-                     data->type=V4L2_CTRL_TYPE_BOOLEAN;
-                     data->selector=0;
-                     data->unit=0;
-                     data->size=1;
-                 }
-                 return 1;
+                 case V4L2_CID_HFLIP:
+                      ctrl->value=dev->current_hflip[data->subdev];
+                      break;
+                 case V4L2_CID_VFLIP:
+                      ctrl->value=dev->current_vflip[data->subdev];
+                      break;
+                 default:
+                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
+                      ctrl->value=uvc_get_sinteger(data->size, &value[0]);
+                      if (ctrl->value)
+                      {
+                          ctrl->value=1;
+                      }
+                      break;
              }
              break;
+    }
+
+    if ((ret==EOK) && (status))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+        }
+        ret=EIO;
+    }
+
+    return ret;
+}
+
+/* Emits control change event to file descriptors which are listening for it */
+static int uvc_ctrl_event(uvc_device_t* dev, uint32_t id, int type, int32_t value, uvc_ocb_t* ocb)
+{
+    int it;
+
+    for(it=0; it<UVC_MAX_OPEN_FDS; it++)
+    {
+        if (((dev->event[it].ocb==ocb) && ((dev->event[it].flags[V4L2_EVENT_CTRL] & V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK)==V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK)) ||
+            (dev->event[it].ocb!=NULL))
+        {
+            /* Check file descriptor listening for ctrl event */
+            if (dev->event[it].type[V4L2_EVENT_CTRL])
+            {
+                /* Check if file descriptor listening for required control id */
+                if ((dev->event[it].type[V4L2_EVENT_CTRL]==0) || (dev->event[it].type[V4L2_EVENT_CTRL]==id))
+                {
+                    struct _uvc_event_entry* entry;
+
+                    entry=calloc(1, sizeof(*entry));
+                    if (entry==NULL)
+                    {
+                        return ENOMEM;
+                    }
+
+                    /* Emit control change event */
+                    entry->event.type=V4L2_EVENT_CTRL;
+                    entry->event.pending=0;
+                    entry->event.sequence=dev->event[it].sequence;
+                    entry->event.id=id;
+                    clock_gettime(CLOCK_MONOTONIC, &entry->event.timestamp);
+                    memset(entry->event.reserved, 0x00, sizeof(entry->event.reserved));
+                    entry->event.u.ctrl.changes=V4L2_EVENT_CTRL_CH_VALUE;
+                    entry->event.u.ctrl.type=type;
+                    entry->event.u.ctrl.flags=0;
+                    entry->event.u.ctrl.value=value;
+                    pthread_mutex_lock(&dev->event[it].access);
+                    dev->event[it].sequence++;
+                    TAILQ_INSERT_TAIL(&dev->event[it].head, entry, link);
+                    pthread_mutex_unlock(&dev->event[it].access);
+
+                    /* Notify callers of select() if any */
+                    iofunc_notify_trigger(dev->event[it].ocb->notify, 1, IOFUNC_NOTIFY_OBAND);
+                }
+            }
+        }
+    }
 
-        /* These are not supported by V4L2          */
-        /*                                          */
-        /* VCT_ZOOM_RELATIVE_CONTROL, on/off dig    */
-        /*                            zoom          */
-        /*                                          */
-        /* VPU_B1_DIGITAL_MULTIPLIER (size 2)       */
-        /* VPU_B1_DIGITAL_MULTIPLIER_LIMIT (size 2) */
-        /* VPU_B2_CONTRAST_AUTO (size 1)            */
-        /* VPU_B2_ANALOG_VIDEO_STANDARD (size 1)    */
-        /* VPU_B2_ANALOG_VIDEO_LOCK_STATUS (size 1) */
-        /* VIT_B0_SCANNING_MODE (size 1)            */
-        /* VIT_B0_EXPOSURE_TIME_RELATIVE (size 1)   */
-        /* VIT_B1_PANTILT_RELATIVE (size 4) havesup */
-        /* VIT_B1_ROLL_ABSOLUTE (size 2)            */
-        /* VIT_B1_ROLL_RELATIVE (size 2)            */
-        /* VIT_B2_FOCUS_SIMPLE (size 1)             */
-        /* VIT_B2_WINDOW (size 12)                  */
-        /* VIT_B2_REGION_OF_INTEREST (size 10)      */
+    return EOK;
+}
+
+/* Flip and rotation are done by driver only for MJPEG frames, which are passed */
+/* through, they are inactive while the stream has another format.              */
+static int uvc_ctrl_inactive(uvc_device_t* dev, int subdev, uint32_t id)
+{
+    switch (id)
+    {
+        case V4L2_CID_HFLIP:
+        case V4L2_CID_VFLIP:
+        case V4L2_CID_ROTATE:
+             return (!uvc_emulation) || (dev->current_pixelformat[subdev]!=V4L2_PIX_FMT_MJPEG) ||
+                    (dev->current_source_format[subdev]!=UVC_FORMAT_MJPG);
     }
 
     return 0;
 }
 
-int uvc_read_ctrl(uvc_device_t* dev, struct v4l2_control* ctrl, control_data_t* data)
+/* Size of the frame after MJPEG rotation, crop rectangle is given in its */
+/* coordinates, because transupp crops the rotated frame.                 */
+static void uvc_crop_bounds(uvc_device_t* dev, int subdev, int* width, int* height)
 {
-    unsigned char value[16];
-    int status=0;
-    int ret=EOK;
+    if (dev->current_rotate[subdev]%180==90)
+    {
+        *width=dev->current_height[subdev];
+        *height=dev->current_width[subdev];
+    }
+    else
+    {
+        *width=dev->current_width[subdev];
+        *height=dev->current_height[subdev];
+    }
+}
 
-    switch (data->type)
+/* Clamps requested crop rectangle to the rotated frame and stores it. Offsets */
+/* are aligned to the largest MCU size (4:2:0 sampling), since transformation */
+/* can't start in the middle of MCU. Cropping is off for the whole frame.     */
+static void uvc_adjust_crop(uvc_device_t* dev, int subdev, struct v4l2_rect* request)
+{
+    struct v4l2_rect* rect=&dev->current_crop[subdev];
+    int width;
+    int height;
+
+    uvc_crop_bounds(dev, subdev, &width, &height);
+
+    rect->left=request->left;
+    rect->top=request->top;
+    if (rect->left<0)
     {
-        case V4L2_CTRL_TYPE_INTEGER:
-             switch (ctrl->id)
-             {
-                 case V4L2_CID_BLUE_BALANCE:
-                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
-                      ctrl->value=uvc_get_sinteger(2, &value[0]);
-                      break;
-                 case V4L2_CID_RED_BALANCE:
-                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
-                      ctrl->value=uvc_get_sinteger(2, &value[2]);
-                      break;
-                 default:
-                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
-                      ctrl->value=uvc_get_sinteger(data->size, &value[0]);
-                      break;
-             }
-             break;
-        case V4L2_CTRL_TYPE_MENU:
-             switch (ctrl->id)
-             {
-                 case V4L2_CID_POWER_LINE_FREQUENCY:
-                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
-                      ctrl->value=uvc_get_sinteger(data->size, &value[0]);
-                      break;
-             }
-             break;
-        case V4L2_CTRL_TYPE_CTRL_CLASS:
-             if (uvc_verbose>2)
-             {
-                 slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EACCES: control can't be retrieved");
-             }
-             ret=EACCES;
-             break;
-        case V4L2_CTRL_TYPE_BOOLEAN:
-             switch (ctrl->id)
-             {
-                 default:
-                      status|=uvc_control_get(dev, VGET_CUR, data->unit, data->selector, data->size, &value[0]);
-                      ctrl->value=uvc_get_sinteger(data->size, &value[0]);
-                      if (ctrl->value)
-                      {
-                          ctrl->value=1;
-                      }
-                      break;
-             }
-             break;
+        rect->left=0;
+    }
+    if (rect->top<0)
+    {
+        rect->top=0;
+    }
+    if (rect->left>width-1)
+    {
+        rect->left=width-1;
+    }
+    if (rect->top>height-1)
+    {
+        rect->top=height-1;
     }
+    rect->left&=~(UVC_JPEG_MCU_SIZE-1);
+    rect->top&=~(UVC_JPEG_MCU_SIZE-1);
 
-    if ((ret==EOK) && (status))
+    rect->width=request->width;
+    rect->height=request->height;
+    if (rect->width>width-rect->left)
     {
-        if (uvc_verbose>2)
-        {
-            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
-        }
-        ret=EIO;
+        rect->width=width-rect->left;
+    }
+    if (rect->height>height-rect->top)
+    {
+        rect->height=height-rect->top;
     }
 
-    return ret;
+    if ((rect->left==0) && (rect->top==0) &&
+        (rect->width==width) && (rect->height==height))
+    {
+        rect->width=0;
+    }
 }
 
 int uvc_write_ctrl(uvc_device_t* dev, struct v4l2_control* ctrl, control_data_t* data, uvc_ocb_t* ocb)
@@ -613,7 +643,15 @@ int uvc_write_ctrl(uvc_device_t* dev, struct v4l2_control* ctrl, control_data_t*
     int64_t res_value;
     int ret=EOK;
     int status=0;
-    int it;
+
+    if (uvc_ctrl_inactive(dev, data->subdev, ctrl->id))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EBUSY: control doesn't apply to current format");
+        }
+        return EBUSY;
+    }
 
     switch (data->type)
     {
@@ -680,6 +718,38 @@ int uvc_write_ctrl(uvc_device_t* dev, struct v4l2_control* ctrl, control_data_t*
                           break;
                       }
                       break;
+                 case V4L2_CID_ROTATE:
+                      if ((ctrl->value<0) || (ctrl->value>270) || (ctrl->value%90!=0))
+                      {
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
+                          }
+                          ret=ERANGE;
+                          break;
+                      }
+                      dev->current_rotate[data->subdev]=ctrl->value;
+                      /* Crop rectangle must fit the frame of the new orientation */
+                      if (dev->current_crop[data->subdev].width)
+                      {
+                          struct v4l2_rect request=dev->current_crop[data->subdev];
+
+                          uvc_adjust_crop(dev, data->subdev, &request);
+                      }
+                      break;
+                 case V4L2_CID_JPEG_COMPRESSION_QUALITY:
+                      /* Encoder picks up new quality with the next frame */
+                      if ((ctrl->value<1) || (ctrl->value>100))
+                      {
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
+                          }
+                          ret=ERANGE;
+                          break;
+                      }
+                      dev->current_quality[data->subdev]=ctrl->value;
+                      break;
                  default:
                       status|=uvc_control_get(dev, VGET_MIN, data->unit, data->selector, data->size, &value1[0]);
                       status|=uvc_control_get(dev, VGET_MAX, data->unit, data->selector, data->size, &value2[0]);
@@ -746,18 +816,24 @@ int uvc_write_ctrl(uvc_device_t* dev, struct v4l2_control* ctrl, control_data_t*
              ret=EACCES;
              break;
         case V4L2_CTRL_TYPE_BOOLEAN:
+             if ((ctrl->value!=1) && (ctrl->value!=0))
+             {
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
+                 }
+                 ret=ERANGE;
+                 break;
+             }
              switch (ctrl->id)
              {
+                 case V4L2_CID_HFLIP:
+                      dev->current_hflip[data->subdev]=ctrl->value;
+                      break;
+                 case V4L2_CID_VFLIP:
+                      dev->current_vflip[data->subdev]=ctrl->value;
+                      break;
                  default:
-                      if ((ctrl->value!=1) && (ctrl->value!=0))
-                      {
-                          if (uvc_verbose>2)
-                          {
-                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
-                          }
-                          ret=ERANGE;
-                          break;
-                      }
                       uvc_set_sinteger(data->size, &value[0], ctrl->value);
                       status=uvc_control_set(dev, VSET_CUR, data->unit, data->selector, data->size, &value[0]);
                       if (status)
@@ -775,48 +851,7 @@ int uvc_write_ctrl(uvc_device_t* dev, struct v4l2_control* ctrl, control_data_t*
 
     if (ret==EOK)
     {
-        for(it=0; it<UVC_MAX_OPEN_FDS; it++)
-        {
-            if (((dev->event[it].ocb==ocb) && ((dev->event[it].flags[V4L2_EVENT_CTRL] & V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK)==V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK)) ||
-                (dev->event[it].ocb!=NULL))
-            {
-                /* Check file descriptor listening for ctrl event */
-                if (dev->event[it].type[V4L2_EVENT_CTRL])
-                {
-                    /* Check if file descriptor listening for required control id */
-                    if ((dev->event[it].type[V4L2_EVENT_CTRL]==0) || (dev->event[it].type[V4L2_EVENT_CTRL]==ctrl->id))
-                    {
-                        struct _uvc_event_entry* entry;
-
-                        entry=calloc(1, sizeof(*entry));
-                        if (entry==NULL)
-                        {
-                            ret=ENOMEM;
-                            break;
-                        }
-
-                        /* Emit control change event */
-                        entry->event.type=V4L2_EVENT_CTRL;
-                        entry->event.pending=0;
-                        entry->event.sequence=dev->event[it].sequence;
-                        entry->event.id=ctrl->id;
-                        clock_gettime(CLOCK_MONOTONIC, &entry->event.timestamp);
-                        memset(entry->event.reserved, 0x00, sizeof(entry->event.reserved));
-                        entry->event.u.ctrl.changes=V4L2_EVENT_CTRL_CH_VALUE;
-                        entry->event.u.ctrl.type=data->type;
-                        entry->event.u.ctrl.flags=0;
-                        entry->event.u.ctrl.value=ctrl->value;
-                        pthread_mutex_lock(&dev->event[it].access);
-                        dev->event[it].sequence++;
-                        TAILQ_INSERT_TAIL(&dev->event[it].head, entry, link);
-                        pthread_mutex_unlock(&dev->event[it].access);
-
-                        /* Notify callers of select() if any */
-                        iofunc_notify_trigger(dev->event[it].ocb->notify, 1, IOFUNC_NOTIFY_OBAND);
-                    }
-                }
-            }
-        }
+        ret=uvc_ctrl_event(dev, ctrl->id, data->type, ctrl->value, ocb);
     }
 
     return ret;
@@ -828,6 +863,11 @@ int uvc_read_ext_ctrl(uvc_device_t* dev, struct v4l2_ext_control* ctrl, control_
     int status=0;
     int ret=EOK;
 
+    if (data->mapping>=0)
+    {
+        return uvc_mapping_read(dev, data, VGET_CUR, &ctrl->value);
+    }
+
     switch (data->type)
     {
         case V4L2_CTRL_TYPE_CTRL_CLASS:
@@ -924,7 +964,6 @@ int uvc_write_ext_ctrl(uvc_device_t* dev, struct v4l2_ext_control* ctrl, control
     int64_t res_value;
     int ret=EOK;
     int status=0;
-    int it;
 
     switch (data->type)
     {
@@ -1119,137 +1158,995 @@ int uvc_write_ext_ctrl(uvc_device_t* dev, struct v4l2_ext_control* ctrl, control
                       break;
              }
              break;
-        case V4L2_CTRL_TYPE_MENU:
-             switch (ctrl->id)
+        case V4L2_CTRL_TYPE_MENU:
+             switch (ctrl->id)
+             {
+                 case V4L2_CID_POWER_LINE_FREQUENCY:
+                      if ((ctrl->value<0) || (ctrl->value>2))
+                      {
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
+                          }
+                          ret=ERANGE;
+                          break;
+                      }
+                      uvc_set_sinteger(data->size, &value[0], ctrl->value);
+                      status|=uvc_control_set(dev, VSET_CUR, data->unit, data->selector, data->size, &value[0]);
+                      if (status)
+                      {
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+                          }
+                          ret=EIO;
+                          break;
+                      }
+                      break;
+                 case V4L2_CID_EXPOSURE_AUTO:
+                      if ((ctrl->value<0) || (ctrl->value>3))
+                      {
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
+                          }
+                          ret=ERANGE;
+                          break;
+                      }
+                      uvc_set_sinteger(data->size, &value[0], (1<<ctrl->value));
+                      status=uvc_control_set(dev, VSET_CUR, data->unit, data->selector, data->size, &value[0]);
+                      if (status)
+                      {
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+                          }
+                          ret=EIO;
+                          break;
+                      }
+                      break;
+             }
+             break;
+        case V4L2_CTRL_TYPE_BOOLEAN:
+             switch (ctrl->id)
+             {
+                 case UVC_CID_EVENT_BUTTON:
+                      if (uvc_verbose>2)
+                      {
+                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EACCES: control can't be set");
+                      }
+                      ret=EACCES;
+                      break;
+                 default:
+                      if ((ctrl->value!=1) && (ctrl->value!=0))
+                      {
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
+                          }
+                          ret=ERANGE;
+                          break;
+                      }
+                      uvc_set_sinteger(data->size, &value[0], ctrl->value);
+                      status=uvc_control_set(dev, VSET_CUR, data->unit, data->selector, data->size, &value[0]);
+                      if (status)
+                      {
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+                          }
+                          ret=EIO;
+                      }
+                      break;
+             }
+             break;
+    }
+
+    if (ret==EOK)
+    {
+        ret=uvc_ctrl_event(dev, ctrl->id, data->type, ctrl->value, ocb);
+    }
+
+    return ret;
+}
+
+/* Reads limits of control component at given offset of the selector payload */
+static int uvc_ctrl_limits(uvc_device_t* dev, control_data_t* data, int offset, int width, int64_t* min_value, int64_t* max_value, int64_t* res_value)
+{
+    unsigned char value1[16];
+    unsigned char value2[16];
+    unsigned char value3[16];
+    int status=0;
+
+    status|=uvc_control_get(dev, VGET_MIN, data->unit, data->selector, data->size, &value1[0]);
+    status|=uvc_control_get(dev, VGET_MAX, data->unit, data->selector, data->size, &value2[0]);
+    status|=uvc_control_get(dev, VGET_RES, data->unit, data->selector, data->size, &value3[0]);
+    *min_value=uvc_get_sinteger(width, &value1[offset]);
+    *max_value=uvc_get_sinteger(width, &value2[offset]);
+    *res_value=uvc_get_sinteger(width, &value3[offset]);
+
+    return status;
+}
+
+/* Checks value of mapped extension unit control and puts it to its bit field */
+static int uvc_mapping_encode(uvc_device_t* dev, struct v4l2_ext_control* ctrl, control_data_t* data, uint8_t* payload, uint8_t* mask)
+{
+    uvc_control_mapping_t* mapping=&dev->mapping[data->mapping];
+    int32_t min_value=0;
+    int32_t max_value=1;
+    int32_t res_value=1;
+    int32_t value=ctrl->value;
+    uint8_t info=0;
+    int ret=EOK;
+
+    if ((uvc_control_get(dev, VGET_INFO, data->unit, data->selector, 1, &info)==0) &&
+        ((info & UVC_CONTROL_INFO_SET)==0))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EACCES: control can't be set");
+        }
+        return EACCES;
+    }
+
+    switch (mapping->v4l2_type)
+    {
+        case V4L2_CTRL_TYPE_INTEGER:
+             ret|=uvc_mapping_read(dev, data, VGET_MIN, &min_value);
+             ret|=uvc_mapping_read(dev, data, VGET_MAX, &max_value);
+             ret|=uvc_mapping_read(dev, data, VGET_RES, &res_value);
+             break;
+        case V4L2_CTRL_TYPE_MENU:
+             max_value=mapping->menu_count-1;
+             break;
+    }
+    if (ret!=EOK)
+    {
+        return EIO;
+    }
+
+    if ((ctrl->value<min_value) || (ctrl->value>max_value) ||
+        ((res_value>1) && (ctrl->value%res_value!=0)))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
+        }
+        return ERANGE;
+    }
+
+    if (mapping->v4l2_type==V4L2_CTRL_TYPE_MENU)
+    {
+        value=mapping->menu[ctrl->value].value;
+    }
+    uvc_mapping_set(mapping, payload, mask, value);
+
+    return EOK;
+}
+
+/* Checks value of unit control and converts it to the part of selector payload, */
+/* bits being set are marked in mask. Controls of driver itself are checked      */
+/* only, their mask is left empty.                                               */
+static int uvc_ctrl_encode(uvc_device_t* dev, struct v4l2_ext_control* ctrl, control_data_t* data, uint8_t* payload, uint8_t* mask)
+{
+    int64_t min_value;
+    int64_t max_value;
+    int64_t res_value;
+    int64_t value=ctrl->value;
+    int status=0;
+    int sign;
+    int offset=0;
+    int width=data->size;
+
+    if ((data->type==V4L2_CTRL_TYPE_CTRL_CLASS) || (ctrl->id==UVC_CID_EVENT_BUTTON))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EACCES: control can't be set");
+        }
+        return EACCES;
+    }
+
+    if (uvc_ctrl_inactive(dev, data->subdev, ctrl->id))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EBUSY: control doesn't apply to current format");
+        }
+        return EBUSY;
+    }
+
+    if (data->mapping>=0)
+    {
+        return uvc_mapping_encode(dev, ctrl, data, payload, mask);
+    }
+
+    switch (ctrl->id)
+    {
+        case V4L2_CID_FOCUS_RELATIVE:
+        case V4L2_CID_ZOOM_RELATIVE:
+             /* Speed is given in the last byte, direction in the first one */
+             status|=uvc_ctrl_limits(dev, data, data->size-1, 1, &min_value, &max_value, &res_value);
+             if (ctrl->id==V4L2_CID_FOCUS_RELATIVE)
+             {
+                 /* Focus speed is unsigned */
+                 max_value&=0xFF;
+                 res_value&=0xFF;
+             }
+             min_value=-max_value;
+             sign=(ctrl->value<0) ? 0xFF : ((ctrl->value>0) ? 0x01 : 0x00);
+             value=((int64_t)abs(ctrl->value)<<((data->size-1)*8)) | sign;
+             break;
+        case V4L2_CID_PAN_ABSOLUTE:
+        case V4L2_CID_BLUE_BALANCE:
+             width=data->size/2;
+             status|=uvc_ctrl_limits(dev, data, offset, width, &min_value, &max_value, &res_value);
+             break;
+        case V4L2_CID_TILT_ABSOLUTE:
+        case V4L2_CID_RED_BALANCE:
+             width=data->size/2;
+             offset=data->size/2;
+             status|=uvc_ctrl_limits(dev, data, offset, width, &min_value, &max_value, &res_value);
+             break;
+        case V4L2_CID_POWER_LINE_FREQUENCY:
+             min_value=0;
+             max_value=2;
+             res_value=1;
+             break;
+        case V4L2_CID_EXPOSURE_AUTO:
+             min_value=0;
+             max_value=3;
+             res_value=1;
+             value=1<<ctrl->value;
+             break;
+        case V4L2_CID_ROTATE:
+             min_value=0;
+             max_value=270;
+             res_value=90;
+             width=0;
+             break;
+        case V4L2_CID_JPEG_COMPRESSION_QUALITY:
+             min_value=1;
+             max_value=100;
+             res_value=1;
+             width=0;
+             break;
+        default:
+             if (data->type==V4L2_CTRL_TYPE_BOOLEAN)
+             {
+                 min_value=0;
+                 max_value=1;
+                 res_value=1;
+             }
+             else
+             {
+                 status|=uvc_ctrl_limits(dev, data, 0, data->size, &min_value, &max_value, &res_value);
+             }
+             if (data->unit==UVC_UNKNOWN_SELECTOR)
+             {
+                 width=0;
+             }
+             break;
+    }
+
+    if (status)
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+        }
+        return EIO;
+    }
+
+    if ((ctrl->value<min_value) || (ctrl->value>max_value) ||
+        ((res_value>1) && (ctrl->value%res_value!=0)))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
+        }
+        return ERANGE;
+    }
+
+    if (width!=0)
+    {
+        uvc_set_sinteger(width, &payload[offset], value);
+        memset(&mask[offset], 0xFF, width);
+    }
+
+    return EOK;
+}
+
+/* Unit controls of one VIDIOC_S_EXT_CTRLS request, which share a selector */
+typedef struct _control_group
+{
+    int      unit;
+    int      selector;
+    int      size;
+    int      first;                       /* Index of the first control in request */
+    int      covered;                     /* All bits of payload are being set     */
+    int      saved;                       /* Previous value is read for rollback   */
+    uint8_t  value[UVC_MAX_CACHED_CONTROL_SIZE];
+    uint8_t  mask[UVC_MAX_CACHED_CONTROL_SIZE];     /* Bits being set          */
+    uint8_t  previous[UVC_MAX_CACHED_CONTROL_SIZE];
+} control_group_t;
+
+/* Writes controls of VIDIOC_S_EXT_CTRLS as one transaction: all values are   */
+/* checked before any write, controls sharing a selector (pan and tilt, blue */
+/* and red balance) are merged to a single SET_CUR, and if one of transfers  */
+/* fails, already written selectors get their previous values back.        */
+static int uvc_write_ext_ctrls(uvc_device_t* dev, uint32_t subdev, struct v4l2_ext_control* ctrls, uint32_t count, uint32_t* error_idx, uvc_ocb_t* ocb)
+{
+    control_group_t groups[UVC_MAX_CONTROLS];
+    int total_groups=0;
+    control_data_t data;
+    uint8_t payload[UVC_MAX_CACHED_CONTROL_SIZE];
+    uint8_t mask[UVC_MAX_CACHED_CONTROL_SIZE];
+    int ret=EOK;
+    int it, jt, kt;
+
+    *error_idx=count;
+
+    /* Check all values and merge them into selector payloads */
+    for (it=0; it<count; it++)
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        controls[%d].id: %08X", it, ctrls[it].id);
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        controls[%d].value: %08X", it, ctrls[it].value);
+        }
+        if (!uvc_query_control_data(dev, ctrls[it].id, subdev, &data))
+        {
+            if (uvc_verbose>2)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: control can't be found");
+            }
+            *error_idx=it;
+            return EINVAL;
+        }
+
+        memset(mask, 0x00, sizeof(mask));
+        ret=uvc_ctrl_encode(dev, &ctrls[it], &data, payload, mask);
+        if (ret!=EOK)
+        {
+            return ret;
+        }
+        if (data.unit==UVC_UNKNOWN_SELECTOR)
+        {
+            continue;
+        }
+
+        for (jt=0; jt<total_groups; jt++)
+        {
+            if ((groups[jt].unit==data.unit) && (groups[jt].selector==data.selector))
+            {
+                break;
+            }
+        }
+        if (jt==total_groups)
+        {
+            if (total_groups==UVC_MAX_CONTROLS)
+            {
+                return E2BIG;
+            }
+            groups[jt].unit=data.unit;
+            groups[jt].selector=data.selector;
+            groups[jt].size=data.size;
+            groups[jt].first=it;
+            groups[jt].saved=0;
+            memset(groups[jt].value, 0x00, sizeof(groups[jt].value));
+            memset(groups[jt].mask, 0x00, sizeof(groups[jt].mask));
+            total_groups++;
+        }
+        for (kt=0; kt<data.size; kt++)
+        {
+            groups[jt].value[kt]=(groups[jt].value[kt] & ~mask[kt]) | (payload[kt] & mask[kt]);
+            groups[jt].mask[kt]|=mask[kt];
+        }
+    }
+
+    for (jt=0; jt<total_groups; jt++)
+    {
+        groups[jt].covered=1;
+        for (kt=0; kt<groups[jt].size; kt++)
+        {
+            if (groups[jt].mask[kt]!=0xFF)
+            {
+                groups[jt].covered=0;
+            }
+        }
+    }
+
+    /* Partially set selectors keep other components, previous values are also */
+    /* needed for rollback, if there is more than one transfer.                 */
+    for (jt=0; jt<total_groups; jt++)
+    {
+        if ((total_groups>1) || (!groups[jt].covered))
+        {
+            if (uvc_control_get(dev, VGET_CUR, groups[jt].unit, groups[jt].selector, groups[jt].size, groups[jt].previous))
+            {
+                if (uvc_verbose>2)
+                {
+                    slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+                }
+                return EIO;
+            }
+            groups[jt].saved=1;
+            for (kt=0; kt<groups[jt].size; kt++)
+            {
+                groups[jt].value[kt]=(groups[jt].value[kt] & groups[jt].mask[kt]) |
+                                     (groups[jt].previous[kt] & ~groups[jt].mask[kt]);
+            }
+        }
+    }
+
+    for (jt=0; jt<total_groups; jt++)
+    {
+        if (uvc_control_set(dev, VSET_CUR, groups[jt].unit, groups[jt].selector, groups[jt].size, groups[jt].value))
+        {
+            if (uvc_verbose>2)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error, rolling back %d selectors", jt);
+            }
+            /* Report control which failed, the earlier ones are restored */
+            *error_idx=groups[jt].first;
+            for (jt--; jt>=0; jt--)
+            {
+                if (groups[jt].saved)
+                {
+                    uvc_control_set(dev, VSET_CUR, groups[jt].unit, groups[jt].selector, groups[jt].size, groups[jt].previous);
+                }
+            }
+            return EIO;
+        }
+    }
+
+    /* Nothing can fail now: apply controls of driver and notify listeners */
+    for (it=0; it<count; it++)
+    {
+        uvc_query_control_data(dev, ctrls[it].id, subdev, &data);
+        if (data.unit==UVC_UNKNOWN_SELECTOR)
+        {
+            struct v4l2_control sctrl;
+
+            sctrl.id=ctrls[it].id;
+            sctrl.value=ctrls[it].value;
+            ret=uvc_write_ctrl(dev, &sctrl, &data, ocb);
+        }
+        else
+        {
+            ret=uvc_ctrl_event(dev, ctrls[it].id, data.type, ctrls[it].value, ocb);
+        }
+        if (ret!=EOK)
+        {
+            *error_idx=it;
+            return ret;
+        }
+    }
+
+    *error_idx=count;
+
+    return EOK;
+}
+
+/* Checks controls of request without writing them */
+static int uvc_check_ext_ctrls(uvc_device_t* dev, uint32_t subdev, struct v4l2_ext_control* ctrls, uint32_t count, uint32_t* error_idx)
+{
+    control_data_t data;
+    uint8_t payload[UVC_MAX_CACHED_CONTROL_SIZE];
+    uint8_t mask[UVC_MAX_CACHED_CONTROL_SIZE];
+    int ret;
+    int it;
+
+    *error_idx=count;
+
+    for (it=0; it<count; it++)
+    {
+        if (!uvc_query_control_data(dev, ctrls[it].id, subdev, &data))
+        {
+            if (uvc_verbose>2)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: control can't be found");
+            }
+            *error_idx=it;
+            return EINVAL;
+        }
+
+        ret=uvc_ctrl_encode(dev, &ctrls[it], &data, payload, mask);
+        if (ret!=EOK)
+        {
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+/* Replies to the client of control job, as uvc_devctl() does it */
+static void uvc_control_reply(uvc_control_job_t* job, int ret)
+{
+    struct _io_devctl_reply reply;
+    struct v4l2_control ctrl;
+    iov_t iovs[3];
+    int parts=1;
+
+    if (job->rcvid==-1)
+    {
+        return;
+    }
+
+    memset(&reply, 0x00, sizeof(reply));
+    reply.ret_val=(ret!=EOK) ? -1 : 0;
+    SETIOV(iovs+0, &reply, sizeof(reply));
+    if (job->dcmd==VIDIOC_S_CTRL)
+    {
+        /* Request structure is returned on success only */
+        if (ret==EOK)
+        {
+            ctrl.id=job->controls[0].id;
+            ctrl.value=job->controls[0].value;
+            reply.nbytes=sizeof(ctrl);
+            SETIOV(iovs+1, &ctrl, sizeof(ctrl));
+            parts++;
+        }
+    }
+    else
+    {
+        reply.nbytes=sizeof(job->ctrls)+job->ctrls.count*sizeof(struct v4l2_ext_control);
+        SETIOV(iovs+1, &job->ctrls, sizeof(job->ctrls));
+        SETIOV(iovs+2, job->controls, job->ctrls.count*sizeof(struct v4l2_ext_control));
+        parts+=2;
+    }
+
+    /* Client could be gone already, nothing to do in this case */
+    MsgWritev(job->rcvid, iovs, parts, 0);
+    MsgError(job->rcvid, ret);
+    job->rcvid=-1;
+}
+
+/* Writes queued controls one request after another, so slow control       */
+/* transfers (PTZ moves could take seconds) never occupy resource manager */
+/* threads, which serve the streaming requests of all devices.            */
+static void* uvc_control_worker(void* arg)
+{
+    uvc_device_t* dev=(uvc_device_t*)arg;
+    uvc_control_job_t* job;
+    uint32_t error_idx;
+    int ret;
+
+    pthread_mutex_lock(&dev->control_job_access);
+    do {
+        while ((TAILQ_EMPTY(&dev->control_jobs)) && (dev->control_worker_state==UVC_WORKER_RUNNING))
+        {
+            pthread_cond_wait(&dev->control_job_ready, &dev->control_job_access);
+        }
+        if (dev->control_worker_state!=UVC_WORKER_RUNNING)
+        {
+            break;
+        }
+
+        job=TAILQ_FIRST(&dev->control_jobs);
+        TAILQ_REMOVE(&dev->control_jobs, job, link);
+        dev->control_job=job;
+        pthread_mutex_unlock(&dev->control_job_access);
+
+        ret=uvc_write_ext_ctrls(dev, job->subdev, job->controls, job->ctrls.count, &error_idx, job->ocb);
+        job->ctrls.error_idx=error_idx;
+        if ((ret!=EOK) && (job->rcvid==-1) && (uvc_verbose))
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Asynchronous control write failed, error %d", ret);
+        }
+        uvc_control_reply(job, ret);
+
+        pthread_mutex_lock(&dev->control_job_access);
+        if ((job->id!=0) && (ret==EOK))
+        {
+            /* Frame being assembled was exposed before the write, at least partially */
+            dev->frame_job_id[job->subdev]=job->id;
+            dev->frame_job_sequence[job->subdev]=dev->frame_sequence[job->subdev]+((dev->frame_length[job->subdev]>0) ? 1 : 0);
+        }
+        dev->control_job=NULL;
+        free(job);
+        pthread_cond_broadcast(&dev->control_job_done);
+    } while(1);
+    pthread_mutex_unlock(&dev->control_job_access);
+
+    return NULL;
+}
+
+/* Starts control worker of device, controls are written by caller of devctl */
+/* if it can't be started.                                                   */
+int uvc_setup_control_worker(uvc_device_t* dev)
+{
+    pthread_attr_t attr;
+    int it;
+
+    TAILQ_INIT(&dev->control_jobs);
+    for (it=0; it<UVC_MAX_VS_COUNT; it++)
+    {
+        TAILQ_INIT(&dev->frame_jobs[it]);
+        dev->frame_job_id[it]=0;
+    }
+    dev->control_job=NULL;
+    pthread_mutex_init(&dev->control_job_access, NULL);
+    pthread_cond_init(&dev->control_job_ready, NULL);
+    pthread_cond_init(&dev->control_job_done, NULL);
+    dev->control_worker_state=UVC_WORKER_RUNNING;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    if (pthread_create(&dev->control_worker, &attr, uvc_control_worker, dev)!=EOK)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't create control worker thread");
+        pthread_attr_destroy(&attr);
+        pthread_cond_destroy(&dev->control_job_done);
+        pthread_cond_destroy(&dev->control_job_ready);
+        pthread_mutex_destroy(&dev->control_job_access);
+        dev->control_worker_state=UVC_WORKER_NONE;
+        return -1;
+    }
+    pthread_attr_destroy(&attr);
+
+    return 0;
+}
+
+/* Drops per-frame requests of file descriptor, or all requests of stream */
+/* if ocb is NULL. Caller holds control_job_access.                        */
+static void uvc_drop_frame_control_jobs(uvc_device_t* dev, int subdev, uvc_ocb_t* ocb)
+{
+    uvc_control_job_t* job;
+    uvc_control_job_t* tjob;
+
+    TAILQ_FOREACH_SAFE(job, &dev->frame_jobs[subdev], link, tjob)
+    {
+        if ((ocb==NULL) || (job->ocb==ocb))
+        {
+            TAILQ_REMOVE(&dev->frame_jobs[subdev], job, link);
+            free(job);
+        }
+    }
+}
+
+/* Stops control worker, must be called while control pipe is still open. */
+/* Clients of pending requests are replied with ENODEV.                   */
+void uvc_unsetup_control_worker(uvc_device_t* dev)
+{
+    uvc_control_job_t* job;
+    int it;
+
+    if (dev->control_worker_state==UVC_WORKER_NONE)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&dev->control_job_access);
+    dev->control_worker_state=UVC_WORKER_STOPPING;
+    pthread_cond_broadcast(&dev->control_job_ready);
+    pthread_mutex_unlock(&dev->control_job_access);
+    pthread_join(dev->control_worker, NULL);
+
+    while ((job=TAILQ_FIRST(&dev->control_jobs))!=NULL)
+    {
+        TAILQ_REMOVE(&dev->control_jobs, job, link);
+        uvc_control_reply(job, ENODEV);
+        free(job);
+    }
+    for (it=0; it<UVC_MAX_VS_COUNT; it++)
+    {
+        uvc_drop_frame_control_jobs(dev, it, NULL);
+    }
+
+    pthread_cond_destroy(&dev->control_job_done);
+    pthread_cond_destroy(&dev->control_job_ready);
+    pthread_mutex_destroy(&dev->control_job_access);
+    dev->control_worker_state=UVC_WORKER_NONE;
+}
+
+/* Drops pending requests of file descriptor being closed and waits for its */
+/* request being written. Asynchronous requests are written anyway.         */
+void uvc_cancel_control_jobs(uvc_device_t* dev, uvc_ocb_t* ocb)
+{
+    uvc_control_job_t* job;
+    uvc_control_job_t* tjob;
+    int it;
+
+    if (dev->control_worker_state==UVC_WORKER_NONE)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&dev->control_job_access);
+    TAILQ_FOREACH_SAFE(job, &dev->control_jobs, link, tjob)
+    {
+        if ((job->ocb==ocb) && (job->rcvid!=-1))
+        {
+            TAILQ_REMOVE(&dev->control_jobs, job, link);
+            uvc_control_reply(job, EBADF);
+            free(job);
+        }
+    }
+    for (it=0; it<UVC_MAX_VS_COUNT; it++)
+    {
+        uvc_drop_frame_control_jobs(dev, it, ocb);
+    }
+    while ((dev->control_job!=NULL) && (dev->control_job->ocb==ocb))
+    {
+        pthread_cond_wait(&dev->control_job_done, &dev->control_job_access);
+    }
+    pthread_mutex_unlock(&dev->control_job_access);
+}
+
+/* Queues control write request to the worker. Client is replied when request */
+/* is written, or now in asynchronous mode (-c option), where values are      */
+/* checked before queueing and completion is reported by V4L2_EVENT_CTRL.     */
+static int uvc_queue_control_job(resmgr_context_t* ctp, uvc_device_t* dev, int subdev, uvc_ocb_t* ocb,
+                                 unsigned int dcmd, struct v4l2_ext_controls* ctrls, struct v4l2_ext_control* controls, uint32_t count)
+{
+    uvc_control_job_t* job;
+    uint32_t error_idx;
+    int ret;
+
+    if (uvc_control_async)
+    {
+        ret=uvc_check_ext_ctrls(dev, subdev, controls, count, &error_idx);
+        if (ctrls!=NULL)
+        {
+            ctrls->error_idx=error_idx;
+        }
+        if (ret!=EOK)
+        {
+            return ret;
+        }
+    }
+
+    job=calloc(1, sizeof(*job)+count*sizeof(struct v4l2_ext_control));
+    if (job==NULL)
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate control job");
+        }
+        return ENOMEM;
+    }
+    job->controls=(struct v4l2_ext_control*)(job+1);
+    memcpy(job->controls, controls, count*sizeof(struct v4l2_ext_control));
+    if (ctrls!=NULL)
+    {
+        job->ctrls=*ctrls;
+    }
+    job->ctrls.count=count;
+    job->subdev=subdev;
+    job->dcmd=dcmd;
+    if (uvc_control_async)
+    {
+        /* File descriptor could be closed before the write */
+        job->rcvid=-1;
+        job->ocb=NULL;
+    }
+    else
+    {
+        job->rcvid=ctp->rcvid;
+        job->ocb=ocb;
+    }
+
+    pthread_mutex_lock(&dev->control_job_access);
+    if (dev->control_worker_state!=UVC_WORKER_RUNNING)
+    {
+        pthread_mutex_unlock(&dev->control_job_access);
+        free(job);
+        return ENODEV;
+    }
+    TAILQ_INSERT_TAIL(&dev->control_jobs, job, link);
+    pthread_cond_signal(&dev->control_job_ready);
+    pthread_mutex_unlock(&dev->control_job_access);
+
+    if (uvc_verbose>2)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EOK: %d control(s) queued", count);
+    }
+
+    return EOK;
+}
+
+/* Keeps per-frame control request until the end of the preceding frame, */
+/* requests are ordered by frame sequence. Caller is replied at once.     */
+static int uvc_queue_frame_control_job(uvc_device_t* dev, int subdev, uvc_ocb_t* ocb, uvc_frame_ctrls_t* request)
+{
+    uvc_control_job_t* job;
+    uvc_control_job_t* next;
+    int pending=0;
+
+    /* Frame which is being assembled could be exposed already */
+    if ((dev->current_transfer[subdev]) && ((int32_t)(request->sequence-dev->frame_sequence[subdev])<=0))
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: frame %d is already started", request->sequence);
+        }
+        return EINVAL;
+    }
+
+    job=calloc(1, sizeof(*job)+request->count*sizeof(struct v4l2_ext_control));
+    if (job==NULL)
+    {
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate control job");
+        }
+        return ENOMEM;
+    }
+    job->controls=(struct v4l2_ext_control*)(job+1);
+    memcpy(job->controls, request->controls, request->count*sizeof(struct v4l2_ext_control));
+    job->ctrls.count=request->count;
+    job->subdev=subdev;
+    job->dcmd=UVCIOC_S_FRAME_CTRLS;
+    job->id=request->id;
+    job->sequence=request->sequence;
+    job->rcvid=-1;
+    job->ocb=ocb;
+
+    pthread_mutex_lock(&dev->control_job_access);
+    if (dev->control_worker_state!=UVC_WORKER_RUNNING)
+    {
+        pthread_mutex_unlock(&dev->control_job_access);
+        free(job);
+        return ENODEV;
+    }
+    TAILQ_FOREACH(next, &dev->frame_jobs[subdev], link)
+    {
+        pending++;
+    }
+    if (pending>=UVC_MAX_FRAME_REQUESTS)
+    {
+        pthread_mutex_unlock(&dev->control_job_access);
+        free(job);
+        if (uvc_verbose>2)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EAGAIN: too many per-frame requests");
+        }
+        return EAGAIN;
+    }
+    TAILQ_FOREACH(next, &dev->frame_jobs[subdev], link)
+    {
+        if ((int32_t)(next->sequence-job->sequence)>0)
+        {
+            break;
+        }
+    }
+    if (next!=NULL)
+    {
+        TAILQ_INSERT_BEFORE(next, job, link);
+    }
+    else
+    {
+        TAILQ_INSERT_TAIL(&dev->frame_jobs[subdev], job, link);
+    }
+    pthread_mutex_unlock(&dev->control_job_access);
+
+    if (uvc_verbose>2)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EOK: %d control(s) queued for frame %d", request->count, request->sequence);
+    }
+
+    return EOK;
+}
+
+/* Called by streaming at the end of the frame with given sequence: queues  */
+/* per-frame requests of the next frame to the worker and returns id of the */
+/* request which was written before this frame started, or 0.               */
+uint32_t uvc_frame_control_jobs(uvc_device_t* dev, int subdev, uint32_t sequence)
+{
+    uvc_control_job_t* job;
+    uint32_t id=0;
+    int queued=0;
+
+    if (dev->control_worker_state!=UVC_WORKER_RUNNING)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&dev->control_job_access);
+    if ((dev->frame_job_id[subdev]!=0) && ((int32_t)(sequence-dev->frame_job_sequence[subdev])>=0))
+    {
+        /* Request is reported once, even if its frame was not delivered */
+        if (sequence==dev->frame_job_sequence[subdev])
+        {
+            id=dev->frame_job_id[subdev];
+        }
+        dev->frame_job_id[subdev]=0;
+    }
+    while (((job=TAILQ_FIRST(&dev->frame_jobs[subdev]))!=NULL) && ((int32_t)(job->sequence-(sequence+1))<=0))
+    {
+        TAILQ_REMOVE(&dev->frame_jobs[subdev], job, link);
+        /* File descriptor could be closed before the write */
+        job->ocb=NULL;
+        TAILQ_INSERT_TAIL(&dev->control_jobs, job, link);
+        queued=1;
+    }
+    if (queued)
+    {
+        pthread_cond_signal(&dev->control_job_ready);
+    }
+    pthread_mutex_unlock(&dev->control_job_access);
+
+    return id;
+}
+
+/* Passes format of native frames to statistics, they are gathered for */
+/* uncompressed frames only.                                            */
+static void uvc_setup_stats(uvc_device_t* dev, int subdev)
+{
+    vs_frame_uncompressed_t* frame;
+
+    switch (dev->current_source_format[subdev])
+    {
+        case UVC_FORMAT_YUY2:
+        case UVC_FORMAT_NV12:
+             frame=&dev->vs_frame_uncompressed[subdev][dev->current_source_frame[subdev]];
+             uvc_stats_format(dev->stats[subdev], dev->current_source_format[subdev], frame->wWidth, frame->wHeight);
+             break;
+        default:
+             uvc_stats_format(dev->stats[subdev], UVC_FORMAT_NONE, 0, 0);
+             break;
+    }
+}
+
+/* Limits of mapped control, menu controls are enumerated by indexes */
+static int uvc_query_mapping(uvc_device_t* dev, control_data_t* data, struct v4l2_queryctrl* ctrl)
+{
+    uvc_control_mapping_t* mapping=&dev->mapping[data->mapping];
+    unsigned char info;
+    int ret=EOK;
+
+    switch (mapping->v4l2_type)
+    {
+        case V4L2_CTRL_TYPE_INTEGER:
+             ret|=uvc_mapping_read(dev, data, VGET_MIN, &ctrl->minimum);
+             ret|=uvc_mapping_read(dev, data, VGET_MAX, &ctrl->maximum);
+             ret|=uvc_mapping_read(dev, data, VGET_RES, &ctrl->step);
+             ret|=uvc_mapping_read(dev, data, VGET_DEF, &ctrl->default_value);
+             if (ret!=EOK)
+             {
+                 return EIO;
+             }
+             break;
+        case V4L2_CTRL_TYPE_BOOLEAN:
+             ctrl->minimum=0;
+             ctrl->maximum=1;
+             ctrl->step=1;
+             ret=uvc_mapping_read(dev, data, VGET_DEF, &ctrl->default_value);
+             if (ret!=EOK)
              {
-                 case V4L2_CID_POWER_LINE_FREQUENCY:
-                      if ((ctrl->value<0) || (ctrl->value>2))
-                      {
-                          if (uvc_verbose>2)
-                          {
-                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
-                          }
-                          ret=ERANGE;
-                          break;
-                      }
-                      uvc_set_sinteger(data->size, &value[0], ctrl->value);
-                      status|=uvc_control_set(dev, VSET_CUR, data->unit, data->selector, data->size, &value[0]);
-                      if (status)
-                      {
-                          if (uvc_verbose>2)
-                          {
-                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
-                          }
-                          ret=EIO;
-                          break;
-                      }
-                      break;
-                 case V4L2_CID_EXPOSURE_AUTO:
-                      if ((ctrl->value<0) || (ctrl->value>3))
-                      {
-                          if (uvc_verbose>2)
-                          {
-                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
-                          }
-                          ret=ERANGE;
-                          break;
-                      }
-                      uvc_set_sinteger(data->size, &value[0], (1<<ctrl->value));
-                      status=uvc_control_set(dev, VSET_CUR, data->unit, data->selector, data->size, &value[0]);
-                      if (status)
-                      {
-                          if (uvc_verbose>2)
-                          {
-                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
-                          }
-                          ret=EIO;
-                          break;
-                      }
-                      break;
+                 return ret;
              }
              break;
-        case V4L2_CTRL_TYPE_BOOLEAN:
-             switch (ctrl->id)
+        case V4L2_CTRL_TYPE_MENU:
+             ctrl->minimum=0;
+             ctrl->maximum=mapping->menu_count-1;
+             ctrl->step=1;
+             ret=uvc_mapping_read(dev, data, VGET_DEF, &ctrl->default_value);
+             if (ret!=EOK)
              {
-                 case UVC_CID_EVENT_BUTTON:
-                      if (uvc_verbose>2)
-                      {
-                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EACCES: control can't be set");
-                      }
-                      ret=EACCES;
-                      break;
-                 default:
-                      if ((ctrl->value!=1) && (ctrl->value!=0))
-                      {
-                          if (uvc_verbose>2)
-                          {
-                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ERANGE: control value is out of range");
-                          }
-                          ret=ERANGE;
-                          break;
-                      }
-                      uvc_set_sinteger(data->size, &value[0], ctrl->value);
-                      status=uvc_control_set(dev, VSET_CUR, data->unit, data->selector, data->size, &value[0]);
-                      if (status)
-                      {
-                          if (uvc_verbose>2)
-                          {
-                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
-                          }
-                          ret=EIO;
-                      }
-                      break;
+                 return ret;
              }
              break;
     }
 
-    if (ret==EOK)
+    /* Device doesn't report changes of extension unit controls */
+    ctrl->flags=V4L2_CTRL_FLAG_VOLATILE;
+    if (uvc_control_get(dev, VGET_INFO, data->unit, data->selector, 1, &info)==0)
     {
-        for(it=0; it<UVC_MAX_OPEN_FDS; it++)
+        if (!(info & UVC_CONTROL_INFO_SET))
         {
-            if (((dev->event[it].ocb==ocb) && ((dev->event[it].flags[V4L2_EVENT_CTRL] & V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK)==V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK)) ||
-                (dev->event[it].ocb!=NULL))
-            {
-                /* Check file descriptor listening for ctrl event */
-                if (dev->event[it].type[V4L2_EVENT_CTRL])
-                {
-                    /* Check if file descriptor listening for required control id */
-                    if ((dev->event[it].type[V4L2_EVENT_CTRL]==0) || (dev->event[it].type[V4L2_EVENT_CTRL]==ctrl->id))
-                    {
-                        struct _uvc_event_entry* entry;
-
-                        entry=calloc(1, sizeof(*entry));
-                        if (entry==NULL)
-                        {
-                            ret=ENOMEM;
-                            break;
-                        }
-
-                        /* Emit control change event */
-                        entry->event.type=V4L2_EVENT_CTRL;
-                        entry->event.pending=0;
-                        entry->event.sequence=dev->event[it].sequence;
-                        entry->event.id=ctrl->id;
-                        clock_gettime(CLOCK_MONOTONIC, &entry->event.timestamp);
-                        memset(entry->event.reserved, 0x00, sizeof(entry->event.reserved));
-                        entry->event.u.ctrl.changes=V4L2_EVENT_CTRL_CH_VALUE;
-                        entry->event.u.ctrl.type=data->type;
-                        entry->event.u.ctrl.flags=0;
-                        entry->event.u.ctrl.value=ctrl->value;
-                        pthread_mutex_lock(&dev->event[it].access);
-                        dev->event[it].sequence++;
-                        TAILQ_INSERT_TAIL(&dev->event[it].head, entry, link);
-                        pthread_mutex_unlock(&dev->event[it].access);
-
-                        /* Notify callers of select() if any */
-                        iofunc_notify_trigger(dev->event[it].ocb->notify, 1, IOFUNC_NOTIFY_OBAND);
-                    }
-                }
-            }
+            ctrl->flags|=V4L2_CTRL_FLAG_READ_ONLY;
+        }
+        if (!(info & UVC_CONTROL_INFO_GET))
+        {
+            ctrl->flags|=V4L2_CTRL_FLAG_WRITE_ONLY;
         }
     }
 
-    return ret;
+    return EOK;
 }
 
 int uvc_query_control(uvc_device_t* dev, uint32_t subdev, struct v4l2_queryctrl* ctrl)
@@ -1263,12 +2160,18 @@ int uvc_query_control(uvc_device_t* dev, uint32_t subdev, struct v4l2_queryctrl*
     int ret=EOK;
 
     data.type=0;
+    data.mapping=-1;
     uvc_query_control_data(dev, ctrl->id, subdev, &data);
 
     ctrl->type=data.type;
     strncpy((char*)ctrl->name, data.name, sizeof(ctrl->name));
     ctrl->flags=0;
 
+    if (data.mapping>=0)
+    {
+        return uvc_query_mapping(dev, &data, ctrl);
+    }
+
     switch (ctrl->type)
     {
         case V4L2_CTRL_TYPE_INTEGER:
@@ -1286,6 +2189,18 @@ int uvc_query_control(uvc_device_t* dev, uint32_t subdev, struct v4l2_queryctrl*
                       ctrl->step=uvc_get_uinteger(1, &value3[1]);
                       ctrl->default_value=uvc_get_uinteger(1, &value4[1]);
                       break;
+                 case V4L2_CID_ROTATE:
+                      ctrl->minimum=0;
+                      ctrl->maximum=270;
+                      ctrl->step=90;
+                      ctrl->default_value=0;
+                      break;
+                 case V4L2_CID_JPEG_COMPRESSION_QUALITY:
+                      ctrl->minimum=1;
+                      ctrl->maximum=100;
+                      ctrl->step=1;
+                      ctrl->default_value=UVC_JPEG_DEFAULT_QUALITY;
+                      break;
                  case V4L2_CID_IRIS_RELATIVE:
                       /* Do not support get max/min according to specification */
                       ctrl->minimum=-1;
@@ -1412,6 +2327,10 @@ int uvc_query_control(uvc_device_t* dev, uint32_t subdev, struct v4l2_queryctrl*
                       ctrl->flags=V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE;
                       ctrl->default_value=0;
                       break;
+                 case V4L2_CID_HFLIP:
+                 case V4L2_CID_VFLIP:
+                      ctrl->default_value=0;
+                      break;
                  default:
                       status|=uvc_control_get(dev, VGET_DEF, data.unit, data.selector, data.size, &value4[0]);
                       ctrl->default_value=uvc_get_sinteger(data.size, &value4[0]);
@@ -1420,6 +2339,17 @@ int uvc_query_control(uvc_device_t* dev, uint32_t subdev, struct v4l2_queryctrl*
              break;
     }
 
+    /* Such controls are never cached, they are read from device each time */
+    if ((data.unit!=UVC_UNKNOWN_SELECTOR) && (uvc_control_volatile(data.unit, data.selector)))
+    {
+        ctrl->flags|=V4L2_CTRL_FLAG_VOLATILE;
+    }
+
+    if (uvc_ctrl_inactive(dev, subdev, ctrl->id))
+    {
+        ctrl->flags|=V4L2_CTRL_FLAG_INACTIVE;
+    }
+
     if ((ret==EOK) && (status))
     {
         if (uvc_verbose>2)
@@ -1432,6 +2362,38 @@ int uvc_query_control(uvc_device_t* dev, uint32_t subdev, struct v4l2_queryctrl*
     return ret;
 }
 
+/* Reads limits and defaults of unit controls of the stream into the control */
+/* table, so VIDIOC_QUERYCTRL and range checks of writes don't touch device. */
+void uvc_prefetch_controls(uvc_device_t* dev, int subdev)
+{
+    struct v4l2_queryctrl ctrl;
+    const control_desc_t* desc;
+    int total=0;
+    int it;
+
+    for (it=0; it<dev->total_controls[subdev]; it++)
+    {
+        /* Streaming and driver controls don't depend on the device */
+        desc=&uvc_controls[dev->controls[subdev][it]];
+        if ((desc->unit==UVC_UNKNOWN_SELECTOR) || (desc->type==V4L2_CTRL_TYPE_CTRL_CLASS))
+        {
+            continue;
+        }
+
+        memset(&ctrl, 0x00, sizeof(ctrl));
+        ctrl.id=desc->id;
+        if (uvc_query_control(dev, subdev, &ctrl)==EOK)
+        {
+            total++;
+        }
+    }
+
+    if (uvc_verbose>1)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] Limits of %d controls are read", total);
+    }
+}
+
 int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
 {
     int status, ret=EOK;
@@ -1540,6 +2502,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                  switch(dev->vs_format[subdev][fmt->index])
                  {
                      case UVC_FORMAT_YUY2:
+                     case UVC_FORMAT_MJPG_YUY2:
                           fmt->pixelformat=V4L2_PIX_FMT_YUYV;
                           fmt->flags=0;
                           strncpy((char*)fmt->description, "YUV 4:2:2 (YUY2/YUYV)", sizeof(fmt->description));
@@ -1561,12 +2524,29 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           fmt->flags=0; /* V4L2_FMT_FLAG_EMULATED */
                           strncpy((char*)fmt->description, "YUV 4:2:2 (VYUY)", sizeof(fmt->description));
                           break;
+                     case UVC_FORMAT_RGB24:
+                          fmt->pixelformat=V4L2_PIX_FMT_RGB24;
+                          fmt->flags=0; /* V4L2_FMT_FLAG_EMULATED */
+                          strncpy((char*)fmt->description, "RGB 8-8-8 (RGB24)", sizeof(fmt->description));
+                          break;
+                     case UVC_FORMAT_BGR32:
+                          fmt->pixelformat=V4L2_PIX_FMT_BGR32;
+                          fmt->flags=0; /* V4L2_FMT_FLAG_EMULATED */
+                          strncpy((char*)fmt->description, "BGR 8-8-8-8 (BGR32)", sizeof(fmt->description));
+                          break;
+                     case UVC_FORMAT_RGB565:
+                          fmt->pixelformat=V4L2_PIX_FMT_RGB565;
+                          fmt->flags=0; /* V4L2_FMT_FLAG_EMULATED */
+                          strncpy((char*)fmt->description, "RGB 5-6-5 (RGB565)", sizeof(fmt->description));
+                          break;
                      case UVC_FORMAT_NV12:
+                     case UVC_FORMAT_MJPG_NV12:
                           fmt->pixelformat=V4L2_PIX_FMT_NV12;
                           fmt->flags=0;
                           strncpy((char*)fmt->description, "YUV 4:2:0 (NV12)", sizeof(fmt->description));
                           break;
                      case UVC_FORMAT_MJPG:
+                     case UVC_FORMAT_YUV_MJPG:
                           fmt->pixelformat=V4L2_PIX_FMT_MJPEG;
                           fmt->flags=V4L2_FMT_FLAG_COMPRESSED;
                           strncpy((char*)fmt->description, "MJPEG", sizeof(fmt->description));
@@ -1633,20 +2613,40 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                  fmt->fmt.pix.pixelformat=dev->current_pixelformat[subdev];
                  fmt->fmt.pix.field=V4L2_FIELD_NONE;
                  fmt->fmt.pix.bytesperline=dev->current_stride[subdev];
-                 fmt->fmt.pix.sizeimage=dev->current_stride[subdev] * dev->current_height[subdev];
+                 fmt->fmt.pix.sizeimage=uvc_emulation_image_size(dev, subdev);
 
                  switch (fmt->fmt.pix.pixelformat)
                  {
                      case V4L2_PIX_FMT_YUYV:
                      case V4L2_PIX_FMT_NV12:
+                          if (dev->current_source_format[subdev]==UVC_FORMAT_MJPG)
+                          {
+                              color_format=&dev->vs_color_format_mjpeg[subdev];
+                              break;
+                          }
                           color_format=&dev->vs_color_format_uncompressed[subdev];
                           break;
                      case V4L2_PIX_FMT_MJPEG:
+                          if (dev->current_source_format[subdev]!=UVC_FORMAT_MJPG)
+                          {
+                              color_format=&dev->vs_color_format_uncompressed[subdev];
+                              break;
+                          }
                           color_format=&dev->vs_color_format_mjpeg[subdev];
                           break;
                      case V4L2_PIX_FMT_H264:
                           color_format=&dev->vs_color_format_h264f[subdev];
                           break;
+                     case V4L2_PIX_FMT_RGB24:
+                     case V4L2_PIX_FMT_BGR32:
+                     case V4L2_PIX_FMT_RGB565:
+                          if (uvc_emulation)
+                          {
+                              /* Matrix coefficients are already applied during conversion */
+                              color_format=NULL;
+                              break;
+                          }
+                          /* fall-through */
                      case V4L2_PIX_FMT_UYVY:
                      case V4L2_PIX_FMT_YVYU:
                      case V4L2_PIX_FMT_VYUY:
@@ -1670,7 +2670,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      break;
                  }
 
-                 switch(color_format->bMatrixCoefficients)
+                 switch((color_format!=NULL) ? color_format->bMatrixCoefficients : VCFMC_UNKNOWN)
                  {
                      case VCFMC_UNKNOWN:
                           fmt->fmt.pix.colorspace=V4L2_COLORSPACE_SRGB;
@@ -1720,6 +2720,11 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                  int best_height=INT_MAX;
                  int suggest_new_format=0;
                  int format_to_search=0;
+                 int source_format=0;
+                 int source_frame=0;
+                 int scale=1;
+                 int native;
+                 uvc_emulated_frame_t emulated;
                  unsigned int frameinterval=0;
 
                  fmt=(struct v4l2_format*)dptr;
@@ -1788,6 +2793,30 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           }
                           suggest_new_format=1;
                           break;
+                     case V4L2_PIX_FMT_RGB24:
+                          if (uvc_emulation)
+                          {
+                              format_to_search=UVC_FORMAT_RGB24;
+                              break;
+                          }
+                          suggest_new_format=1;
+                          break;
+                     case V4L2_PIX_FMT_BGR32:
+                          if (uvc_emulation)
+                          {
+                              format_to_search=UVC_FORMAT_BGR32;
+                              break;
+                          }
+                          suggest_new_format=1;
+                          break;
+                     case V4L2_PIX_FMT_RGB565:
+                          if (uvc_emulation)
+                          {
+                              format_to_search=UVC_FORMAT_RGB565;
+                              break;
+                          }
+                          suggest_new_format=1;
+                          break;
                      default:
                           suggest_new_format=1;
                           break;
@@ -1798,7 +2827,10 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      suggest_new_format=1;
                      for (it=0; it<dev->vs_formats[subdev]; it++)
                      {
-                         if (dev->vs_format[subdev][it]==format_to_search)
+                         if ((dev->vs_format[subdev][it]==format_to_search) ||
+                             ((format_to_search==UVC_FORMAT_YUY2) && (dev->vs_format[subdev][it]==UVC_FORMAT_MJPG_YUY2)) ||
+                             ((format_to_search==UVC_FORMAT_NV12) && (dev->vs_format[subdev][it]==UVC_FORMAT_MJPG_NV12)) ||
+                             ((format_to_search==UVC_FORMAT_MJPG) && (dev->vs_format[subdev][it]==UVC_FORMAT_YUV_MJPG)))
                          {
                              suggest_new_format=0;
                          }
@@ -1843,11 +2875,26 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      case V4L2_PIX_FMT_UYVY:
                      case V4L2_PIX_FMT_YVYU:
                      case V4L2_PIX_FMT_VYUY:
+                     case V4L2_PIX_FMT_RGB24:
+                     case V4L2_PIX_FMT_BGR32:
+                     case V4L2_PIX_FMT_RGB565:
                      case V4L2_PIX_FMT_NV12:
                           if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_NV12)
                           {
                               bpp=1;
                           }
+                          if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_RGB565)
+                          {
+                              bpp=2;
+                          }
+                          if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_RGB24)
+                          {
+                              bpp=3;
+                          }
+                          if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_BGR32)
+                          {
+                              bpp=4;
+                          }
                           if ((fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_YUYV) ||
                               (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_UYVY) ||
                               (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_YVYU) ||
@@ -1856,13 +2903,18 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                               bpp=2;
                           }
                           color_format=&dev->vs_color_format_uncompressed[subdev];
+                          source_format=(fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_NV12) ? UVC_FORMAT_NV12 : UVC_FORMAT_YUY2;
+
+                          /* Uncompressed frames are native only if device supports this format */
+                          native=uvc_emulation_has_format(dev, subdev, source_format);
 
-                          for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
+                          for (it=0; (native) && (it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors); it++)
                           {
                               if ((dev->vs_frame_uncompressed[subdev][it].wWidth==fmt->fmt.pix.width) &&
                                   (dev->vs_frame_uncompressed[subdev][it].wHeight==fmt->fmt.pix.height))
                               {
                                   frameinterval=dev->vs_frame_uncompressed[subdev][it].dwDefaultFrameInterval;
+                                  source_frame=it;
                                   match=1;
                                   break;
                               }
@@ -1872,8 +2924,24 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                               break;
                           }
 
+                          /* Check frame sizes which are produced by driver */
+                          if (uvc_emulated_frame_by_size(dev, subdev, fmt->fmt.pix.pixelformat,
+                              fmt->fmt.pix.width, fmt->fmt.pix.height, &emulated)==0)
+                          {
+                              frameinterval=emulated.default_frameinterval;
+                              source_format=emulated.source_format;
+                              source_frame=emulated.source_frame;
+                              scale=emulated.scale;
+                              if (source_format==UVC_FORMAT_MJPG)
+                              {
+                                  color_format=&dev->vs_color_format_mjpeg[subdev];
+                              }
+                              match=1;
+                              break;
+                          }
+
                           /* Suggest new video mode, close to desired by width */
-                          for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
+                          for (it=0; (native) && (it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors); it++)
                           {
                               if ((dev->vs_frame_uncompressed[subdev][it].wWidth-fmt->fmt.pix.width)<
                                   (best_width-fmt->fmt.pix.width))
@@ -1881,6 +2949,23 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   best_width=dev->vs_frame_uncompressed[subdev][it].wWidth;
                                   best_height=dev->vs_frame_uncompressed[subdev][it].wHeight;
                                   frameinterval=dev->vs_frame_uncompressed[subdev][it].dwDefaultFrameInterval;
+                                  source_frame=it;
+                              }
+                          }
+
+                          /* No native frames, suggest the first emulated one */
+                          if ((best_width==INT_MAX) &&
+                              (uvc_emulated_frame_by_index(dev, subdev, fmt->fmt.pix.pixelformat, 0, &emulated)==0))
+                          {
+                              best_width=emulated.width;
+                              best_height=emulated.height;
+                              frameinterval=emulated.default_frameinterval;
+                              source_format=emulated.source_format;
+                              source_frame=emulated.source_frame;
+                              scale=emulated.scale;
+                              if (source_format==UVC_FORMAT_MJPG)
+                              {
+                                  color_format=&dev->vs_color_format_mjpeg[subdev];
                               }
                           }
                           fmt->fmt.pix.width=best_width;
@@ -1889,12 +2974,18 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      case V4L2_PIX_FMT_MJPEG:
                           bpp=3;
                           color_format=&dev->vs_color_format_mjpeg[subdev];
-                          for (it=0; it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors; it++)
+                          source_format=UVC_FORMAT_MJPG;
+
+                          /* Without native MJPEG frames are encoded by driver */
+                          native=uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG);
+
+                          for (it=0; (native) && (it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors); it++)
                           {
                               if ((dev->vs_frame_mjpeg[subdev][it].wWidth==fmt->fmt.pix.width) &&
                                   (dev->vs_frame_mjpeg[subdev][it].wHeight==fmt->fmt.pix.height))
                               {
                                   frameinterval=dev->vs_frame_mjpeg[subdev][it].dwDefaultFrameInterval;
+                                  source_frame=it;
                                   match=1;
                                   break;
                               }
@@ -1903,8 +2994,22 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           {
                               break;
                           }
+
+                          /* Check frame sizes which are produced by driver */
+                          if ((!native) && (uvc_emulated_frame_by_size(dev, subdev, fmt->fmt.pix.pixelformat,
+                              fmt->fmt.pix.width, fmt->fmt.pix.height, &emulated)==0))
+                          {
+                              frameinterval=emulated.default_frameinterval;
+                              source_format=emulated.source_format;
+                              source_frame=emulated.source_frame;
+                              scale=emulated.scale;
+                              color_format=&dev->vs_color_format_uncompressed[subdev];
+                              match=1;
+                              break;
+                          }
+
                           /* Suggest new video mode, close to desired by width */
-                          for (it=0; it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors; it++)
+                          for (it=0; (native) && (it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors); it++)
                           {
                               if ((dev->vs_frame_mjpeg[subdev][it].wWidth-fmt->fmt.pix.width)<
                                   (best_width-fmt->fmt.pix.width))
@@ -1912,20 +3017,36 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   best_width=dev->vs_frame_mjpeg[subdev][it].wWidth;
                                   best_height=dev->vs_frame_mjpeg[subdev][it].wHeight;
                                   frameinterval=dev->vs_frame_mjpeg[subdev][it].dwDefaultFrameInterval;
+                                  source_frame=it;
                               }
                           }
+
+                          /* No native frames, suggest the first emulated one */
+                          if ((best_width==INT_MAX) &&
+                              (uvc_emulated_frame_by_index(dev, subdev, fmt->fmt.pix.pixelformat, 0, &emulated)==0))
+                          {
+                              best_width=emulated.width;
+                              best_height=emulated.height;
+                              frameinterval=emulated.default_frameinterval;
+                              source_format=emulated.source_format;
+                              source_frame=emulated.source_frame;
+                              scale=emulated.scale;
+                              color_format=&dev->vs_color_format_uncompressed[subdev];
+                          }
                           fmt->fmt.pix.width=best_width;
                           fmt->fmt.pix.height=best_height;
                           break;
                      case V4L2_PIX_FMT_H264:
                           bpp=3;
                           color_format=&dev->vs_color_format_h264f[subdev];
+                          source_format=UVC_FORMAT_H264F;
                           for (it=0; it<dev->vs_format_h264f[subdev].bNumFrameDescriptors; it++)
                           {
                               if ((dev->vs_frame_h264f[subdev][it].wWidth==fmt->fmt.pix.width) &&
                                   (dev->vs_frame_h264f[subdev][it].wHeight==fmt->fmt.pix.height))
                               {
                                   frameinterval=dev->vs_frame_h264f[subdev][it].dwDefaultFrameInterval;
+                                  source_frame=it;
                                   match=1;
                                   break;
                               }
@@ -1943,6 +3064,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   best_width=dev->vs_frame_h264f[subdev][it].wWidth;
                                   best_height=dev->vs_frame_h264f[subdev][it].wHeight;
                                   frameinterval=dev->vs_frame_h264f[subdev][it].dwDefaultFrameInterval;
+                                  source_frame=it;
                               }
                           }
                           fmt->fmt.pix.width=best_width;
@@ -1958,6 +3080,10 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      fmt->fmt.pix.bytesperline=fmt->fmt.pix.width*bpp;
                  }
                  fmt->fmt.pix.sizeimage=fmt->fmt.pix.bytesperline * fmt->fmt.pix.height;
+                 if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_NV12)
+                 {
+                     fmt->fmt.pix.sizeimage+=fmt->fmt.pix.sizeimage/2;
+                 }
 
                  /* Always set hardware colorspace */
                  switch(color_format->bMatrixCoefficients)
@@ -1985,15 +3111,28 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           break;
                  }
 
+                 /* Conversion to RGB is done by driver according to hardware colorspace */
+                 if ((fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_RGB24) ||
+                     (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_BGR32) ||
+                     (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_RGB565))
+                 {
+                     fmt->fmt.pix.colorspace=V4L2_COLORSPACE_SRGB;
+                 }
+
                  /* Store negotiated parameters */
                  dev->current_width[subdev]=fmt->fmt.pix.width;
                  dev->current_height[subdev]=fmt->fmt.pix.height;
                  dev->current_pixelformat[subdev]=fmt->fmt.pix.pixelformat;
                  dev->current_stride[subdev]=fmt->fmt.pix.bytesperline;
+                 dev->current_source_format[subdev]=source_format;
+                 dev->current_source_frame[subdev]=source_frame;
+                 dev->current_scale[subdev]=scale;
+                 dev->current_crop[subdev].width=0;
                  fmt->fmt.pix.priv=0;
 
                  /* Now reset frame interval to default */
                  dev->current_frameinterval[subdev]=frameinterval;
+                 dev->current_decimation[subdev]=1;
 
                  if (uvc_verbose>2)
                  {
@@ -2019,6 +3158,9 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                  int best_height=INT_MAX;
                  int suggest_new_format=0;
                  int format_to_search=0;
+                 int source_format=0;
+                 int native;
+                 uvc_emulated_frame_t emulated;
 
                  fmt=(struct v4l2_format*)dptr;
 
@@ -2076,6 +3218,30 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           }
                           suggest_new_format=1;
                           break;
+                     case V4L2_PIX_FMT_RGB24:
+                          if (uvc_emulation)
+                          {
+                              format_to_search=UVC_FORMAT_RGB24;
+                              break;
+                          }
+                          suggest_new_format=1;
+                          break;
+                     case V4L2_PIX_FMT_BGR32:
+                          if (uvc_emulation)
+                          {
+                              format_to_search=UVC_FORMAT_BGR32;
+                              break;
+                          }
+                          suggest_new_format=1;
+                          break;
+                     case V4L2_PIX_FMT_RGB565:
+                          if (uvc_emulation)
+                          {
+                              format_to_search=UVC_FORMAT_RGB565;
+                              break;
+                          }
+                          suggest_new_format=1;
+                          break;
                      default:
                           suggest_new_format=1;
                           break;
@@ -2086,7 +3252,10 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      suggest_new_format=1;
                      for (it=0; it<dev->vs_formats[subdev]; it++)
                      {
-                         if (dev->vs_format[subdev][it]==format_to_search)
+                         if ((dev->vs_format[subdev][it]==format_to_search) ||
+                             ((format_to_search==UVC_FORMAT_YUY2) && (dev->vs_format[subdev][it]==UVC_FORMAT_MJPG_YUY2)) ||
+                             ((format_to_search==UVC_FORMAT_NV12) && (dev->vs_format[subdev][it]==UVC_FORMAT_MJPG_NV12)) ||
+                             ((format_to_search==UVC_FORMAT_MJPG) && (dev->vs_format[subdev][it]==UVC_FORMAT_YUV_MJPG)))
                          {
                              suggest_new_format=0;
                          }
@@ -2132,11 +3301,26 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      case V4L2_PIX_FMT_UYVY:
                      case V4L2_PIX_FMT_YVYU:
                      case V4L2_PIX_FMT_VYUY:
+                     case V4L2_PIX_FMT_RGB24:
+                     case V4L2_PIX_FMT_BGR32:
+                     case V4L2_PIX_FMT_RGB565:
                      case V4L2_PIX_FMT_NV12:
                           if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_NV12)
                           {
                               bpp=1;
                           }
+                          if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_RGB565)
+                          {
+                              bpp=2;
+                          }
+                          if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_RGB24)
+                          {
+                              bpp=3;
+                          }
+                          if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_BGR32)
+                          {
+                              bpp=4;
+                          }
                           if ((fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_YUYV) ||
                               (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_UYVY) ||
                               (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_VYUY) ||
@@ -2145,8 +3329,12 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                               bpp=2;
                           }
                           color_format=&dev->vs_color_format_uncompressed[subdev];
+                          source_format=(fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_NV12) ? UVC_FORMAT_NV12 : UVC_FORMAT_YUY2;
+
+                          /* Uncompressed frames are native only if device supports this format */
+                          native=uvc_emulation_has_format(dev, subdev, source_format);
 
-                          for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
+                          for (it=0; (native) && (it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors); it++)
                           {
                               if ((dev->vs_frame_uncompressed[subdev][it].wWidth==fmt->fmt.pix.width) &&
                                   (dev->vs_frame_uncompressed[subdev][it].wHeight==fmt->fmt.pix.height))
@@ -2160,8 +3348,21 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                               break;
                           }
 
+                          /* Check frame sizes which are produced by driver */
+                          if (uvc_emulated_frame_by_size(dev, subdev, fmt->fmt.pix.pixelformat,
+                              fmt->fmt.pix.width, fmt->fmt.pix.height, &emulated)==0)
+                          {
+                              source_format=emulated.source_format;
+                              if (source_format==UVC_FORMAT_MJPG)
+                              {
+                                  color_format=&dev->vs_color_format_mjpeg[subdev];
+                              }
+                              match=1;
+                              break;
+                          }
+
                           /* Suggest new video mode, close to desired by width */
-                          for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
+                          for (it=0; (native) && (it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors); it++)
                           {
                               if ((dev->vs_frame_uncompressed[subdev][it].wWidth-fmt->fmt.pix.width)<
                                   (best_width-fmt->fmt.pix.width))
@@ -2170,13 +3371,31 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   best_height=dev->vs_frame_uncompressed[subdev][it].wHeight;
                               }
                           }
+
+                          /* No native frames, suggest the first emulated one */
+                          if ((best_width==INT_MAX) &&
+                              (uvc_emulated_frame_by_index(dev, subdev, fmt->fmt.pix.pixelformat, 0, &emulated)==0))
+                          {
+                              best_width=emulated.width;
+                              best_height=emulated.height;
+                              source_format=emulated.source_format;
+                              if (source_format==UVC_FORMAT_MJPG)
+                              {
+                                  color_format=&dev->vs_color_format_mjpeg[subdev];
+                              }
+                          }
                           fmt->fmt.pix.width=best_width;
                           fmt->fmt.pix.height=best_height;
                           break;
                      case V4L2_PIX_FMT_MJPEG:
                           bpp=3;
                           color_format=&dev->vs_color_format_mjpeg[subdev];
-                          for (it=0; it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors; it++)
+                          source_format=UVC_FORMAT_MJPG;
+
+                          /* Without native MJPEG frames are encoded by driver */
+                          native=uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG);
+
+                          for (it=0; (native) && (it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors); it++)
                           {
                               if ((dev->vs_frame_mjpeg[subdev][it].wWidth==fmt->fmt.pix.width) &&
                                   (dev->vs_frame_mjpeg[subdev][it].wHeight==fmt->fmt.pix.height))
@@ -2189,8 +3408,19 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           {
                               break;
                           }
+
+                          /* Check frame sizes which are produced by driver */
+                          if ((!native) && (uvc_emulated_frame_by_size(dev, subdev, fmt->fmt.pix.pixelformat,
+                              fmt->fmt.pix.width, fmt->fmt.pix.height, &emulated)==0))
+                          {
+                              source_format=emulated.source_format;
+                              color_format=&dev->vs_color_format_uncompressed[subdev];
+                              match=1;
+                              break;
+                          }
+
                           /* Suggest new video mode, close to desired by width */
-                          for (it=0; it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors; it++)
+                          for (it=0; (native) && (it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors); it++)
                           {
                               if ((dev->vs_frame_mjpeg[subdev][it].wWidth-fmt->fmt.pix.width)<
                                   (best_width-fmt->fmt.pix.width))
@@ -2199,12 +3429,23 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   best_height=dev->vs_frame_mjpeg[subdev][it].wHeight;
                               }
                           }
+
+                          /* No native frames, suggest the first emulated one */
+                          if ((best_width==INT_MAX) &&
+                              (uvc_emulated_frame_by_index(dev, subdev, fmt->fmt.pix.pixelformat, 0, &emulated)==0))
+                          {
+                              best_width=emulated.width;
+                              best_height=emulated.height;
+                              source_format=emulated.source_format;
+                              color_format=&dev->vs_color_format_uncompressed[subdev];
+                          }
                           fmt->fmt.pix.width=best_width;
                           fmt->fmt.pix.height=best_height;
                           break;
                      case V4L2_PIX_FMT_H264:
                           bpp=3;
                           color_format=&dev->vs_color_format_h264f[subdev];
+                          source_format=UVC_FORMAT_H264F;
                           for (it=0; it<dev->vs_format_h264f[subdev].bNumFrameDescriptors; it++)
                           {
                               if ((dev->vs_frame_h264f[subdev][it].wWidth==fmt->fmt.pix.width) &&
@@ -2241,6 +3482,10 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      fmt->fmt.pix.bytesperline=fmt->fmt.pix.width*bpp;
                  }
                  fmt->fmt.pix.sizeimage=fmt->fmt.pix.bytesperline*fmt->fmt.pix.height;
+                 if (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_NV12)
+                 {
+                     fmt->fmt.pix.sizeimage+=fmt->fmt.pix.sizeimage/2;
+                 }
 
                  /* Always set hardware colorspace */
                  switch(color_format->bMatrixCoefficients)
@@ -2268,6 +3513,14 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           break;
                  }
 
+                 /* Conversion to RGB is done by driver according to hardware colorspace */
+                 if ((fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_RGB24) ||
+                     (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_BGR32) ||
+                     (fmt->fmt.pix.pixelformat==V4L2_PIX_FMT_RGB565))
+                 {
+                     fmt->fmt.pix.colorspace=V4L2_COLORSPACE_SRGB;
+                 }
+
                  fmt->fmt.pix.priv=0;
 
                  if (uvc_verbose>2)
@@ -2338,6 +3591,8 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
         case VIDIOC_G_CROP:
              {
                  struct v4l2_crop* crop;
+                 int width;
+                 int height;
 
                  crop=(struct v4l2_crop*)dptr;
 
@@ -2355,10 +3610,18 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      ret=EINVAL;
                      break;
                  }
-                 crop->c.left=0;
-                 crop->c.top=0;
-                 crop->c.width=dev->current_width[subdev];
-                 crop->c.height=dev->current_height[subdev];
+                 if (dev->current_crop[subdev].width)
+                 {
+                     crop->c=dev->current_crop[subdev];
+                 }
+                 else
+                 {
+                     uvc_crop_bounds(dev, subdev, &width, &height);
+                     crop->c.left=0;
+                     crop->c.top=0;
+                     crop->c.width=width;
+                     crop->c.height=height;
+                 }
 
                  if (uvc_verbose>2)
                  {
@@ -2374,6 +3637,8 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
         case VIDIOC_S_CROP:
              {
                  struct v4l2_crop* crop;
+                 int width;
+                 int height;
 
                  crop=(struct v4l2_crop*)dptr;
                  if (uvc_verbose>2)
@@ -2398,9 +3663,20 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        c.height: %d", crop->c.height);
                  }
 
-                 if ((crop->c.left!=0) || (crop->c.top!=0) ||
-                     (crop->c.width!=dev->current_width[subdev]) ||
-                     (crop->c.height!=dev->current_height[subdev]))
+                 uvc_crop_bounds(dev, subdev, &width, &height);
+                 if ((crop->c.left==0) && (crop->c.top==0) &&
+                     (crop->c.width==width) && (crop->c.height==height))
+                 {
+                     /* Full frame, cropping is off */
+                     dev->current_crop[subdev].width=0;
+                     break;
+                 }
+
+                 /* Cropping is possible only for MJPEG frames, which are passed through */
+                 /* the driver, it is done losslessly on DCT blocks.                     */
+                 if ((!uvc_emulation) || (dev->current_pixelformat[subdev]!=V4L2_PIX_FMT_MJPEG) ||
+                     (dev->current_source_format[subdev]!=UVC_FORMAT_MJPG) ||
+                     (crop->c.width<=0) || (crop->c.height<=0))
                  {
                      ret=EINVAL;
                      if (uvc_verbose>2)
@@ -2409,6 +3685,14 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      }
                      break;
                  }
+
+                 uvc_adjust_crop(dev, subdev, &crop->c);
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        adjusted to %dx%d at %d,%d",
+                         dev->current_crop[subdev].width, dev->current_crop[subdev].height,
+                         dev->current_crop[subdev].left, dev->current_crop[subdev].top);
+                 }
              }
              break;
         case VIDIOC_ENUMINPUT:
@@ -2538,6 +3822,8 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
         case VIDIOC_ENUM_FRAMESIZES:
              {
                  struct v4l2_frmsizeenum* frm;
+                 uvc_emulated_frame_t emulated;
+                 int native_frames=0;
 
                  frm=(struct v4l2_frmsizeenum*)dptr;
                  frm->reserved[0]=0;
@@ -2558,9 +3844,10 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      case V4L2_PIX_FMT_UYVY:
                      case V4L2_PIX_FMT_VYUY:
                      case V4L2_PIX_FMT_YVYU:
-                          if (((frm->pixel_format==V4L2_PIX_FMT_UYVY) ||
-                               (frm->pixel_format==V4L2_PIX_FMT_YVYU) ||
-                               (frm->pixel_format==V4L2_PIX_FMT_VYUY)) && (!uvc_emulation))
+                     case V4L2_PIX_FMT_RGB24:
+                     case V4L2_PIX_FMT_BGR32:
+                     case V4L2_PIX_FMT_RGB565:
+                          if ((frm->pixel_format!=V4L2_PIX_FMT_YUYV) && (!uvc_emulation))
                           {
                               if (uvc_verbose>2)
                               {
@@ -2568,63 +3855,64 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                               }
                               break;
                           }
-                          for (it=0; it<dev->vs_formats[subdev]; it++)
+                          /* Native frame sizes go first, then sizes produced by driver */
+                          if (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUY2))
                           {
-                              if ((dev->vs_format[subdev][it]==UVC_FORMAT_YUY2) ||
-                                  (dev->vs_format[subdev][it]==UVC_FORMAT_UYVY) ||
-                                  (dev->vs_format[subdev][it]==UVC_FORMAT_YVYU) ||
-                                  (dev->vs_format[subdev][it]==UVC_FORMAT_VYUY))
-                              {
-                                  ret=EOK;
-                                  if (frm->index>=dev->vs_format_uncompressed[subdev].bNumFrameDescriptors)
-                                  {
-                                      if (uvc_verbose>2)
-                                      {
-                                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of frame descriptors");
-                                      }
-                                      ret=EINVAL;
-                                      break;
-                                  }
-                                  break;
-                              }
+                              native_frames=dev->vs_format_uncompressed[subdev].bNumFrameDescriptors;
+                          }
+                          if (frm->index<native_frames)
+                          {
+                              ret=EOK;
+                              break;
+                          }
+                          if (uvc_emulated_frame_by_index(dev, subdev, frm->pixel_format, frm->index-native_frames, &emulated)==0)
+                          {
+                              ret=EOK;
+                              break;
+                          }
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of frame descriptors");
                           }
                           break;
                      case V4L2_PIX_FMT_NV12:
-                          for (it=0; it<dev->vs_formats[subdev]; it++)
+                          if (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_NV12))
                           {
-                              if (dev->vs_format[subdev][it]==UVC_FORMAT_NV12)
-                              {
-                                  ret=EOK;
-                                  if (frm->index>=dev->vs_format_uncompressed[subdev].bNumFrameDescriptors)
-                                  {
-                                      if (uvc_verbose>2)
-                                      {
-                                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of frame descriptors");
-                                      }
-                                      ret=EINVAL;
-                                      break;
-                                  }
-                                  break;
-                              }
+                              native_frames=dev->vs_format_uncompressed[subdev].bNumFrameDescriptors;
+                          }
+                          if (frm->index<native_frames)
+                          {
+                              ret=EOK;
+                              break;
+                          }
+                          if (uvc_emulated_frame_by_index(dev, subdev, frm->pixel_format, frm->index-native_frames, &emulated)==0)
+                          {
+                              ret=EOK;
+                              break;
+                          }
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of frame descriptors");
                           }
                           break;
                      case V4L2_PIX_FMT_MJPEG:
-                          for (it=0; it<dev->vs_formats[subdev]; it++)
+                          if (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG))
                           {
-                              if (dev->vs_format[subdev][it]==UVC_FORMAT_MJPG)
-                              {
-                                  ret=EOK;
-                                  if (frm->index>=dev->vs_format_mjpeg[subdev].bNumFrameDescriptors)
-                                  {
-                                      if (uvc_verbose>2)
-                                      {
-                                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of frame descriptors");
-                                      }
-                                      ret=EINVAL;
-                                      break;
-                                  }
-                                  break;
-                              }
+                              native_frames=dev->vs_format_mjpeg[subdev].bNumFrameDescriptors;
+                          }
+                          if (frm->index<native_frames)
+                          {
+                              ret=EOK;
+                              break;
+                          }
+                          if (uvc_emulated_frame_by_index(dev, subdev, frm->pixel_format, frm->index-native_frames, &emulated)==0)
+                          {
+                              ret=EOK;
+                              break;
+                          }
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of frame descriptors");
                           }
                           break;
                      case V4L2_PIX_FMT_H264:
@@ -2673,11 +3961,26 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      case V4L2_PIX_FMT_UYVY:
                      case V4L2_PIX_FMT_VYUY:
                      case V4L2_PIX_FMT_YVYU:
+                     case V4L2_PIX_FMT_RGB24:
+                     case V4L2_PIX_FMT_BGR32:
+                     case V4L2_PIX_FMT_RGB565:
                      case V4L2_PIX_FMT_NV12:
+                          if (frm->index>=native_frames)
+                          {
+                              frm->discrete.width=emulated.width;
+                              frm->discrete.height=emulated.height;
+                              break;
+                          }
                           frm->discrete.width=dev->vs_frame_uncompressed[subdev][frm->index].wWidth;
                           frm->discrete.height=dev->vs_frame_uncompressed[subdev][frm->index].wHeight;
                           break;
                      case V4L2_PIX_FMT_MJPEG:
+                          if (frm->index>=native_frames)
+                          {
+                              frm->discrete.width=emulated.width;
+                              frm->discrete.height=emulated.height;
+                              break;
+                          }
                           frm->discrete.width=dev->vs_frame_mjpeg[subdev][frm->index].wWidth;
                           frm->discrete.height=dev->vs_frame_mjpeg[subdev][frm->index].wHeight;
                           break;
@@ -2701,6 +4004,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
              {
                  struct v4l2_frmivalenum* frm;
                  int frameno=-1;
+                 uvc_emulated_frame_t emulated;
 
                  frm=(struct v4l2_frmivalenum*)dptr;
 
@@ -2721,9 +4025,10 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      case V4L2_PIX_FMT_UYVY:
                      case V4L2_PIX_FMT_YVYU:
                      case V4L2_PIX_FMT_VYUY:
-                          if (((frm->pixel_format==V4L2_PIX_FMT_UYVY) ||
-                               (frm->pixel_format==V4L2_PIX_FMT_YVYU) ||
-                               (frm->pixel_format==V4L2_PIX_FMT_VYUY)) && (!uvc_emulation))
+                     case V4L2_PIX_FMT_RGB24:
+                     case V4L2_PIX_FMT_BGR32:
+                     case V4L2_PIX_FMT_RGB565:
+                          if ((frm->pixel_format!=V4L2_PIX_FMT_YUYV) && (!uvc_emulation))
                           {
                               break;
                           }
@@ -2745,15 +4050,22 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                           {
                                               if (frm->index>=dev->vs_frame_uncompressed[subdev][frameno].bFrameIntervalType)
                                               {
-                                                  if (uvc_verbose>2)
+                                                  /* Lower frame rates are produced by dropping of frames */
+                                                  if (uvc_emulated_decimated_interval(dev, subdev, UVC_FORMAT_YUY2, frameno, frm->index, frm)<0)
                                                   {
-                                                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                                      if (uvc_verbose>2)
+                                                      {
+                                                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                                      }
+                                                      break;
                                                   }
-                                                  break;
                                               }
-                                              frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
-                                              frm->discrete.numerator=dev->vs_frame_uncompressed[subdev][frameno].dwFrameInterval[frm->index];
-                                              frm->discrete.denominator=10000000;
+                                              else
+                                              {
+                                                  frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
+                                                  frm->discrete.numerator=dev->vs_frame_uncompressed[subdev][frameno].dwFrameInterval[frm->index];
+                                                  frm->discrete.denominator=10000000;
+                                              }
                                           }
                                           else
                                           {
@@ -2780,6 +4092,24 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   }
                               }
                           }
+
+                          /* Check frame sizes which are produced by driver */
+                          if ((frameno==-1) && (uvc_emulated_frame_by_size(dev, subdev, frm->pixel_format,
+                              frm->width, frm->height, &emulated)==0))
+                          {
+                              if (uvc_emulated_frame_interval(dev, subdev, emulated.source_format,
+                                  emulated.source_frame, frm->index, frm)==0)
+                              {
+                                  ret=EOK;
+                              }
+                              else
+                              {
+                                  if (uvc_verbose>2)
+                                  {
+                                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                  }
+                              }
+                          }
                           break;
                      case V4L2_PIX_FMT_NV12:
                           for (jt=0; jt<dev->vs_formats[subdev]; jt++)
@@ -2797,15 +4127,22 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                           {
                                               if (frm->index>=dev->vs_frame_uncompressed[subdev][frameno].bFrameIntervalType)
                                               {
-                                                  if (uvc_verbose>2)
+                                                  /* Lower frame rates are produced by dropping of frames */
+                                                  if (uvc_emulated_decimated_interval(dev, subdev, UVC_FORMAT_NV12, frameno, frm->index, frm)<0)
                                                   {
-                                                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                                      if (uvc_verbose>2)
+                                                      {
+                                                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                                      }
+                                                      break;
                                                   }
-                                                  break;
                                               }
-                                              frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
-                                              frm->discrete.numerator=dev->vs_frame_uncompressed[subdev][frameno].dwFrameInterval[frm->index];
-                                              frm->discrete.denominator=10000000;
+                                              else
+                                              {
+                                                  frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
+                                                  frm->discrete.numerator=dev->vs_frame_uncompressed[subdev][frameno].dwFrameInterval[frm->index];
+                                                  frm->discrete.denominator=10000000;
+                                              }
                                           }
                                           else
                                           {
@@ -2832,6 +4169,24 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   }
                               }
                           }
+
+                          /* Check frame sizes which are produced by driver */
+                          if ((frameno==-1) && (uvc_emulated_frame_by_size(dev, subdev, frm->pixel_format,
+                              frm->width, frm->height, &emulated)==0))
+                          {
+                              if (uvc_emulated_frame_interval(dev, subdev, emulated.source_format,
+                                  emulated.source_frame, frm->index, frm)==0)
+                              {
+                                  ret=EOK;
+                              }
+                              else
+                              {
+                                  if (uvc_verbose>2)
+                                  {
+                                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                  }
+                              }
+                          }
                           break;
                      case V4L2_PIX_FMT_MJPEG:
                           for (jt=0; jt<dev->vs_formats[subdev]; jt++)
@@ -2849,15 +4204,22 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                           {
                                               if (frm->index>=dev->vs_frame_mjpeg[subdev][frameno].bFrameIntervalType)
                                               {
-                                                  if (uvc_verbose>2)
+                                                  /* Lower frame rates are produced by dropping of frames */
+                                                  if (uvc_emulated_decimated_interval(dev, subdev, UVC_FORMAT_MJPG, frameno, frm->index, frm)<0)
                                                   {
-                                                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                                      if (uvc_verbose>2)
+                                                      {
+                                                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                                      }
+                                                      break;
                                                   }
-                                                  break;
                                               }
-                                              frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
-                                              frm->discrete.numerator=dev->vs_frame_mjpeg[subdev][frameno].dwFrameInterval[frm->index];
-                                              frm->discrete.denominator=10000000;
+                                              else
+                                              {
+                                                  frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
+                                                  frm->discrete.numerator=dev->vs_frame_mjpeg[subdev][frameno].dwFrameInterval[frm->index];
+                                                  frm->discrete.denominator=10000000;
+                                              }
                                           }
                                           else
                                           {
@@ -2884,6 +4246,24 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   }
                               }
                           }
+
+                          /* Check frame sizes which are produced by driver */
+                          if ((frameno==-1) && (uvc_emulated_frame_by_size(dev, subdev, frm->pixel_format,
+                              frm->width, frm->height, &emulated)==0))
+                          {
+                              if (uvc_emulated_frame_interval(dev, subdev, emulated.source_format,
+                                  emulated.source_frame, frm->index, frm)==0)
+                              {
+                                  ret=EOK;
+                              }
+                              else
+                              {
+                                  if (uvc_verbose>2)
+                                  {
+                                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: index higher than amount of interval descriptors");
+                                  }
+                              }
+                          }
                           break;
                      case V4L2_PIX_FMT_H264:
                           for (jt=0; jt<dev->vs_formats[subdev]; jt++)
@@ -2976,7 +4356,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
         case VIDIOC_QUERYCTRL:
              {
                  struct v4l2_queryctrl* ctrl;
-                 int newid=-1;
+                 uint32_t newid;
 
                  ctrl=(struct v4l2_queryctrl*)dptr;
 
@@ -2991,39 +4371,8 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                  {
                      ctrl->id&=~(V4L2_CTRL_FLAG_NEXT_CTRL);
 
-                     if ((V4L2_CTRL_ID2CLASS(ctrl->id)==V4L2_CTRL_CLASS_USER) || (newid==-1))
-                     {
-                         if (ctrl->id<V4L2_CTRL_CLASS_USER)
-                         {
-                             ctrl->id=V4L2_CTRL_CLASS_USER-1;
-                         }
-                         for (it=ctrl->id+1; it<V4L2_CTRL_CLASS_USER+0x00001FFF; it++)
-                         {
-                             if (uvc_query_control_data(dev, it, subdev, NULL))
-                             {
-                                 newid=it;
-                                 break;
-                             }
-                         }
-                     }
-
-                     if ((V4L2_CTRL_ID2CLASS(ctrl->id)==V4L2_CTRL_CLASS_CAMERA) || (newid==-1))
-                     {
-                         if (ctrl->id<V4L2_CTRL_CLASS_CAMERA)
-                         {
-                             ctrl->id=V4L2_CTRL_CLASS_CAMERA-1;
-                         }
-                         for (it=ctrl->id+1; it<V4L2_CTRL_CLASS_CAMERA+0x00001FFF; it++)
-                         {
-                             if (uvc_query_control_data(dev, it, subdev, NULL))
-                             {
-                                 newid=it;
-                                 break;
-                             }
-                         }
-                     }
-
-                     if (newid==-1)
+                     newid=uvc_next_control(dev, subdev, ctrl->id);
+                     if (newid==0)
                      {
                          if (uvc_verbose>2)
                          {
@@ -3144,7 +4493,42 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
 
                  if (uvc_query_control_data(dev, ctrl->id, subdev, &data))
                  {
-                     if (V4L2_CTRL_ID2CLASS(ctrl->id)==V4L2_CTRL_CLASS_CAMERA)
+                     if (dev->control_worker_state==UVC_WORKER_RUNNING)
+                     {
+                         struct v4l2_ext_control ectrl;
+
+                         memset(&ectrl, 0x00, sizeof(ectrl));
+                         ectrl.id=ctrl->id;
+                         ectrl.value=ctrl->value;
+                         ret=uvc_queue_control_job(ctp, dev, subdev, ocb, msg->i.dcmd, NULL, &ectrl, 1);
+                         if ((ret==EOK) && (!uvc_control_async))
+                         {
+                             /* Worker replies when control is written */
+                             return _RESMGR_NOREPLY;
+                         }
+                         if (ret==EOK)
+                         {
+                             dctldatasize=sizeof(*ctrl);
+                         }
+                         break;
+                     }
+                     if (data.mapping>=0)
+                     {
+                         struct v4l2_ext_control ectrl;
+                         uint32_t error_idx;
+
+                         /* Bit fields of extension unit control are merged with */
+                         /* its current value by the control writer.             */
+                         memset(&ectrl, 0x00, sizeof(ectrl));
+                         ectrl.id=ctrl->id;
+                         ectrl.value=ctrl->value;
+                         ret=uvc_write_ext_ctrls(dev, subdev, &ectrl, 1, &error_idx, ocb);
+                         if (ret!=EOK)
+                         {
+                             break;
+                         }
+                     }
+                     else if (V4L2_CTRL_ID2CLASS(ctrl->id)==V4L2_CTRL_CLASS_CAMERA)
                      {
                          struct v4l2_ext_control ectrl;
 
@@ -3205,52 +4589,69 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                          break;
                      }
 
-                     switch (menu->id)
+                     if (data.mapping>=0)
                      {
-                         case V4L2_CID_POWER_LINE_FREQUENCY:
-                              switch (menu->index)
-                              {
-                                  case 0:
-                                       strncpy((char*)menu->name, "Disabled", sizeof(menu->name));
-                                       break;
-                                  case 1:
-                                       strncpy((char*)menu->name, "50 Hz", sizeof(menu->name));
-                                       break;
-                                  case 2:
-                                       strncpy((char*)menu->name, "60 Hz", sizeof(menu->name));
-                                       break;
-                                  default:
-                                       ret=EINVAL;
-                                       break;
-                              }
-                              break;
-                         case V4L2_CID_EXPOSURE_AUTO:
-                              switch (menu->index)
-                              {
-                                  case 0:
-                                       strncpy((char*)menu->name, "Auto Mode", sizeof(menu->name));
-                                       break;
-                                  case 1:
-                                       strncpy((char*)menu->name, "Manual Mode", sizeof(menu->name));
-                                       break;
-                                  case 2:
-                                       strncpy((char*)menu->name, "Shutter Priority Mode", sizeof(menu->name));
-                                       break;
-                                  case 3:
-                                       strncpy((char*)menu->name, "Aperture Priority Mode", sizeof(menu->name));
-                                       break;
-                                  default:
-                                       ret=EINVAL;
-                                       break;
-                              }
-                              break;
-                         default:
-                              if (uvc_verbose>2)
-                              {
-                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: control type is not a menu");
-                              }
-                              ret=EINVAL;
-                              break;
+                         if (menu->index>=dev->mapping[data.mapping].menu_count)
+                         {
+                             if (uvc_verbose>2)
+                             {
+                                 slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: menu index is out of range");
+                             }
+                             ret=EINVAL;
+                             break;
+                         }
+                         strncpy((char*)menu->name, (char*)dev->mapping[data.mapping].menu[menu->index].name, sizeof(menu->name));
+                         menu->name[sizeof(menu->name)-1]=0;
+                     }
+                     else
+                     {
+                         switch (menu->id)
+                         {
+                             case V4L2_CID_POWER_LINE_FREQUENCY:
+                                  switch (menu->index)
+                                  {
+                                      case 0:
+                                           strncpy((char*)menu->name, "Disabled", sizeof(menu->name));
+                                           break;
+                                      case 1:
+                                           strncpy((char*)menu->name, "50 Hz", sizeof(menu->name));
+                                           break;
+                                      case 2:
+                                           strncpy((char*)menu->name, "60 Hz", sizeof(menu->name));
+                                           break;
+                                      default:
+                                           ret=EINVAL;
+                                           break;
+                                  }
+                                  break;
+                             case V4L2_CID_EXPOSURE_AUTO:
+                                  switch (menu->index)
+                                  {
+                                      case 0:
+                                           strncpy((char*)menu->name, "Auto Mode", sizeof(menu->name));
+                                           break;
+                                      case 1:
+                                           strncpy((char*)menu->name, "Manual Mode", sizeof(menu->name));
+                                           break;
+                                      case 2:
+                                           strncpy((char*)menu->name, "Shutter Priority Mode", sizeof(menu->name));
+                                           break;
+                                      case 3:
+                                           strncpy((char*)menu->name, "Aperture Priority Mode", sizeof(menu->name));
+                                           break;
+                                      default:
+                                           ret=EINVAL;
+                                           break;
+                                  }
+                                  break;
+                             default:
+                                  if (uvc_verbose>2)
+                                  {
+                                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: control type is not a menu");
+                                  }
+                                  ret=EINVAL;
+                                  break;
+                         }
                      }
                  }
                  else
@@ -3414,7 +4815,6 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
              {
                  struct v4l2_ext_controls* ctrl;
                  struct v4l2_ext_control* _ctrl;
-                 control_data_t data;
                  unsigned int data_class;
 
                  /* We have to return the request stucture in any case */
@@ -3467,65 +4867,29 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                  ret=EINVAL;
                                  break;
                              }
-                         }
-                     }
-                     if (ret!=EOK)
-                     {
-                         ctrl->error_idx=ctrl->count;
-                         break;
-                     }
-                 }
-
-                 for (it=0; it<ctrl->count; it++)
-                 {
-                     if (uvc_verbose>2)
-                     {
-                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        controls[%d].id: %08X", it, _ctrl[it].id);
-                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        controls[%d].value: %08X", it, _ctrl[it].value);
-                     }
-                     if (uvc_query_control_data(dev, _ctrl[it].id, subdev, &data))
-                     {
-                         if (V4L2_CTRL_ID2CLASS(_ctrl[it].id)==V4L2_CTRL_CLASS_CAMERA)
-                         {
-                             ret=uvc_write_ext_ctrl(dev, &_ctrl[it], &data, ocb);
-                             if (ret!=EOK)
-                             {
-                                 break;
-                             }
-                         }
-                         else
-                         {
-                             struct v4l2_control sctrl;
-
-                             sctrl.id=_ctrl[it].id;
-                             sctrl.value=_ctrl[it].value;
-                             ret=uvc_write_ctrl(dev, &sctrl, &data, ocb);
-                             if (ret!=EOK)
-                             {
-                                 break;
-                             }
-                         }
-                     }
-                     else
-                     {
-                         if (uvc_verbose>2)
-                         {
-                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: control can't be found");
-                         }
-                         ret=EINVAL;
-                         break;
+                         }
                      }
-
                      if (ret!=EOK)
                      {
+                         ctrl->error_idx=ctrl->count;
                          break;
                      }
                  }
 
-                 ctrl->error_idx=it;
-                 if (ret!=EOK)
+                 /* Controls are checked first and written with the least number */
+                 /* of transfers, error_idx equals to count if nothing is written */
+                 if (dev->control_worker_state==UVC_WORKER_RUNNING)
                  {
-                     ctrl->error_idx++;
+                     ret=uvc_queue_control_job(ctp, dev, subdev, ocb, msg->i.dcmd, ctrl, _ctrl, ctrl->count);
+                     if ((ret==EOK) && (!uvc_control_async))
+                     {
+                         /* Worker replies when controls are written */
+                         return _RESMGR_NOREPLY;
+                     }
+                 }
+                 else
+                 {
+                     ret=uvc_write_ext_ctrls(dev, subdev, _ctrl, ctrl->count, &ctrl->error_idx, ocb);
                  }
 
                  if (uvc_verbose>2)
@@ -3790,6 +5154,31 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           dev->event[event_it].flags[event->type]=event->flags;
                           dev->event[event_it].id[event->type]=event->id;
                           break;
+                     case UVC_EVENT_MOTION:
+                          /* Motion is detected on MJPEG frames of the device */
+                          if (!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG))
+                          {
+                              if (uvc_verbose>2)
+                              {
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: Motion detection needs MJPEG format");
+                              }
+                              ret=EINVAL;
+                              break;
+                          }
+                          if (uvc_motion_subscribe(dev, subdev)!=0)
+                          {
+                              if (uvc_verbose>2)
+                              {
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate memory for motion detector");
+                              }
+                              ret=ENOMEM;
+                              break;
+                          }
+                          /* Events are bound to the stream of this file descriptor */
+                          dev->event[event_it].type[UVC_EVENT_SLOT_MOTION]=1;
+                          dev->event[event_it].flags[UVC_EVENT_SLOT_MOTION]=event->flags;
+                          dev->event[event_it].id[UVC_EVENT_SLOT_MOTION]=subdev;
+                          break;
                      default:
                           if (uvc_verbose>2)
                           {
@@ -3974,6 +5363,10 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                           dev->event[event_it].type[event->type]=0;
                           dev->event[event_it].flags[event->type]=event->flags;
                           break;
+                     case UVC_EVENT_MOTION:
+                          dev->event[event_it].type[UVC_EVENT_SLOT_MOTION]=0;
+                          dev->event[event_it].flags[UVC_EVENT_SLOT_MOTION]=event->flags;
+                          break;
                      default:
                           if (uvc_verbose>2)
                           {
@@ -4118,6 +5511,11 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        Deleting %d old buffer(s)", dev->current_buffer_count[subdev]);
                      }
 
+                     if (dev->buffer_ptr[subdev]!=NULL)
+                     {
+                         munmap(dev->buffer_ptr[subdev], dev->current_buffer_size[subdev]*dev->current_buffer_count[subdev]);
+                         dev->buffer_ptr[subdev]=NULL;
+                     }
                      if (dev->current_buffer_fds[subdev]!=-1)
                      {
                          close(dev->current_buffer_fds[subdev]);
@@ -4149,7 +5547,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      unsigned int size;
                      unsigned int chunksize;
 
-                     size=dev->current_stride[subdev]*dev->current_height[subdev];
+                     size=uvc_emulation_image_size(dev, subdev);
                      chunksize=sysconf(_SC_PAGE_SIZE);
                      /* Adjust buffer size to system page size */
                      size=(size+chunksize-1) & ~(chunksize-1);
@@ -4185,9 +5583,24 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                          break;
                      }
 
+                     /* Map buffers into driver's address space to fill them with frames */
+                     dev->buffer_ptr[subdev]=mmap(NULL, size*buf->count, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                     if (dev->buffer_ptr[subdev]==MAP_FAILED)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: Can't map shared memory object");
+                         }
+                         dev->buffer_ptr[subdev]=NULL;
+                         close(fd);
+                         ret=ENOMEM;
+                         break;
+                     }
+
                      /* Store requested buffer count */
                      dev->current_reqbufs_ocb[subdev]=ocb;
                      dev->current_buffer_count[subdev]=buf->count;
+                     dev->current_buffer_size[subdev]=size;
                      dev->buffer_mode_mmap[subdev]=1;
                      dev->current_buffer_fds[subdev]=fd;
                      TAILQ_INIT(&dev->input_buffer[subdev].head);
@@ -4252,7 +5665,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      break;
                  }
 
-                 size=dev->current_stride[subdev]*dev->current_height[subdev];
+                 size=uvc_emulation_image_size(dev, subdev);
                  chunksize=sysconf(_SC_PAGE_SIZE);
                  /* Adjust buffer size to system page size */
                  size=(size+chunksize-1) & ~(chunksize-1);
@@ -4407,13 +5820,20 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      break;
                  }
 
-                 buf->flags&=~(V4L2_BUF_FLAG_DONE);
+                 buf->flags&=~(V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_ERROR);
                  buf->flags|=V4L2_BUF_FLAG_QUEUED;
                  buf->sequence=0;
                  buf->bytesused=0;
 
+                 /* Mapped buffer is owned by driver, its geometry is not taken from application */
+                 buf->length=dev->current_buffer_size[subdev];
+                 buf->m.offset=dev->current_buffer_size[subdev]*buf->index;
+
                  entry->buffer=*buf;
 
+                 /* Statistics of the previous frame in this buffer are stale now */
+                 uvc_stats_invalidate(dev->stats[subdev], buf->index);
+
                  /* Enqueue buffer */
                  if (dev->input_buffer[subdev].mutex_inited)
                  {
@@ -4538,6 +5958,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                  int frameindex=0;
                  int frameinterval=0;
                  int framesize=0;
+                 unsigned int linesize;
                  probe_commit_control_t ctrl;
                  usbd_interface_descriptor_t* uvc_interface_descriptor;
                  usbd_descriptors_t* uvc_descriptor;
@@ -4603,57 +6024,37 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      pthread_mutex_unlock(&dev->input_buffer[subdev].access);
                  }
 
-                 /* Initiate the transfer */
-                 switch (dev->current_pixelformat[subdev])
+                 /* Initiate the transfer, emulated formats use their source format and frame */
+                 it=dev->current_source_frame[subdev];
+                 switch (dev->current_source_format[subdev])
                  {
-                     case V4L2_PIX_FMT_YUYV:
-                     case V4L2_PIX_FMT_UYVY:
-                     case V4L2_PIX_FMT_YVYU:
-                     case V4L2_PIX_FMT_VYUY:
-                     case V4L2_PIX_FMT_NV12:
+                     case UVC_FORMAT_YUY2:
+                     case UVC_FORMAT_NV12:
                           formatindex=dev->vs_format_uncompressed[subdev].bFormatIndex;
-                          for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
-                          {
-                              if ((dev->vs_frame_uncompressed[subdev][it].wWidth==dev->current_width[subdev]) &&
-                                  (dev->vs_frame_uncompressed[subdev][it].wHeight==dev->current_height[subdev]))
-                              {
-                                  frameindex=dev->vs_frame_uncompressed[subdev][it].bFrameIndex;
-                                  framesize=dev->vs_frame_uncompressed[subdev][it].dwMaxVideoFrameBufferSize;
-                                  break;
-                              }
-                          }
+                          frameindex=dev->vs_frame_uncompressed[subdev][it].bFrameIndex;
+                          framesize=dev->vs_frame_uncompressed[subdev][it].dwMaxVideoFrameBufferSize;
                           break;
-                     case V4L2_PIX_FMT_MJPEG:
+                     case UVC_FORMAT_MJPG:
                           formatindex=dev->vs_format_mjpeg[subdev].bFormatIndex;
-                          for (it=0; it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors; it++)
-                          {
-                              if ((dev->vs_frame_mjpeg[subdev][it].wWidth==dev->current_width[subdev]) &&
-                                  (dev->vs_frame_mjpeg[subdev][it].wHeight==dev->current_height[subdev]))
-                              {
-                                  frameindex=dev->vs_frame_mjpeg[subdev][it].bFrameIndex;
-                                  framesize=dev->vs_frame_mjpeg[subdev][it].dwMaxVideoFrameBufferSize;
-                                  break;
-                              }
-                          }
+                          frameindex=dev->vs_frame_mjpeg[subdev][it].bFrameIndex;
+                          framesize=dev->vs_frame_mjpeg[subdev][it].dwMaxVideoFrameBufferSize;
                           break;
-                     case V4L2_PIX_FMT_H264:
+                     case UVC_FORMAT_H264F:
                           formatindex=dev->vs_format_h264f[subdev].bFormatIndex;
-                          for (it=0; it<dev->vs_format_h264f[subdev].bNumFrameDescriptors; it++)
-                          {
-                              if ((dev->vs_frame_h264f[subdev][it].wWidth==dev->current_width[subdev]) &&
-                                  (dev->vs_frame_h264f[subdev][it].wHeight==dev->current_height[subdev]))
-                              {
-                                  frameindex=dev->vs_frame_h264f[subdev][it].bFrameIndex;
-                                  framesize=dev->vs_frame_h264f[subdev][it].dwBytesPerLine *
-                                            dev->vs_frame_h264f[subdev][it].wHeight;
-                              }
-                          }
+                          frameindex=dev->vs_frame_h264f[subdev][it].bFrameIndex;
+                          framesize=dev->vs_frame_h264f[subdev][it].dwBytesPerLine *
+                                    dev->vs_frame_h264f[subdev][it].wHeight;
                           break;
                      default:
                           slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] unsupported internal pixel format, please report!");
                           break;
                  }
                  frameinterval=dev->current_frameinterval[subdev];
+                 if (dev->current_decimation[subdev]>1)
+                 {
+                     /* Device streams at the source frame rate, driver drops extra frames */
+                     frameinterval/=dev->current_decimation[subdev];
+                 }
 
                  /* Universal USB bandwidth calculation for isochronous and bulk transfers */
                  estimated_payload_size=(uint64_t)framesize * (10000000000ULL / (uint64_t)frameinterval);
@@ -4807,6 +6208,138 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      break;
                  }
 
+                 /* Allocate buffers for the frame assembly, the second one keeps */
+                 /* completed frame until the frame worker converts it.           */
+                 if (ctrl.dwMaxVideoFrameSize<framesize)
+                 {
+                     ctrl.dwMaxVideoFrameSize=framesize;
+                 }
+                 if (dev->frame_buffer_size[subdev]<ctrl.dwMaxVideoFrameSize)
+                 {
+                     if (dev->frame_buffer[subdev]!=NULL)
+                     {
+                         free(dev->frame_buffer[subdev]);
+                     }
+                     if (dev->frame_work_buffer[subdev]!=NULL)
+                     {
+                         free(dev->frame_work_buffer[subdev]);
+                     }
+                     dev->frame_buffer_size[subdev]=0;
+                     dev->frame_buffer[subdev]=malloc(ctrl.dwMaxVideoFrameSize);
+                     dev->frame_work_buffer[subdev]=malloc(ctrl.dwMaxVideoFrameSize);
+                     if ((dev->frame_buffer[subdev]==NULL) || (dev->frame_work_buffer[subdev]==NULL))
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate memory for frame assembly");
+                         }
+                         ret=ENOMEM;
+                         break;
+                     }
+                     dev->frame_buffer_size[subdev]=ctrl.dwMaxVideoFrameSize;
+                 }
+
+                 /* Allocate line buffer for the conversion of decoded frames, box */
+                 /* filter of uncompressed frames needs the whole source line.     */
+                 linesize=dev->current_width[subdev]*2;
+                 if ((dev->current_scale[subdev]>1) &&
+                     ((dev->current_source_format[subdev]==UVC_FORMAT_YUY2) ||
+                      (dev->current_source_format[subdev]==UVC_FORMAT_NV12)))
+                 {
+                     linesize=dev->vs_frame_uncompressed[subdev][dev->current_source_frame[subdev]].wWidth*2;
+                 }
+                 if (dev->convert_buffer_size[subdev]<linesize)
+                 {
+                     if (dev->convert_buffer[subdev]!=NULL)
+                     {
+                         free(dev->convert_buffer[subdev]);
+                     }
+                     dev->convert_buffer_size[subdev]=0;
+                     dev->convert_buffer[subdev]=malloc(linesize);
+                     if (dev->convert_buffer[subdev]==NULL)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate memory for frame conversion");
+                         }
+                         ret=ENOMEM;
+                         break;
+                     }
+                     dev->convert_buffer_size[subdev]=linesize;
+                 }
+
+                 /* Decoder is created once per stream, so frames are decoded */
+                 /* without any allocations.                                  */
+                 uvc_jpeg_destroy(dev->jpeg_context[subdev]);
+                 dev->jpeg_context[subdev]=NULL;
+                 if ((dev->current_source_format[subdev]==UVC_FORMAT_MJPG) &&
+                     (dev->current_pixelformat[subdev]!=V4L2_PIX_FMT_MJPEG))
+                 {
+                     dev->jpeg_context[subdev]=uvc_jpeg_create(dev->vs_frame_mjpeg[subdev][dev->current_source_frame[subdev]].wWidth);
+                     if (dev->jpeg_context[subdev]==NULL)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate memory for MJPEG decoder");
+                         }
+                         ret=ENOMEM;
+                         break;
+                     }
+                 }
+
+                 /* The same for the transformer of MJPEG frames, which are passed */
+                 /* through, flip, rotation and crop could be changed later.       */
+                 uvc_jpeg_transformer_destroy(dev->jpeg_transformer[subdev]);
+                 dev->jpeg_transformer[subdev]=NULL;
+                 if ((uvc_emulation) && (dev->current_source_format[subdev]==UVC_FORMAT_MJPG) &&
+                     (dev->current_pixelformat[subdev]==V4L2_PIX_FMT_MJPEG))
+                 {
+                     dev->jpeg_transformer[subdev]=uvc_jpeg_transformer_create(
+                         dev->vs_frame_mjpeg[subdev][dev->current_source_frame[subdev]].wWidth,
+                         dev->vs_frame_mjpeg[subdev][dev->current_source_frame[subdev]].wHeight);
+                     if (dev->jpeg_transformer[subdev]==NULL)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate memory for MJPEG transformer");
+                         }
+                         ret=ENOMEM;
+                         break;
+                     }
+                 }
+
+                 /* The same for the encoder of uncompressed frames */
+                 uvc_jpeg_encoder_destroy(dev->jpeg_encoder[subdev]);
+                 dev->jpeg_encoder[subdev]=NULL;
+                 if ((dev->current_source_format[subdev]!=UVC_FORMAT_MJPG) &&
+                     (dev->current_pixelformat[subdev]==V4L2_PIX_FMT_MJPEG))
+                 {
+                     dev->jpeg_encoder[subdev]=uvc_jpeg_encoder_create(dev->current_width[subdev], dev->current_height[subdev],
+                         (dev->current_source_format[subdev]==UVC_FORMAT_NV12) ? V4L2_PIX_FMT_NV12 : V4L2_PIX_FMT_YUYV);
+                     if (dev->jpeg_encoder[subdev]==NULL)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate memory for MJPEG encoder");
+                         }
+                         ret=ENOMEM;
+                         break;
+                     }
+                 }
+                 dev->frame_length[subdev]=0;
+                 dev->frame_fid[subdev]=0;
+                 dev->frame_error[subdev]=0;
+                 dev->frame_eof[subdev]=1;
+                 dev->frame_skip[subdev]=0;
+                 dev->frame_skip_count[subdev]=0;
+                 dev->frame_sequence[subdev]=0;
+                 uvc_motion_reset(dev->motion[subdev]);
+                 if (dev->stats[subdev]!=NULL)
+                 {
+                     uvc_setup_stats(dev, subdev);
+                     uvc_stats_reset(dev->stats[subdev]);
+                 }
+
                  if (uvc_verbose>2)
                  {
                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "      COMMIT get:");
@@ -4991,6 +6524,17 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      }
                  }
 
+                 if (ret!=EOK)
+                 {
+                     break;
+                 }
+
+                 /* Requests for the first frame are written while streaming starts */
+                 uvc_frame_control_jobs(dev, subdev, (uint32_t)-1);
+
+                 /* Completion handler resubmits URBs only while transfer is active */
+                 dev->current_transfer[subdev]=1;
+
                  /* Fire all packets at once */
                  status=0;
                  for (it=0; it<UVC_MAX_ISO_BUFFERS; it++)
@@ -5005,13 +6549,10 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      {
                          slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB i/o error");
                      }
+                     dev->current_transfer[subdev]=0;
                      ret=EIO;
                      break;
                  }
-                 else
-                 {
-                     dev->current_transfer[subdev]=1;
-                 }
              }
              break;
         case VIDIOC_STREAMOFF:
@@ -5056,8 +6597,18 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      break;
                  }
 
-                 /* Stop the transfer */
+                 /* Stop the transfer and wait for the frame being converted */
                  dev->current_transfer[subdev]=0;
+                 uvc_drain_frame_worker(dev, subdev);
+
+                 /* Per-frame control requests are bound to sequence numbers of this run */
+                 if (dev->control_worker_state==UVC_WORKER_RUNNING)
+                 {
+                     pthread_mutex_lock(&dev->control_job_access);
+                     uvc_drop_frame_control_jobs(dev, subdev, NULL);
+                     dev->frame_job_id[subdev]=0;
+                     pthread_mutex_unlock(&dev->control_job_access);
+                 }
 
                  /* Drain input and output queues, all information will be lost */
                  if (dev->input_buffer[subdev].mutex_inited)
@@ -5189,8 +6740,28 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                  }
                  else
                  {
-                     uint64_t desired_frameinterval=
-                         (((uint64_t)parm->parm.capture.timeperframe.denominator)<<32) /
+                     uint64_t desired_frameinterval;
+                     int decimation;
+
+                     if (dev->current_transfer[subdev])
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EBUSY: transfer is active");
+                         }
+                         ret=EBUSY;
+                         break;
+                     }
+                     if (parm->parm.capture.timeperframe.numerator==0)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: zero frame interval");
+                         }
+                         ret=EINVAL;
+                         break;
+                     }
+                     desired_frameinterval=(((uint64_t)parm->parm.capture.timeperframe.denominator)<<32) /
                          parm->parm.capture.timeperframe.numerator;
 
                      /* Find a suitable frame rate */
@@ -5200,6 +6771,9 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                          case V4L2_PIX_FMT_UYVY:
                          case V4L2_PIX_FMT_YVYU:
                          case V4L2_PIX_FMT_VYUY:
+                         case V4L2_PIX_FMT_RGB24:
+                         case V4L2_PIX_FMT_BGR32:
+                         case V4L2_PIX_FMT_RGB565:
                          case V4L2_PIX_FMT_NV12:
                               for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
                               {
@@ -5315,63 +6889,194 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                               }
                               break;
                      }
-                     parm->parm.capture.timeperframe.numerator=best_frameinterval_num;
-                     parm->parm.capture.timeperframe.denominator=10000000;
+
+                     /* Frames produced by driver use frame intervals of the source frame */
+                     if (((dev->current_source_format[subdev]==UVC_FORMAT_MJPG) &&
+                         (dev->current_pixelformat[subdev]!=V4L2_PIX_FMT_MJPEG)) ||
+                         ((dev->current_source_format[subdev]!=UVC_FORMAT_MJPG) &&
+                         (dev->current_pixelformat[subdev]==V4L2_PIX_FMT_MJPEG)) ||
+                         (dev->current_scale[subdev]>1))
+                     {
+                         best_frameinterval_num=uvc_emulated_frame_best_interval(dev, subdev,
+                             dev->current_source_format[subdev], dev->current_source_frame[subdev],
+                             desired_frameinterval);
+                     }
+
+                     /* Lower frame rates are produced by dropping of source frames */
+                     decimation=uvc_emulated_frame_decimation(dev, subdev, desired_frameinterval, &best_frameinterval_num);
+
+                     /* Store negotiated frame interval, STREAMON requests the source one */
+                     if (best_frameinterval_num!=INT_MAX)
+                     {
+                         dev->current_frameinterval[subdev]=best_frameinterval_num;
+                         dev->current_decimation[subdev]=decimation;
+                     }
+                     parm->parm.capture.timeperframe.numerator=dev->current_frameinterval[subdev];
+                     parm->parm.capture.timeperframe.denominator=10000000;
+                 }
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "      on return:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        type: %d", parm->type);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        capability: %d", parm->parm.capture.capability);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        capturemode: %d", parm->parm.capture.capturemode);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        timeperframe.numerator: %d", parm->parm.capture.timeperframe.numerator);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        timeperframe.denominator: %d", parm->parm.capture.timeperframe.denominator);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        extendedmode: %d", parm->parm.capture.extendedmode);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        readbuffers: %d", parm->parm.capture.readbuffers);
+                 }
+
+                 dctldatasize=sizeof(*parm);
+             }
+             break;
+        case VIDIOC_ENUMSTD:
+             {
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_ENUMSTD:");
+                 }
+
+                 /* Output and input enumeration are not supported */
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: Can't enumerate video standard (according to UVC standard)");
+                 }
+                 ret=ENODATA;
+                 break;
+             }
+             break;
+        case VIDIOC_S_STD:
+             {
+                 v4l2_std_id* id;
+
+                 id=(v4l2_std_id*)dptr;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_S_STD:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %08llX", *id);
+                 }
+
+                 /* Output and input enumeration are not supported */
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: Can't set video standard (according to UVC standard)");
+                 }
+                 ret=ENODATA;
+                 break;
+             }
+             break;
+        case VIDIOC_G_STD:
+             {
+                 v4l2_std_id* id;
+
+                 status=0;
+                 id=(v4l2_std_id*)dptr;
+                 *id=V4L2_STD_UNKNOWN;
+
+                 dctldatasize=sizeof(*id);
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_G_STD:");
+                 }
+
+                 if ((dev->vc_processing_unit.bmControls[2] &
+                     (VPU_B2_ANALOG_VIDEO_STANDARD | VPU_B2_ANALOG_VIDEO_LOCK_STATUS))==
+                     (VPU_B2_ANALOG_VIDEO_STANDARD | VPU_B2_ANALOG_VIDEO_LOCK_STATUS))
+                 {
+                     unsigned char value;
+
+                     status|=uvc_control_get(dev, VGET_CUR, UVC_PUNIT_SELECTOR,
+                         VPU_ANALOG_LOCK_STATUS_CONTROL, 1, &value);
+                     if (!value)
+                     {
+                         status|=uvc_control_get(dev, VGET_CUR, UVC_PUNIT_SELECTOR,
+                             VPU_ANALOG_VIDEO_STANDARD_CONTROL, 1, &value);
+                         switch(value)
+                         {
+                             case VPU_STD_NTSC_525_60:
+                                  *id=V4L2_STD_NTSC;
+                                  break;
+                             case VPU_STD_PAL_625_50:
+                                  *id=V4L2_STD_PAL;
+                                  break;
+                             case VPU_STD_SECAM_625_50:
+                                  *id=V4L2_STD_SECAM;
+                                  break;
+                             case VPU_STD_NTSC_625_50:
+                                  *id=V4L2_STD_NTSC;
+                                  break;
+                             case VPU_STD_PAL_525_60:
+                                  *id=V4L2_STD_PAL_60;
+                                  break;
+                         }
+                     }
+                     else
+                     {
+                         *id=V4L2_STD_UNKNOWN;
+                     }
                  }
-
-                 if (uvc_verbose>2)
+                 else
                  {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "      on return:");
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        type: %d", parm->type);
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        capability: %d", parm->parm.capture.capability);
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        capturemode: %d", parm->parm.capture.capturemode);
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        timeperframe.numerator: %d", parm->parm.capture.timeperframe.numerator);
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        timeperframe.denominator: %d", parm->parm.capture.timeperframe.denominator);
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        extendedmode: %d", parm->parm.capture.extendedmode);
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        readbuffers: %d", parm->parm.capture.readbuffers);
-                 }
+                     if ((dev->vc_processing_unit.bmControls[2] &
+                         VPU_B2_ANALOG_VIDEO_STANDARD)==VPU_B2_ANALOG_VIDEO_STANDARD)
+                     {
+                         unsigned char value;
 
-                 dctldatasize=sizeof(*parm);
-             }
-             break;
-        case VIDIOC_ENUMSTD:
-             {
-                 if (uvc_verbose>2)
-                 {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_ENUMSTD:");
+                         status|=uvc_control_get(dev, VGET_CUR, UVC_PUNIT_SELECTOR,
+                             VPU_ANALOG_VIDEO_STANDARD_CONTROL, 1, &value);
+                         switch(value)
+                         {
+                             case VPU_STD_NTSC_525_60:
+                                  *id=V4L2_STD_NTSC;
+                                  break;
+                             case VPU_STD_PAL_625_50:
+                                  *id=V4L2_STD_PAL;
+                                  break;
+                             case VPU_STD_SECAM_625_50:
+                                  *id=V4L2_STD_SECAM;
+                                  break;
+                             case VPU_STD_NTSC_625_50:
+                                  *id=V4L2_STD_NTSC;
+                                  break;
+                             case VPU_STD_PAL_525_60:
+                                  *id=V4L2_STD_PAL_60;
+                                  break;
+                         }
+                     }
+                     else
+                     {
+                         if (*id==V4L2_STD_UNKNOWN)
+                         {
+                             if (uvc_verbose>2)
+                             {
+                                 slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: video standards are not supported");
+                             }
+                             ret=ENODATA;
+                             break;
+                         }
+                     }
                  }
 
-                 /* Output and input enumeration are not supported */
-                 if (uvc_verbose>2)
+                 if (status)
                  {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: Can't enumerate video standard (according to UVC standard)");
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+                     }
+                     ret=EIO;
+                     break;
                  }
-                 ret=ENODATA;
-                 break;
-             }
-             break;
-        case VIDIOC_S_STD:
-             {
-                 v4l2_std_id* id;
-
-                 id=(v4l2_std_id*)dptr;
 
                  if (uvc_verbose>2)
                  {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_S_STD:");
                      slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %08llX", *id);
                  }
-
-                 /* Output and input enumeration are not supported */
-                 if (uvc_verbose>2)
-                 {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: Can't set video standard (according to UVC standard)");
-                 }
-                 ret=ENODATA;
-                 break;
              }
              break;
-        case VIDIOC_G_STD:
+        case VIDIOC_QUERYSTD:
              {
                  v4l2_std_id* id;
 
@@ -5383,7 +7088,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
 
                  if (uvc_verbose>2)
                  {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_G_STD:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_QUERYSTD:");
                  }
 
                  if ((dev->vc_processing_unit.bmControls[2] &
@@ -5417,54 +7122,309 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                                   break;
                          }
                      }
-                     else
+                     else
+                     {
+                         *id=V4L2_STD_UNKNOWN;
+                     }
+                 }
+                 else
+                 {
+                     if ((dev->vc_processing_unit.bmControls[2] &
+                         VPU_B2_ANALOG_VIDEO_STANDARD)==VPU_B2_ANALOG_VIDEO_STANDARD)
+                     {
+                         unsigned char value;
+
+                         status|=uvc_control_get(dev, VGET_CUR, UVC_PUNIT_SELECTOR,
+                             VPU_ANALOG_VIDEO_STANDARD_CONTROL, 1, &value);
+                         switch(value)
+                         {
+                             case VPU_STD_NTSC_525_60:
+                                  *id=V4L2_STD_NTSC;
+                                  break;
+                             case VPU_STD_PAL_625_50:
+                                  *id=V4L2_STD_PAL;
+                                  break;
+                             case VPU_STD_SECAM_625_50:
+                                  *id=V4L2_STD_SECAM;
+                                  break;
+                             case VPU_STD_NTSC_625_50:
+                                  *id=V4L2_STD_NTSC;
+                                  break;
+                             case VPU_STD_PAL_525_60:
+                                  *id=V4L2_STD_PAL_60;
+                                  break;
+                         }
+                     }
+                     else
+                     {
+                         if (*id==V4L2_STD_UNKNOWN)
+                         {
+                             if (uvc_verbose>2)
+                             {
+                                 slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: video standards are not supported");
+                             }
+                             ret=ENODATA;
+                             break;
+                         }
+                     }
+                 }
+
+                 if (status)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EIO: USB I/O error");
+                     }
+                     ret=EIO;
+                     break;
+                 }
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %08llX", *id);
+                 }
+             }
+             break;
+        case UVCIOC_S_FRAME_CTRLS:
+             {
+                 uvc_frame_ctrls_t* request;
+
+                 request=(uvc_frame_ctrls_t*)dptr;
+                 dctldatasize=sizeof(*request);
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    UVCIOC_S_FRAME_CTRLS:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        id: %08X", request->id);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        sequence: %08X", request->sequence);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        count: %08X", request->count);
+                 }
+
+                 request->error_idx=request->count;
+                 if ((request->id==0) || (request->count==0) || (request->count>UVC_MAX_FRAME_CONTROLS))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: wrong request id or controls count");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 /* Requests are written by control worker only */
+                 if (dev->control_worker_state!=UVC_WORKER_RUNNING)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOTSUP: control worker is not running");
+                     }
+                     ret=ENOTSUP;
+                     break;
+                 }
+
+                 /* Values are checked now, the write itself could fail only on USB */
+                 ret=uvc_check_ext_ctrls(dev, subdev, request->controls, request->count, &request->error_idx);
+                 if (ret!=EOK)
+                 {
+                     break;
+                 }
+
+                 ret=uvc_queue_frame_control_job(dev, subdev, ocb, request);
+             }
+             break;
+        case UVCIOC_S_STATS:
+             {
+                 uvc_stats_config_t* config;
+
+                 config=(uvc_stats_config_t*)dptr;
+                 dctldatasize=sizeof(*config);
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    UVCIOC_S_STATS:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        enable: %d", config->enable);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        grid: %dx%d", config->columns, config->rows);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        clip: %d-%d", config->clip_low, config->clip_high);
+                 }
+
+                 /* Statistics are kept until device removal, because frames */
+                 /* could be accounted at the same time.                     */
+                 if (dev->stats[subdev]==NULL)
+                 {
+                     if (!config->enable)
+                     {
+                         break;
+                     }
+                     dev->stats[subdev]=uvc_stats_create();
+                     if (dev->stats[subdev]==NULL)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: can't allocate memory for statistics");
+                         }
+                         ret=ENOMEM;
+                         break;
+                     }
+                 }
+
+                 if (uvc_stats_configure(dev->stats[subdev], config)!=0)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: wrong grid size or clipping levels");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+                 uvc_setup_stats(dev, subdev);
+
+                 /* New configuration is applied by streaming at frame boundary */
+                 if (!dev->current_transfer[subdev])
+                 {
+                     uvc_stats_reset(dev->stats[subdev]);
+                 }
+             }
+             break;
+        case UVCIOC_G_STATS:
+             {
+                 uvc_frame_stats_t* result;
+
+                 result=(uvc_frame_stats_t*)dptr;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    UVCIOC_G_STATS:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %d", result->index);
+                 }
+
+                 if ((dev->stats[subdev]==NULL) || (uvc_stats_get(dev->stats[subdev], result)!=0))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: buffer has no statistics");
+                     }
+                     ret=ENODATA;
+                     break;
+                 }
+
+                 dctldatasize=sizeof(*result);
+             }
+             break;
+        case UVCIOC_CTRL_MAP:
+             {
+                 struct uvc_xu_control_mapping* map;
+                 struct uvc_menu_info* menu;
+                 uvc_control_mapping_t* mapping;
+                 unsigned char value[2];
+                 int length;
+                 int xu;
+                 int vs;
+
+                 map=(struct uvc_xu_control_mapping*)dptr;
+                 menu=(struct uvc_menu_info*)(map+1);
+                 dctldatasize=sizeof(*map);
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    UVCIOC_CTRL_MAP:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        id: %08X", map->id);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        selector: %02X", map->selector);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        size: %d, offset: %d", map->size, map->offset);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        v4l2_type: %08X", map->v4l2_type);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        data_type: %08X", map->data_type);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        menu_count: %08X", map->menu_count);
+                 }
+
+                 /* Check if we have to work with embedded pointers */
+                 if ((map->v4l2_type==V4L2_CTRL_TYPE_MENU) && (map->menu_count>0) &&
+                     (map->menu_count<=UVC_MAX_MAPPING_MENUS) && (map->menu_info!=NULL) &&
+                     (dev->current_stage[subdev]==0))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EMORE: asking for embedded pointer lookup");
+                     }
+                     dev->current_stage[subdev]=1;
+                     ret=EMORE;
+                     break;
+                 }
+
+                 /* Clear the second stage of embedded pointer gathering */
+                 dev->current_stage[subdev]=0;
+
+                 for (xu=0; xu<dev->total_vc_extensions; xu++)
+                 {
+                     if (memcmp(dev->vc_extension[xu].guidExtensionCode, map->entity, 16)==0)
                      {
-                         *id=V4L2_STD_UNKNOWN;
+                         break;
                      }
                  }
-                 else
+                 if (xu==dev->total_vc_extensions)
                  {
-                     if ((dev->vc_processing_unit.bmControls[2] &
-                         VPU_B2_ANALOG_VIDEO_STANDARD)==VPU_B2_ANALOG_VIDEO_STANDARD)
+                     if (uvc_verbose>2)
                      {
-                         unsigned char value;
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOENT: extension unit can't be found");
+                     }
+                     ret=ENOENT;
+                     break;
+                 }
 
-                         status|=uvc_control_get(dev, VGET_CUR, UVC_PUNIT_SELECTOR,
-                             VPU_ANALOG_VIDEO_STANDARD_CONTROL, 1, &value);
-                         switch(value)
-                         {
-                             case VPU_STD_NTSC_525_60:
-                                  *id=V4L2_STD_NTSC;
-                                  break;
-                             case VPU_STD_PAL_625_50:
-                                  *id=V4L2_STD_PAL;
-                                  break;
-                             case VPU_STD_SECAM_625_50:
-                                  *id=V4L2_STD_SECAM;
-                                  break;
-                             case VPU_STD_NTSC_625_50:
-                                  *id=V4L2_STD_NTSC;
-                                  break;
-                             case VPU_STD_PAL_525_60:
-                                  *id=V4L2_STD_PAL_60;
-                                  break;
-                         }
+                 /* Mappings are shared by all streams, id must be unique for each of them */
+                 for (vs=0; vs<dev->total_vs_devices; vs++)
+                 {
+                     if (uvc_query_control_data(dev, map->id, vs, NULL))
+                     {
+                         break;
                      }
-                     else
+                 }
+                 if (vs!=dev->total_vs_devices)
+                 {
+                     if (uvc_verbose>2)
                      {
-                         if (*id==V4L2_STD_UNKNOWN)
-                         {
-                             if (uvc_verbose>2)
-                             {
-                                 slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: video standards are not supported");
-                             }
-                             ret=ENODATA;
-                             break;
-                         }
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EEXIST: control already exists");
                      }
+                     ret=EEXIST;
+                     break;
                  }
 
-                 if (status)
+                 switch (map->v4l2_type)
+                 {
+                     case V4L2_CTRL_TYPE_INTEGER:
+                     case V4L2_CTRL_TYPE_BOOLEAN:
+                          break;
+                     case V4L2_CTRL_TYPE_MENU:
+                          if ((map->menu_count==0) || (map->menu_count>UVC_MAX_MAPPING_MENUS) || (map->menu_info==NULL))
+                          {
+                              if (uvc_verbose>2)
+                              {
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: menu is not supported");
+                              }
+                              ret=EINVAL;
+                          }
+                          break;
+                     default:
+                          if (uvc_verbose>2)
+                          {
+                              slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: control type is not supported");
+                          }
+                          ret=EINVAL;
+                          break;
+                 }
+                 if ((map->size<1) || (map->size>32))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: bit field size is not supported");
+                     }
+                     ret=EINVAL;
+                 }
+                 if (ret!=EOK)
+                 {
+                     break;
+                 }
+
+                 /* Control length is cached, it is used for every access */
+                 if (uvc_control_get(dev, VGET_LEN, UVC_XUNIT_SELECTOR(dev->vc_extension[xu].bUnitID), map->selector, 2, value))
                  {
                      if (uvc_verbose>2)
                      {
@@ -5473,106 +7433,168 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      ret=EIO;
                      break;
                  }
+                 length=uvc_get_uinteger(2, &value[0]);
+                 if ((length==0) || (length>UVC_MAX_CACHED_CONTROL_SIZE) || (map->offset+map->size>length*8))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: bit field doesn't fit control of %d bytes", length);
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
 
-                 if (uvc_verbose>2)
+                 pthread_mutex_lock(&dev->control_access);
+                 if (dev->total_mappings==UVC_MAX_MAPPINGS)
                  {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %08llX", *id);
+                     pthread_mutex_unlock(&dev->control_access);
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: too many mapped controls");
+                     }
+                     ret=ENOMEM;
+                     break;
+                 }
+
+                 /* Mapping is filled before it is counted, readers do not lock */
+                 mapping=&dev->mapping[dev->total_mappings];
+                 memset(mapping, 0x00, sizeof(*mapping));
+                 mapping->id=map->id;
+                 strncpy(mapping->name, (char*)map->name, sizeof(mapping->name)-1);
+                 mapping->unit_id=dev->vc_extension[xu].bUnitID;
+                 mapping->selector=map->selector;
+                 mapping->size=map->size;
+                 mapping->offset=map->offset;
+                 mapping->length=length;
+                 mapping->v4l2_type=map->v4l2_type;
+                 mapping->data_type=map->data_type;
+                 if (map->v4l2_type==V4L2_CTRL_TYPE_MENU)
+                 {
+                     mapping->menu_count=map->menu_count;
+                     memcpy(mapping->menu, menu, map->menu_count*sizeof(struct uvc_menu_info));
+                     for (it=0; it<map->menu_count; it++)
+                     {
+                         mapping->menu[it].name[sizeof(mapping->menu[it].name)-1]=0;
+                     }
                  }
+                 dev->total_mappings++;
+                 pthread_mutex_unlock(&dev->control_access);
              }
              break;
-        case VIDIOC_QUERYSTD:
+        case UVCIOC_CTRL_QUERY:
              {
-                 v4l2_std_id* id;
-
-                 status=0;
-                 id=(v4l2_std_id*)dptr;
-                 *id=V4L2_STD_UNKNOWN;
+                 struct uvc_xu_control_query* query;
+                 uint8_t* data;
+                 unsigned char value[2];
+                 int xu;
 
-                 dctldatasize=sizeof(*id);
+                 query=(struct uvc_xu_control_query*)dptr;
+                 data=(uint8_t*)(query+1);
+                 dctldatasize=sizeof(*query);
 
                  if (uvc_verbose>2)
                  {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_QUERYSTD:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    UVCIOC_CTRL_QUERY:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        unit: %02X", query->unit);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        selector: %02X", query->selector);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        query: %02X", query->query);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        size: %d", query->size);
                  }
 
-                 if ((dev->vc_processing_unit.bmControls[2] &
-                     (VPU_B2_ANALOG_VIDEO_STANDARD | VPU_B2_ANALOG_VIDEO_LOCK_STATUS))==
-                     (VPU_B2_ANALOG_VIDEO_STANDARD | VPU_B2_ANALOG_VIDEO_LOCK_STATUS))
+                 if ((query->size==0) || (query->size>UVC_MAX_CONTROL_PAYLOAD_SIZE) || (query->data==NULL))
                  {
-                     unsigned char value;
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: size of data is not supported");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
 
-                     status|=uvc_control_get(dev, VGET_CUR, UVC_PUNIT_SELECTOR,
-                         VPU_ANALOG_LOCK_STATUS_CONTROL, 1, &value);
-                     if (!value)
+                 /* Check if we have to work with embedded pointers */
+                 if (dev->current_stage[subdev]==0)
+                 {
+                     if (uvc_verbose>2)
                      {
-                         status|=uvc_control_get(dev, VGET_CUR, UVC_PUNIT_SELECTOR,
-                             VPU_ANALOG_VIDEO_STANDARD_CONTROL, 1, &value);
-                         switch(value)
-                         {
-                             case VPU_STD_NTSC_525_60:
-                                  *id=V4L2_STD_NTSC;
-                                  break;
-                             case VPU_STD_PAL_625_50:
-                                  *id=V4L2_STD_PAL;
-                                  break;
-                             case VPU_STD_SECAM_625_50:
-                                  *id=V4L2_STD_SECAM;
-                                  break;
-                             case VPU_STD_NTSC_625_50:
-                                  *id=V4L2_STD_NTSC;
-                                  break;
-                             case VPU_STD_PAL_525_60:
-                                  *id=V4L2_STD_PAL_60;
-                                  break;
-                         }
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EMORE: asking for embedded pointer lookup");
                      }
-                     else
+                     dev->current_stage[subdev]=1;
+                     ret=EMORE;
+                     break;
+                 }
+
+                 /* Clear the second stage of embedded pointer gathering */
+                 dev->current_stage[subdev]=0;
+
+                 /* Raw access is allowed to extension units only */
+                 for (xu=0; xu<dev->total_vc_extensions; xu++)
+                 {
+                     if (dev->vc_extension[xu].bUnitID==query->unit)
                      {
-                         *id=V4L2_STD_UNKNOWN;
+                         break;
                      }
                  }
-                 else
+                 if (xu==dev->total_vc_extensions)
                  {
-                     if ((dev->vc_processing_unit.bmControls[2] &
-                         VPU_B2_ANALOG_VIDEO_STANDARD)==VPU_B2_ANALOG_VIDEO_STANDARD)
+                     if (uvc_verbose>2)
                      {
-                         unsigned char value;
-
-                         status|=uvc_control_get(dev, VGET_CUR, UVC_PUNIT_SELECTOR,
-                             VPU_ANALOG_VIDEO_STANDARD_CONTROL, 1, &value);
-                         switch(value)
-                         {
-                             case VPU_STD_NTSC_525_60:
-                                  *id=V4L2_STD_NTSC;
-                                  break;
-                             case VPU_STD_PAL_625_50:
-                                  *id=V4L2_STD_PAL;
-                                  break;
-                             case VPU_STD_SECAM_625_50:
-                                  *id=V4L2_STD_SECAM;
-                                  break;
-                             case VPU_STD_NTSC_625_50:
-                                  *id=V4L2_STD_NTSC;
-                                  break;
-                             case VPU_STD_PAL_525_60:
-                                  *id=V4L2_STD_PAL_60;
-                                  break;
-                         }
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOENT: extension unit can't be found");
                      }
-                     else
+                     ret=ENOENT;
+                     break;
+                 }
+
+                 switch (query->query)
+                 {
+                     case VGET_LEN:
+                          if (query->size!=2)
+                          {
+                              ret=EINVAL;
+                          }
+                          break;
+                     case VGET_INFO:
+                          if (query->size!=1)
+                          {
+                              ret=EINVAL;
+                          }
+                          break;
+                     case VSET_CUR:
+                     case VGET_CUR:
+                     case VGET_MIN:
+                     case VGET_MAX:
+                     case VGET_RES:
+                     case VGET_DEF:
+                          if (uvc_control_get(dev, VGET_LEN, UVC_XUNIT_SELECTOR(query->unit), query->selector, 2, value))
+                          {
+                              ret=EIO;
+                              break;
+                          }
+                          if (query->size!=uvc_get_uinteger(2, &value[0]))
+                          {
+                              ret=EINVAL;
+                          }
+                          break;
+                     default:
+                          ret=EINVAL;
+                          break;
+                 }
+                 if (ret!=EOK)
+                 {
+                     if (uvc_verbose>2)
                      {
-                         if (*id==V4L2_STD_UNKNOWN)
-                         {
-                             if (uvc_verbose>2)
-                             {
-                                 slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENODATA: video standards are not supported");
-                             }
-                             ret=ENODATA;
-                             break;
-                         }
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        %s: request doesn't match the control", (ret==EIO) ? "EIO" : "EINVAL");
                      }
+                     break;
                  }
 
+                 if (query->query==VSET_CUR)
+                 {
+                     status=uvc_control_set(dev, VSET_CUR, UVC_XUNIT_SELECTOR(query->unit), query->selector, query->size, data);
+                 }
+                 else
+                 {
+                     status=uvc_control_get(dev, query->query, UVC_XUNIT_SELECTOR(query->unit), query->selector, query->size, data);
+                 }
                  if (status)
                  {
                      if (uvc_verbose>2)
@@ -5583,10 +7605,7 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                      break;
                  }
 
-                 if (uvc_verbose>2)
-                 {
-                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %08llX", *id);
-                 }
+                 dctlextdatasize=query->size;
              }
              break;
         case DCMD_MISC_GETPTREMBED:
@@ -5631,6 +7650,60 @@ int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
                               slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EOK: supported request");
                           }
                           return EOK;
+                     case UVCIOC_CTRL_MAP:
+                          {
+                              struct uvc_xu_control_mapping* map=(struct uvc_xu_control_mapping*)ctrl;
+
+                              if (uvc_verbose>2)
+                              {
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        embedding pointer: %08X", (uint32_t)map->menu_info);
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        pointer data size: %08X", map->menu_count*sizeof(struct uvc_menu_info));
+                              }
+                              /* setup menu pointer */
+                              SETIOV(iov+0, map->menu_info, map->menu_count*sizeof(struct uvc_menu_info));
+                              SETIOV(iov+1, 0x00000000, 0);
+                              SETIOV(iov+2, 0x00000000, 0);
+                              SETIOV(iov+3, 0x00000000, 0);
+                              SETIOV(iov+4, 0x00000000, 0);
+                              SETIOV(iov+5, 0x00000000, 0);
+                              /* return an original structure as is */
+                              _RESMGR_STATUS(ctp, EOK);
+                              msg->o.ret_val=0;
+                              status=resmgr_msgwrite(ctp, &msg->o, sizeof(struct __ioctl_getptrembed)+
+                                  6*sizeof(iov_t)+sizeof(struct uvc_xu_control_mapping), 0);
+                              if (uvc_verbose>2)
+                              {
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EOK: supported request");
+                              }
+                          }
+                          return EOK;
+                     case UVCIOC_CTRL_QUERY:
+                          {
+                              struct uvc_xu_control_query* query=(struct uvc_xu_control_query*)ctrl;
+
+                              if (uvc_verbose>2)
+                              {
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        embedding pointer: %08X", (uint32_t)query->data);
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        pointer data size: %08X", query->size);
+                              }
+                              /* setup data pointer */
+                              SETIOV(iov+0, query->data, query->size);
+                              SETIOV(iov+1, 0x00000000, 0);
+                              SETIOV(iov+2, 0x00000000, 0);
+                              SETIOV(iov+3, 0x00000000, 0);
+                              SETIOV(iov+4, 0x00000000, 0);
+                              SETIOV(iov+5, 0x00000000, 0);
+                              /* return an original structure as is */
+                              _RESMGR_STATUS(ctp, EOK);
+                              msg->o.ret_val=0;
+                              status=resmgr_msgwrite(ctp, &msg->o, sizeof(struct __ioctl_getptrembed)+
+                                  6*sizeof(iov_t)+sizeof(struct uvc_xu_control_query), 0);
+                              if (uvc_verbose>2)
+                              {
+                                  slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EOK: supported request");
+                              }
+                          }
+                          return EOK;
                  }
                  if (uvc_verbose>2)
                  {
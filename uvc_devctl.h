@@ -27,5 +27,11 @@
 #include "uvc.h"
 
 int uvc_devctl(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb);
+void uvc_build_controls(uvc_device_t* dev, int subdev);
+void uvc_prefetch_controls(uvc_device_t* dev, int subdev);
+int uvc_setup_control_worker(uvc_device_t* dev);
+void uvc_unsetup_control_worker(uvc_device_t* dev);
+void uvc_cancel_control_jobs(uvc_device_t* dev, uvc_ocb_t* ocb);
+uint32_t uvc_frame_control_jobs(uvc_device_t* dev, int subdev, uint32_t sequence);
 
 #endif /* __UVC_DEVCTL_H__ */
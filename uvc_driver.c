@@ -36,10 +36,16 @@
 #include "usbvc.h"
 #include "usbids.h"
 #include "uvc_rm.h"
+#include "uvc_jpeg.h"
 #include "uvc_sysfs.h"
 #include "uvc_media.h"
+#include "uvc_stats.h"
+#include "uvc_motion.h"
+#include "uvc_preview.h"
 #include "uvc_driver.h"
+#include "uvc_devctl.h"
 #include "uvc_control.h"
+#include "uvc_emulation.h"
 #include "uvc_streaming.h"
 #include "uvc_interrupt.h"
 
@@ -48,6 +54,8 @@ int uvc_exit=0;
 int uvc_verbose=0;
 int uvc_emulation=1;
 int uvc_audio=1;
+int uvc_preview=0;
+int uvc_control_async=0;
 
 int coid;
 int chid;
@@ -261,6 +269,15 @@ void uvc_insertion(struct usbd_connection* connection, usbd_device_instance_t* i
             }
         }
 
+        /* Preallocate control transfers, before interrupts can request controls */
+        uvc_setup_control(uvcd);
+
+        /* Control writes are done by worker thread of device */
+        uvc_setup_control_worker(uvcd);
+
+        /* Completed frames are converted by another worker thread */
+        uvc_setup_frame_worker(uvcd);
+
         /* Initialize USB interrupt pipe */
         uvc_setup_interrupt(uvcd);
 
@@ -385,6 +402,14 @@ void uvc_insertion(struct usbd_connection* connection, usbd_device_instance_t* i
             }
         }
 
+        /* Add formats which are produced by driver from native formats */
+        uvc_emulation_add_formats(uvcd, uvcd->total_vs_devices);
+
+        /* List controls of the stream, their limits are read once, range */
+        /* change interrupts update them.                                 */
+        uvc_build_controls(uvcd, uvcd->total_vs_devices);
+        uvc_prefetch_controls(uvcd, uvcd->total_vs_devices);
+
         if (uvc_register_name(uvcd, devmap_id)<0)
         {
             usbd_detach(uvc_device);
@@ -406,12 +431,24 @@ void uvc_insertion(struct usbd_connection* connection, usbd_device_instance_t* i
             return;
         }
 
+        if ((uvc_preview) && (uvc_register_preview(uvcd, devmap_id)<0))
+        {
+            usbd_detach(uvc_device);
+            slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't register preview device name");
+            return;
+        }
+
         /* Store interface number for future references */
         uvcd->vs_usb_iface[uvcd->total_vs_devices]=instance->iface;
         uvcd->vs_usb_config[uvcd->total_vs_devices]=instance->config;
 
         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc]     Device /dev/video%d, USB ID %04X:%04X",
             devmap[devmap_id].devid[uvcd->total_vs_devices], uvcd->vendor_id, uvcd->device_id);
+        if (uvcd->preview[uvcd->total_vs_devices]!=NULL)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc]     Preview /dev/video%d",
+                minor(uvcd->preview[uvcd->total_vs_devices]->hdr.rdev));
+        }
 
         {
             char cap[256];
@@ -454,6 +491,24 @@ void uvc_insertion(struct usbd_connection* connection, usbd_device_instance_t* i
                     case UVC_FORMAT_MJPG:
                          strcat(cap, "MJPG");
                          break;
+                    case UVC_FORMAT_MJPG_YUY2:
+                         strcat(cap, "YUY2 (MJPG)");
+                         break;
+                    case UVC_FORMAT_MJPG_NV12:
+                         strcat(cap, "NV12 (MJPG)");
+                         break;
+                    case UVC_FORMAT_YUV_MJPG:
+                         strcat(cap, "MJPG (YUV)");
+                         break;
+                    case UVC_FORMAT_RGB24:
+                         strcat(cap, "RGB24");
+                         break;
+                    case UVC_FORMAT_BGR32:
+                         strcat(cap, "BGR32");
+                         break;
+                    case UVC_FORMAT_RGB565:
+                         strcat(cap, "RGB565");
+                         break;
                     case UVC_FORMAT_H264:
                     case UVC_FORMAT_H264F:
                          strcat(cap, "H264");
@@ -481,6 +536,7 @@ void uvc_insertion(struct usbd_connection* connection, usbd_device_instance_t* i
             uvcd->current_priority[uvcd->total_vs_devices]=V4L2_PRIORITY_DEFAULT;
             uvcd->current_priority_ocb[uvcd->total_vs_devices]=NULL;
             uvcd->current_buffer_fds[uvcd->total_vs_devices]=-1;
+            uvcd->current_quality[uvcd->total_vs_devices]=UVC_JPEG_DEFAULT_QUALITY;
 
             /* Find and fill default frame settings */
             error=1;
@@ -530,6 +586,11 @@ void uvc_insertion(struct usbd_connection* connection, usbd_device_instance_t* i
                                           uvcd->current_width[uvcd->total_vs_devices];
                                       break;
                              }
+                             uvcd->current_source_format[uvcd->total_vs_devices]=
+                                 (uvcd->vs_format[uvcd->total_vs_devices][0]==UVC_FORMAT_NV12) ? UVC_FORMAT_NV12 : UVC_FORMAT_YUY2;
+                             uvcd->current_source_frame[uvcd->total_vs_devices]=it;
+                             uvcd->current_scale[uvcd->total_vs_devices]=1;
+                             uvcd->current_decimation[uvcd->total_vs_devices]=1;
                              error=0;
                          }
                      }
@@ -549,6 +610,10 @@ void uvc_insertion(struct usbd_connection* connection, usbd_device_instance_t* i
                                  uvcd->current_width[uvcd->total_vs_devices]*4;
                              uvcd->current_frameinterval[uvcd->total_vs_devices]=
                                  uvcd->vs_frame_mjpeg[uvcd->total_vs_devices][it].dwDefaultFrameInterval;
+                             uvcd->current_source_format[uvcd->total_vs_devices]=UVC_FORMAT_MJPG;
+                             uvcd->current_source_frame[uvcd->total_vs_devices]=it;
+                             uvcd->current_scale[uvcd->total_vs_devices]=1;
+                             uvcd->current_decimation[uvcd->total_vs_devices]=1;
                              error=0;
                          }
                      }
@@ -568,6 +633,10 @@ void uvc_insertion(struct usbd_connection* connection, usbd_device_instance_t* i
                                  uvcd->current_width[uvcd->total_vs_devices]*4;
                              uvcd->current_frameinterval[uvcd->total_vs_devices]=
                                  uvcd->vs_frame_h264f[uvcd->total_vs_devices][it].dwDefaultFrameInterval;
+                             uvcd->current_source_format[uvcd->total_vs_devices]=UVC_FORMAT_H264F;
+                             uvcd->current_source_frame[uvcd->total_vs_devices]=it;
+                             uvcd->current_scale[uvcd->total_vs_devices]=1;
+                             uvcd->current_decimation[uvcd->total_vs_devices]=1;
                              error=0;
                          }
                      }
@@ -625,12 +694,21 @@ void uvc_removal(struct usbd_connection* connection, usbd_device_instance_t* ins
         /* Stop handling of interrupts */
         uvc_unsetup_interrupt(devmap[devmap_id].uvcd);
 
-        /* Destroy isochronous pipes, buffers and lists */
+        /* Abort isochronous transfers, then stop conversion of their frames */
         for (jt=0; jt<devmap[devmap_id].uvcd->total_vs_devices; jt++)
         {
             if (devmap[devmap_id].uvcd->vs_isochronous_pipe[jt]!=NULL)
             {
                 usbd_abort_pipe(devmap[devmap_id].uvcd->vs_isochronous_pipe[jt]);
+            }
+        }
+        uvc_unsetup_frame_worker(devmap[devmap_id].uvcd);
+
+        /* Destroy isochronous pipes, buffers and lists */
+        for (jt=0; jt<devmap[devmap_id].uvcd->total_vs_devices; jt++)
+        {
+            if (devmap[devmap_id].uvcd->vs_isochronous_pipe[jt]!=NULL)
+            {
                 usbd_close_pipe(devmap[devmap_id].uvcd->vs_isochronous_pipe[jt]);
                 devmap[devmap_id].uvcd->vs_isochronous_pipe[jt]=NULL;
             }
@@ -652,13 +730,47 @@ void uvc_removal(struct usbd_connection* connection, usbd_device_instance_t* ins
                     devmap[devmap_id].uvcd->iso_buffer[jt][it]=NULL;
                 }
             }
+            if (devmap[devmap_id].uvcd->frame_buffer[jt]!=NULL)
+            {
+                free(devmap[devmap_id].uvcd->frame_buffer[jt]);
+                devmap[devmap_id].uvcd->frame_buffer[jt]=NULL;
+                devmap[devmap_id].uvcd->frame_buffer_size[jt]=0;
+            }
+            if (devmap[devmap_id].uvcd->frame_work_buffer[jt]!=NULL)
+            {
+                free(devmap[devmap_id].uvcd->frame_work_buffer[jt]);
+                devmap[devmap_id].uvcd->frame_work_buffer[jt]=NULL;
+            }
+            if (devmap[devmap_id].uvcd->convert_buffer[jt]!=NULL)
+            {
+                free(devmap[devmap_id].uvcd->convert_buffer[jt]);
+                devmap[devmap_id].uvcd->convert_buffer[jt]=NULL;
+                devmap[devmap_id].uvcd->convert_buffer_size[jt]=0;
+            }
+            uvc_jpeg_destroy(devmap[devmap_id].uvcd->jpeg_context[jt]);
+            devmap[devmap_id].uvcd->jpeg_context[jt]=NULL;
+            uvc_jpeg_transformer_destroy(devmap[devmap_id].uvcd->jpeg_transformer[jt]);
+            devmap[devmap_id].uvcd->jpeg_transformer[jt]=NULL;
+            uvc_jpeg_encoder_destroy(devmap[devmap_id].uvcd->jpeg_encoder[jt]);
+            devmap[devmap_id].uvcd->jpeg_encoder[jt]=NULL;
+            uvc_motion_destroy(devmap[devmap_id].uvcd->motion[jt]);
+            devmap[devmap_id].uvcd->motion[jt]=NULL;
+            uvc_stats_destroy(devmap[devmap_id].uvcd->stats[jt]);
+            devmap[devmap_id].uvcd->stats[jt]=NULL;
         }
 
         /* Destroy /dev/mediaX, /dev/videoX devices and sysfs files */
+        uvc_unregister_preview(devmap[devmap_id].uvcd, devmap_id);
         uvc_unregister_media(devmap[devmap_id].uvcd, devmap_id);
         uvc_unregister_sysfs(devmap[devmap_id].uvcd, devmap_id);
         uvc_unregister_name(devmap[devmap_id].uvcd, devmap_id);
 
+        /* Finish or fail queued control writes, while control pipe is open */
+        uvc_unsetup_control_worker(devmap[devmap_id].uvcd);
+
+        /* Wait for control requests in flight and free their URBs */
+        uvc_unsetup_control(devmap[devmap_id].uvcd);
+
         /* Close control pipes */
         if (devmap[devmap_id].uvcd->vc_control_pipe!=NULL)
         {
@@ -743,7 +855,7 @@ int main(int argc, char** argv)
     /* Parse command line options */
     while (optind < argc)
     {
-        if ((c=getopt(argc, argv, "vlea")) == -1)
+        if ((c=getopt(argc, argv, "vleapc")) == -1)
         {
             optind++;
             continue;
@@ -759,6 +871,12 @@ int main(int argc, char** argv)
             case 'a':
                  uvc_audio=0;
                  break;
+            case 'p':
+                 uvc_preview=1;
+                 break;
+            case 'c':
+                 uvc_control_async=1;
+                 break;
             case 'l':
                  uvc_exit=1;
                  fprintf(stdout, "Static compiled in libraries:\n");
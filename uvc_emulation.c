@@ -0,0 +1,966 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/slog.h>
+#include <sys/slogcodes.h>
+
+#include <linux/videodev2.h>
+
+#include "uvc.h"
+#include "usbvc.h"
+#include "uvc_jpeg.h"
+#include "uvc_color.h"
+#include "uvc_scale.h"
+#include "uvc_emulation.h"
+
+extern int uvc_verbose;
+extern int uvc_emulation;
+
+/* Decimation factors of DCT-domain scaled MJPEG decoding */
+static const int uvc_mjpeg_scales[]={1, 2, 4, 8};
+
+/* Decimation factors of box filter for uncompressed frames */
+static const int uvc_uncompressed_scales[]={2, 4};
+
+int uvc_emulation_has_format(uvc_device_t* dev, int subdev, int format)
+{
+    int it;
+
+    for (it=0; it<dev->vs_formats[subdev]; it++)
+    {
+        if (dev->vs_format[subdev][it]==format)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void uvc_emulation_add_formats(uvc_device_t* dev, int subdev)
+{
+    if (!uvc_emulation)
+    {
+        return;
+    }
+
+    /* Provide decoded MJPEG frames as YUY2 if device has no native YUY2 support */
+    if ((uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG)) &&
+        (!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUY2)) &&
+        (dev->vs_formats[subdev]<UVC_TOTAL_FORMATS))
+    {
+        dev->vs_format[subdev][dev->vs_formats[subdev]]=UVC_FORMAT_MJPG_YUY2;
+        dev->vs_formats[subdev]++;
+    }
+
+    /* The same for NV12, YCbCr planes of MJPEG frames are taken as is */
+    if ((uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG)) &&
+        (!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_NV12)) &&
+        (dev->vs_formats[subdev]<UVC_TOTAL_FORMATS))
+    {
+        dev->vs_format[subdev][dev->vs_formats[subdev]]=UVC_FORMAT_MJPG_NV12;
+        dev->vs_formats[subdev]++;
+    }
+
+    /* Provide MJPEG encoded from uncompressed frames if device has no native MJPEG */
+    if ((!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG)) &&
+        ((uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUY2)) ||
+        (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_NV12))) &&
+        (dev->vs_formats[subdev]<UVC_TOTAL_FORMATS))
+    {
+        dev->vs_format[subdev][dev->vs_formats[subdev]]=UVC_FORMAT_YUV_MJPG;
+        dev->vs_formats[subdev]++;
+    }
+
+    /* RGB formats are converted from native or decoded YUY2 frames */
+    if (((uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUY2)) ||
+        (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG_YUY2))) &&
+        (dev->vs_formats[subdev]+3<=UVC_TOTAL_FORMATS))
+    {
+        dev->vs_format[subdev][dev->vs_formats[subdev]]=UVC_FORMAT_RGB24;
+        dev->vs_formats[subdev]++;
+        dev->vs_format[subdev][dev->vs_formats[subdev]]=UVC_FORMAT_BGR32;
+        dev->vs_formats[subdev]++;
+        dev->vs_format[subdev][dev->vs_formats[subdev]]=UVC_FORMAT_RGB565;
+        dev->vs_formats[subdev]++;
+    }
+}
+
+/* Returns emulated frame candidate by its number, -1 if there are no more candidates. */
+/* Downscaled uncompressed frames go first, then decoded MJPEG frames. Encoded MJPEG   */
+/* frames are produced from uncompressed frames of the native sizes only.              */
+static int uvc_emulation_candidate(uvc_device_t* dev, int subdev, uint32_t pixelformat, int candidate, uvc_emulated_frame_t* frame)
+{
+    int source_format=(pixelformat==V4L2_PIX_FMT_NV12) ? UVC_FORMAT_NV12 : UVC_FORMAT_YUY2;
+    int frames=0;
+    vs_frame_uncompressed_t* uncompressed;
+    vs_frame_mjpeg_t* mjpeg;
+
+    if (pixelformat==V4L2_PIX_FMT_MJPEG)
+    {
+        source_format=(uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUY2)) ? UVC_FORMAT_YUY2 : UVC_FORMAT_NV12;
+        frames=dev->vs_format_uncompressed[subdev].bNumFrameDescriptors;
+        if (candidate>=frames)
+        {
+            return -1;
+        }
+
+        uncompressed=&dev->vs_frame_uncompressed[subdev][candidate];
+
+        frame->source_format=source_format;
+        frame->source_frame=candidate;
+        frame->scale=1;
+        frame->width=uncompressed->wWidth;
+        frame->height=uncompressed->wHeight;
+        frame->default_frameinterval=uncompressed->dwDefaultFrameInterval;
+
+        return 0;
+    }
+
+    if (uvc_emulation_has_format(dev, subdev, source_format))
+    {
+        frames=dev->vs_format_uncompressed[subdev].bNumFrameDescriptors;
+    }
+    if (candidate<frames*(sizeof(uvc_uncompressed_scales)/sizeof(uvc_uncompressed_scales[0])))
+    {
+        uncompressed=&dev->vs_frame_uncompressed[subdev][candidate%frames];
+
+        frame->source_format=source_format;
+        frame->source_frame=candidate%frames;
+        frame->scale=uvc_uncompressed_scales[candidate/frames];
+        frame->width=uvc_scale_size(uncompressed->wWidth, frame->scale);
+        frame->height=uvc_scale_size(uncompressed->wHeight, frame->scale);
+        frame->default_frameinterval=uncompressed->dwDefaultFrameInterval;
+
+        return 0;
+    }
+    candidate-=frames*(sizeof(uvc_uncompressed_scales)/sizeof(uvc_uncompressed_scales[0]));
+
+    if (!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG))
+    {
+        return -1;
+    }
+
+    frames=dev->vs_format_mjpeg[subdev].bNumFrameDescriptors;
+    if ((frames==0) || (candidate>=frames*(sizeof(uvc_mjpeg_scales)/sizeof(uvc_mjpeg_scales[0]))))
+    {
+        return -1;
+    }
+
+    mjpeg=&dev->vs_frame_mjpeg[subdev][candidate%frames];
+
+    frame->source_format=UVC_FORMAT_MJPG;
+    frame->source_frame=candidate%frames;
+    frame->scale=uvc_mjpeg_scales[candidate/frames];
+    /* libjpeg rounds up scaled dimensions */
+    frame->width=(mjpeg->wWidth+frame->scale-1)/frame->scale;
+    frame->height=(mjpeg->wHeight+frame->scale-1)/frame->scale;
+    frame->default_frameinterval=mjpeg->dwDefaultFrameInterval;
+
+    return 0;
+}
+
+static int uvc_emulation_valid_frame(uvc_device_t* dev, int subdev, uint32_t pixelformat, uvc_emulated_frame_t* frame)
+{
+    int it;
+
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_RGB24:
+        case V4L2_PIX_FMT_BGR32:
+        case V4L2_PIX_FMT_RGB565:
+             /* Packed 4:2:2 formats require even width, RGB is converted from them */
+             if ((frame->width & 1) || (frame->width==0) || (frame->height==0))
+             {
+                 return 0;
+             }
+
+             /* Do not duplicate frame sizes which are natively supported */
+             if (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUY2))
+             {
+                 for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
+                 {
+                     if ((dev->vs_frame_uncompressed[subdev][it].wWidth==frame->width) &&
+                         (dev->vs_frame_uncompressed[subdev][it].wHeight==frame->height))
+                     {
+                         return 0;
+                     }
+                 }
+             }
+             break;
+        case V4L2_PIX_FMT_NV12:
+             /* Both dimensions of 4:2:0 format must be even */
+             if ((frame->width & 1) || (frame->height & 1) || (frame->width==0) || (frame->height==0))
+             {
+                 return 0;
+             }
+
+             if (uvc_emulation_has_format(dev, subdev, UVC_FORMAT_NV12))
+             {
+                 for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
+                 {
+                     if ((dev->vs_frame_uncompressed[subdev][it].wWidth==frame->width) &&
+                         (dev->vs_frame_uncompressed[subdev][it].wHeight==frame->height))
+                     {
+                         return 0;
+                     }
+                 }
+             }
+             break;
+        case V4L2_PIX_FMT_MJPEG:
+             /* Chroma of both source formats is subsampled horizontally by 2, NV12 */
+             /* vertically too, encoder takes chroma planes as is.                  */
+             if ((frame->width & 1) || (frame->height & 1) || (frame->width==0) || (frame->height==0))
+             {
+                 return 0;
+             }
+             break;
+        default:
+             return 0;
+    }
+
+    return 1;
+}
+
+/* Walks through all emulated frames of the pixel format, if index is negative */
+/* then frame is searched by its dimensions.                                   */
+static int uvc_emulation_enum_frames(uvc_device_t* dev, int subdev, uint32_t pixelformat, int index, int width, int height, uvc_emulated_frame_t* frame)
+{
+    uvc_emulated_frame_t candidate;
+    uvc_emulated_frame_t previous;
+    int found=0;
+    int duplicate;
+    int it, jt;
+
+    if (!uvc_emulation)
+    {
+        return -1;
+    }
+
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_RGB24:
+        case V4L2_PIX_FMT_BGR32:
+        case V4L2_PIX_FMT_RGB565:
+             if ((!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG)) &&
+                 (!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUY2)))
+             {
+                 return -1;
+             }
+             break;
+        case V4L2_PIX_FMT_NV12:
+             if ((!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_MJPG)) &&
+                 (!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_NV12)))
+             {
+                 return -1;
+             }
+             break;
+        case V4L2_PIX_FMT_MJPEG:
+             if (!uvc_emulation_has_format(dev, subdev, UVC_FORMAT_YUV_MJPG))
+             {
+                 return -1;
+             }
+             break;
+        default:
+             return -1;
+    }
+
+    for (it=0; uvc_emulation_candidate(dev, subdev, pixelformat, it, &candidate)==0; it++)
+    {
+        if (!uvc_emulation_valid_frame(dev, subdev, pixelformat, &candidate))
+        {
+            continue;
+        }
+
+        /* Different source frames could be reduced to the same size, the first one wins */
+        duplicate=0;
+        for (jt=0; jt<it; jt++)
+        {
+            uvc_emulation_candidate(dev, subdev, pixelformat, jt, &previous);
+            if ((previous.width==candidate.width) && (previous.height==candidate.height) &&
+                (uvc_emulation_valid_frame(dev, subdev, pixelformat, &previous)))
+            {
+                duplicate=1;
+                break;
+            }
+        }
+        if (duplicate)
+        {
+            continue;
+        }
+
+        if (((index>=0) && (found==index)) ||
+            ((index<0) && (candidate.width==width) && (candidate.height==height)))
+        {
+            *frame=candidate;
+            return 0;
+        }
+        found++;
+    }
+
+    return -1;
+}
+
+int uvc_emulated_frame_by_index(uvc_device_t* dev, int subdev, uint32_t pixelformat, int index, uvc_emulated_frame_t* frame)
+{
+    if (index<0)
+    {
+        return -1;
+    }
+
+    return uvc_emulation_enum_frames(dev, subdev, pixelformat, index, 0, 0, frame);
+}
+
+int uvc_emulated_frame_by_size(uvc_device_t* dev, int subdev, uint32_t pixelformat, int width, int height, uvc_emulated_frame_t* frame)
+{
+    return uvc_emulation_enum_frames(dev, subdev, pixelformat, -1, width, height, frame);
+}
+
+int uvc_emulated_frame_interval(uvc_device_t* dev, int subdev, int source_format, int source_frame, int index, struct v4l2_frmivalenum* frm)
+{
+    vs_frame_uncompressed_t* uncompressed;
+    vs_frame_mjpeg_t* mjpeg;
+
+    switch (source_format)
+    {
+        case UVC_FORMAT_YUY2:
+        case UVC_FORMAT_NV12:
+             uncompressed=&dev->vs_frame_uncompressed[subdev][source_frame];
+             if (uncompressed->bFrameIntervalType)
+             {
+                 if (index>=uncompressed->bFrameIntervalType)
+                 {
+                     return uvc_emulated_decimated_interval(dev, subdev, source_format, source_frame, index, frm);
+                 }
+                 frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
+                 frm->discrete.numerator=uncompressed->dwFrameInterval[index];
+                 frm->discrete.denominator=10000000;
+             }
+             else
+             {
+                 if (index>=1)
+                 {
+                     return -1;
+                 }
+                 frm->type=V4L2_FRMIVAL_TYPE_STEPWISE;
+                 frm->stepwise.min.numerator=uncompressed->dwMinFrameInterval;
+                 frm->stepwise.min.denominator=10000000;
+                 frm->stepwise.max.numerator=uncompressed->dwMaxFrameInterval;
+                 frm->stepwise.max.denominator=10000000;
+                 frm->stepwise.step.numerator=uncompressed->dwFrameIntervalStep;
+                 frm->stepwise.step.denominator=10000000;
+             }
+             return 0;
+        case UVC_FORMAT_MJPG:
+             mjpeg=&dev->vs_frame_mjpeg[subdev][source_frame];
+             if (mjpeg->bFrameIntervalType)
+             {
+                 if (index>=mjpeg->bFrameIntervalType)
+                 {
+                     return uvc_emulated_decimated_interval(dev, subdev, source_format, source_frame, index, frm);
+                 }
+                 frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
+                 frm->discrete.numerator=mjpeg->dwFrameInterval[index];
+                 frm->discrete.denominator=10000000;
+             }
+             else
+             {
+                 if (index>=1)
+                 {
+                     return -1;
+                 }
+                 frm->type=V4L2_FRMIVAL_TYPE_STEPWISE;
+                 frm->stepwise.min.numerator=mjpeg->dwMinFrameInterval;
+                 frm->stepwise.min.denominator=10000000;
+                 frm->stepwise.max.numerator=mjpeg->dwMaxFrameInterval;
+                 frm->stepwise.max.denominator=10000000;
+                 frm->stepwise.step.numerator=mjpeg->dwFrameIntervalStep;
+                 frm->stepwise.step.denominator=10000000;
+             }
+             return 0;
+    }
+
+    return -1;
+}
+
+uint32_t uvc_emulated_frame_best_interval(uvc_device_t* dev, int subdev, int source_format, int source_frame, uint64_t desired_frameinterval)
+{
+    vs_frame_uncompressed_t* uncompressed;
+    vs_frame_mjpeg_t* mjpeg;
+    uint64_t best_frameinterval=LONGLONG_MAX;
+    uint32_t best_frameinterval_num=INT_MAX;
+    uint64_t value;
+    uint64_t kt;
+
+    switch (source_format)
+    {
+        case UVC_FORMAT_YUY2:
+        case UVC_FORMAT_NV12:
+             uncompressed=&dev->vs_frame_uncompressed[subdev][source_frame];
+             if (uncompressed->bFrameIntervalType)
+             {
+                 for (kt=0; kt<uncompressed->bFrameIntervalType; kt++)
+                 {
+                     value=((uint64_t)10000000ULL<<32) / uncompressed->dwFrameInterval[kt];
+                     if (llabs((int64_t)(desired_frameinterval-value))<llabs((int64_t)(best_frameinterval-value)))
+                     {
+                         best_frameinterval=value;
+                         best_frameinterval_num=uncompressed->dwFrameInterval[kt];
+                     }
+                 }
+             }
+             else
+             {
+                 for (kt=uncompressed->dwMinFrameInterval; kt<=uncompressed->dwMaxFrameInterval; kt+=uncompressed->dwFrameIntervalStep)
+                 {
+                     value=((uint64_t)10000000ULL<<32) / kt;
+                     if (llabs((int64_t)(desired_frameinterval-value))<llabs((int64_t)(best_frameinterval-value)))
+                     {
+                         best_frameinterval=value;
+                         best_frameinterval_num=kt;
+                     }
+                 }
+             }
+             break;
+        case UVC_FORMAT_MJPG:
+             mjpeg=&dev->vs_frame_mjpeg[subdev][source_frame];
+             if (mjpeg->bFrameIntervalType)
+             {
+                 for (kt=0; kt<mjpeg->bFrameIntervalType; kt++)
+                 {
+                     value=((uint64_t)10000000ULL<<32) / mjpeg->dwFrameInterval[kt];
+                     if (llabs((int64_t)(desired_frameinterval-value))<llabs((int64_t)(best_frameinterval-value)))
+                     {
+                         best_frameinterval=value;
+                         best_frameinterval_num=mjpeg->dwFrameInterval[kt];
+                     }
+                 }
+             }
+             else
+             {
+                 for (kt=mjpeg->dwMinFrameInterval; kt<=mjpeg->dwMaxFrameInterval; kt+=mjpeg->dwFrameIntervalStep)
+                 {
+                     value=((uint64_t)10000000ULL<<32) / kt;
+                     if (llabs((int64_t)(desired_frameinterval-value))<llabs((int64_t)(best_frameinterval-value)))
+                     {
+                         best_frameinterval=value;
+                         best_frameinterval_num=kt;
+                     }
+                 }
+             }
+             break;
+    }
+
+    return best_frameinterval_num;
+}
+
+/* YUY2 byte order is Y0 U Y1 V, reorder it to the requested packed format */
+static void uvc_emulation_swizzle(uint8_t* src, uint8_t* dst, int pixels, uint32_t pixelformat)
+{
+    int it;
+
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_UYVY:
+             for (it=0; it<pixels; it+=2)
+             {
+                 dst[0]=src[1];
+                 dst[1]=src[0];
+                 dst[2]=src[3];
+                 dst[3]=src[2];
+                 src+=4;
+                 dst+=4;
+             }
+             break;
+        case V4L2_PIX_FMT_YVYU:
+             for (it=0; it<pixels; it+=2)
+             {
+                 dst[0]=src[0];
+                 dst[1]=src[3];
+                 dst[2]=src[2];
+                 dst[3]=src[1];
+                 src+=4;
+                 dst+=4;
+             }
+             break;
+        case V4L2_PIX_FMT_VYUY:
+             for (it=0; it<pixels; it+=2)
+             {
+                 dst[0]=src[3];
+                 dst[1]=src[0];
+                 dst[2]=src[1];
+                 dst[3]=src[2];
+                 src+=4;
+                 dst+=4;
+             }
+             break;
+        default:
+             memcpy(dst, src, pixels*2);
+             break;
+    }
+}
+
+/* Returns the shortest and the longest frame intervals of source frame and amount */
+/* of discrete intervals, which is zero for continuous frame intervals.           */
+static int uvc_emulation_interval_range(uvc_device_t* dev, int subdev, int source_format, int source_frame,
+    uint32_t* shortest, uint32_t* longest)
+{
+    uint32_t* intervals;
+    int count;
+    int it;
+
+    switch (source_format)
+    {
+        case UVC_FORMAT_YUY2:
+        case UVC_FORMAT_NV12:
+             intervals=dev->vs_frame_uncompressed[subdev][source_frame].dwFrameInterval;
+             count=dev->vs_frame_uncompressed[subdev][source_frame].bFrameIntervalType;
+             *shortest=dev->vs_frame_uncompressed[subdev][source_frame].dwMinFrameInterval;
+             *longest=dev->vs_frame_uncompressed[subdev][source_frame].dwMaxFrameInterval;
+             break;
+        case UVC_FORMAT_MJPG:
+             intervals=dev->vs_frame_mjpeg[subdev][source_frame].dwFrameInterval;
+             count=dev->vs_frame_mjpeg[subdev][source_frame].bFrameIntervalType;
+             *shortest=dev->vs_frame_mjpeg[subdev][source_frame].dwMinFrameInterval;
+             *longest=dev->vs_frame_mjpeg[subdev][source_frame].dwMaxFrameInterval;
+             break;
+        default:
+             /* Dropping of H.264 frames breaks the references of predicted frames */
+             return -1;
+    }
+
+    if (count)
+    {
+        *shortest=UINT_MAX;
+        *longest=0;
+        for (it=0; it<count; it++)
+        {
+            if (intervals[it]<*shortest)
+            {
+                *shortest=intervals[it];
+            }
+            if (intervals[it]>*longest)
+            {
+                *longest=intervals[it];
+            }
+        }
+    }
+    if (*shortest==0)
+    {
+        return -1;
+    }
+
+    return count;
+}
+
+/* Enumerates frame intervals which are produced by driver by dropping of frames. */
+/* They follow the discrete frame intervals of the device, each of them is the    */
+/* multiple of the shortest frame interval and is longer than the longest one.    */
+int uvc_emulated_decimated_interval(uvc_device_t* dev, int subdev, int source_format, int source_frame, int index, struct v4l2_frmivalenum* frm)
+{
+    uint32_t shortest;
+    uint32_t longest;
+    int count;
+    int it;
+
+    if (!uvc_emulation)
+    {
+        return -1;
+    }
+
+    count=uvc_emulation_interval_range(dev, subdev, source_format, source_frame, &shortest, &longest);
+    if ((count<=0) || (index<count))
+    {
+        return -1;
+    }
+    index-=count;
+
+    for (it=2; it<=UVC_MAX_DECIMATION; it++)
+    {
+        if ((uint64_t)shortest*it>UVC_MAX_DECIMATED_INTERVAL)
+        {
+            break;
+        }
+        if (shortest*it<=longest)
+        {
+            continue;
+        }
+        if (index==0)
+        {
+            frm->type=V4L2_FRMIVAL_TYPE_DISCRETE;
+            frm->discrete.numerator=shortest*it;
+            frm->discrete.denominator=10000000;
+            return 0;
+        }
+        index--;
+    }
+
+    return -1;
+}
+
+/* Checks if dropping of source frames gives a frame rate closer to desired one */
+/* than the frame interval chosen from the device. Returns amount of the source  */
+/* frames per one delivered frame and updates the frame interval accordingly.    */
+/* Continuous frame intervals are enumerated as a single stepwise range, which   */
+/* can't list the decimated intervals, so they are never decimated.              */
+int uvc_emulated_frame_decimation(uvc_device_t* dev, int subdev, uint64_t desired_frameinterval, uint32_t* frameinterval)
+{
+    uint32_t shortest;
+    uint32_t longest;
+    int64_t best_distance;
+    int64_t distance;
+    int decimation=1;
+    int it;
+
+    if ((!uvc_emulation) || (*frameinterval==0))
+    {
+        return 1;
+    }
+
+    if (uvc_emulation_interval_range(dev, subdev, dev->current_source_format[subdev],
+        dev->current_source_frame[subdev], &shortest, &longest)<=0)
+    {
+        return 1;
+    }
+
+    best_distance=llabs((int64_t)(desired_frameinterval-((uint64_t)10000000ULL<<32) / *frameinterval));
+    for (it=2; it<=UVC_MAX_DECIMATION; it++)
+    {
+        if ((uint64_t)shortest*it>UVC_MAX_DECIMATED_INTERVAL)
+        {
+            break;
+        }
+        if (shortest*it<=longest)
+        {
+            continue;
+        }
+        distance=llabs((int64_t)(desired_frameinterval-((uint64_t)10000000ULL<<32) / (shortest*it)));
+        if (distance<best_distance)
+        {
+            best_distance=distance;
+            decimation=it;
+        }
+    }
+
+    if (decimation>1)
+    {
+        *frameinterval=shortest*decimation;
+    }
+
+    return decimation;
+}
+
+/* Returns size of the image in the negotiated format, NV12 has a chroma plane */
+/* of the half height below the luma plane.                                    */
+unsigned int uvc_emulation_image_size(uvc_device_t* dev, int subdev)
+{
+    unsigned int size=dev->current_stride[subdev]*dev->current_height[subdev];
+
+    if (dev->current_pixelformat[subdev]==V4L2_PIX_FMT_NV12)
+    {
+        size+=size/2;
+    }
+
+    return size;
+}
+
+/* Checks that the whole source frame of box filter is received and line buffer */
+/* can hold a source line.                                                       */
+static int uvc_emulation_scale_check(uvc_device_t* dev, int subdev, unsigned int size, int bpp)
+{
+    vs_frame_uncompressed_t* frame=&dev->vs_frame_uncompressed[subdev][dev->current_source_frame[subdev]];
+
+    if ((dev->convert_buffer[subdev]==NULL) || (dev->convert_buffer_size[subdev]<frame->wWidth*2))
+    {
+        return -1;
+    }
+    if (size<frame->wWidth*frame->wHeight*bpp/2)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Produces one line of the downscaled YUY2 frame in the line buffer */
+static uint8_t* uvc_emulation_scale_yuy2(uvc_device_t* dev, int subdev, uint8_t* src, int line)
+{
+    vs_frame_uncompressed_t* frame=&dev->vs_frame_uncompressed[subdev][dev->current_source_frame[subdev]];
+    int scale=dev->current_scale[subdev];
+    int pixels=frame->wWidth;
+
+    uvc_scale_rows(src+line*scale*pixels*2, pixels*2, scale, dev->convert_buffer[subdev], pixels*2);
+    for (; scale>1; scale/=2)
+    {
+        pixels=uvc_scale_yuy2_half(dev->convert_buffer[subdev], pixels);
+    }
+
+    return dev->convert_buffer[subdev];
+}
+
+/* Downscales both planes of NV12 frame */
+static int uvc_emulation_scale_nv12(uvc_device_t* dev, int subdev, uint8_t* src, uint8_t* dst)
+{
+    vs_frame_uncompressed_t* frame=&dev->vs_frame_uncompressed[subdev][dev->current_source_frame[subdev]];
+    int width=dev->current_width[subdev];
+    int height=dev->current_height[subdev];
+    int stride=dev->current_stride[subdev];
+    uint8_t* line=dev->convert_buffer[subdev];
+    int scale;
+    int samples;
+    int it;
+
+    /* Luma plane */
+    for (it=0; it<height; it++)
+    {
+        uvc_scale_rows(src+it*dev->current_scale[subdev]*frame->wWidth, frame->wWidth,
+            dev->current_scale[subdev], line, frame->wWidth);
+        samples=frame->wWidth;
+        for (scale=dev->current_scale[subdev]; scale>1; scale/=2)
+        {
+            samples=uvc_scale_y_half(line, samples);
+        }
+        memcpy(dst+it*stride, line, width);
+    }
+
+    /* Interleaved chroma plane */
+    src+=frame->wWidth*frame->wHeight;
+    dst+=stride*height;
+    for (it=0; it<height/2; it++)
+    {
+        uvc_scale_rows(src+it*dev->current_scale[subdev]*frame->wWidth, frame->wWidth,
+            dev->current_scale[subdev], line, frame->wWidth);
+        samples=frame->wWidth/2;
+        for (scale=dev->current_scale[subdev]; scale>1; scale/=2)
+        {
+            samples=uvc_scale_uv_half(line, samples);
+        }
+        memcpy(dst+it*stride, line, width);
+    }
+
+    return stride*height*3/2;
+}
+
+/* Converts assembled frame of source format to the buffer of negotiated format. */
+/* Returns amount of bytes used in the buffer or -1 if frame is corrupted.       */
+int uvc_emulation_convert(uvc_device_t* dev, int subdev, uint8_t* src, unsigned int size, uint8_t* dst, unsigned int length)
+{
+    int width=dev->current_width[subdev];
+    int height=dev->current_height[subdev];
+    int stride=dev->current_stride[subdev];
+    uvc_color_matrix_t matrix;
+    int it;
+
+    /* Broken MJPEG frames are rejected before decoding, data after EOI is trimmed */
+    if (dev->current_source_format[subdev]==UVC_FORMAT_MJPG)
+    {
+        it=uvc_jpeg_validate(src, size);
+        if (it<0)
+        {
+            if (uvc_verbose>3)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] Broken MJPEG frame, %d bytes", size);
+            }
+            return -1;
+        }
+        size=it;
+    }
+
+    switch (dev->current_pixelformat[subdev])
+    {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+        case V4L2_PIX_FMT_YVYU:
+        case V4L2_PIX_FMT_VYUY:
+             if (stride*height>length)
+             {
+                 return -1;
+             }
+             if (dev->current_source_format[subdev]==UVC_FORMAT_MJPG)
+             {
+                 if (uvc_jpeg_decode(dev->jpeg_context[subdev], src, size, dst, stride, width, height, dev->current_scale[subdev],
+                     V4L2_PIX_FMT_YUYV)<0)
+                 {
+                     return -1;
+                 }
+                 return stride*height;
+             }
+             if (dev->current_scale[subdev]>1)
+             {
+                 if (uvc_emulation_scale_check(dev, subdev, size, 4)<0)
+                 {
+                     return -1;
+                 }
+                 for (it=0; it<height; it++)
+                 {
+                     uvc_emulation_swizzle(uvc_emulation_scale_yuy2(dev, subdev, src, it), dst+it*stride,
+                         width, dev->current_pixelformat[subdev]);
+                 }
+                 return stride*height;
+             }
+             if (size<width*2*height)
+             {
+                 return -1;
+             }
+             for (it=0; it<height; it++)
+             {
+                 uvc_emulation_swizzle(src+it*width*2, dst+it*stride, width, dev->current_pixelformat[subdev]);
+             }
+             return stride*height;
+        case V4L2_PIX_FMT_RGB24:
+        case V4L2_PIX_FMT_BGR32:
+        case V4L2_PIX_FMT_RGB565:
+             if (stride*height>length)
+             {
+                 return -1;
+             }
+             if (dev->current_source_format[subdev]==UVC_FORMAT_MJPG)
+             {
+                 /* libjpeg converts JFIF YCbCr (BT.601, full range) to RGB24 and */
+                 /* BGR32 directly, other matrices and RGB565 go through YUY2.    */
+                 if (dev->current_pixelformat[subdev]!=V4L2_PIX_FMT_RGB565)
+                 {
+                     switch (dev->vs_color_format_mjpeg[subdev].bMatrixCoefficients)
+                     {
+                         case VCFMC_BT_709:
+                         case VCFMC_FCC:
+                         case VCFMC_SMPTE_240M:
+                              break;
+                         default:
+                              if (uvc_jpeg_decode(dev->jpeg_context[subdev], src, size, dst, stride, width, height, dev->current_scale[subdev],
+                                  dev->current_pixelformat[subdev])<0)
+                              {
+                                  return -1;
+                              }
+                              return stride*height;
+                     }
+                 }
+
+                 uvc_color_matrix(dev->vs_color_format_mjpeg[subdev].bMatrixCoefficients, 1, &matrix);
+
+                 /* Decode YUY2 lines to the beginning of each RGB line, then convert */
+                 /* them through the line buffer, since RGB line is larger.           */
+                 if ((dev->convert_buffer[subdev]==NULL) || (dev->convert_buffer_size[subdev]<width*2))
+                 {
+                     return -1;
+                 }
+                 if (uvc_jpeg_decode(dev->jpeg_context[subdev], src, size, dst, stride, width, height, dev->current_scale[subdev],
+                     V4L2_PIX_FMT_YUYV)<0)
+                 {
+                     return -1;
+                 }
+                 for (it=0; it<height; it++)
+                 {
+                     memcpy(dev->convert_buffer[subdev], dst+it*stride, width*2);
+                     uvc_color_yuy2_to_rgb(dev->convert_buffer[subdev], dst+it*stride, width,
+                         dev->current_pixelformat[subdev], &matrix);
+                 }
+                 return stride*height;
+             }
+             uvc_color_matrix(dev->vs_color_format_uncompressed[subdev].bMatrixCoefficients, 0, &matrix);
+             if (dev->current_scale[subdev]>1)
+             {
+                 if (uvc_emulation_scale_check(dev, subdev, size, 4)<0)
+                 {
+                     return -1;
+                 }
+                 for (it=0; it<height; it++)
+                 {
+                     uvc_color_yuy2_to_rgb(uvc_emulation_scale_yuy2(dev, subdev, src, it), dst+it*stride,
+                         width, dev->current_pixelformat[subdev], &matrix);
+                 }
+                 return stride*height;
+             }
+             if (size<width*2*height)
+             {
+                 return -1;
+             }
+             for (it=0; it<height; it++)
+             {
+                 uvc_color_yuy2_to_rgb(src+it*width*2, dst+it*stride, width, dev->current_pixelformat[subdev], &matrix);
+             }
+             return stride*height;
+        case V4L2_PIX_FMT_NV12:
+             if (dev->current_source_format[subdev]==UVC_FORMAT_MJPG)
+             {
+                 if (stride*height*3/2>length)
+                 {
+                     return -1;
+                 }
+                 if (uvc_jpeg_decode(dev->jpeg_context[subdev], src, size, dst, stride, width, height, dev->current_scale[subdev],
+                     V4L2_PIX_FMT_NV12)<0)
+                 {
+                     return -1;
+                 }
+                 return stride*height*3/2;
+             }
+             if (dev->current_scale[subdev]>1)
+             {
+                 if ((stride*height*3/2>length) || (uvc_emulation_scale_check(dev, subdev, size, 3)<0))
+                 {
+                     return -1;
+                 }
+                 return uvc_emulation_scale_nv12(dev, subdev, src, dst);
+             }
+             break;
+        case V4L2_PIX_FMT_MJPEG:
+             if ((uvc_emulation) && (dev->current_source_format[subdev]==UVC_FORMAT_MJPG))
+             {
+                 struct v4l2_rect* crop=&dev->current_crop[subdev];
+                 int transform;
+
+                 transform=uvc_jpeg_transform_code(dev->current_hflip[subdev],
+                     dev->current_vflip[subdev], dev->current_rotate[subdev]);
+                 if ((transform!=UVC_JPEG_XFORM_NONE) || (crop->width))
+                 {
+                     return uvc_jpeg_transform(dev->jpeg_transformer[subdev], src, size, dst, length,
+                         transform, crop->left, crop->top, crop->width, crop->height);
+                 }
+             }
+             /* Uncompressed frames of the same size are encoded by driver */
+             if ((dev->current_source_format[subdev]==UVC_FORMAT_YUY2) ||
+                 (dev->current_source_format[subdev]==UVC_FORMAT_NV12))
+             {
+                 it=(dev->current_source_format[subdev]==UVC_FORMAT_NV12) ? width*height*3/2 : width*2*height;
+                 if ((dev->jpeg_encoder[subdev]==NULL) || (size<it))
+                 {
+                     return -1;
+                 }
+                 return uvc_jpeg_encode(dev->jpeg_encoder[subdev], src, dst, length, dev->current_quality[subdev]);
+             }
+             break;
+    }
+
+    /* Native formats are passed as is, truncated frame would look valid */
+    if (size>length)
+    {
+        return -1;
+    }
+    memcpy(dst, src, size);
+
+    return size;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#ifndef __UVC_EMULATION_H__
+#define __UVC_EMULATION_H__
+
+#include <stdint.h>
+
+/* Lowest frame rate which is produced by dropping of source frames is 1 fps */
+#define UVC_MAX_DECIMATION          30
+#define UVC_MAX_DECIMATED_INTERVAL  10000000
+
+/* Frame size which is not provided by device, but produced by driver from */
+/* the frames of source format.                                            */
+typedef struct _uvc_emulated_frame
+{
+    int source_format;   /* UVC_FORMAT_xxx, which is transferred over USB */
+    int source_frame;    /* Frame descriptor index of the source format   */
+    int scale;           /* Source frame is reduced by 1, 2, 4 or 8 times */
+    int width;
+    int height;
+    uint32_t default_frameinterval;
+} uvc_emulated_frame_t;
+
+int uvc_emulation_has_format(uvc_device_t* dev, int subdev, int format);
+void uvc_emulation_add_formats(uvc_device_t* dev, int subdev);
+
+int uvc_emulated_frame_by_index(uvc_device_t* dev, int subdev, uint32_t pixelformat, int index, uvc_emulated_frame_t* frame);
+int uvc_emulated_frame_by_size(uvc_device_t* dev, int subdev, uint32_t pixelformat, int width, int height, uvc_emulated_frame_t* frame);
+int uvc_emulated_frame_interval(uvc_device_t* dev, int subdev, int source_format, int source_frame, int index, struct v4l2_frmivalenum* frm);
+uint32_t uvc_emulated_frame_best_interval(uvc_device_t* dev, int subdev, int source_format, int source_frame, uint64_t desired_frameinterval);
+
+int uvc_emulated_decimated_interval(uvc_device_t* dev, int subdev, int source_format, int source_frame, int index, struct v4l2_frmivalenum* frm);
+int uvc_emulated_frame_decimation(uvc_device_t* dev, int subdev, uint64_t desired_frameinterval, uint32_t* frameinterval);
+
+unsigned int uvc_emulation_image_size(uvc_device_t* dev, int subdev);
+int uvc_emulation_convert(uvc_device_t* dev, int subdev, uint8_t* src, unsigned int size, uint8_t* dst, unsigned int length);
+
+#endif /* __UVC_EMULATION_H__ */
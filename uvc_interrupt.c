@@ -457,9 +457,13 @@ void uvc_interrupt_completion(struct usbd_urb* urb, struct usbd_pipe* pipe, void
 {
     uvc_device_t* dev=(uvc_device_t*)handle;
     uint8_t* data=(uint8_t*)dev->interrupt_buffer;
+    uint32_t urb_status;
+    uint32_t urb_len=0;
     int status;
     int it;
 
+    usbd_urb_status(urb, &urb_status, &urb_len);
+
     if (uvc_verbose>3)
     {
         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "  INTERRUPT:");
@@ -491,6 +495,9 @@ void uvc_interrupt_completion(struct usbd_urb* urb, struct usbd_pipe* pipe, void
                  struct _uvc_event_entry* entry=NULL;
                  struct _uvc_event_entry tentry;
 
+                 /* Keep cached control value in sync with the device */
+                 uvc_control_cache_update(dev, data[1], data[3], data[4], &data[5], (int)urb_len-5);
+
                  if (uvc_selector_to_cid(dev, data, &tentry))
                  {
                      /* Emit control change event */
@@ -0,0 +1,1302 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/slog.h>
+#include <sys/slogcodes.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#include "jpeglib.h"
+#include "jerror.h"
+#include "transupp.h"
+
+#include "uvc.h"
+#include "uvc_jpeg.h"
+
+extern int uvc_verbose;
+
+typedef struct _uvc_jpeg_error
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+} uvc_jpeg_error_t;
+
+/* Decoder kept for the whole stream: libjpeg object with fixed arena for    */
+/* per-frame allocations and source manager, which reads the assembled frame */
+/* in place.                                                                 */
+struct _uvc_jpeg_context
+{
+    struct jpeg_decompress_struct cinfo;
+    uvc_jpeg_error_t error;
+    struct jpeg_source_mgr source;
+};
+
+/* Encoder of emulated MJPEG stream: libjpeg object set up once for raw YCbCr */
+/* input of the negotiated frame size, planes are gathered from YUY2 or NV12  */
+/* frames by iMCU rows, so neither color conversion nor downsampling is done. */
+struct _uvc_jpeg_encoder
+{
+    struct jpeg_compress_struct cinfo;
+    uvc_jpeg_error_t error;
+    struct jpeg_destination_mgr dest;
+    uint32_t pixelformat;
+    int width;
+    int height;
+    int quality;
+    int ylines;              /* Luma lines per iMCU row, 8 or 16 */
+    int ywidth;              /* Luma line length padded to MCU   */
+    JSAMPARRAY ybuffer;
+    JSAMPARRAY cbbuffer;
+    JSAMPARRAY crbuffer;
+    JSAMPARRAY planes[3];
+};
+
+/* Lossless transformation of MJPEG stream: decompressor and compressor are   */
+/* created once and reused for every frame. Options of transupp are rebuilt */
+/* only when transformation or crop rectangle is changed.                   */
+struct _uvc_jpeg_transformer
+{
+    struct jpeg_decompress_struct srcinfo;
+    struct jpeg_compress_struct dstinfo;
+    uvc_jpeg_error_t error;
+    struct jpeg_source_mgr source;
+    struct jpeg_destination_mgr dest;
+    int width;
+    int height;
+    int arena;               /* Arena of coefficient arrays is reserved */
+    int transform;
+    struct v4l2_rect crop;
+    jpeg_transform_info options;
+};
+
+/* Marker codes checked by frame validator, names follow JPEG_MARKER of */
+/* jdmarker.c, which is private to the library.                        */
+#define M_SOF0  0xC0
+#define M_SOF15 0xCF
+#define M_DHT   0xC4
+#define M_JPG   0xC8
+#define M_DAC   0xCC
+#define M_RST7  (JPEG_RST0+7)
+#define M_SOI   0xD8
+#define M_SOS   0xDA
+#define M_TEM   0x01
+
+/* Per-frame libjpeg allocations: fixed part (component, IDCT and Huffman   */
+/* tables) and MCU rows of the sample buffers, which scale with width. 2x2  */
+/* sampled 3840 pixels wide frame decoded to BGR32 needs about 150KB.       */
+#define UVC_JPEG_ARENA_SIZE(width) (32768+(width)*48)
+
+/* Per-frame allocations of encoder with raw input do not depend on the frame */
+/* size: quantization divisors, Huffman tables and MCU buffer, about 12KB.    */
+#define UVC_JPEG_ENCODER_ARENA_SIZE 32768
+
+/* Transformation keeps whole-frame coefficient arrays of the source and of */
+/* the rotated copy, up to 4 bytes per pixel each for 4:2:2 sampling.      */
+#define UVC_JPEG_TRANSFORM_ARENA_SIZE(width, height) (65536+(width)*(height)*8)
+
+static const JXFORM_CODE uvc_jpeg_xforms[]=
+{
+    JXFORM_NONE,            /* UVC_JPEG_XFORM_NONE       */
+    JXFORM_FLIP_H,          /* UVC_JPEG_XFORM_FLIP_H     */
+    JXFORM_FLIP_V,          /* UVC_JPEG_XFORM_FLIP_V     */
+    JXFORM_TRANSPOSE,       /* UVC_JPEG_XFORM_TRANSPOSE  */
+    JXFORM_TRANSVERSE,      /* UVC_JPEG_XFORM_TRANSVERSE */
+    JXFORM_ROT_90,          /* UVC_JPEG_XFORM_ROT_90     */
+    JXFORM_ROT_180,         /* UVC_JPEG_XFORM_ROT_180    */
+    JXFORM_ROT_270,         /* UVC_JPEG_XFORM_ROT_270    */
+};
+
+/* Standard Huffman tables (JPEG standard section K.3). Most of UVC devices */
+/* strip DHT marker from the MJPEG frames (AVI1 format), so these must be   */
+/* supplied by decoder.                                                     */
+static const UINT8 uvc_bits_dc_luminance[17]=
+    {0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const UINT8 uvc_val_dc_luminance[]=
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const UINT8 uvc_bits_dc_chrominance[17]=
+    {0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const UINT8 uvc_val_dc_chrominance[]=
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const UINT8 uvc_bits_ac_luminance[17]=
+    {0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D};
+static const UINT8 uvc_val_ac_luminance[]=
+    {0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06,
+     0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08,
+     0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0, 0x24, 0x33, 0x62, 0x72,
+     0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+     0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45,
+     0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+     0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74, 0x75,
+     0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+     0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3,
+     0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
+     0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9,
+     0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+     0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4,
+     0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA};
+
+static const UINT8 uvc_bits_ac_chrominance[17]=
+    {0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const UINT8 uvc_val_ac_chrominance[]=
+    {0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41,
+     0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+     0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0, 0x15, 0x62, 0x72, 0xD1,
+     0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+     0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44,
+     0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+     0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74,
+     0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+     0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A,
+     0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4,
+     0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7,
+     0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+     0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4,
+     0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA};
+
+static void uvc_jpeg_error_exit(j_common_ptr cinfo)
+{
+    uvc_jpeg_error_t* error=(uvc_jpeg_error_t*)cinfo->err;
+
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(error->setjmp_buffer, 1);
+}
+
+static void uvc_jpeg_output_message(j_common_ptr cinfo)
+{
+    char buffer[JMSG_LENGTH_MAX];
+
+    /* Do not flood system log by broken frames */
+    if (uvc_verbose>3)
+    {
+        (*cinfo->err->format_message)(cinfo, buffer);
+        slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] libjpeg: %s", buffer);
+    }
+}
+
+static void uvc_jpeg_add_huff_table(j_decompress_ptr cinfo, JHUFF_TBL** table, const UINT8* bits, const UINT8* val, int size)
+{
+    if (*table==NULL)
+    {
+        *table=jpeg_alloc_huff_table((j_common_ptr)cinfo);
+    }
+
+    memcpy((*table)->bits, bits, sizeof((*table)->bits));
+    memcpy((*table)->huffval, val, size);
+    (*table)->sent_table=FALSE;
+}
+
+static void uvc_jpeg_std_huff_tables(j_decompress_ptr cinfo)
+{
+    if ((cinfo->dc_huff_tbl_ptrs[0]==NULL) && (cinfo->dc_huff_tbl_ptrs[1]==NULL) &&
+        (cinfo->ac_huff_tbl_ptrs[0]==NULL) && (cinfo->ac_huff_tbl_ptrs[1]==NULL))
+    {
+        uvc_jpeg_add_huff_table(cinfo, &cinfo->dc_huff_tbl_ptrs[0], uvc_bits_dc_luminance,
+            uvc_val_dc_luminance, sizeof(uvc_val_dc_luminance));
+        uvc_jpeg_add_huff_table(cinfo, &cinfo->ac_huff_tbl_ptrs[0], uvc_bits_ac_luminance,
+            uvc_val_ac_luminance, sizeof(uvc_val_ac_luminance));
+        uvc_jpeg_add_huff_table(cinfo, &cinfo->dc_huff_tbl_ptrs[1], uvc_bits_dc_chrominance,
+            uvc_val_dc_chrominance, sizeof(uvc_val_dc_chrominance));
+        uvc_jpeg_add_huff_table(cinfo, &cinfo->ac_huff_tbl_ptrs[1], uvc_bits_ac_chrominance,
+            uvc_val_ac_chrominance, sizeof(uvc_val_ac_chrominance));
+    }
+}
+
+/* Checks that the frame is YCbCr with a single sample of each chroma component */
+/* per MCU, so chroma planes could be taken from libjpeg as is (raw data).    */
+static int uvc_jpeg_raw_capable(j_decompress_ptr cinfo)
+{
+    jpeg_component_info* comp=cinfo->comp_info;
+
+    if ((cinfo->num_components!=3) || (cinfo->jpeg_color_space!=JCS_YCbCr))
+    {
+        return 0;
+    }
+    if ((comp[1].h_samp_factor!=1) || (comp[1].v_samp_factor!=1) ||
+        (comp[2].h_samp_factor!=1) || (comp[2].v_samp_factor!=1))
+    {
+        return 0;
+    }
+    if ((comp[0].h_samp_factor>2) || (comp[0].v_samp_factor>2))
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Interleaves chroma samples of one line for pairs of pixels, if chroma is   */
+/* not subsampled horizontally (ratio is 1), neighbour samples are averaged. */
+static void uvc_jpeg_raw_uv(JSAMPROW cb, JSAMPROW cr, int ratio, uint8_t* dst, int pairs)
+{
+    int it;
+
+    if (ratio==2)
+    {
+        for (it=0; it<pairs; it++)
+        {
+            dst[it*2+0]=cb[it];
+            dst[it*2+1]=cr[it];
+        }
+    }
+    else
+    {
+        for (it=0; it<pairs; it++)
+        {
+            dst[it*2+0]=(cb[it*2]+cb[it*2+1]+1)>>1;
+            dst[it*2+1]=(cr[it*2]+cr[it*2+1]+1)>>1;
+        }
+    }
+}
+
+static void uvc_jpeg_raw_yuyv(JSAMPROW y, JSAMPROW cb, JSAMPROW cr, int ratio, uint8_t* dst, int pairs)
+{
+    int it;
+
+    if (ratio==2)
+    {
+        for (it=0; it<pairs; it++)
+        {
+            dst[it*4+0]=y[it*2];
+            dst[it*4+1]=cb[it];
+            dst[it*4+2]=y[it*2+1];
+            dst[it*4+3]=cr[it];
+        }
+    }
+    else
+    {
+        for (it=0; it<pairs; it++)
+        {
+            dst[it*4+0]=y[it*2];
+            dst[it*4+1]=(cb[it*2]+cb[it*2+1]+1)>>1;
+            dst[it*4+2]=y[it*2+1];
+            dst[it*4+3]=(cr[it*2]+cr[it*2+1]+1)>>1;
+        }
+    }
+}
+
+/* Reads decoded planes by iMCU rows, bypassing color conversion and upsampling. */
+/* libjpeg could upscale chroma by IDCT at reduced scales, so chroma to luma    */
+/* ratio is 1 or 2 in each direction. Luma of NV12 is decoded in place.         */
+static int uvc_jpeg_read_raw(j_decompress_ptr cinfo, uint8_t* dst, int stride, int width, int height, uint32_t pixelformat)
+{
+    jpeg_component_info* comp=cinfo->comp_info;
+    int ylines=comp[0].v_samp_factor*comp[0].DCT_v_scaled_size;
+    int ywidth=comp[0].width_in_blocks*comp[0].DCT_h_scaled_size;
+    int hratio=comp[0].h_samp_factor*comp[0].DCT_h_scaled_size/comp[1].DCT_h_scaled_size;
+    int vratio=ylines/comp[1].DCT_v_scaled_size;
+    uint8_t* uvplane=dst+stride*height;
+    JSAMPARRAY yscratch;
+    JSAMPARRAY uvscratch;
+    JSAMPARRAY planes[3];
+    int base, line;
+    int it, jt;
+
+    if (((hratio!=1) && (hratio!=2)) || ((vratio!=1) && (vratio!=2)))
+    {
+        return -1;
+    }
+
+    yscratch=(*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE, ywidth, ylines);
+    uvscratch=(*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE, width, 1);
+    planes[0]=(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_IMAGE, ylines*sizeof(JSAMPROW));
+    for (it=1; it<3; it++)
+    {
+        planes[it]=(*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE,
+            comp[it].width_in_blocks*comp[it].DCT_h_scaled_size, comp[it].DCT_v_scaled_size);
+    }
+
+    for (base=0; cinfo->output_scanline<cinfo->output_height; base+=ylines)
+    {
+        for (it=0; it<ylines; it++)
+        {
+            line=base+it;
+            if ((pixelformat==V4L2_PIX_FMT_NV12) && (line<height) && (stride>=ywidth))
+            {
+                planes[0][it]=dst+line*stride;
+            }
+            else
+            {
+                planes[0][it]=yscratch[it];
+            }
+        }
+
+        if (jpeg_read_raw_data(cinfo, planes, ylines)!=ylines)
+        {
+            return -1;
+        }
+
+        for (it=0; (it<ylines) && (base+it<height); it++)
+        {
+            line=base+it;
+            jt=it/vratio;
+            if (pixelformat==V4L2_PIX_FMT_YUYV)
+            {
+                uvc_jpeg_raw_yuyv(planes[0][it], planes[1][jt], planes[2][jt], hratio, dst+line*stride, width/2);
+                continue;
+            }
+
+            if (planes[0][it]!=dst+line*stride)
+            {
+                memcpy(dst+line*stride, planes[0][it], width);
+            }
+
+            /* Chroma line of NV12 is shared by two luma lines, without vertical */
+            /* subsampling in the source it is the average of two chroma lines.  */
+            if ((line & 1)==0)
+            {
+                uvc_jpeg_raw_uv(planes[1][jt], planes[2][jt], hratio, uvplane+(line/2)*stride, width/2);
+            }
+            else
+            {
+                if (vratio==1)
+                {
+                    uint8_t* uv=uvplane+(line/2)*stride;
+                    int kt;
+
+                    uvc_jpeg_raw_uv(planes[1][jt], planes[2][jt], hratio, uvscratch[0], width/2);
+                    for (kt=0; kt<(width & ~1); kt++)
+                    {
+                        uv[kt]=(uv[kt]+uvscratch[0][kt]+1)>>1;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Source manager which reads the frame buffer in place, truncated frame is */
+/* terminated by fake EOI marker, the same way as jpeg_mem_src() does.      */
+static void uvc_jpeg_init_source(j_decompress_ptr cinfo)
+{
+}
+
+static boolean uvc_jpeg_fill_input_buffer(j_decompress_ptr cinfo)
+{
+    static const JOCTET eoi[2]={0xFF, JPEG_EOI};
+
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    cinfo->src->next_input_byte=eoi;
+    cinfo->src->bytes_in_buffer=2;
+
+    return TRUE;
+}
+
+static void uvc_jpeg_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+    struct jpeg_source_mgr* src=cinfo->src;
+
+    if (num_bytes>0)
+    {
+        while (num_bytes>(long)src->bytes_in_buffer)
+        {
+            num_bytes-=(long)src->bytes_in_buffer;
+            (*src->fill_input_buffer)(cinfo);
+        }
+        src->next_input_byte+=(size_t)num_bytes;
+        src->bytes_in_buffer-=(size_t)num_bytes;
+    }
+}
+
+static void uvc_jpeg_term_source(j_decompress_ptr cinfo)
+{
+}
+
+/* Creates decoder for frames up to the given width. Per-frame allocations  */
+/* of libjpeg (component buffers, IDCT and Huffman tables, row buffers) are */
+/* served from the arena, which grows with frame width.                     */
+uvc_jpeg_context_t* uvc_jpeg_create(int width)
+{
+    uvc_jpeg_context_t* context;
+
+    context=calloc(1, sizeof(*context));
+    if (context==NULL)
+    {
+        return NULL;
+    }
+
+    context->cinfo.err=jpeg_std_error(&context->error.pub);
+    context->error.pub.error_exit=uvc_jpeg_error_exit;
+    context->error.pub.output_message=uvc_jpeg_output_message;
+    if (setjmp(context->error.setjmp_buffer))
+    {
+        jpeg_destroy_decompress(&context->cinfo);
+        free(context);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&context->cinfo);
+    jpeg_mem_arena((j_common_ptr)&context->cinfo, UVC_JPEG_ARENA_SIZE(width));
+
+    context->source.init_source=uvc_jpeg_init_source;
+    context->source.fill_input_buffer=uvc_jpeg_fill_input_buffer;
+    context->source.skip_input_data=uvc_jpeg_skip_input_data;
+    context->source.resync_to_restart=jpeg_resync_to_restart;
+    context->source.term_source=uvc_jpeg_term_source;
+    context->cinfo.src=&context->source;
+
+    return context;
+}
+
+void uvc_jpeg_destroy(uvc_jpeg_context_t* context)
+{
+    if (context!=NULL)
+    {
+        jpeg_destroy_decompress(&context->cinfo);
+        free(context);
+    }
+}
+
+/* Decodes MJPEG frame to the YUY2, NV12, RGB24 or BGR32 buffer. Scale could  */
+/* be 1, 2, 4 or 8, in this case libjpeg uses reduced size IDCT (jpeg_idct_4x4, */
+/* jpeg_idct_2x2, etc) and skips most of the decoding work, instead of         */
+/* decoding of full frame and then resizing it. YCbCr frames are read as raw   */
+/* planes for YUY2 and NV12, RGB formats are emitted by libjpeg directly, for  */
+/* 4:2:2 and 4:2:0 frames through merged upsampler.                            */
+int uvc_jpeg_decode(uvc_jpeg_context_t* context, uint8_t* src, int size, uint8_t* dst, int stride, int width, int height, int scale, uint32_t pixelformat)
+{
+    j_decompress_ptr cinfo;
+    JSAMPARRAY row;
+    JSAMPROW out;
+    int line;
+    int bpp;
+    int status;
+
+    if (context==NULL)
+    {
+        return -1;
+    }
+    cinfo=&context->cinfo;
+
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_YUYV:
+             bpp=2;
+             break;
+        case V4L2_PIX_FMT_NV12:
+             bpp=1;
+             break;
+        case V4L2_PIX_FMT_RGB24:
+             bpp=3;
+             break;
+        case V4L2_PIX_FMT_BGR32:
+             bpp=4;
+             break;
+        default:
+             return -1;
+    }
+
+    /* Object is reused for the next frame after abort */
+    if (setjmp(context->error.setjmp_buffer))
+    {
+        jpeg_abort_decompress(cinfo);
+        return -1;
+    }
+
+    context->source.next_input_byte=src;
+    context->source.bytes_in_buffer=size;
+    jpeg_read_header(cinfo, TRUE);
+    uvc_jpeg_std_huff_tables(cinfo);
+
+    cinfo->scale_num=1;
+    cinfo->scale_denom=scale;
+    switch (pixelformat)
+    {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_NV12:
+             if (uvc_jpeg_raw_capable(cinfo))
+             {
+                 cinfo->raw_data_out=TRUE;
+                 break;
+             }
+             if (pixelformat==V4L2_PIX_FMT_NV12)
+             {
+                 if (uvc_verbose>3)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] MJPEG frame can't be decoded to NV12, unsupported sampling");
+                 }
+                 jpeg_abort_decompress(cinfo);
+                 return -1;
+             }
+             cinfo->out_color_space=JCS_EXT_YUYV;
+             break;
+        case V4L2_PIX_FMT_RGB24:
+             cinfo->out_color_space=JCS_RGB;
+             break;
+        case V4L2_PIX_FMT_BGR32:
+             cinfo->out_color_space=JCS_EXT_BGRX;
+             break;
+    }
+    cinfo->dct_method=JDCT_IFAST;
+    cinfo->do_fancy_upsampling=FALSE;
+    jpeg_start_decompress(cinfo);
+
+    if ((cinfo->output_width<width) || (cinfo->output_height<height))
+    {
+        if (uvc_verbose>3)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] MJPEG frame is %dx%d, while %dx%d is expected",
+                cinfo->output_width, cinfo->output_height, width, height);
+        }
+        jpeg_abort_decompress(cinfo);
+        return -1;
+    }
+
+    if (cinfo->raw_data_out)
+    {
+        status=uvc_jpeg_read_raw(cinfo, dst, stride, width, height, pixelformat);
+        if (status==0)
+        {
+            jpeg_finish_decompress(cinfo);
+        }
+        else
+        {
+            jpeg_abort_decompress(cinfo);
+        }
+        return status;
+    }
+
+    /* Scanlines are written directly to the buffer, unless frame is wider */
+    row=(*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE, cinfo->output_width*bpp, 1);
+
+    line=0;
+    while (cinfo->output_scanline<cinfo->output_height)
+    {
+        if ((line<height) && (cinfo->output_width==width))
+        {
+            out=dst+line*stride;
+            jpeg_read_scanlines(cinfo, &out, 1);
+        }
+        else
+        {
+            jpeg_read_scanlines(cinfo, row, 1);
+            if (line<height)
+            {
+                memcpy(dst+line*stride, row[0], width*bpp);
+            }
+        }
+        line++;
+    }
+
+    jpeg_finish_decompress(cinfo);
+
+    return 0;
+}
+
+/* Decodes luma of MJPEG frame at 1/8 scale, one sample per 8x8 block. Only  */
+/* DC coefficients of luma are kept, libjpeg skips the rest of Huffman codes */
+/* and chroma blocks, IDCT is reduced to DC scaling. Thumbnail is written   */
+/* with stride equal to its width, it must fit max_width x max_height.      */
+int uvc_jpeg_decode_dc(uvc_jpeg_context_t* context, uint8_t* src, int size, uint8_t* dst, int max_width, int max_height, int* width, int* height)
+{
+    j_decompress_ptr cinfo;
+    JSAMPROW out;
+
+    if (context==NULL)
+    {
+        return -1;
+    }
+    cinfo=&context->cinfo;
+
+    if (setjmp(context->error.setjmp_buffer))
+    {
+        jpeg_abort_decompress(cinfo);
+        return -1;
+    }
+
+    context->source.next_input_byte=src;
+    context->source.bytes_in_buffer=size;
+    jpeg_read_header(cinfo, TRUE);
+    uvc_jpeg_std_huff_tables(cinfo);
+
+    cinfo->scale_num=1;
+    cinfo->scale_denom=8;
+    cinfo->out_color_space=JCS_GRAYSCALE;
+    cinfo->dct_method=JDCT_IFAST;
+    cinfo->do_fancy_upsampling=FALSE;
+    jpeg_start_decompress(cinfo);
+
+    if ((cinfo->output_width>max_width) || (cinfo->output_height>max_height))
+    {
+        jpeg_abort_decompress(cinfo);
+        return -1;
+    }
+
+    while (cinfo->output_scanline<cinfo->output_height)
+    {
+        out=dst+cinfo->output_scanline*cinfo->output_width;
+        jpeg_read_scanlines(cinfo, &out, 1);
+    }
+    *width=cinfo->output_width;
+    *height=cinfo->output_height;
+
+    jpeg_finish_decompress(cinfo);
+
+    return 0;
+}
+
+/* Destination manager which writes to the fixed size buffer, the buffer is */
+/* mapped to the client, so it can't be reallocated.                       */
+static void uvc_jpeg_init_destination(j_compress_ptr cinfo)
+{
+}
+
+static boolean uvc_jpeg_empty_output_buffer(j_compress_ptr cinfo)
+{
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+    return TRUE;
+}
+
+static void uvc_jpeg_term_destination(j_compress_ptr cinfo)
+{
+}
+
+/* Splits pairs of YUY2 pixels to the planes, Y0 U Y1 V byte order */
+static void uvc_jpeg_split_yuyv(uint8_t* src, JSAMPROW y, JSAMPROW cb, JSAMPROW cr, int pairs)
+{
+    int it=0;
+
+#if defined(__SSE2__)
+    __m128i mask=_mm_set1_epi16(0x00FF);
+    __m128i p0, p1, uv;
+
+    for (; it+8<=pairs; it+=8)
+    {
+        p0=_mm_loadu_si128((__m128i*)(src+it*4));
+        p1=_mm_loadu_si128((__m128i*)(src+it*4+16));
+        _mm_storeu_si128((__m128i*)(y+it*2), _mm_packus_epi16(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask)));
+        uv=_mm_packus_epi16(_mm_srli_epi16(p0, 8), _mm_srli_epi16(p1, 8));
+        uv=_mm_packus_epi16(_mm_and_si128(uv, mask), _mm_srli_epi16(uv, 8));
+        _mm_storel_epi64((__m128i*)(cb+it), uv);
+        _mm_storel_epi64((__m128i*)(cr+it), _mm_srli_si128(uv, 8));
+    }
+#endif /* __SSE2__ */
+
+    for (; it<pairs; it++)
+    {
+        y[it*2+0]=src[it*4+0];
+        cb[it]=src[it*4+1];
+        y[it*2+1]=src[it*4+2];
+        cr[it]=src[it*4+3];
+    }
+}
+
+/* Splits interleaved chroma line of NV12 */
+static void uvc_jpeg_split_uv(uint8_t* src, JSAMPROW cb, JSAMPROW cr, int pairs)
+{
+    int it=0;
+
+#if defined(__SSE2__)
+    __m128i mask=_mm_set1_epi16(0x00FF);
+    __m128i p0, uv;
+
+    for (; it+8<=pairs; it+=8)
+    {
+        p0=_mm_loadu_si128((__m128i*)(src+it*2));
+        uv=_mm_packus_epi16(_mm_and_si128(p0, mask), _mm_srli_epi16(p0, 8));
+        _mm_storel_epi64((__m128i*)(cb+it), uv);
+        _mm_storel_epi64((__m128i*)(cr+it), _mm_srli_si128(uv, 8));
+    }
+#endif /* __SSE2__ */
+
+    for (; it<pairs; it++)
+    {
+        cb[it]=src[it*2+0];
+        cr[it]=src[it*2+1];
+    }
+}
+
+/* Replicates the last sample of the line up to the padded length */
+static void uvc_jpeg_pad_line(JSAMPROW line, int length, int padded)
+{
+    if (padded>length)
+    {
+        memset(line+length, line[length-1], padded-length);
+    }
+}
+
+/* Fills plane rows of one iMCU row starting from the luma line base. Rows   */
+/* below the frame repeat the last line, libjpeg reads whole DCT blocks.     */
+static void uvc_jpeg_gather_rows(uvc_jpeg_encoder_t* encoder, uint8_t* src, int base)
+{
+    int width=encoder->width;
+    int height=encoder->height;
+    int cwidth=encoder->ywidth/2;
+    int line;
+    int it;
+
+    if (encoder->pixelformat==V4L2_PIX_FMT_YUYV)
+    {
+        /* 4:2:2, chroma rows follow luma rows */
+        for (it=0; it<encoder->ylines; it++)
+        {
+            if (base+it>=height)
+            {
+                encoder->planes[0][it]=encoder->planes[0][it-1];
+                encoder->planes[1][it]=encoder->planes[1][it-1];
+                encoder->planes[2][it]=encoder->planes[2][it-1];
+                continue;
+            }
+            encoder->planes[0][it]=encoder->ybuffer[it];
+            encoder->planes[1][it]=encoder->cbbuffer[it];
+            encoder->planes[2][it]=encoder->crbuffer[it];
+            uvc_jpeg_split_yuyv(src+(base+it)*width*2, encoder->ybuffer[it], encoder->cbbuffer[it],
+                encoder->crbuffer[it], width/2);
+            uvc_jpeg_pad_line(encoder->ybuffer[it], width, encoder->ywidth);
+            uvc_jpeg_pad_line(encoder->cbbuffer[it], width/2, cwidth);
+            uvc_jpeg_pad_line(encoder->crbuffer[it], width/2, cwidth);
+        }
+        return;
+    }
+
+    /* 4:2:0, luma is taken from the frame in place if no padding is needed */
+    for (it=0; it<encoder->ylines; it++)
+    {
+        line=base+it;
+        if (line>=height)
+        {
+            encoder->planes[0][it]=encoder->planes[0][it-1];
+            continue;
+        }
+        if ((width & (DCTSIZE-1))==0)
+        {
+            encoder->planes[0][it]=src+line*width;
+            continue;
+        }
+        encoder->planes[0][it]=encoder->ybuffer[it];
+        memcpy(encoder->ybuffer[it], src+line*width, width);
+        uvc_jpeg_pad_line(encoder->ybuffer[it], width, encoder->ywidth);
+    }
+
+    src+=width*height;
+    for (it=0; it<encoder->ylines/2; it++)
+    {
+        line=base/2+it;
+        if (line>=height/2)
+        {
+            encoder->planes[1][it]=encoder->planes[1][it-1];
+            encoder->planes[2][it]=encoder->planes[2][it-1];
+            continue;
+        }
+        encoder->planes[1][it]=encoder->cbbuffer[it];
+        encoder->planes[2][it]=encoder->crbuffer[it];
+        uvc_jpeg_split_uv(src+line*width, encoder->cbbuffer[it], encoder->crbuffer[it], width/2);
+        uvc_jpeg_pad_line(encoder->cbbuffer[it], width/2, cwidth);
+        uvc_jpeg_pad_line(encoder->crbuffer[it], width/2, cwidth);
+    }
+}
+
+/* Creates encoder for YUY2 or NV12 frames of the given size, both dimensions */
+/* must be even. Sampling of the JPEG frame follows the source: 4:2:2 for    */
+/* YUY2 and 4:2:0 for NV12, chroma is passed to libjpeg as is.               */
+uvc_jpeg_encoder_t* uvc_jpeg_encoder_create(int width, int height, uint32_t pixelformat)
+{
+    uvc_jpeg_encoder_t* encoder;
+    j_compress_ptr cinfo;
+    int it;
+
+    if ((width<=0) || (height<=0) || (width & 1) || (height & 1))
+    {
+        return NULL;
+    }
+    if ((pixelformat!=V4L2_PIX_FMT_YUYV) && (pixelformat!=V4L2_PIX_FMT_NV12))
+    {
+        return NULL;
+    }
+
+    encoder=calloc(1, sizeof(*encoder));
+    if (encoder==NULL)
+    {
+        return NULL;
+    }
+    cinfo=&encoder->cinfo;
+
+    cinfo->err=jpeg_std_error(&encoder->error.pub);
+    encoder->error.pub.error_exit=uvc_jpeg_error_exit;
+    encoder->error.pub.output_message=uvc_jpeg_output_message;
+    if (setjmp(encoder->error.setjmp_buffer))
+    {
+        jpeg_destroy_compress(cinfo);
+        free(encoder);
+        return NULL;
+    }
+
+    jpeg_create_compress(cinfo);
+    jpeg_mem_arena((j_common_ptr)cinfo, UVC_JPEG_ENCODER_ARENA_SIZE);
+
+    encoder->dest.init_destination=uvc_jpeg_init_destination;
+    encoder->dest.empty_output_buffer=uvc_jpeg_empty_output_buffer;
+    encoder->dest.term_destination=uvc_jpeg_term_destination;
+    cinfo->dest=&encoder->dest;
+
+    cinfo->image_width=width;
+    cinfo->image_height=height;
+    cinfo->input_components=3;
+    cinfo->in_color_space=JCS_YCbCr;
+    jpeg_set_defaults(cinfo);
+    cinfo->raw_data_in=TRUE;
+    /* Chroma planes are already subsampled, keep 8x8 DCT for all components */
+    cinfo->do_fancy_downsampling=FALSE;
+    cinfo->dct_method=JDCT_ISLOW;
+    cinfo->comp_info[0].h_samp_factor=2;
+    cinfo->comp_info[0].v_samp_factor=(pixelformat==V4L2_PIX_FMT_NV12) ? 2 : 1;
+    jpeg_set_quality(cinfo, UVC_JPEG_DEFAULT_QUALITY, TRUE);
+
+    encoder->pixelformat=pixelformat;
+    encoder->width=width;
+    encoder->height=height;
+    encoder->quality=UVC_JPEG_DEFAULT_QUALITY;
+    encoder->ylines=cinfo->comp_info[0].v_samp_factor*DCTSIZE;
+    encoder->ywidth=(width+2*DCTSIZE-1) & ~(2*DCTSIZE-1);
+
+    /* Plane buffers and row pointers live as long as the encoder */
+    encoder->ybuffer=(*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_PERMANENT,
+        encoder->ywidth, encoder->ylines);
+    encoder->cbbuffer=(*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_PERMANENT,
+        encoder->ywidth/2, DCTSIZE);
+    encoder->crbuffer=(*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_PERMANENT,
+        encoder->ywidth/2, DCTSIZE);
+    for (it=0; it<3; it++)
+    {
+        encoder->planes[it]=(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_PERMANENT,
+            encoder->ylines*sizeof(JSAMPROW));
+    }
+
+    return encoder;
+}
+
+void uvc_jpeg_encoder_destroy(uvc_jpeg_encoder_t* encoder)
+{
+    if (encoder!=NULL)
+    {
+        jpeg_destroy_compress(&encoder->cinfo);
+        free(encoder);
+    }
+}
+
+/* Encodes the whole YUY2 or NV12 frame of the encoder size to the buffer,   */
+/* quantization tables are rebuilt only when quality is changed. Returns     */
+/* amount of bytes written or -1 if frame does not fit in the buffer.        */
+int uvc_jpeg_encode(uvc_jpeg_encoder_t* encoder, uint8_t* src, uint8_t* dst, int length, int quality)
+{
+    j_compress_ptr cinfo;
+    int base;
+
+    if (encoder==NULL)
+    {
+        return -1;
+    }
+    cinfo=&encoder->cinfo;
+
+    /* Object is reused for the next frame after abort */
+    if (setjmp(encoder->error.setjmp_buffer))
+    {
+        jpeg_abort_compress(cinfo);
+        return -1;
+    }
+
+    if (quality!=encoder->quality)
+    {
+        jpeg_set_quality(cinfo, quality, TRUE);
+        encoder->quality=quality;
+    }
+
+    encoder->dest.next_output_byte=dst;
+    encoder->dest.free_in_buffer=length;
+    jpeg_start_compress(cinfo, TRUE);
+
+    for (base=0; cinfo->next_scanline<cinfo->image_height; base+=encoder->ylines)
+    {
+        uvc_jpeg_gather_rows(encoder, src, base);
+        jpeg_write_raw_data(cinfo, encoder->planes, encoder->ylines);
+    }
+
+    jpeg_finish_compress(cinfo);
+
+    return length-encoder->dest.free_in_buffer;
+}
+
+/* Combines horizontal flip, vertical flip and clockwise rotation to the */
+/* single transformation. Flips are applied before rotation.            */
+int uvc_jpeg_transform_code(int hflip, int vflip, int rotate)
+{
+    rotate%=360;
+
+    if (hflip && vflip)
+    {
+        hflip=0;
+        vflip=0;
+        rotate=(rotate+180)%360;
+    }
+
+    if (hflip)
+    {
+        switch (rotate)
+        {
+            case 90:
+                 return UVC_JPEG_XFORM_TRANSVERSE;
+            case 180:
+                 return UVC_JPEG_XFORM_FLIP_V;
+            case 270:
+                 return UVC_JPEG_XFORM_TRANSPOSE;
+            default:
+                 return UVC_JPEG_XFORM_FLIP_H;
+        }
+    }
+
+    if (vflip)
+    {
+        switch (rotate)
+        {
+            case 90:
+                 return UVC_JPEG_XFORM_TRANSPOSE;
+            case 180:
+                 return UVC_JPEG_XFORM_FLIP_H;
+            case 270:
+                 return UVC_JPEG_XFORM_TRANSVERSE;
+            default:
+                 return UVC_JPEG_XFORM_FLIP_V;
+        }
+    }
+
+    switch (rotate)
+    {
+        case 90:
+             return UVC_JPEG_XFORM_ROT_90;
+        case 180:
+             return UVC_JPEG_XFORM_ROT_180;
+        case 270:
+             return UVC_JPEG_XFORM_ROT_270;
+    }
+
+    return UVC_JPEG_XFORM_NONE;
+}
+
+/* Creates transformer for MJPEG frames up to the given size. Arena for the */
+/* coefficient arrays is reserved with the first transformed frame, so      */
+/* streams which are passed as is do not hold it.                           */
+uvc_jpeg_transformer_t* uvc_jpeg_transformer_create(int width, int height)
+{
+    uvc_jpeg_transformer_t* transformer;
+
+    transformer=calloc(1, sizeof(*transformer));
+    if (transformer==NULL)
+    {
+        return NULL;
+    }
+
+    transformer->srcinfo.err=jpeg_std_error(&transformer->error.pub);
+    transformer->dstinfo.err=&transformer->error.pub;
+    transformer->error.pub.error_exit=uvc_jpeg_error_exit;
+    transformer->error.pub.output_message=uvc_jpeg_output_message;
+    if (setjmp(transformer->error.setjmp_buffer))
+    {
+        /* Both objects are destroyed, even if compressor wasn't created */
+        jpeg_destroy_compress(&transformer->dstinfo);
+        jpeg_destroy_decompress(&transformer->srcinfo);
+        free(transformer);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&transformer->srcinfo);
+    jpeg_create_compress(&transformer->dstinfo);
+    jpeg_mem_arena((j_common_ptr)&transformer->dstinfo, UVC_JPEG_ENCODER_ARENA_SIZE);
+
+    transformer->source.init_source=uvc_jpeg_init_source;
+    transformer->source.fill_input_buffer=uvc_jpeg_fill_input_buffer;
+    transformer->source.skip_input_data=uvc_jpeg_skip_input_data;
+    transformer->source.resync_to_restart=jpeg_resync_to_restart;
+    transformer->source.term_source=uvc_jpeg_term_source;
+    transformer->srcinfo.src=&transformer->source;
+
+    transformer->dest.init_destination=uvc_jpeg_init_destination;
+    transformer->dest.empty_output_buffer=uvc_jpeg_empty_output_buffer;
+    transformer->dest.term_destination=uvc_jpeg_term_destination;
+    transformer->dstinfo.dest=&transformer->dest;
+
+    transformer->width=width;
+    transformer->height=height;
+    transformer->transform=-1;
+
+    return transformer;
+}
+
+void uvc_jpeg_transformer_destroy(uvc_jpeg_transformer_t* transformer)
+{
+    if (transformer!=NULL)
+    {
+        jpeg_destroy_compress(&transformer->dstinfo);
+        jpeg_destroy_decompress(&transformer->srcinfo);
+        free(transformer);
+    }
+}
+
+/* Builds options of transupp for the new transformation and crop rectangle */
+static void uvc_jpeg_transformer_setup(uvc_jpeg_transformer_t* transformer, int transform, int crop_x, int crop_y, int crop_width, int crop_height)
+{
+    jpeg_transform_info* options=&transformer->options;
+
+    memset(options, 0x00, sizeof(*options));
+    options->transform=uvc_jpeg_xforms[transform];
+    options->perfect=FALSE;
+    options->trim=TRUE;
+    options->force_grayscale=FALSE;
+    options->crop=FALSE;
+    if (crop_width)
+    {
+        options->crop=TRUE;
+        options->crop_width=crop_width;
+        options->crop_width_set=JCROP_POS;
+        options->crop_height=crop_height;
+        options->crop_height_set=JCROP_POS;
+        options->crop_xoffset=crop_x;
+        options->crop_xoffset_set=JCROP_POS;
+        options->crop_yoffset=crop_y;
+        options->crop_yoffset_set=JCROP_POS;
+    }
+
+    transformer->transform=transform;
+    transformer->crop.left=crop_x;
+    transformer->crop.top=crop_y;
+    transformer->crop.width=crop_width;
+    transformer->crop.height=crop_height;
+}
+
+/* Crops and rotates MJPEG frame without decoding of the image data, only     */
+/* Huffman coding is redone and DCT coefficient blocks are reordered. Crop    */
+/* rectangle is given in coordinates of the rotated frame, offsets must be    */
+/* aligned to the MCU size, partial MCUs at the right and bottom edges are    */
+/* trimmed. If crop_width is zero, whole frame is used. Returns amount of     */
+/* bytes written to the destination buffer or -1 on error.                    */
+int uvc_jpeg_transform(uvc_jpeg_transformer_t* transformer, uint8_t* src, int size, uint8_t* dst, int length, int transform, int crop_x, int crop_y, int crop_width, int crop_height)
+{
+    jpeg_transform_info options;
+    jvirt_barray_ptr* src_coef_arrays;
+    jvirt_barray_ptr* dst_coef_arrays;
+
+    if ((transformer==NULL) || (transform<UVC_JPEG_XFORM_NONE) || (transform>UVC_JPEG_XFORM_ROT_270))
+    {
+        return -1;
+    }
+
+    if ((transform!=transformer->transform) || (crop_x!=transformer->crop.left) ||
+        (crop_y!=transformer->crop.top) || (crop_width!=transformer->crop.width) ||
+        (crop_height!=transformer->crop.height))
+    {
+        uvc_jpeg_transformer_setup(transformer, transform, crop_x, crop_y, crop_width, crop_height);
+    }
+
+    /* Objects are reused for the next frame after abort */
+    if (setjmp(transformer->error.setjmp_buffer))
+    {
+        jpeg_abort_compress(&transformer->dstinfo);
+        jpeg_abort_decompress(&transformer->srcinfo);
+        return -1;
+    }
+
+    if (!transformer->arena)
+    {
+        jpeg_mem_arena((j_common_ptr)&transformer->srcinfo,
+            UVC_JPEG_TRANSFORM_ARENA_SIZE(transformer->width, transformer->height));
+        transformer->arena=1;
+    }
+
+    /* transupp fills in the geometry of the frame, keep the template intact */
+    options=transformer->options;
+
+    transformer->source.next_input_byte=src;
+    transformer->source.bytes_in_buffer=size;
+    jpeg_read_header(&transformer->srcinfo, TRUE);
+    uvc_jpeg_std_huff_tables(&transformer->srcinfo);
+
+    if (!jtransform_request_workspace(&transformer->srcinfo, &options))
+    {
+        jpeg_abort_decompress(&transformer->srcinfo);
+        return -1;
+    }
+
+    src_coef_arrays=jpeg_read_coefficients(&transformer->srcinfo);
+    jpeg_copy_critical_parameters(&transformer->srcinfo, &transformer->dstinfo);
+    dst_coef_arrays=jtransform_adjust_parameters(&transformer->srcinfo, &transformer->dstinfo, src_coef_arrays, &options);
+
+    transformer->dest.next_output_byte=dst;
+    transformer->dest.free_in_buffer=length;
+
+    jpeg_write_coefficients(&transformer->dstinfo, dst_coef_arrays);
+    jtransform_execute_transform(&transformer->srcinfo, &transformer->dstinfo, src_coef_arrays, &options);
+
+    jpeg_finish_compress(&transformer->dstinfo);
+    jpeg_finish_decompress(&transformer->srcinfo);
+
+    return length-transformer->dest.free_in_buffer;
+}
+
+/* Returns offset of the first marker after entropy-coded segment, stuffed */
+/* zero bytes and restart markers are skipped. Returns -1 if frame ends    */
+/* inside of the segment.                                                  */
+static int uvc_jpeg_scan_entropy(uint8_t* data, int pos, int size)
+{
+#if defined(__SSE2__)
+    __m128i ff=_mm_set1_epi8((char)0xFF);
+    int mask;
+#endif /* __SSE2__ */
+    int marker;
+
+    while (pos<size-1)
+    {
+#if defined(__SSE2__)
+        /* Skip blocks of 16 bytes which have no 0xFF */
+        while (pos+16<=size)
+        {
+            mask=_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(data+pos)), ff));
+            if (mask)
+            {
+                pos+=__builtin_ctz(mask);
+                break;
+            }
+            pos+=16;
+        }
+        if (pos>=size-1)
+        {
+            break;
+        }
+#endif /* __SSE2__ */
+        if (data[pos]!=0xFF)
+        {
+            pos++;
+            continue;
+        }
+
+        marker=data[pos+1];
+        if ((marker==0x00) || ((marker>=JPEG_RST0) && (marker<=M_RST7)))
+        {
+            pos+=2;
+            continue;
+        }
+        if (marker==0xFF)
+        {
+            /* Fill byte before marker */
+            pos++;
+            continue;
+        }
+
+        return pos;
+    }
+
+    return -1;
+}
+
+/* Walks through the markers of MJPEG frame without entropy decoding. Checks  */
+/* that SOI, SOF, SOS and EOI are present and each segment fits in the frame. */
+/* Returns size of the frame up to EOI marker or -1 if frame is broken.       */
+int uvc_jpeg_validate(uint8_t* data, int size)
+{
+    int pos;
+    int marker;
+    int length;
+    int sof=0;
+    int sos=0;
+
+    if ((size<4) || (data[0]!=0xFF) || (data[1]!=M_SOI))
+    {
+        return -1;
+    }
+
+    pos=2;
+    for (;;)
+    {
+        /* Each marker may be preceded by any amount of fill bytes */
+        if ((pos>=size) || (data[pos]!=0xFF))
+        {
+            return -1;
+        }
+        while ((pos<size) && (data[pos]==0xFF))
+        {
+            pos++;
+        }
+        if (pos>=size)
+        {
+            return -1;
+        }
+        marker=data[pos++];
+
+        if (marker==JPEG_EOI)
+        {
+            return (sos) ? pos : -1;
+        }
+        if ((marker==M_TEM) || ((marker>=JPEG_RST0) && (marker<=M_RST7)))
+        {
+            continue;
+        }
+        if ((marker==0x00) || (marker==M_SOI))
+        {
+            return -1;
+        }
+
+        if (pos+2>size)
+        {
+            return -1;
+        }
+        length=(data[pos]<<8) | data[pos+1];
+        if ((length<2) || (pos+length>size))
+        {
+            return -1;
+        }
+
+        if ((marker>=M_SOF0) && (marker<=M_SOF15) && (marker!=M_DHT) && (marker!=M_JPG) && (marker!=M_DAC))
+        {
+            /* Precision, height, width, amount of components, 3 bytes per component */
+            if ((length<8) || (length!=8+3*data[pos+7]) || (data[pos+7]==0) ||
+                ((data[pos+5] | data[pos+6])==0))
+            {
+                return -1;
+            }
+            sof=1;
+        }
+        if (marker==M_SOS)
+        {
+            /* Amount of components, 2 bytes per component, 3 bytes of spectral selection */
+            if ((!sof) || (length<6) || (length!=6+2*data[pos+2]))
+            {
+                return -1;
+            }
+            pos=uvc_jpeg_scan_entropy(data, pos+length, size);
+            if (pos<0)
+            {
+                return -1;
+            }
+            sos=1;
+            continue;
+        }
+
+        pos+=length;
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#ifndef __UVC_JPEG_H__
+#define __UVC_JPEG_H__
+
+#include <stdint.h>
+
+/* Lossless transformations of MJPEG frame, performed on DCT coefficients */
+#define UVC_JPEG_XFORM_NONE       0
+#define UVC_JPEG_XFORM_FLIP_H     1
+#define UVC_JPEG_XFORM_FLIP_V     2
+#define UVC_JPEG_XFORM_TRANSPOSE  3
+#define UVC_JPEG_XFORM_TRANSVERSE 4
+#define UVC_JPEG_XFORM_ROT_90     5
+#define UVC_JPEG_XFORM_ROT_180    6
+#define UVC_JPEG_XFORM_ROT_270    7
+
+/* Largest MCU size in pixels, crop offsets must be aligned to it */
+#define UVC_JPEG_MCU_SIZE         16
+
+/* Per-stream MJPEG decoder */
+typedef struct _uvc_jpeg_context uvc_jpeg_context_t;
+
+uvc_jpeg_context_t* uvc_jpeg_create(int width);
+void uvc_jpeg_destroy(uvc_jpeg_context_t* context);
+int uvc_jpeg_decode(uvc_jpeg_context_t* context, uint8_t* src, int size, uint8_t* dst, int stride, int width, int height, int scale, uint32_t pixelformat);
+int uvc_jpeg_decode_dc(uvc_jpeg_context_t* context, uint8_t* src, int size, uint8_t* dst, int max_width, int max_height, int* width, int* height);
+int uvc_jpeg_transform_code(int hflip, int vflip, int rotate);
+int uvc_jpeg_validate(uint8_t* data, int size);
+
+/* Per-stream lossless transformation of MJPEG frames */
+typedef struct _uvc_jpeg_transformer uvc_jpeg_transformer_t;
+
+uvc_jpeg_transformer_t* uvc_jpeg_transformer_create(int width, int height);
+void uvc_jpeg_transformer_destroy(uvc_jpeg_transformer_t* transformer);
+int uvc_jpeg_transform(uvc_jpeg_transformer_t* transformer, uint8_t* src, int size, uint8_t* dst, int length, int transform, int crop_x, int crop_y, int crop_width, int crop_height);
+
+/* Per-stream MJPEG encoder of uncompressed frames */
+typedef struct _uvc_jpeg_encoder uvc_jpeg_encoder_t;
+
+/* Default JPEG quality of emulated MJPEG stream */
+#define UVC_JPEG_DEFAULT_QUALITY  85
+
+uvc_jpeg_encoder_t* uvc_jpeg_encoder_create(int width, int height, uint32_t pixelformat);
+void uvc_jpeg_encoder_destroy(uvc_jpeg_encoder_t* encoder);
+int uvc_jpeg_encode(uvc_jpeg_encoder_t* encoder, uint8_t* src, uint8_t* dst, int length, int quality);
+
+#endif /* __UVC_JPEG_H__ */
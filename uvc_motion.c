@@ -0,0 +1,353 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/slog.h>
+#include <sys/slogcodes.h>
+
+#include <linux/videodev2.h>
+
+#include "uvc.h"
+#include "uvc_jpeg.h"
+#include "uvc_motion.h"
+
+extern int uvc_verbose;
+
+/* Background adaption rates, as shifts of the difference: still blocks follow */
+/* the scene in about 16 frames, changed blocks are absorbed in about 256     */
+/* frames, so stopped objects become background eventually.                   */
+#define UVC_MOTION_RATE           4
+#define UVC_MOTION_SLOW_RATE      8
+
+/* Motion detector works on 1/8 scale luma thumbnails (DC coefficients) of */
+/* the MJPEG frames, background is a running average of thumbnails in 8.8  */
+/* fixed point. Buffers are sized for the largest MJPEG frame of device.   */
+struct _uvc_motion
+{
+    uvc_jpeg_context_t* jpeg;
+    int max_width;
+    int max_height;
+    int width;               /* Background size, zero if it is not set yet */
+    int height;
+    int moving;              /* Motion was reported for the previous frame */
+    uint8_t* thumbnail;
+    uint16_t* background;
+};
+
+uvc_motion_t* uvc_motion_create(int width, int height)
+{
+    uvc_motion_t* motion;
+
+    motion=calloc(1, sizeof(*motion));
+    if (motion==NULL)
+    {
+        return NULL;
+    }
+
+    /* libjpeg rounds up scaled dimensions */
+    motion->max_width=(width+7)/8;
+    motion->max_height=(height+7)/8;
+    motion->thumbnail=malloc(motion->max_width*motion->max_height);
+    motion->background=malloc(motion->max_width*motion->max_height*sizeof(uint16_t));
+    motion->jpeg=uvc_jpeg_create(width);
+    if ((motion->thumbnail==NULL) || (motion->background==NULL) || (motion->jpeg==NULL))
+    {
+        uvc_motion_destroy(motion);
+        return NULL;
+    }
+
+    return motion;
+}
+
+void uvc_motion_destroy(uvc_motion_t* motion)
+{
+    if (motion!=NULL)
+    {
+        uvc_jpeg_destroy(motion->jpeg);
+        free(motion->thumbnail);
+        free(motion->background);
+        free(motion);
+    }
+}
+
+/* Next frame becomes the background */
+void uvc_motion_reset(uvc_motion_t* motion)
+{
+    if (motion!=NULL)
+    {
+        motion->width=0;
+        motion->height=0;
+        motion->moving=0;
+    }
+}
+
+/* Creates motion detector of the stream for the first subscriber, it is kept */
+/* until device removal, because frames could be analysed at the same time.  */
+int uvc_motion_subscribe(uvc_device_t* dev, int subdev)
+{
+    uvc_motion_t* motion;
+    int width=0;
+    int height=0;
+    int it;
+
+    if (dev->motion[subdev]!=NULL)
+    {
+        return 0;
+    }
+
+    for (it=0; it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors; it++)
+    {
+        if (dev->vs_frame_mjpeg[subdev][it].wWidth>width)
+        {
+            width=dev->vs_frame_mjpeg[subdev][it].wWidth;
+        }
+        if (dev->vs_frame_mjpeg[subdev][it].wHeight>height)
+        {
+            height=dev->vs_frame_mjpeg[subdev][it].wHeight;
+        }
+    }
+    if ((width==0) || (height==0))
+    {
+        return -1;
+    }
+
+    motion=uvc_motion_create(width, height);
+    if (motion==NULL)
+    {
+        return -1;
+    }
+    dev->motion[subdev]=motion;
+
+    return 0;
+}
+
+/* Checks if any file descriptor of the stream listens for motion events */
+int uvc_motion_active(uvc_device_t* dev, int subdev)
+{
+    int it;
+
+    for (it=0; it<UVC_MAX_OPEN_FDS; it++)
+    {
+        if ((dev->event[it].ocb!=NULL) && (dev->event[it].type[UVC_EVENT_SLOT_MOTION]) &&
+            (dev->event[it].id[UVC_EVENT_SLOT_MOTION]==subdev))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Compares thumbnail of the frame with the background. Returns 1 if event must */
+/* be sent: frame has motion or motion stopped at this frame.                  */
+static int uvc_motion_analyse(uvc_motion_t* motion, uint8_t* src, unsigned int size, uvc_event_motion_t* result)
+{
+    int width, height, cells;
+    int left, top, right, bottom;
+    int changed, shift, diff, sample;
+    int it, jt, pos;
+
+    if (uvc_jpeg_decode_dc(motion->jpeg, src, size, motion->thumbnail, motion->max_width, motion->max_height, &width, &height)!=0)
+    {
+        return 0;
+    }
+    cells=width*height;
+
+    /* The first frame or new frame size, thumbnail becomes the background */
+    if ((width!=motion->width) || (height!=motion->height))
+    {
+        for (it=0; it<cells; it++)
+        {
+            motion->background[it]=motion->thumbnail[it]<<8;
+        }
+        motion->width=width;
+        motion->height=height;
+        motion->moving=0;
+        return 0;
+    }
+
+    /* Change of brightness of the whole scene (exposure, lights) is not a */
+    /* motion, mean difference is compensated before thresholding.         */
+    shift=0;
+    for (it=0; it<cells; it++)
+    {
+        shift+=motion->thumbnail[it]-(motion->background[it]>>8);
+    }
+    shift/=cells;
+
+    changed=0;
+    left=width;
+    top=height;
+    right=-1;
+    bottom=-1;
+    for (jt=0; jt<height; jt++)
+    {
+        for (it=0; it<width; it++)
+        {
+            pos=jt*width+it;
+            sample=motion->thumbnail[pos]<<8;
+            diff=motion->thumbnail[pos]-shift-(motion->background[pos]>>8);
+            if ((diff>UVC_MOTION_THRESHOLD) || (diff<-UVC_MOTION_THRESHOLD))
+            {
+                changed++;
+                left=(it<left) ? it : left;
+                right=(it>right) ? it : right;
+                top=(jt<top) ? jt : top;
+                bottom=jt;
+                motion->background[pos]+=(sample-motion->background[pos])>>UVC_MOTION_SLOW_RATE;
+            }
+            else
+            {
+                motion->background[pos]+=(sample-motion->background[pos])>>UVC_MOTION_RATE;
+            }
+        }
+    }
+
+    /* Changes below 1/1000 of the frame are noise */
+    result->score=changed*1000/cells;
+    if (result->score>0)
+    {
+        result->region.left=left*8;
+        result->region.top=top*8;
+        result->region.width=(right-left+1)*8;
+        result->region.height=(bottom-top+1)*8;
+        motion->moving=1;
+        return 1;
+    }
+
+    memset(&result->region, 0x00, sizeof(result->region));
+    if (motion->moving)
+    {
+        motion->moving=0;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Queues motion event for each file descriptor of the stream, which is */
+/* subscribed to it. Unread motion events are limited per queue.       */
+static void uvc_motion_send(uvc_device_t* dev, int subdev, uvc_event_motion_t* result)
+{
+    struct _uvc_event_entry* entry;
+    struct _uvc_event_entry* oldest;
+    int pending;
+    int it;
+
+    for (it=0; it<UVC_MAX_OPEN_FDS; it++)
+    {
+        if ((dev->event[it].ocb==NULL) || (!dev->event[it].type[UVC_EVENT_SLOT_MOTION]) ||
+            (dev->event[it].id[UVC_EVENT_SLOT_MOTION]!=subdev))
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&dev->event[it].access);
+        pending=0;
+        oldest=NULL;
+        TAILQ_FOREACH(entry, &dev->event[it].head, link)
+        {
+            if (entry->event.type==UVC_EVENT_MOTION)
+            {
+                if (oldest==NULL)
+                {
+                    oldest=entry;
+                }
+                pending++;
+            }
+        }
+        if (pending>=UVC_MOTION_MAX_EVENTS)
+        {
+            TAILQ_REMOVE(&dev->event[it].head, oldest, link);
+            entry=oldest;
+        }
+        else
+        {
+            entry=calloc(1, sizeof(*entry));
+            if (entry==NULL)
+            {
+                pthread_mutex_unlock(&dev->event[it].access);
+                if (uvc_verbose>3)
+                {
+                    slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] Can't allocate motion event, frame %d", result->frame_sequence);
+                }
+                continue;
+            }
+        }
+
+        entry->event.type=UVC_EVENT_MOTION;
+        entry->event.pending=0;
+        entry->event.sequence=dev->event[it].sequence;
+        entry->event.id=0;
+        clock_gettime(CLOCK_MONOTONIC, &entry->event.timestamp);
+        memset(entry->event.reserved, 0x00, sizeof(entry->event.reserved));
+        memset(entry->event.u.data, 0x00, sizeof(entry->event.u.data));
+        memcpy(entry->event.u.data, result, sizeof(*result));
+        dev->event[it].sequence++;
+        TAILQ_INSERT_TAIL(&dev->event[it].head, entry, link);
+        pthread_mutex_unlock(&dev->event[it].access);
+
+        /* Notify callers of select() if any */
+        iofunc_notify_trigger(dev->event[it].ocb->notify, 1, IOFUNC_NOTIFY_OBAND);
+    }
+}
+
+/* Analyses assembled MJPEG frame, before it is copied or decoded */
+void uvc_motion_frame(uvc_device_t* dev, int subdev, uint8_t* src, unsigned int size, uint32_t sequence)
+{
+    uvc_motion_t* motion=dev->motion[subdev];
+    uvc_event_motion_t result;
+    vs_frame_mjpeg_t* frame;
+
+    if ((motion==NULL) || (dev->current_source_format[subdev]!=UVC_FORMAT_MJPG))
+    {
+        return;
+    }
+
+    /* Background is rebuilt, when application subscribes again */
+    if (!uvc_motion_active(dev, subdev))
+    {
+        uvc_motion_reset(motion);
+        return;
+    }
+
+    if (!uvc_motion_analyse(motion, src, size, &result))
+    {
+        return;
+    }
+
+    /* Region is aligned to 8x8 blocks, clip it by the frame size */
+    frame=&dev->vs_frame_mjpeg[subdev][dev->current_source_frame[subdev]];
+    if (result.region.left+result.region.width>frame->wWidth)
+    {
+        result.region.width=frame->wWidth-result.region.left;
+    }
+    if (result.region.top+result.region.height>frame->wHeight)
+    {
+        result.region.height=frame->wHeight-result.region.top;
+    }
+    result.frame_sequence=sequence;
+
+    uvc_motion_send(dev, subdev, &result);
+}
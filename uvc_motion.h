@@ -0,0 +1,45 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#ifndef __UVC_MOTION_H__
+#define __UVC_MOTION_H__
+
+#include <stdint.h>
+
+/* Difference of 1/8 scale luma sample from the background, which marks */
+/* its 8x8 block as changed.                                             */
+#define UVC_MOTION_THRESHOLD      16
+
+/* Motion events kept in the queue of one file descriptor, the oldest one */
+/* is replaced if application doesn't dequeue them.                       */
+#define UVC_MOTION_MAX_EVENTS     16
+
+/* Per-stream motion detector on DC coefficients of MJPEG frames */
+typedef struct _uvc_motion uvc_motion_t;
+
+uvc_motion_t* uvc_motion_create(int width, int height);
+void uvc_motion_destroy(uvc_motion_t* motion);
+void uvc_motion_reset(uvc_motion_t* motion);
+
+int uvc_motion_subscribe(uvc_device_t* dev, int subdev);
+int uvc_motion_active(uvc_device_t* dev, int subdev);
+void uvc_motion_frame(uvc_device_t* dev, int subdev, uint8_t* src, unsigned int size, uint32_t sequence);
+
+#endif /* __UVC_MOTION_H__ */
@@ -0,0 +1,1275 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/procmgr.h>
+#include <sys/rsrcdbmgr.h>
+#include <sys/slogcodes.h>
+
+#include <linux/videodev2.h>
+
+#include "bsdqueue.h"
+
+#include "uvc.h"
+#include "uvc_rm.h"
+#include "uvc_jpeg.h"
+#include "uvc_scale.h"
+#include "uvc_driver.h"
+#include "uvc_devctl.h"
+#include "uvc_preview.h"
+#include "uvc_emulation.h"
+
+extern uvc_device_mapping_t devmap[MAX_UVC_DEVICES];
+extern int uvc_verbose;
+
+/* MJPEG frames are reduced by IDCT scaling, uncompressed ones by box filter */
+static const int uvc_preview_scales[]={2, 4, 8};
+
+#define UVC_PREVIEW_SCALES (sizeof(uvc_preview_scales)/sizeof(uvc_preview_scales[0]))
+
+/* Returns source format of the main stream and its frame size, UVC_FORMAT_NONE */
+/* if preview can't be produced from this format.                              */
+static int uvc_preview_source(uvc_device_t* dev, int subdev, int* width, int* height)
+{
+    int frame=dev->current_source_frame[subdev];
+
+    switch (dev->current_source_format[subdev])
+    {
+        case UVC_FORMAT_YUY2:
+        case UVC_FORMAT_NV12:
+             *width=dev->vs_frame_uncompressed[subdev][frame].wWidth;
+             *height=dev->vs_frame_uncompressed[subdev][frame].wHeight;
+             return dev->current_source_format[subdev];
+        case UVC_FORMAT_MJPG:
+             *width=dev->vs_frame_mjpeg[subdev][frame].wWidth;
+             *height=dev->vs_frame_mjpeg[subdev][frame].wHeight;
+             return UVC_FORMAT_MJPG;
+    }
+
+    return UVC_FORMAT_NONE;
+}
+
+/* Returns size of YUY2 preview frame for the current source frame and scale */
+static int uvc_preview_size(uvc_device_t* dev, int subdev, int scale, int* width, int* height)
+{
+    int source_width, source_height;
+
+    switch (uvc_preview_source(dev, subdev, &source_width, &source_height))
+    {
+        case UVC_FORMAT_YUY2:
+        case UVC_FORMAT_NV12:
+             *width=uvc_scale_size(source_width, scale);
+             *height=uvc_scale_size(source_height, scale);
+             break;
+        case UVC_FORMAT_MJPG:
+             /* libjpeg rounds up scaled dimensions, YUY2 requires even width */
+             *width=((source_width+scale-1)/scale) & ~1;
+             *height=(source_height+scale-1)/scale;
+             break;
+        default:
+             return -1;
+    }
+
+    if ((*width==0) || (*height==0))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Selects scale with the nearest preview frame size */
+static int uvc_preview_best_scale(uvc_device_t* dev, int subdev, int width, int height)
+{
+    int best_scale=-1;
+    int best_distance=INT_MAX;
+    int distance;
+    int w, h;
+    int it;
+
+    for (it=0; it<UVC_PREVIEW_SCALES; it++)
+    {
+        if (uvc_preview_size(dev, subdev, uvc_preview_scales[it], &w, &h)<0)
+        {
+            continue;
+        }
+        distance=abs(w-width)+abs(h-height);
+        if (distance<best_distance)
+        {
+            best_distance=distance;
+            best_scale=uvc_preview_scales[it];
+        }
+    }
+
+    return best_scale;
+}
+
+static void uvc_preview_drain(uvc_buffer_t* queue)
+{
+    struct _uvc_buffer_entry* entry;
+    struct _uvc_buffer_entry* tentry;
+
+    pthread_mutex_lock(&queue->access);
+    TAILQ_FOREACH_SAFE(entry, &queue->head, link, tentry)
+    {
+        TAILQ_REMOVE(&queue->head, entry, link);
+        if (entry!=NULL)
+        {
+            free(entry);
+        }
+    }
+    pthread_mutex_unlock(&queue->access);
+}
+
+/* Stops the preview and frees its buffers */
+static void uvc_preview_release(uvc_device_t* dev, uvc_preview_device_t* preview)
+{
+    char fdname[128];
+
+    preview->transfer=0;
+    preview->reqbufs_ocb=NULL;
+
+    /* Shared memory name consist of device minor, usb path and usb devno */
+    sprintf(fdname, "/devu-uvc-%d-%d-%d", minor(preview->hdr.rdev), dev->map->usb_path, dev->map->usb_devno);
+
+    if (preview->buffer_ptr!=NULL)
+    {
+        munmap(preview->buffer_ptr, preview->buffer_size*preview->buffer_count);
+        preview->buffer_ptr=NULL;
+    }
+    preview->buffer_count=0;
+    if (preview->buffer_fd!=-1)
+    {
+        close(preview->buffer_fd);
+    }
+    preview->buffer_fd=-1;
+    shm_unlink(fdname);
+
+    uvc_preview_drain(&preview->input_buffer);
+    uvc_preview_drain(&preview->output_buffer);
+}
+
+uvc_ocb_t* _uvc_preview_ocb_calloc(resmgr_context_t* ctp, uvc_device_t* dev)
+{
+    uvc_ocb_t* ocb;
+    int it;
+    int jt;
+
+    ocb = calloc(1, sizeof(uvc_ocb_t));
+    ocb->dev=NULL;
+    ocb->handle=dev;
+    ocb->subdev=-1;
+
+    if (ocb != NULL)
+    {
+        /* Handle is iofunc_attr_t of the preview device, search its owner */
+        for (it=0; it<MAX_UVC_DEVICES; it++)
+        {
+            if ((devmap[it].initialized) && (devmap[it].uvcd!=NULL))
+            {
+                for(jt=0; jt<devmap[it].uvcd->total_vs_devices; jt++)
+                {
+                    if (devmap[it].uvcd->preview[jt]!=NULL)
+                    {
+                        if (&devmap[it].uvcd->preview[jt]->hdr==(void*)dev)
+                        {
+                            ocb->dev=devmap[it].uvcd;
+                            ocb->subdev=jt;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (ocb->dev!=NULL)
+            {
+                break;
+            }
+        }
+
+        IOFUNC_NOTIFY_INIT(ocb->notify);
+    }
+
+    return ocb;
+}
+
+void _uvc_preview_ocb_free(uvc_ocb_t* ocb)
+{
+    free(ocb);
+}
+
+int uvc_open_preview(resmgr_context_t* ctp, io_open_t* msg, RESMGR_HANDLE_T* handle, void* extra)
+{
+    int status;
+
+    status=iofunc_open_default(ctp, msg, (iofunc_attr_t*)handle, extra);
+    if (status)
+    {
+        return status;
+    }
+
+    return EOK;
+}
+
+int uvc_close_preview(resmgr_context_t* ctp, void* reserved, uvc_ocb_t* ocb)
+{
+    int status;
+
+    if ((ocb->dev!=NULL) && (ocb->subdev!=-1) && (ocb->dev->preview[ocb->subdev]!=NULL))
+    {
+        /* Remove buffers ownership */
+        if (ocb->dev->preview[ocb->subdev]->reqbufs_ocb==ocb)
+        {
+            uvc_preview_release(ocb->dev, ocb->dev->preview[ocb->subdev]);
+        }
+    }
+
+    /* Remove notify queues at exit */
+    iofunc_notify_remove(ctp, ocb->notify);
+
+    status=iofunc_close_ocb_default(ctp, reserved, (iofunc_ocb_t*)ocb);
+    if (status)
+    {
+        return status;
+    }
+
+    return EOK;
+}
+
+int uvc_notify_preview(resmgr_context_t* ctp, io_notify_t* msg, uvc_ocb_t* ocb)
+{
+    uvc_preview_device_t* preview;
+    int trigger=0;
+
+    if (ocb->subdev==-1)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] preview notify(): can't locate subdevice!");
+        return ENODEV;
+    }
+    preview=ocb->dev->preview[ocb->subdev];
+
+    /* Check if driver got some new buffers */
+    if (!TAILQ_EMPTY(&preview->output_buffer.head))
+    {
+        trigger|=_NOTIFY_COND_EXTEN | _NOTIFY_CONDE_RDNORM;
+    }
+
+    /* We always have a room for some buffers in the input queue */
+    trigger|=_NOTIFY_COND_EXTEN | _NOTIFY_CONDE_WRNORM;
+
+    return iofunc_notify(ctp, msg, ocb->notify, trigger, NULL, NULL);
+}
+
+int uvc_mmap_preview(resmgr_context_t *ctp, io_mmap_t *msg, uvc_ocb_t* ocb)
+{
+    uvc_preview_device_t* preview;
+    unsigned int offset=msg->i.offset;
+    int result;
+
+    if (ocb->subdev==-1)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] preview mmap(): can't locate subdevice!");
+        return ENODEV;
+    }
+    preview=ocb->dev->preview[ocb->subdev];
+
+    if (preview->buffer_fd==-1)
+    {
+        return ENOMEM;
+    }
+
+    result=iofunc_mmap_default(ctp, msg, (iofunc_ocb_t*)ocb);
+    if (result<0)
+    {
+        /* Replace coid of the reply with our shared memory descriptor, */
+        /* the same as for the main video device.                       */
+        msg->o.fd=-1;
+        msg->o.coid=preview->buffer_fd;
+        msg->o.offset=offset;
+    }
+
+    return result;
+}
+
+int uvc_devctl_preview(resmgr_context_t* ctp, io_devctl_t* msg, uvc_ocb_t* ocb)
+{
+    int status, ret=EOK;
+    uvc_device_t* dev=ocb->dev;
+    void* dptr=_DEVCTL_DATA(msg->i);
+    int dctldatasize=0;
+    int subdev=ocb->subdev;
+    uvc_preview_device_t* preview;
+    int width, height;
+    int it;
+
+    status = iofunc_devctl_default(ctp, msg, &ocb->hdr);
+    if (status != _RESMGR_DEFAULT)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] preview iofunc_devctl_default() failed");
+        return _RESMGR_ERRNO(status);
+    }
+
+    if (subdev==-1)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] preview devctl(): can't locate subdevice!");
+        return _RESMGR_ERRNO(ENODEV);
+    }
+    preview=dev->preview[subdev];
+
+    if (uvc_verbose>2)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_INFO, "preview devctl(): cmd %08X, subdevice %d, rdev=%08X, ocb=%08X", msg->i.dcmd, subdev, ocb->hdr.attr->hdr->rdev, (unsigned int)ocb);
+    }
+
+    switch (msg->i.dcmd)
+    {
+        case VIDIOC_QUERYCAP:
+             {
+                 struct v4l2_capability* cap;
+
+                 cap=(struct v4l2_capability*)dptr;
+                 memset(cap, 0x00, sizeof(*cap));
+
+                 strncpy((char*)cap->driver, "devu-uvc", sizeof(cap->driver));
+                 snprintf((char*)cap->card, sizeof(cap->card), "%s (preview)", dev->device_id_str);
+                 snprintf((char*)cap->bus_info, sizeof(cap->bus_info), "usb-%d:%d", dev->map->usb_path, dev->map->usb_devno);
+                 /* Pretend it is linux running 6.x.0 kernel */
+                 cap->version=((_NTO_VERSION/100)<<16) | (((_NTO_VERSION-(_NTO_VERSION/100)*100)/10)<<8);
+                 cap->capabilities=V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_DEVICE_CAPS |
+                                   V4L2_CAP_STREAMING;
+                 cap->device_caps=V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+                 dctldatasize=sizeof(*cap);
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_QUERYCAP:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        card: %s", cap->card);
+                 }
+             }
+             break;
+        case VIDIOC_ENUM_FMT:
+             {
+                 struct v4l2_fmtdesc* fmt;
+
+                 fmt=(struct v4l2_fmtdesc*)dptr;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_ENUM_FMT:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        type: %08X", fmt->type);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %d", fmt->index);
+                 }
+
+                 /* Preview is always YUY2, whatever the source format is */
+                 if ((fmt->type!=V4L2_BUF_TYPE_VIDEO_CAPTURE) || (fmt->index!=0))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: wrong buffer type or index");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+                 memset(fmt->reserved, 0x00, sizeof(fmt->reserved));
+                 fmt->pixelformat=V4L2_PIX_FMT_YUYV;
+                 fmt->flags=0;
+                 strncpy((char*)fmt->description, "YUV 4:2:2 (YUY2/YUYV)", sizeof(fmt->description));
+
+                 dctldatasize=sizeof(*fmt);
+             }
+             break;
+        case VIDIOC_G_FMT:
+        case VIDIOC_S_FMT:
+        case VIDIOC_TRY_FMT:
+             {
+                 struct v4l2_format* fmt;
+                 int scale;
+
+                 fmt=(struct v4l2_format*)dptr;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_%s_FMT:", (msg->i.dcmd==VIDIOC_G_FMT) ? "G" :
+                         ((msg->i.dcmd==VIDIOC_S_FMT) ? "S" : "TRY"));
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        type: %08X", fmt->type);
+                 }
+
+                 if (fmt->type!=V4L2_BUF_TYPE_VIDEO_CAPTURE)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: buffer type is not V4L2_BUF_TYPE_VIDEO_CAPTURE");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 scale=preview->scale;
+                 if (msg->i.dcmd!=VIDIOC_G_FMT)
+                 {
+                     scale=uvc_preview_best_scale(dev, subdev, fmt->fmt.pix.width, fmt->fmt.pix.height);
+                 }
+                 if ((scale<0) || (uvc_preview_size(dev, subdev, scale, &width, &height)<0))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: source format of the stream can't be reduced");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 if (msg->i.dcmd==VIDIOC_S_FMT)
+                 {
+                     if (preview->buffer_count)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EBUSY: buffers are allocated");
+                         }
+                         ret=EBUSY;
+                         break;
+                     }
+                     preview->scale=scale;
+                 }
+
+                 memset(fmt, 0x00, sizeof(*fmt));
+                 fmt->type=V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                 fmt->fmt.pix.width=width;
+                 fmt->fmt.pix.height=height;
+                 fmt->fmt.pix.pixelformat=V4L2_PIX_FMT_YUYV;
+                 fmt->fmt.pix.field=V4L2_FIELD_NONE;
+                 fmt->fmt.pix.bytesperline=width*2;
+                 fmt->fmt.pix.sizeimage=width*2*height;
+                 fmt->fmt.pix.colorspace=V4L2_COLORSPACE_SMPTE170M;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        width: %d", fmt->fmt.pix.width);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        height: %d", fmt->fmt.pix.height);
+                 }
+
+                 dctldatasize=sizeof(*fmt);
+             }
+             break;
+        case VIDIOC_ENUM_FRAMESIZES:
+             {
+                 struct v4l2_frmsizeenum* frm;
+
+                 frm=(struct v4l2_frmsizeenum*)dptr;
+                 frm->reserved[0]=0;
+                 frm->reserved[1]=0;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_ENUM_FRAMESIZES:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %d", frm->index);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        pixel_format: %08X", frm->pixel_format);
+                 }
+
+                 if ((frm->pixel_format!=V4L2_PIX_FMT_YUYV) || (frm->index>=UVC_PREVIEW_SCALES) ||
+                     (uvc_preview_size(dev, subdev, uvc_preview_scales[frm->index], &width, &height)<0))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: unsupported pixel format or index");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 frm->type=V4L2_FRMSIZE_TYPE_DISCRETE;
+                 frm->discrete.width=width;
+                 frm->discrete.height=height;
+
+                 dctldatasize=sizeof(*frm);
+             }
+             break;
+        case VIDIOC_G_PARM:
+        case VIDIOC_S_PARM:
+             {
+                 struct v4l2_streamparm* parm;
+                 uint64_t frameinterval;
+
+                 parm=(struct v4l2_streamparm*)dptr;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_%s_PARM:", (msg->i.dcmd==VIDIOC_G_PARM) ? "G" : "S");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        type: %d", parm->type);
+                 }
+
+                 if (parm->type!=V4L2_BUF_TYPE_VIDEO_CAPTURE)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: buffer type is not V4L2_BUF_TYPE_VIDEO_CAPTURE");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 /* Preview frame rate is an integer divisor of the main stream frame rate */
+                 if ((msg->i.dcmd==VIDIOC_S_PARM) && (parm->parm.capture.timeperframe.denominator!=0) &&
+                     (dev->current_frameinterval[subdev]!=0))
+                 {
+                     frameinterval=(uint64_t)parm->parm.capture.timeperframe.numerator*10000000/
+                         parm->parm.capture.timeperframe.denominator;
+                     it=(frameinterval+dev->current_frameinterval[subdev]/2)/dev->current_frameinterval[subdev];
+                     if (it<1)
+                     {
+                         it=1;
+                     }
+                     if (it>UVC_MAX_DECIMATION)
+                     {
+                         it=UVC_MAX_DECIMATION;
+                     }
+                     preview->decimation=it;
+                     preview->decimation_count=0;
+                 }
+
+                 memset(&parm->parm.capture, 0x00, sizeof(parm->parm.capture));
+                 parm->parm.capture.capability=V4L2_CAP_TIMEPERFRAME;
+                 parm->parm.capture.timeperframe.numerator=dev->current_frameinterval[subdev]*preview->decimation;
+                 parm->parm.capture.timeperframe.denominator=10000000;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        timeperframe.numerator: %d", parm->parm.capture.timeperframe.numerator);
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        timeperframe.denominator: %d", parm->parm.capture.timeperframe.denominator);
+                 }
+
+                 dctldatasize=sizeof(*parm);
+             }
+             break;
+        case VIDIOC_REQBUFS:
+             {
+                 struct v4l2_requestbuffers* buf;
+                 char fdname[128];
+                 unsigned int size;
+                 unsigned int chunksize;
+                 int fd;
+
+                 buf=(struct v4l2_requestbuffers*)dptr;
+                 memset(buf->reserved, 0x00, sizeof(buf->reserved));
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_REQBUFS:");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        count: %d", buf->count);
+                 }
+
+                 if ((buf->type!=V4L2_BUF_TYPE_VIDEO_CAPTURE) || (buf->memory!=V4L2_MEMORY_MMAP))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: buffer type is not V4L2_BUF_TYPE_VIDEO_CAPTURE or V4L2_MEMORY_MMAP");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 if (preview->transfer)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EBUSY: transfer is active");
+                     }
+                     ret=EBUSY;
+                     break;
+                 }
+
+                 if ((preview->reqbufs_ocb!=NULL) && (preview->reqbufs_ocb!=ocb))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EBUSY: can't acquire permissions");
+                     }
+                     ret=EBUSY;
+                     break;
+                 }
+
+                 /* Free any previously allocated buffers */
+                 uvc_preview_release(dev, preview);
+
+                 if (buf->count==0)
+                 {
+                     dctldatasize=sizeof(*buf);
+                     break;
+                 }
+                 if (buf->count>VIDEO_MAX_FRAME)
+                 {
+                     buf->count=VIDEO_MAX_FRAME;
+                 }
+
+                 /* Frame size is fixed until buffers are released */
+                 if (uvc_preview_size(dev, subdev, preview->scale, &width, &height)<0)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: source format of the stream can't be reduced");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+                 preview->width=width;
+                 preview->height=height;
+                 preview->stride=width*2;
+
+                 size=preview->stride*preview->height;
+                 chunksize=sysconf(_SC_PAGE_SIZE);
+                 /* Adjust buffer size to system page size */
+                 size=(size+chunksize-1) & ~(chunksize-1);
+
+                 sprintf(fdname, "/devu-uvc-%d-%d-%d", minor(preview->hdr.rdev), dev->map->usb_path, dev->map->usb_devno);
+                 fd=shm_open(fdname, O_RDWR | O_CREAT,
+                     S_IRUSR | S_IRGRP | S_IROTH | S_IWUSR | S_IWGRP | S_IWOTH);
+                 if (fd==-1)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: Can't create shared memory object");
+                     }
+                     ret=ENOMEM;
+                     break;
+                 }
+                 if (shm_ctl(fd, SHMCTL_GLOBAL | SHMCTL_ANON, 0, size*buf->count)==-1)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: Can't change size of shared memory object");
+                     }
+                     close(fd);
+                     ret=ENOMEM;
+                     break;
+                 }
+
+                 preview->buffer_ptr=mmap(NULL, size*buf->count, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                 if (preview->buffer_ptr==MAP_FAILED)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: Can't map shared memory object");
+                     }
+                     preview->buffer_ptr=NULL;
+                     close(fd);
+                     ret=ENOMEM;
+                     break;
+                 }
+
+                 preview->reqbufs_ocb=ocb;
+                 preview->buffer_count=buf->count;
+                 preview->buffer_size=size;
+                 preview->buffer_fd=fd;
+
+                 dctldatasize=sizeof(*buf);
+             }
+             break;
+        case VIDIOC_QUERYBUF:
+        case VIDIOC_QBUF:
+             {
+                 struct v4l2_buffer* buf;
+                 struct _uvc_buffer_entry* entry;
+                 int queued=0;
+
+                 buf=(struct v4l2_buffer*)dptr;
+                 memset(&buf->reserved, 0x00, sizeof(buf->reserved));
+                 memset(&buf->reserved2, 0x00, sizeof(buf->reserved2));
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_%s:", (msg->i.dcmd==VIDIOC_QBUF) ? "QBUF" : "QUERYBUF");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        index: %d", buf->index);
+                 }
+
+                 if ((buf->type!=V4L2_BUF_TYPE_VIDEO_CAPTURE) || (buf->memory!=V4L2_MEMORY_MMAP))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: buffer type is not V4L2_BUF_TYPE_VIDEO_CAPTURE or V4L2_MEMORY_MMAP");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 if (buf->index>=preview->buffer_count)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: buffer index is out of range (%d of %d)", buf->index, preview->buffer_count);
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 buf->field=V4L2_FIELD_NONE;
+                 buf->flags=V4L2_BUF_FLAG_MAPPED | V4L2_BUF_FLAG_PREPARED;
+                 buf->m.offset=preview->buffer_size*buf->index;
+                 buf->length=preview->buffer_size;
+                 buf->sequence=0;
+                 buf->bytesused=0;
+                 memset(&buf->timecode, 0x00, sizeof(buf->timecode));
+
+                 /* Fill state of the buffer from the queues */
+                 pthread_mutex_lock(&preview->output_buffer.access);
+                 TAILQ_FOREACH(entry, &preview->output_buffer.head, link)
+                 {
+                     if (entry->buffer.index==buf->index)
+                     {
+                         buf->flags|=V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+                         buf->sequence=entry->buffer.sequence;
+                         buf->bytesused=entry->buffer.bytesused;
+                         buf->timestamp=entry->buffer.timestamp;
+                         queued=1;
+                         break;
+                     }
+                 }
+                 pthread_mutex_unlock(&preview->output_buffer.access);
+                 pthread_mutex_lock(&preview->input_buffer.access);
+                 TAILQ_FOREACH(entry, &preview->input_buffer.head, link)
+                 {
+                     if (entry->buffer.index==buf->index)
+                     {
+                         buf->flags|=V4L2_BUF_FLAG_QUEUED;
+                         queued=1;
+                         break;
+                     }
+                 }
+                 pthread_mutex_unlock(&preview->input_buffer.access);
+
+                 if (msg->i.dcmd==VIDIOC_QBUF)
+                 {
+                     if (queued)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EBUSY: buffer %d is already queued", buf->index);
+                         }
+                         ret=EBUSY;
+                         break;
+                     }
+
+                     entry=calloc(1, sizeof(struct _uvc_buffer_entry));
+                     if (entry==NULL)
+                     {
+                         if (uvc_verbose>2)
+                         {
+                             slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        ENOMEM: no memory to enqueue buffer %d", buf->index);
+                         }
+                         ret=ENOMEM;
+                         break;
+                     }
+
+                     /* Entry is built by driver, application gives buffer index only */
+                     buf->flags|=V4L2_BUF_FLAG_QUEUED;
+                     entry->buffer.index=buf->index;
+                     entry->buffer.type=V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                     entry->buffer.memory=V4L2_MEMORY_MMAP;
+                     entry->buffer.field=V4L2_FIELD_NONE;
+                     entry->buffer.flags=V4L2_BUF_FLAG_MAPPED | V4L2_BUF_FLAG_QUEUED;
+                     entry->buffer.m.offset=preview->buffer_size*buf->index;
+                     entry->buffer.length=preview->buffer_size;
+
+                     pthread_mutex_lock(&preview->input_buffer.access);
+                     TAILQ_INSERT_TAIL(&preview->input_buffer.head, entry, link);
+                     pthread_mutex_unlock(&preview->input_buffer.access);
+                 }
+
+                 dctldatasize=sizeof(*buf);
+             }
+             break;
+        case VIDIOC_DQBUF:
+             {
+                 struct v4l2_buffer* buf;
+                 struct _uvc_buffer_entry* entry;
+                 struct timespec ts={0, 1};
+
+                 buf=(struct v4l2_buffer*)dptr;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_DQBUF:");
+                 }
+
+                 if ((buf->type!=V4L2_BUF_TYPE_VIDEO_CAPTURE) || (buf->memory!=V4L2_MEMORY_MMAP))
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: buffer type is not V4L2_BUF_TYPE_VIDEO_CAPTURE or V4L2_MEMORY_MMAP");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 do {
+                     pthread_mutex_lock(&preview->output_buffer.access);
+                     entry=TAILQ_FIRST(&preview->output_buffer.head);
+                     if (entry!=NULL)
+                     {
+                         TAILQ_REMOVE(&preview->output_buffer.head, entry, link);
+                     }
+                     pthread_mutex_unlock(&preview->output_buffer.access);
+
+                     if (entry!=NULL)
+                     {
+                         break;
+                     }
+                     if ((ocb->hdr.ioflag & O_NONBLOCK)==O_NONBLOCK)
+                     {
+                         /* Yield a bit and then return EAGAIN */
+                         nanosleep(&ts, NULL);
+                         ret=EAGAIN;
+                         break;
+                     }
+
+                     /* wait for the new buffer in the blocked state */
+                     nanosleep(&ts, NULL);
+                 } while(1);
+
+                 if (ret!=EOK)
+                 {
+                     break;
+                 }
+
+                 *buf=entry->buffer;
+                 free(entry);
+                 memset(&buf->reserved, 0x00, sizeof(buf->reserved));
+                 memset(&buf->reserved2, 0x00, sizeof(buf->reserved2));
+
+                 dctldatasize=sizeof(*buf);
+             }
+             break;
+        case VIDIOC_STREAMON:
+        case VIDIOC_STREAMOFF:
+             {
+                 int* type;
+                 int source_width, source_height;
+
+                 type=(int*)dptr;
+
+                 if (uvc_verbose>2)
+                 {
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "    VIDIOC_STREAM%s:", (msg->i.dcmd==VIDIOC_STREAMON) ? "ON" : "OFF");
+                     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        type: %d", *type);
+                 }
+
+                 if (*type!=V4L2_BUF_TYPE_VIDEO_CAPTURE)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        EINVAL: buffer type is not V4L2_BUF_TYPE_VIDEO_CAPTURE");
+                     }
+                     ret=EINVAL;
+                     break;
+                 }
+
+                 if (msg->i.dcmd==VIDIOC_STREAMOFF)
+                 {
+                     /* Drain input and output queues, all information will be lost */
+                     preview->transfer=0;
+                     uvc_preview_drain(&preview->input_buffer);
+                     uvc_preview_drain(&preview->output_buffer);
+                     break;
+                 }
+
+                 if ((preview->transfer) || (preview->reqbufs_ocb!=ocb))
+                 {
+                     ret=(preview->transfer) ? EOK : EINVAL;
+                     break;
+                 }
+
+                 /* Decoder and line buffer are kept until device removal, since */
+                 /* USB callback could use them at any time.                    */
+                 switch (uvc_preview_source(dev, subdev, &source_width, &source_height))
+                 {
+                     case UVC_FORMAT_MJPG:
+                          if (preview->jpeg==NULL)
+                          {
+                              width=0;
+                              for (it=0; it<dev->vs_format_mjpeg[subdev].bNumFrameDescriptors; it++)
+                              {
+                                  if (dev->vs_frame_mjpeg[subdev][it].wWidth>width)
+                                  {
+                                      width=dev->vs_frame_mjpeg[subdev][it].wWidth;
+                                  }
+                              }
+                              preview->jpeg=uvc_jpeg_create(width);
+                              if (preview->jpeg==NULL)
+                              {
+                                  ret=ENOMEM;
+                              }
+                          }
+                          break;
+                     case UVC_FORMAT_YUY2:
+                     case UVC_FORMAT_NV12:
+                          if (preview->line==NULL)
+                          {
+                              width=0;
+                              for (it=0; it<dev->vs_format_uncompressed[subdev].bNumFrameDescriptors; it++)
+                              {
+                                  if (dev->vs_frame_uncompressed[subdev][it].wWidth>width)
+                                  {
+                                      width=dev->vs_frame_uncompressed[subdev][it].wWidth;
+                                  }
+                              }
+                              preview->line=malloc(width*2);
+                              if (preview->line==NULL)
+                              {
+                                  ret=ENOMEM;
+                                  break;
+                              }
+                              preview->line_size=width*2;
+                          }
+                          break;
+                     default:
+                          ret=EINVAL;
+                          break;
+                 }
+                 if (ret!=EOK)
+                 {
+                     if (uvc_verbose>2)
+                     {
+                         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "        %s: can't prepare preview of the source format", (ret==ENOMEM) ? "ENOMEM" : "EINVAL");
+                     }
+                     break;
+                 }
+
+                 /* Frames are delivered while the main stream is running */
+                 preview->sequence=0;
+                 preview->decimation_count=0;
+                 preview->transfer=1;
+             }
+             break;
+        default:
+             ret=ENOTTY;
+             break;
+    }
+
+    /* Setup error code and reply size */
+    msg->o.nbytes=dctldatasize;
+    msg->o.ret_val=0;
+    if (ret!=EOK)
+    {
+        msg->o.ret_val=-1;
+    }
+
+    _RESMGR_STATUS(ctp, ret);
+    {
+        iov_t iovs[2];
+
+        SETIOV(iovs+0, (char*)&msg->o, sizeof(msg->o));
+        SETIOV(iovs+1, (char*)&msg->o+sizeof(msg->o), dctldatasize);
+
+        status=resmgr_msgwritev(ctp, &iovs[0], 2, 0);
+    }
+
+    return _RESMGR_ERRNO(ret);
+}
+
+/* Reduces source frame of the main stream to YUY2 preview frame. Returns */
+/* amount of bytes used in the buffer or -1 if frame can't be converted.   */
+static int uvc_preview_convert(uvc_device_t* dev, int subdev, uvc_preview_device_t* preview, uint8_t* src, unsigned int size, uint8_t* dst, unsigned int length)
+{
+    int source_width, source_height;
+    int width, height;
+    int scale=preview->scale;
+    int samples;
+    uint8_t* luma;
+    uint8_t* chroma;
+    uint8_t* out;
+    int it, jt;
+
+    /* Source frame could be changed by the main video device after buffers allocation */
+    if ((uvc_preview_size(dev, subdev, scale, &width, &height)<0) ||
+        (width!=preview->width) || (height!=preview->height) || (preview->stride*height>length))
+    {
+        return -1;
+    }
+
+    switch (uvc_preview_source(dev, subdev, &source_width, &source_height))
+    {
+        case UVC_FORMAT_MJPG:
+             /* Reduced size IDCT skips most of the decoding work */
+             it=uvc_jpeg_validate(src, size);
+             if (it<0)
+             {
+                 return -1;
+             }
+             if (uvc_jpeg_decode(preview->jpeg, src, it, dst, preview->stride, width, height, scale, V4L2_PIX_FMT_YUYV)<0)
+             {
+                 return -1;
+             }
+             break;
+        case UVC_FORMAT_YUY2:
+             if ((preview->line==NULL) || (preview->line_size<source_width*2) || (size<source_width*2*source_height))
+             {
+                 return -1;
+             }
+             for (it=0; it<height; it++)
+             {
+                 uvc_scale_rows(src+it*scale*source_width*2, source_width*2, scale, preview->line, source_width*2);
+                 samples=source_width;
+                 for (jt=scale; jt>1; jt/=2)
+                 {
+                     samples=uvc_scale_yuy2_half(preview->line, samples);
+                 }
+                 memcpy(dst+it*preview->stride, preview->line, width*2);
+             }
+             break;
+        case UVC_FORMAT_NV12:
+             if ((preview->line==NULL) || (preview->line_size<source_width*2) || (size<source_width*source_height*3/2))
+             {
+                 return -1;
+             }
+             luma=preview->line;
+             chroma=preview->line+source_width;
+             for (it=0; it<height; it++)
+             {
+                 /* Chroma plane has half of luma lines */
+                 uvc_scale_rows(src+it*scale*source_width, source_width, scale, luma, source_width);
+                 uvc_scale_rows(src+source_width*source_height+it*(scale/2)*source_width, source_width, scale/2,
+                     chroma, source_width);
+                 samples=source_width;
+                 for (jt=scale; jt>1; jt/=2)
+                 {
+                     samples=uvc_scale_y_half(luma, samples);
+                 }
+                 samples=source_width/2;
+                 for (jt=scale; jt>1; jt/=2)
+                 {
+                     samples=uvc_scale_uv_half(chroma, samples);
+                 }
+
+                 /* Pack planar luma and interleaved chroma to YUY2 */
+                 out=dst+it*preview->stride;
+                 for (jt=0; jt<width; jt+=2)
+                 {
+                     out[0]=luma[jt];
+                     out[1]=chroma[jt];
+                     out[2]=luma[jt+1];
+                     out[3]=chroma[jt+1];
+                     out+=4;
+                 }
+             }
+             break;
+        default:
+             return -1;
+    }
+
+    return preview->stride*height;
+}
+
+/* Called for each assembled frame of the main stream, frames are dropped to */
+/* the preview frame rate before conversion.                                 */
+void uvc_preview_frame(uvc_device_t* dev, int subdev, uint8_t* src, unsigned int size)
+{
+    uvc_preview_device_t* preview=dev->preview[subdev];
+    uvc_buffer_entry_t* entry=NULL;
+    struct timespec ts;
+    int bytesused;
+
+    if ((preview==NULL) || (!preview->transfer))
+    {
+        return;
+    }
+
+    preview->decimation_count++;
+    if (preview->decimation_count<preview->decimation)
+    {
+        return;
+    }
+    preview->decimation_count=0;
+
+    pthread_mutex_lock(&preview->input_buffer.access);
+    entry=TAILQ_FIRST(&preview->input_buffer.head);
+    if (entry!=NULL)
+    {
+        TAILQ_REMOVE(&preview->input_buffer.head, entry, link);
+    }
+    pthread_mutex_unlock(&preview->input_buffer.access);
+
+    /* No free buffers, preview application is too slow, drop this frame */
+    if (entry==NULL)
+    {
+        if (uvc_verbose>3)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] No queued preview buffers, frame %d is dropped", preview->sequence);
+        }
+        preview->sequence++;
+        return;
+    }
+
+    bytesused=-1;
+    if (preview->buffer_ptr!=NULL)
+    {
+        bytesused=uvc_preview_convert(dev, subdev, preview, src, size,
+            (uint8_t*)preview->buffer_ptr+entry->buffer.index*preview->buffer_size, preview->buffer_size);
+    }
+    if (bytesused<0)
+    {
+        entry->buffer.bytesused=0;
+        entry->buffer.flags|=V4L2_BUF_FLAG_ERROR;
+    }
+    else
+    {
+        entry->buffer.bytesused=bytesused;
+        entry->buffer.flags&=~(V4L2_BUF_FLAG_ERROR);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    entry->buffer.timestamp.tv_sec=ts.tv_sec;
+    entry->buffer.timestamp.tv_usec=ts.tv_nsec/1000;
+    entry->buffer.sequence=preview->sequence++;
+    entry->buffer.field=V4L2_FIELD_NONE;
+    entry->buffer.flags&=~(V4L2_BUF_FLAG_QUEUED);
+    entry->buffer.flags|=V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+
+    pthread_mutex_lock(&preview->output_buffer.access);
+    TAILQ_INSERT_TAIL(&preview->output_buffer.head, entry, link);
+    pthread_mutex_unlock(&preview->output_buffer.access);
+
+    if (preview->reqbufs_ocb!=NULL)
+    {
+        iofunc_notify_trigger(preview->reqbufs_ocb->notify, 1, IOFUNC_NOTIFY_INPUT);
+    }
+}
+
+int uvc_register_preview(uvc_device_t* dev, int mapid)
+{
+    char name[PATH_MAX];
+    struct _uvc_preview_device* preview;
+
+    if (dev->preview[dev->total_vs_devices])
+    {
+        free(dev->preview[dev->total_vs_devices]);
+        dev->preview[dev->total_vs_devices]=NULL;
+    }
+    dev->preview[dev->total_vs_devices]=calloc(1, sizeof(struct _uvc_preview_device));
+    if (dev->preview[dev->total_vs_devices]==NULL)
+    {
+        return -1;
+    }
+    preview=dev->preview[dev->total_vs_devices];
+
+    preview->scale=UVC_PREVIEW_DEFAULT_SCALE;
+    preview->decimation=1;
+    preview->buffer_fd=-1;
+    TAILQ_INIT(&preview->input_buffer.head);
+    TAILQ_INIT(&preview->output_buffer.head);
+    pthread_mutex_init(&preview->input_buffer.access, NULL);
+    pthread_mutex_init(&preview->output_buffer.access, NULL);
+    preview->input_buffer.mutex_inited=1;
+    preview->output_buffer.mutex_inited=1;
+
+    memset(&preview->ocb_funcs, 0x00, sizeof(preview->ocb_funcs));
+    preview->ocb_funcs.nfuncs=_IOFUNC_NFUNCS;
+    preview->ocb_funcs.ocb_calloc=_uvc_preview_ocb_calloc;
+    preview->ocb_funcs.ocb_free=_uvc_preview_ocb_free;
+    memset(&preview->io_mount, 0x00, sizeof(preview->io_mount));
+    preview->io_mount.funcs=&preview->ocb_funcs;
+
+    memset(&preview->rattr, 0, sizeof(preview->rattr));
+    iofunc_func_init(_RESMGR_CONNECT_NFUNCS, &preview->connect_funcs,
+                     _RESMGR_IO_NFUNCS, &preview->io_funcs);
+    iofunc_attr_init(&preview->hdr, S_IFCHR | S_IRUSR | S_IWUSR | S_IRGRP |
+        S_IWGRP | S_IROTH | S_IWOTH, NULL, NULL);
+
+    preview->hdr.rdev=rsrcdbmgr_devno_attach("video", -1, 0);
+    if (preview->hdr.rdev==-1)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] rsrcdbmgr_devno_attach() failed: %s", strerror(errno));
+        return -1;
+    }
+
+    preview->connect_funcs.open=uvc_open_preview;
+    preview->io_funcs.devctl=uvc_devctl_preview;
+    preview->io_funcs.notify=uvc_notify_preview;
+    preview->io_funcs.mmap=uvc_mmap_preview;
+    preview->io_funcs.close_ocb=uvc_close_preview;
+
+    preview->hdr.mount=&preview->io_mount;
+
+    snprintf(name, PATH_MAX, "/dev/video%d", minor(preview->hdr.rdev));
+
+    preview->resmgr_id=resmgr_attach(dispatch,
+        &preview->rattr, name, _FTYPE_ANY, 0, &preview->connect_funcs,
+        &preview->io_funcs, (RESMGR_HANDLE_T*)&preview->hdr);
+    if (preview->resmgr_id==-1)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] resmgr_attach() failed: %s", strerror(errno));
+        rsrcdbmgr_devno_detach(preview->hdr.rdev, 0);
+        return -1;
+    }
+
+    resmgr_devino(preview->resmgr_id, &preview->io_mount.dev, &preview->hdr.inode);
+
+    return 0;
+}
+
+int uvc_unregister_preview(uvc_device_t* dev, int mapid)
+{
+    struct _uvc_preview_device* preview;
+    int status;
+    int it;
+
+    for (it=0; it<dev->total_vs_devices; it++)
+    {
+        preview=dev->preview[it];
+        if (preview==NULL)
+        {
+            continue;
+        }
+        if ((preview->resmgr_id!=-1) && (preview->resmgr_id!=0))
+        {
+            status=rsrcdbmgr_devno_detach(preview->hdr.rdev, 0);
+            if (status)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] rsrcdbmgr_devno_detach() failed: %s", strerror(errno));
+                /* fall through */
+            }
+
+            status=resmgr_detach(dispatch, preview->resmgr_id,
+                _RESMGR_DETACH_ALL | _RESMGR_DETACH_CLOSE);
+            if (status)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] resmgr_detach() failed: %s", strerror(errno));
+                /* fall through */
+            }
+        }
+
+        uvc_preview_release(dev, preview);
+        pthread_mutex_destroy(&preview->input_buffer.access);
+        pthread_mutex_destroy(&preview->output_buffer.access);
+        uvc_jpeg_destroy(preview->jpeg);
+        free(preview->line);
+        free(dev->preview[it]);
+        dev->preview[it]=NULL;
+    }
+
+    return 0;
+}
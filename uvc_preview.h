@@ -0,0 +1,77 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#ifndef __UVC_PREVIEW_H__
+#define __UVC_PREVIEW_H__
+
+#include <stdint.h>
+
+#include "uvc.h"
+#include "uvc_rm.h"
+#include "uvc_devctl.h"
+
+extern dispatch_t* dispatch;
+
+/* Default reduction of the preview frame relative to the source frame */
+#define UVC_PREVIEW_DEFAULT_SCALE 4
+
+/* Secondary video node of the stream, it serves YUY2 frames of reduced size */
+/* produced from the source frames of the main stream, USB transfer is owned */
+/* by the main video node.                                                   */
+typedef struct _uvc_preview_device
+{
+    iofunc_attr_t             hdr;
+    int                       resmgr_id;
+    resmgr_io_funcs_t         io_funcs;
+    resmgr_connect_funcs_t    connect_funcs;
+    iofunc_funcs_t            ocb_funcs;
+    iofunc_mount_t            io_mount;
+    resmgr_attr_t             rattr;
+
+    /* Negotiated format, size is fixed when buffers are allocated */
+    int                       scale;       /* Source frame is reduced by 2, 4 or 8 times */
+    int                       width;
+    int                       height;
+    int                       stride;
+    int                       decimation;  /* Main stream frames per preview frame       */
+    int                       decimation_count;
+
+    /* Buffers and streaming state of the preview node */
+    int                       transfer;
+    uint32_t                  sequence;
+    uvc_ocb_t*                reqbufs_ocb;
+    int                       buffer_count;
+    unsigned int              buffer_size;
+    int                       buffer_fd;
+    void*                     buffer_ptr;
+    uvc_buffer_t              input_buffer;
+    uvc_buffer_t              output_buffer;
+
+    /* Reduced size IDCT decoder for MJPEG source, line buffer for box filter */
+    struct _uvc_jpeg_context* jpeg;
+    uint8_t*                  line;
+    unsigned int              line_size;
+} uvc_preview_device_t;
+
+int uvc_register_preview(uvc_device_t* dev, int mapid);
+int uvc_unregister_preview(uvc_device_t* dev, int mapid);
+void uvc_preview_frame(uvc_device_t* dev, int subdev, uint8_t* src, unsigned int size);
+
+#endif /* __UVC_PREVIEW_H__ */
@@ -37,6 +37,8 @@
 #include "uvc_rm.h"
 #include "uvc_driver.h"
 #include "uvc_devctl.h"
+#include "uvc_emulation.h"
+#include "uvc_streaming.h"
 
 extern uvc_device_mapping_t devmap[MAX_UVC_DEVICES];
 extern int uvc_verbose;
@@ -121,6 +123,9 @@ int uvc_close(resmgr_context_t* ctp, void* reserved, uvc_ocb_t* ocb)
         slogf(_SLOGC_USB_GEN, _SLOG_INFO, "close(): ocb=%08X", (uint32_t)ocb);
     }
 
+    /* Drop pending control writes of this file descriptor */
+    uvc_cancel_control_jobs(dev, ocb);
+
     for (it=0; it<dev->total_vs_devices; it++)
     {
         if (dev->map->devid[it]==minor(ocb->hdr.attr->hdr->rdev))
@@ -150,8 +155,9 @@ int uvc_close(resmgr_context_t* ctp, void* reserved, uvc_ocb_t* ocb)
             struct _uvc_buffer_entry* entry;
             struct _uvc_buffer_entry* tentry;
 
-            /* Stop the current transfer */
+            /* Stop the current transfer, buffers are not filled after that */
             dev->current_transfer[subdev]=0;
+            uvc_drain_frame_worker(dev, subdev);
             dev->buffer_mode_mmap[subdev]=0;
 
             dev->current_reqbufs_ocb[subdev]=NULL;
@@ -160,6 +166,11 @@ int uvc_close(resmgr_context_t* ctp, void* reserved, uvc_ocb_t* ocb)
             sprintf(fdname, "/devu-uvc-%d-%d-%d", minor(ocb->hdr.attr->hdr->rdev), dev->map->usb_path, dev->map->usb_devno);
 
             /* Free any previously allocated buffers */
+            if (dev->buffer_ptr[subdev]!=NULL)
+            {
+                munmap(dev->buffer_ptr[subdev], dev->current_buffer_size[subdev]*dev->current_buffer_count[subdev]);
+                dev->buffer_ptr[subdev]=NULL;
+            }
             dev->current_buffer_count[subdev]=0;
             if (dev->current_buffer_fds[subdev]!=-1)
             {
@@ -341,7 +352,7 @@ int uvc_mmap(resmgr_context_t *ctp, io_mmap_t *msg, uvc_ocb_t* ocb)
         return ENOMEM;
     }
 
-    size=dev->current_stride[subdev]*dev->current_height[subdev];
+    size=uvc_emulation_image_size(dev, subdev);
     chunksize=sysconf(_SC_PAGE_SIZE);
     /* Adjust buffer size to system page size */
     size=(size+chunksize-1) & ~(chunksize-1);
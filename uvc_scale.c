@@ -0,0 +1,235 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#include "uvc_scale.h"
+
+/* Box filter downscaler for uncompressed frames. Frame is reduced by 2, 4 or */
+/* 8 times: source lines are averaged vertically to the line buffer first,    */
+/* then line is halved horizontally in place one to three times.              */
+
+/* Returns reduced frame dimension, it is always even to keep 4:2:x chroma */
+int uvc_scale_size(int size, int scale)
+{
+    while (scale>1)
+    {
+        size=(size/4)*2;
+        scale/=2;
+    }
+
+    return size;
+}
+
+/* Averages 1, 2, 4 or 8 source lines to the destination line */
+void uvc_scale_rows(uint8_t* src, int stride, int rows, uint8_t* dst, int length)
+{
+    uint8_t* r0=src;
+    uint8_t* r1=src+stride;
+    uint8_t* r2=src+stride*2;
+    uint8_t* r3=src+stride*3;
+    int it=0;
+
+    switch (rows)
+    {
+        case 2:
+#if defined(__SSE2__)
+             for (; it+16<=length; it+=16)
+             {
+                 _mm_storeu_si128((__m128i*)(dst+it), _mm_avg_epu8(_mm_loadu_si128((__m128i*)(r0+it)),
+                     _mm_loadu_si128((__m128i*)(r1+it))));
+             }
+#endif /* __SSE2__ */
+             for (; it<length; it++)
+             {
+                 dst[it]=(r0[it]+r1[it]+1)>>1;
+             }
+             break;
+        case 4:
+#if defined(__SSE2__)
+             for (; it+16<=length; it+=16)
+             {
+                 __m128i a=_mm_avg_epu8(_mm_loadu_si128((__m128i*)(r0+it)), _mm_loadu_si128((__m128i*)(r1+it)));
+                 __m128i b=_mm_avg_epu8(_mm_loadu_si128((__m128i*)(r2+it)), _mm_loadu_si128((__m128i*)(r3+it)));
+
+                 _mm_storeu_si128((__m128i*)(dst+it), _mm_avg_epu8(a, b));
+             }
+#endif /* __SSE2__ */
+             for (; it<length; it++)
+             {
+                 dst[it]=(((r0[it]+r1[it]+1)>>1)+((r2[it]+r3[it]+1)>>1)+1)>>1;
+             }
+             break;
+        case 8:
+             {
+                 uint8_t* r4=src+stride*4;
+                 uint8_t* r5=src+stride*5;
+                 uint8_t* r6=src+stride*6;
+                 uint8_t* r7=src+stride*7;
+                 int a, b;
+
+#if defined(__SSE2__)
+                 for (; it+16<=length; it+=16)
+                 {
+                     __m128i x=_mm_avg_epu8(_mm_avg_epu8(_mm_loadu_si128((__m128i*)(r0+it)), _mm_loadu_si128((__m128i*)(r1+it))),
+                         _mm_avg_epu8(_mm_loadu_si128((__m128i*)(r2+it)), _mm_loadu_si128((__m128i*)(r3+it))));
+                     __m128i y=_mm_avg_epu8(_mm_avg_epu8(_mm_loadu_si128((__m128i*)(r4+it)), _mm_loadu_si128((__m128i*)(r5+it))),
+                         _mm_avg_epu8(_mm_loadu_si128((__m128i*)(r6+it)), _mm_loadu_si128((__m128i*)(r7+it))));
+
+                     _mm_storeu_si128((__m128i*)(dst+it), _mm_avg_epu8(x, y));
+                 }
+#endif /* __SSE2__ */
+                 for (; it<length; it++)
+                 {
+                     a=(((r0[it]+r1[it]+1)>>1)+((r2[it]+r3[it]+1)>>1)+1)>>1;
+                     b=(((r4[it]+r5[it]+1)>>1)+((r6[it]+r7[it]+1)>>1)+1)>>1;
+                     dst[it]=(a+b+1)>>1;
+                 }
+             }
+             break;
+        default:
+             memcpy(dst, r0, length);
+             break;
+    }
+}
+
+/* Halves YUY2 line in place, returns amount of pixels left */
+int uvc_scale_yuy2_half(uint8_t* line, int pixels)
+{
+    uint8_t* src=line;
+    uint8_t* dst=line;
+    int it=0;
+
+#if defined(__SSE2__)
+    {
+        const __m128i mask=_mm_set1_epi16(0x00FF);
+        const __m128i ones=_mm_set1_epi16(1);
+        __m128i x, y, c, uv;
+
+        /* 8 source pixels to 4 destination pixels */
+        for (; it+8<=pixels; it+=8)
+        {
+            x=_mm_loadu_si128((__m128i*)src);
+            y=_mm_and_si128(x, mask);
+            c=_mm_srli_epi16(x, 8);
+
+            /* Y0+Y1, Y2+Y3, ... as 16 bit values */
+            y=_mm_madd_epi16(y, ones);
+            y=_mm_packs_epi32(y, y);
+            /* U0+U1, V0+V1, ... as 16 bit values */
+            uv=_mm_add_epi16(_mm_shuffle_epi32(c, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 1, 3, 1)));
+
+            x=_mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi16(y, uv), ones), 1);
+            _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(x, x));
+
+            src+=16;
+            dst+=8;
+        }
+    }
+#endif /* __SSE2__ */
+
+    /* 4 source pixels to 2 destination pixels */
+    for (; it+4<=pixels; it+=4)
+    {
+        dst[0]=(src[0]+src[2]+1)>>1;
+        dst[1]=(src[1]+src[5]+1)>>1;
+        dst[2]=(src[4]+src[6]+1)>>1;
+        dst[3]=(src[3]+src[7]+1)>>1;
+        src+=8;
+        dst+=4;
+    }
+
+    return (pixels/4)*2;
+}
+
+/* Halves line of 8 bit samples (luma plane) in place, returns amount of samples left */
+int uvc_scale_y_half(uint8_t* line, int samples)
+{
+    uint8_t* src=line;
+    uint8_t* dst=line;
+    int it=0;
+
+#if defined(__SSE2__)
+    {
+        const __m128i mask=_mm_set1_epi16(0x00FF);
+        __m128i x;
+
+        for (; it+16<=samples; it+=16)
+        {
+            x=_mm_loadu_si128((__m128i*)src);
+            x=_mm_avg_epu16(_mm_and_si128(x, mask), _mm_srli_epi16(x, 8));
+            _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(x, x));
+
+            src+=16;
+            dst+=8;
+        }
+    }
+#endif /* __SSE2__ */
+
+    for (; it+2<=samples; it+=2)
+    {
+        dst[0]=(src[0]+src[1]+1)>>1;
+        src+=2;
+        dst+=1;
+    }
+
+    return samples/2;
+}
+
+/* Halves line of interleaved chroma pairs (NV12 plane) in place, returns amount of pairs left */
+int uvc_scale_uv_half(uint8_t* line, int pairs)
+{
+    uint8_t* src=line;
+    uint8_t* dst=line;
+    int it=0;
+
+#if defined(__SSE2__)
+    {
+        __m128i x, a, b;
+
+        for (; it+8<=pairs; it+=8)
+        {
+            x=_mm_loadu_si128((__m128i*)src);
+            a=_mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 0, 2, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+            b=_mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 1, 3, 1)), _MM_SHUFFLE(3, 1, 3, 1));
+            x=_mm_shuffle_epi32(_mm_avg_epu8(a, b), _MM_SHUFFLE(2, 0, 2, 0));
+            _mm_storel_epi64((__m128i*)dst, x);
+
+            src+=16;
+            dst+=8;
+        }
+    }
+#endif /* __SSE2__ */
+
+    for (; it+2<=pairs; it+=2)
+    {
+        dst[0]=(src[0]+src[2]+1)>>1;
+        dst[1]=(src[1]+src[3]+1)>>1;
+        src+=4;
+        dst+=2;
+    }
+
+    return pairs/2;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#ifndef __UVC_SCALE_H__
+#define __UVC_SCALE_H__
+
+#include <stdint.h>
+
+int uvc_scale_size(int size, int scale);
+
+void uvc_scale_rows(uint8_t* src, int stride, int rows, uint8_t* dst, int length);
+int uvc_scale_yuy2_half(uint8_t* line, int pixels);
+int uvc_scale_y_half(uint8_t* line, int samples);
+int uvc_scale_uv_half(uint8_t* line, int pairs);
+
+#endif /* __UVC_SCALE_H__ */
@@ -0,0 +1,453 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#include <linux/videodev2.h>
+
+#include "uvc.h"
+#include "uvc_stats.h"
+
+/* Statistics are gathered row by row right after payload is copied to the */
+/* frame buffer, while it is still in cache. Row which is not complete yet */
+/* is processed after the next payload. NV12 chroma rows follow luma rows. */
+/* Statistics of completed frame wait for the frame worker, which passes   */
+/* them to the buffer where the frame is delivered.                        */
+struct _uvc_stats
+{
+    /* Protects new configuration and format, written by devctl threads, */
+    /* and statistics passed from the frame assembly to the applications */
+    pthread_mutex_t access;
+
+    /* Configuration and frame format, new ones are applied between frames */
+    uvc_stats_config_t config;
+    uvc_stats_config_t next_config;
+    int format;              /* UVC_FORMAT_NONE if frames are not supported */
+    int width;
+    int height;
+    int next_format;
+    int next_width;
+    int next_height;
+    int changed;
+    int column_start[UVC_STATS_MAX_GRID+1];
+    unsigned int row_size;
+    int total_rows;
+
+    /* Accumulators of the frame being assembled */
+    unsigned int position;
+    int row;
+    uint32_t histogram[4][256];      /* Interleaved samples go to own table */
+    uint32_t sum_y[UVC_STATS_MAX_TILES];
+    uint32_t sum_u[UVC_STATS_MAX_TILES];
+    uint32_t sum_v[UVC_STATS_MAX_TILES];
+    uint32_t count_y[UVC_STATS_MAX_TILES];
+    uint32_t count_c[UVC_STATS_MAX_TILES];
+
+    /* Statistics of completed frame, which is not delivered yet */
+    int pending_valid;
+    uvc_frame_stats_t pending;
+
+    /* Results of the last frames, by buffer index */
+    int valid[VIDEO_MAX_FRAME];
+    uvc_frame_stats_t result[VIDEO_MAX_FRAME];
+};
+
+uvc_stats_t* uvc_stats_create(void)
+{
+    uvc_stats_t* stats;
+
+    stats=calloc(1, sizeof(*stats));
+    if (stats==NULL)
+    {
+        return NULL;
+    }
+    stats->format=UVC_FORMAT_NONE;
+    stats->next_format=UVC_FORMAT_NONE;
+    pthread_mutex_init(&stats->access, NULL);
+
+    return stats;
+}
+
+void uvc_stats_destroy(uvc_stats_t* stats)
+{
+    if (stats!=NULL)
+    {
+        pthread_mutex_destroy(&stats->access);
+        free(stats);
+    }
+}
+
+/* Sum of bytes selected by the 32 bit mask, which is repeated over the data */
+static uint32_t uvc_stats_sum(uint8_t* src, int length, uint32_t mask)
+{
+    uint32_t sum=0;
+    int it=0;
+
+#if defined(__SSE2__)
+    {
+        const __m128i vmask=_mm_set1_epi32(mask);
+        const __m128i zero=_mm_setzero_si128();
+        __m128i acc=_mm_setzero_si128();
+
+        for (; it+16<=length; it+=16)
+        {
+            acc=_mm_add_epi64(acc, _mm_sad_epu8(_mm_and_si128(_mm_loadu_si128((__m128i*)(src+it)), vmask), zero));
+        }
+        sum=_mm_cvtsi128_si32(acc)+_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+    }
+#endif /* __SSE2__ */
+    for (; it<length; it++)
+    {
+        sum+=src[it] & ((mask>>((it & 3)*8)) & 0xFF);
+    }
+
+    return sum;
+}
+
+/* Luma histogram, neighbour samples are counted in separate tables, so */
+/* increments of the same bin don't wait for each other. It is scalar:  */
+/* SSE2 has no scatter, bins are incremented one by one anyway, and     */
+/* loading of 16 luma samples at once (YUY2 packed out of 32 bytes)     */
+/* gave the same speed, since the increments take all the time. SSE2    */
+/* is used for sums of tiles, see uvc_stats_sum().                      */
+static void uvc_stats_histogram(uvc_stats_t* stats, uint8_t* src, int count, int step)
+{
+    uint32_t* h0=stats->histogram[0];
+    uint32_t* h1=stats->histogram[1];
+    uint32_t* h2=stats->histogram[2];
+    uint32_t* h3=stats->histogram[3];
+    int it;
+
+    for (it=0; it+4<=count; it+=4)
+    {
+        h0[src[0]]++;
+        h1[src[step]]++;
+        h2[src[step*2]]++;
+        h3[src[step*3]]++;
+        src+=step*4;
+    }
+    for (; it<count; it++)
+    {
+        h0[src[0]]++;
+        src+=step;
+    }
+}
+
+static void uvc_stats_row(uvc_stats_t* stats, uint8_t* src)
+{
+    int columns=stats->config.columns;
+    int tile;
+    int start;
+    int end;
+    int it;
+
+    switch (stats->format)
+    {
+        case UVC_FORMAT_YUY2:
+             tile=(stats->row*stats->config.rows/stats->height)*columns;
+             uvc_stats_histogram(stats, src, stats->width, 2);
+             for (it=0; it<columns; it++, tile++)
+             {
+                 start=stats->column_start[it];
+                 end=stats->column_start[it+1];
+                 stats->sum_y[tile]+=uvc_stats_sum(src+start*2, (end-start)*2, 0x00FF00FF);
+                 stats->sum_u[tile]+=uvc_stats_sum(src+start*2, (end-start)*2, 0x0000FF00);
+                 stats->sum_v[tile]+=uvc_stats_sum(src+start*2, (end-start)*2, 0xFF000000);
+                 stats->count_y[tile]+=end-start;
+                 stats->count_c[tile]+=(end-start)/2;
+             }
+             break;
+        case UVC_FORMAT_NV12:
+             if (stats->row<stats->height)
+             {
+                 tile=(stats->row*stats->config.rows/stats->height)*columns;
+                 uvc_stats_histogram(stats, src, stats->width, 1);
+                 for (it=0; it<columns; it++, tile++)
+                 {
+                     start=stats->column_start[it];
+                     end=stats->column_start[it+1];
+                     stats->sum_y[tile]+=uvc_stats_sum(src+start, end-start, 0xFFFFFFFF);
+                     stats->count_y[tile]+=end-start;
+                 }
+             }
+             else
+             {
+                 /* Chroma row covers two luma rows */
+                 tile=((stats->row-stats->height)*2*stats->config.rows/stats->height)*columns;
+                 for (it=0; it<columns; it++, tile++)
+                 {
+                     start=stats->column_start[it];
+                     end=stats->column_start[it+1];
+                     stats->sum_u[tile]+=uvc_stats_sum(src+start, end-start, 0x00FF00FF);
+                     stats->sum_v[tile]+=uvc_stats_sum(src+start, end-start, 0xFF00FF00);
+                     stats->count_c[tile]+=(end-start)/2;
+                 }
+             }
+             break;
+    }
+}
+
+/* Applies the new configuration and frame format, caller holds access */
+static void uvc_stats_apply(uvc_stats_t* stats)
+{
+    int it;
+
+    stats->config=stats->next_config;
+    stats->format=stats->next_format;
+    stats->width=stats->next_width;
+    stats->height=stats->next_height;
+    stats->changed=0;
+
+    switch (stats->format)
+    {
+        case UVC_FORMAT_YUY2:
+             stats->row_size=stats->width*2;
+             stats->total_rows=stats->height;
+             break;
+        case UVC_FORMAT_NV12:
+             stats->row_size=stats->width;
+             stats->total_rows=stats->height+stats->height/2;
+             break;
+        default:
+             stats->format=UVC_FORMAT_NONE;
+             break;
+    }
+    if ((stats->width<2) || (stats->height<2) || (!stats->config.enable))
+    {
+        stats->format=UVC_FORMAT_NONE;
+    }
+    if (stats->format==UVC_FORMAT_NONE)
+    {
+        return;
+    }
+
+    /* Tile borders are kept at even pixels, where chroma samples start */
+    for (it=0; it<stats->config.columns; it++)
+    {
+        stats->column_start[it]=(it*stats->width/stats->config.columns) & ~1;
+    }
+    stats->column_start[stats->config.columns]=stats->width & ~1;
+}
+
+/* Prepares accumulators for the next frame */
+static void uvc_stats_clear(uvc_stats_t* stats)
+{
+    stats->position=0;
+    stats->row=0;
+    if (stats->format!=UVC_FORMAT_NONE)
+    {
+        memset(stats->histogram, 0x00, sizeof(stats->histogram));
+        memset(stats->sum_y, 0x00, sizeof(stats->sum_y));
+        memset(stats->sum_u, 0x00, sizeof(stats->sum_u));
+        memset(stats->sum_v, 0x00, sizeof(stats->sum_v));
+        memset(stats->count_y, 0x00, sizeof(stats->count_y));
+        memset(stats->count_c, 0x00, sizeof(stats->count_c));
+    }
+}
+
+/* Checks and keeps new configuration, it is applied at the next frame */
+int uvc_stats_configure(uvc_stats_t* stats, uvc_stats_config_t* config)
+{
+    if (config->enable)
+    {
+        if ((config->columns<1) || (config->columns>UVC_STATS_MAX_GRID) ||
+            (config->rows<1) || (config->rows>UVC_STATS_MAX_GRID) ||
+            (config->clip_low>=config->clip_high) || (config->clip_high>255))
+        {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&stats->access);
+    stats->next_config=*config;
+    stats->changed=1;
+    pthread_mutex_unlock(&stats->access);
+
+    return 0;
+}
+
+/* Format of native frames, statistics are gathered for YUY2 and NV12 only */
+void uvc_stats_format(uvc_stats_t* stats, int format, int width, int height)
+{
+    pthread_mutex_lock(&stats->access);
+    stats->next_format=format;
+    stats->next_width=width;
+    stats->next_height=height;
+    stats->changed=1;
+    pthread_mutex_unlock(&stats->access);
+}
+
+/* Applies new configuration at once and drops results, streaming must be off */
+void uvc_stats_reset(uvc_stats_t* stats)
+{
+    if (stats!=NULL)
+    {
+        pthread_mutex_lock(&stats->access);
+        uvc_stats_apply(stats);
+        uvc_stats_clear(stats);
+        stats->pending_valid=0;
+        memset(stats->valid, 0x00, sizeof(stats->valid));
+        pthread_mutex_unlock(&stats->access);
+    }
+}
+
+/* Drops results of the buffer, which is queued again */
+void uvc_stats_invalidate(uvc_stats_t* stats, int index)
+{
+    if ((stats!=NULL) && (index>=0) && (index<VIDEO_MAX_FRAME))
+    {
+        pthread_mutex_lock(&stats->access);
+        stats->valid[index]=0;
+        pthread_mutex_unlock(&stats->access);
+    }
+}
+
+/* Accounts complete rows of the frame being assembled */
+void uvc_stats_payload(uvc_stats_t* stats, uint8_t* frame, unsigned int length)
+{
+    if (stats->format==UVC_FORMAT_NONE)
+    {
+        return;
+    }
+
+    while ((stats->row<stats->total_rows) && (stats->position+stats->row_size<=length))
+    {
+        uvc_stats_row(stats, frame+stats->position);
+        stats->position+=stats->row_size;
+        stats->row++;
+    }
+}
+
+/* Finishes statistics of the assembled frame and starts the next frame. */
+/* They are kept until uvc_stats_deliver() is called for this frame.     */
+void uvc_stats_complete(uvc_stats_t* stats, uint8_t* frame, unsigned int length, int error)
+{
+    uvc_frame_stats_t* result=&stats->pending;
+    uint32_t count;
+    int it;
+
+    uvc_stats_payload(stats, frame, length);
+
+    pthread_mutex_lock(&stats->access);
+    stats->pending_valid=0;
+    if ((stats->format!=UVC_FORMAT_NONE) && (!error) && (!stats->changed) && (stats->row==stats->total_rows))
+    {
+        memset(result, 0x00, sizeof(*result));
+        result->width=stats->width;
+        result->height=stats->height;
+        result->columns=stats->config.columns;
+        result->rows=stats->config.rows;
+        for (it=0; it<256; it++)
+        {
+            result->histogram[it]=stats->histogram[0][it]+stats->histogram[1][it]+
+                                  stats->histogram[2][it]+stats->histogram[3][it];
+            if (it<=stats->config.clip_low)
+            {
+                result->clipped_low+=result->histogram[it];
+            }
+            if (it>=stats->config.clip_high)
+            {
+                result->clipped_high+=result->histogram[it];
+            }
+        }
+        for (it=0; it<stats->config.columns*stats->config.rows; it++)
+        {
+            count=stats->count_y[it];
+            if (count!=0)
+            {
+                result->mean_y[it]=(stats->sum_y[it]+count/2)/count;
+            }
+            count=stats->count_c[it];
+            if (count!=0)
+            {
+                result->mean_u[it]=(stats->sum_u[it]+count/2)/count;
+                result->mean_v[it]=(stats->sum_v[it]+count/2)/count;
+            }
+        }
+        stats->pending_valid=1;
+    }
+
+    if (stats->changed)
+    {
+        uvc_stats_apply(stats);
+    }
+    pthread_mutex_unlock(&stats->access);
+    uvc_stats_clear(stats);
+}
+
+/* Starts the next frame, statistics of the dropped frame are not kept */
+void uvc_stats_drop(uvc_stats_t* stats)
+{
+    pthread_mutex_lock(&stats->access);
+    if (stats->changed)
+    {
+        uvc_stats_apply(stats);
+    }
+    pthread_mutex_unlock(&stats->access);
+    uvc_stats_clear(stats);
+}
+
+/* Passes statistics of the completed frame to the buffer with given index, */
+/* they are dropped if index is -1 or frame is not delivered correctly.    */
+void uvc_stats_deliver(uvc_stats_t* stats, int index, uint32_t sequence, int error)
+{
+    pthread_mutex_lock(&stats->access);
+    if ((index>=0) && (index<VIDEO_MAX_FRAME))
+    {
+        stats->valid[index]=0;
+        if ((stats->pending_valid) && (!error))
+        {
+            stats->result[index]=stats->pending;
+            stats->result[index].index=index;
+            stats->result[index].sequence=sequence;
+            stats->valid[index]=1;
+        }
+    }
+    stats->pending_valid=0;
+    pthread_mutex_unlock(&stats->access);
+}
+
+/* Returns statistics of the frame in buffer result->index */
+int uvc_stats_get(uvc_stats_t* stats, uvc_frame_stats_t* result)
+{
+    int ret=-1;
+
+    if (result->index>=VIDEO_MAX_FRAME)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&stats->access);
+    if (stats->valid[result->index])
+    {
+        *result=stats->result[result->index];
+        ret=0;
+    }
+    pthread_mutex_unlock(&stats->access);
+
+    return ret;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2013-2014 Mike Gorchak
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"). You
+ * may not reproduce, modify or distribute this software except in
+ * compliance with the License. You may obtain a copy of the License
+ * at: http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTIES OF ANY KIND, either express or implied,
+ *
+ * This file may contain contributions from others, either as
+ * contributors under the License or as licensors under other terms.
+ * Please review this entire file for other proprietary rights or license
+ * notices, as well as the QNX Development Suite License Guide at
+ * http://licensing.qnx.com/license-guide/ for other information.
+ * $
+ */
+
+#ifndef __UVC_STATS_H__
+#define __UVC_STATS_H__
+
+#include <stdint.h>
+
+#include "uvc.h"
+
+/* Per-stream statistics of uncompressed frames, gathered during assembly */
+typedef struct _uvc_stats uvc_stats_t;
+
+uvc_stats_t* uvc_stats_create(void);
+void uvc_stats_destroy(uvc_stats_t* stats);
+
+int uvc_stats_configure(uvc_stats_t* stats, uvc_stats_config_t* config);
+void uvc_stats_format(uvc_stats_t* stats, int format, int width, int height);
+void uvc_stats_reset(uvc_stats_t* stats);
+void uvc_stats_invalidate(uvc_stats_t* stats, int index);
+
+void uvc_stats_payload(uvc_stats_t* stats, uint8_t* frame, unsigned int length);
+void uvc_stats_complete(uvc_stats_t* stats, uint8_t* frame, unsigned int length, int error);
+void uvc_stats_drop(uvc_stats_t* stats);
+void uvc_stats_deliver(uvc_stats_t* stats, int index, uint32_t sequence, int error);
+int uvc_stats_get(uvc_stats_t* stats, uvc_frame_stats_t* result);
+
+#endif /* __UVC_STATS_H__ */
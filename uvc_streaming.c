@@ -18,18 +18,26 @@
  * $
  */
 
+#include <time.h>
 #include <stdio.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/slog.h>
 #include <sys/usbdi.h>
 #include <sys/slogcodes.h>
+#include <linux/videodev2.h>
 
 #include "uuid.h"
 
 #include "uvc.h"
 #include "usbvc.h"
+#include "uvc_devctl.h"
 #include "uvc_control.h"
+#include "uvc_emulation.h"
+#include "uvc_stats.h"
+#include "uvc_motion.h"
+#include "uvc_preview.h"
 
 extern int uvc_verbose;
 extern int uvc_emulation;
@@ -1203,21 +1211,15 @@ int uvc_probe_commit_get(uvc_device_t* dev, int subdev, int operation, int iface
     struct usbd_urb* urb;
     uint8_t* buffer;
     int status;
+    int slot;
 
-    urb=usbd_alloc_urb(NULL);
-    if (urb==NULL)
+    slot=uvc_control_acquire(dev, size);
+    if (slot<0)
     {
-        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate urb");
-        return -1;
-    }
-
-    buffer=usbd_alloc(size);
-    if (buffer==NULL)
-    {
-        usbd_free_urb(urb);
-        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate buffer");
         return -1;
     }
+    urb=dev->control_urb[slot];
+    buffer=dev->control_buffer[slot];
 
     if (uvc_verbose>3)
     {
@@ -1264,11 +1266,10 @@ int uvc_probe_commit_get(uvc_device_t* dev, int subdev, int operation, int iface
 
     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "%02X %02X %02X %02X %02X %02X %02X %02X", UVC_REQUEST_GET_VC, operation, (selector<<8) & 0xFF, ((selector<<8)>>8) & 0xFF, iface, 0x00, size, 0x00);
     usbd_setup_vendor(urb, URB_DIR_IN, operation, UVC_REQUEST_GET_VC, selector<<8, iface, buffer, size);
-    status=usbd_io(urb, dev->vc_control_pipe, NULL, dev, USBD_TIME_INFINITY);
+    status=uvc_control_io(dev, urb, UVC_CONTROL_STREAMING_TIMEOUT);
     if (status!=EOK)
     {
-        usbd_free_urb(urb);
-        usbd_free(buffer);
+        uvc_control_release(dev, slot);
         slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't perform usb i/o operation");
         return -1;
     }
@@ -1341,8 +1342,7 @@ int uvc_probe_commit_get(uvc_device_t* dev, int subdev, int operation, int iface
                                 ((uint64_t)buffer[41]<<8) | buffer[40];
     }
 
-    usbd_free_urb(urb);
-    usbd_free(buffer);
+    uvc_control_release(dev, slot);
 
     return 0;
 }
@@ -1353,21 +1353,15 @@ int uvc_probe_commit_set(uvc_device_t* dev, int subdev, int operation, int iface
     struct usbd_urb* urb;
     uint8_t* buffer;
     int status;
+    int slot;
 
-    urb=usbd_alloc_urb(NULL);
-    if (urb==NULL)
-    {
-        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate urb");
-        return -1;
-    }
-
-    buffer=usbd_alloc(size);
-    if (buffer==NULL)
+    slot=uvc_control_acquire(dev, size);
+    if (slot<0)
     {
-        usbd_free_urb(urb);
-        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't allocate buffer");
         return -1;
     }
+    urb=dev->control_urb[slot];
+    buffer=dev->control_buffer[slot];
 
     /* Copy to USB buffer, handling USB endianess, UVC 1.0 */
     buffer[0]=ctrl->bmHint & 0x000000FF;
@@ -1467,21 +1461,396 @@ int uvc_probe_commit_set(uvc_device_t* dev, int subdev, int operation, int iface
 
     slogf(_SLOGC_USB_GEN, _SLOG_INFO, "%02X %02X %02X %02X %02X %02X %02X %02X", UVC_REQUEST_SET_VC, operation, (selector<<8) & 0xFF, ((selector<<8)>>8) & 0xFF, iface, 0x00, size, 0x00);
     usbd_setup_vendor(urb, URB_DIR_OUT, operation, UVC_REQUEST_SET_VC, selector<<8, iface, buffer, size);
-    status=usbd_io(urb, dev->vc_control_pipe, NULL, dev, USBD_TIME_INFINITY);
+    status=uvc_control_io(dev, urb, UVC_CONTROL_STREAMING_TIMEOUT);
     if (status!=EOK)
     {
-        usbd_free_urb(urb);
-        usbd_free(buffer);
+        uvc_control_release(dev, slot);
         slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't perform usb i/o operation");
         return -1;
     }
 
-    usbd_free_urb(urb);
-    usbd_free(buffer);
+    uvc_control_release(dev, slot);
 
     return 0;
 }
 
+/* States of frame handed over to the frame worker */
+#define UVC_FRAME_WORK_NONE   0
+#define UVC_FRAME_WORK_QUEUED 1
+#define UVC_FRAME_WORK_BUSY   2
+
+/* Moves completed frame into the first queued buffer and passes it to the output queue */
+static void uvc_frame_deliver(uvc_device_t* dev, int subdev, uint8_t* frame, unsigned int length, int error,
+                              uint32_t sequence, uint32_t frame_job_id, struct timespec* ts)
+{
+    uvc_buffer_entry_t* entry=NULL;
+    int bytesused;
+
+    /* Motion detection and preview see every frame which reaches the */
+    /* worker, even if there is no queued buffer for it.              */
+    if (!error)
+    {
+        uvc_motion_frame(dev, subdev, frame, length, sequence);
+        uvc_preview_frame(dev, subdev, frame, length);
+    }
+
+    if (dev->input_buffer[subdev].mutex_inited)
+    {
+        pthread_mutex_lock(&dev->input_buffer[subdev].access);
+    }
+    if (!TAILQ_EMPTY(&dev->input_buffer[subdev].head))
+    {
+        entry=TAILQ_FIRST(&dev->input_buffer[subdev].head);
+        TAILQ_REMOVE(&dev->input_buffer[subdev].head, entry, link);
+    }
+    if (dev->input_buffer[subdev].mutex_inited)
+    {
+        pthread_mutex_unlock(&dev->input_buffer[subdev].access);
+    }
+
+    /* No free buffers, application is too slow, drop this frame */
+    if (entry==NULL)
+    {
+        if (uvc_verbose>3)
+        {
+            slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] No queued buffers, frame %d is dropped", sequence);
+        }
+        if (dev->stats[subdev]!=NULL)
+        {
+            uvc_stats_deliver(dev->stats[subdev], -1, 0, 1);
+        }
+        return;
+    }
+
+    bytesused=-1;
+    if ((!error) && (dev->buffer_ptr[subdev]!=NULL))
+    {
+        bytesused=uvc_emulation_convert(dev, subdev, frame, length,
+            (uint8_t*)dev->buffer_ptr[subdev]+entry->buffer.index*dev->current_buffer_size[subdev],
+            dev->current_buffer_size[subdev]);
+    }
+    if (bytesused<0)
+    {
+        entry->buffer.bytesused=0;
+        entry->buffer.flags|=V4L2_BUF_FLAG_ERROR;
+    }
+    else
+    {
+        entry->buffer.bytesused=bytesused;
+        entry->buffer.flags&=~(V4L2_BUF_FLAG_ERROR);
+    }
+
+    entry->buffer.timestamp.tv_sec=ts->tv_sec;
+    entry->buffer.timestamp.tv_usec=ts->tv_nsec/1000;
+    if (dev->stats[subdev]!=NULL)
+    {
+        uvc_stats_deliver(dev->stats[subdev], entry->buffer.index, sequence, (bytesused<0));
+    }
+    entry->buffer.sequence=sequence;
+    entry->buffer.reserved2=frame_job_id;
+    entry->buffer.field=V4L2_FIELD_NONE;
+    entry->buffer.flags&=~(V4L2_BUF_FLAG_QUEUED);
+    entry->buffer.flags|=V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+
+    if (dev->output_buffer[subdev].mutex_inited)
+    {
+        pthread_mutex_lock(&dev->output_buffer[subdev].access);
+    }
+    TAILQ_INSERT_TAIL(&dev->output_buffer[subdev].head, entry, link);
+    if (dev->output_buffer[subdev].mutex_inited)
+    {
+        pthread_mutex_unlock(&dev->output_buffer[subdev].access);
+    }
+
+    if (dev->current_reqbufs_ocb[subdev]!=NULL)
+    {
+        iofunc_notify_trigger(dev->current_reqbufs_ocb[subdev]->notify, 1, IOFUNC_NOTIFY_INPUT);
+    }
+}
+
+/* Hands assembled frame over to the frame worker, so it is converted out of */
+/* USB completion callback, and starts the next frame in the spare buffer.   */
+/* Frame is dropped if worker is still busy with previous frame of stream.   */
+static void uvc_frame_complete(uvc_device_t* dev, int subdev)
+{
+    struct timespec ts;
+    uint32_t frame_job_id;
+    uint8_t* buffer;
+
+    /* Per-frame control requests of the next frame are written from now on */
+    frame_job_id=uvc_frame_control_jobs(dev, subdev, dev->frame_sequence[subdev]);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    if (dev->frame_worker_state!=UVC_WORKER_RUNNING)
+    {
+        /* There is no worker, frame is converted right here */
+        if (dev->stats[subdev]!=NULL)
+        {
+            uvc_stats_complete(dev->stats[subdev], dev->frame_buffer[subdev], dev->frame_length[subdev], dev->frame_error[subdev]);
+        }
+        uvc_frame_deliver(dev, subdev, dev->frame_buffer[subdev], dev->frame_length[subdev],
+            dev->frame_error[subdev], dev->frame_sequence[subdev], frame_job_id, &ts);
+    }
+    else
+    {
+        pthread_mutex_lock(&dev->frame_work_access);
+        if ((dev->frame_work_state[subdev]==UVC_FRAME_WORK_NONE) && (dev->current_transfer[subdev]))
+        {
+            /* Remaining rows are accounted, statistics wait for the worker */
+            if (dev->stats[subdev]!=NULL)
+            {
+                uvc_stats_complete(dev->stats[subdev], dev->frame_buffer[subdev], dev->frame_length[subdev], dev->frame_error[subdev]);
+            }
+            buffer=dev->frame_work_buffer[subdev];
+            dev->frame_work_buffer[subdev]=dev->frame_buffer[subdev];
+            dev->frame_buffer[subdev]=buffer;
+            dev->frame_work_length[subdev]=dev->frame_length[subdev];
+            dev->frame_work_error[subdev]=dev->frame_error[subdev];
+            dev->frame_work_sequence[subdev]=dev->frame_sequence[subdev];
+            dev->frame_work_job_id[subdev]=frame_job_id;
+            dev->frame_work_time[subdev]=ts;
+            dev->frame_work_state[subdev]=UVC_FRAME_WORK_QUEUED;
+            pthread_cond_signal(&dev->frame_work_ready);
+        }
+        else
+        {
+            if (uvc_verbose>3)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_INFO, "[devu-uvc] Frame worker is busy, frame %d is dropped", dev->frame_sequence[subdev]);
+            }
+            if (dev->stats[subdev]!=NULL)
+            {
+                uvc_stats_drop(dev->stats[subdev]);
+            }
+        }
+        pthread_mutex_unlock(&dev->frame_work_access);
+    }
+
+    dev->frame_sequence[subdev]++;
+    dev->frame_length[subdev]=0;
+    dev->frame_error[subdev]=0;
+}
+
+/* Converts frames handed over by uvc_frame_complete(), so decoding, encoding  */
+/* and lossless transformations never delay completion callbacks of USB stack. */
+/* Streams which have frames ready are served in turn.                         */
+static void* uvc_frame_worker(void* arg)
+{
+    uvc_device_t* dev=(uvc_device_t*)arg;
+    int subdev;
+    int next=0;
+    int it;
+
+    pthread_mutex_lock(&dev->frame_work_access);
+    while (dev->frame_worker_state==UVC_WORKER_RUNNING)
+    {
+        subdev=-1;
+        for (it=0; it<UVC_MAX_VS_COUNT; it++)
+        {
+            if (dev->frame_work_state[(next+it)%UVC_MAX_VS_COUNT]==UVC_FRAME_WORK_QUEUED)
+            {
+                subdev=(next+it)%UVC_MAX_VS_COUNT;
+                break;
+            }
+        }
+        if (subdev==-1)
+        {
+            pthread_cond_wait(&dev->frame_work_ready, &dev->frame_work_access);
+            continue;
+        }
+        next=(subdev+1)%UVC_MAX_VS_COUNT;
+
+        /* Assembly buffer is not swapped with the frame, while it is busy */
+        dev->frame_work_state[subdev]=UVC_FRAME_WORK_BUSY;
+        pthread_mutex_unlock(&dev->frame_work_access);
+
+        uvc_frame_deliver(dev, subdev, dev->frame_work_buffer[subdev], dev->frame_work_length[subdev],
+            dev->frame_work_error[subdev], dev->frame_work_sequence[subdev], dev->frame_work_job_id[subdev],
+            &dev->frame_work_time[subdev]);
+
+        pthread_mutex_lock(&dev->frame_work_access);
+        dev->frame_work_state[subdev]=UVC_FRAME_WORK_NONE;
+        pthread_cond_broadcast(&dev->frame_work_done);
+    }
+    pthread_mutex_unlock(&dev->frame_work_access);
+
+    return NULL;
+}
+
+/* Starts frame worker of device, frames are converted by USB completion */
+/* callbacks if it can't be started.                                     */
+int uvc_setup_frame_worker(uvc_device_t* dev)
+{
+    pthread_attr_t attr;
+    int it;
+
+    for (it=0; it<UVC_MAX_VS_COUNT; it++)
+    {
+        dev->frame_work_state[it]=UVC_FRAME_WORK_NONE;
+    }
+    pthread_mutex_init(&dev->frame_work_access, NULL);
+    pthread_cond_init(&dev->frame_work_ready, NULL);
+    pthread_cond_init(&dev->frame_work_done, NULL);
+    dev->frame_worker_state=UVC_WORKER_RUNNING;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    if (pthread_create(&dev->frame_worker, &attr, uvc_frame_worker, dev)!=EOK)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Can't create frame worker thread");
+        pthread_attr_destroy(&attr);
+        pthread_cond_destroy(&dev->frame_work_done);
+        pthread_cond_destroy(&dev->frame_work_ready);
+        pthread_mutex_destroy(&dev->frame_work_access);
+        dev->frame_worker_state=UVC_WORKER_NONE;
+        return -1;
+    }
+    pthread_attr_destroy(&attr);
+
+    return 0;
+}
+
+/* Stops frame worker, isochronous pipes must be aborted already. Frames */
+/* which are not converted yet are dropped.                              */
+void uvc_unsetup_frame_worker(uvc_device_t* dev)
+{
+    int it;
+
+    if (dev->frame_worker_state==UVC_WORKER_NONE)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&dev->frame_work_access);
+    dev->frame_worker_state=UVC_WORKER_STOPPING;
+    pthread_cond_broadcast(&dev->frame_work_ready);
+    pthread_mutex_unlock(&dev->frame_work_access);
+    pthread_join(dev->frame_worker, NULL);
+
+    for (it=0; it<UVC_MAX_VS_COUNT; it++)
+    {
+        dev->frame_work_state[it]=UVC_FRAME_WORK_NONE;
+    }
+    pthread_cond_destroy(&dev->frame_work_done);
+    pthread_cond_destroy(&dev->frame_work_ready);
+    pthread_mutex_destroy(&dev->frame_work_access);
+    dev->frame_worker_state=UVC_WORKER_NONE;
+}
+
+/* Drops frame of stream, which waits for the worker, and waits for its */
+/* frame being converted. Transfer of stream must be stopped already.   */
+void uvc_drain_frame_worker(uvc_device_t* dev, int subdev)
+{
+    if (dev->frame_worker_state==UVC_WORKER_NONE)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&dev->frame_work_access);
+    if (dev->frame_work_state[subdev]==UVC_FRAME_WORK_QUEUED)
+    {
+        dev->frame_work_state[subdev]=UVC_FRAME_WORK_NONE;
+    }
+    while (dev->frame_work_state[subdev]==UVC_FRAME_WORK_BUSY)
+    {
+        pthread_cond_wait(&dev->frame_work_done, &dev->frame_work_access);
+    }
+    pthread_mutex_unlock(&dev->frame_work_access);
+}
+
+/* Parses payload header and appends payload data to the frame being assembled */
+static void uvc_frame_payload(uvc_device_t* dev, int subdev, uint8_t* data, unsigned int length)
+{
+    unsigned int header_length;
+    uint8_t header_info;
+
+    /* Each payload must contain at least header length and header info fields */
+    if (length<2)
+    {
+        return;
+    }
+
+    header_length=data[0];
+    header_info=data[1];
+    if ((header_length<2) || (header_length>length))
+    {
+        dev->frame_error[subdev]=1;
+        return;
+    }
+
+    /* Frame ID toggle or data after EOF bit of previous payload start the new */
+    /* frame, empty payloads which some devices send after EOF are ignored.    */
+    if (((header_info & UVC_PAYLOAD_HEADER_FID)!=dev->frame_fid[subdev]) ||
+        ((dev->frame_eof[subdev]) && (length>header_length)))
+    {
+        /* Frame ID toggle means that previous frame is finished without EOF bit */
+        if (dev->frame_length[subdev]>0)
+        {
+            uvc_frame_complete(dev, subdev);
+        }
+        dev->frame_eof[subdev]=0;
+
+        /* Emulated frame rate, only each n-th source frame is assembled */
+        dev->frame_skip[subdev]=(dev->frame_skip_count[subdev]!=0);
+        dev->frame_skip_count[subdev]++;
+        if (dev->frame_skip_count[subdev]>=dev->current_decimation[subdev])
+        {
+            dev->frame_skip_count[subdev]=0;
+        }
+    }
+    dev->frame_fid[subdev]=header_info & UVC_PAYLOAD_HEADER_FID;
+
+    /* Payloads of dropped frames are not copied at all */
+    if (dev->frame_skip[subdev])
+    {
+        if (header_info & UVC_PAYLOAD_HEADER_EOF)
+        {
+            dev->frame_eof[subdev]=1;
+        }
+        dev->frame_error[subdev]=0;
+        return;
+    }
+
+    if (header_info & UVC_PAYLOAD_HEADER_ERR)
+    {
+        dev->frame_error[subdev]=1;
+    }
+
+    length-=header_length;
+    data+=header_length;
+    if (length>0)
+    {
+        if (dev->frame_length[subdev]+length>dev->frame_buffer_size[subdev])
+        {
+            if (uvc_verbose>1)
+            {
+                slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Frame size exceeds dwMaxVideoFrameSize");
+            }
+            dev->frame_error[subdev]=1;
+        }
+        else
+        {
+            memcpy(dev->frame_buffer[subdev]+dev->frame_length[subdev], data, length);
+            dev->frame_length[subdev]+=length;
+
+            /* Rows of uncompressed frame are accounted while they are in cache */
+            if (dev->stats[subdev]!=NULL)
+            {
+                uvc_stats_payload(dev->stats[subdev], dev->frame_buffer[subdev], dev->frame_length[subdev]);
+            }
+        }
+    }
+
+    if (header_info & UVC_PAYLOAD_HEADER_EOF)
+    {
+        if (dev->frame_length[subdev]>0)
+        {
+            uvc_frame_complete(dev, subdev);
+        }
+        dev->frame_eof[subdev]=1;
+    }
+}
+
 void uvc_isochronous_completion(struct usbd_urb* urb, struct usbd_pipe* pipe, void* handle)
 {
     uvc_device_t* dev=(uvc_device_t*)handle;
@@ -1492,9 +1861,7 @@ void uvc_isochronous_completion(struct usbd_urb* urb, struct usbd_pipe* pipe, vo
     int urb_id=-1;
     int it;
 
-    slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "uvc_isochronous_completion():");
     status=usbd_urb_status(urb, &urb_status, &urb_len);
-    slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "    status=%d, urb_status=%08X, urb_len=%d", status, urb_status, urb_len);
 
     for (it=0; it<dev->total_vs_devices; it++)
     {
@@ -1519,35 +1886,36 @@ void uvc_isochronous_completion(struct usbd_urb* urb, struct usbd_pipe* pipe, vo
             break;
         }
     }
-    slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "    subdev=%d, urb_id=%d", subdev, urb_id);
+
+    if (urb_id==-1)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "[devu-uvc] Unknown isochronous urb, please report");
+        return;
+    }
+
+    /* Streaming has been stopped, do not resubmit this URB */
+    if (!dev->current_transfer[subdev])
+    {
+        return;
+    }
+
+    if (uvc_verbose>4)
+    {
+        slogf(_SLOGC_USB_GEN, _SLOG_INFO, "uvc_isochronous_completion(): status=%d, urb_status=%08X, urb_len=%d, subdev=%d, urb_id=%d",
+            status, urb_status, urb_len, subdev, urb_id);
+    }
 
     if (urb_len>0)
     {
         for (it=0; it<UVC_MAX_ISO_FRAMES; it++)
         {
-            int bytes_to_print;
-
-            slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "        [%d] frame_status=%08X, frame_len=%d", it, dev->iso_list[subdev][urb_id][it].frame_status, dev->iso_list[subdev][urb_id][it].frame_len);
-            if (dev->iso_list[subdev][urb_id][it].frame_len>=12)
-            {
-                bytes_to_print=(dev->iso_list[subdev][urb_id][it].frame_len>20)?20:12;
-            }
-            else
+            if (dev->iso_list[subdev][urb_id][it].frame_status!=0)
             {
-                bytes_to_print=0;
-            }
-            if (bytes_to_print>0)
-            {
-                char tempbuf[256];
-                int jt;
-
-                tempbuf[0]=0;
-                for (jt=0; jt<bytes_to_print; jt++)
-                {
-                    sprintf(tempbuf+strlen(tempbuf), "%02X ", dev->iso_buffer[subdev][urb_id][it*dev->iso_payload_size[subdev]+jt]);
-                }
-                slogf(_SLOGC_USB_GEN, _SLOG_ERROR, "            %s", tempbuf);
+                dev->frame_error[subdev]=1;
+                continue;
             }
+            uvc_frame_payload(dev, subdev, &dev->iso_buffer[subdev][urb_id][it*dev->iso_payload_size[subdev]],
+                dev->iso_list[subdev][urb_id][it].frame_len);
         }
     }
 
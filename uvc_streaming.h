@@ -30,4 +30,8 @@ int uvc_probe_commit_set(uvc_device_t* dev, int subdev, int operation, int unit,
 
 void uvc_isochronous_completion(struct usbd_urb* urb, struct usbd_pipe* pipe, void* handle);
 
+int uvc_setup_frame_worker(uvc_device_t* dev);
+void uvc_unsetup_frame_worker(uvc_device_t* dev);
+void uvc_drain_frame_worker(uvc_device_t* dev, int subdev);
+
 #endif /* __UVC_STREAMING_H__ */